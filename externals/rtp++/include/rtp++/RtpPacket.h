@@ -0,0 +1,163 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace rtp_plus_plus {
+
+/**
+ * @brief The RtpPacket class describes an RTP packet as a list of segments for scatter/gather I/O.
+ *
+ * The RTP header, payload headers and aggregation length fields are written into header space
+ * that is part of the packet, while payload segments point into the media sample data which is
+ * never copied. The media samples must therefore outlive the packet.
+ */
+class RtpPacket
+{
+public:
+  static const uint32_t RTP_HEADER_SIZE = 12;
+  static const uint32_t MAX_HEADER_BYTES = 96;
+  static const uint32_t MAX_SEGMENTS = 33;
+
+  RtpPacket()
+    :m_uiHeaderSize(0),
+      m_uiSegmentCount(0),
+      m_uiPayloadSize(0)
+  {
+
+  }
+  /**
+   * @brief writeRtpHeader resets the packet and writes the fixed RTP header without CSRCs
+   */
+  void writeRtpHeader(bool bMarker, uint8_t uiPayloadType, uint16_t uiSequenceNumber, uint32_t uiRtpTime, uint32_t uiSsrc)
+  {
+    m_uiHeaderSize = 0;
+    m_uiSegmentCount = 0;
+    m_uiPayloadSize = 0;
+    uint8_t* pHeader = addHeader(RTP_HEADER_SIZE);
+    pHeader[0] = 0x80;
+    pHeader[1] = (bMarker ? 0x80 : 0x00) | (uiPayloadType & 0x7F);
+    pHeader[2] = uiSequenceNumber >> 8;
+    pHeader[3] = uiSequenceNumber & 0xFF;
+    pHeader[4] = uiRtpTime >> 24;
+    pHeader[5] = (uiRtpTime >> 16) & 0xFF;
+    pHeader[6] = (uiRtpTime >> 8) & 0xFF;
+    pHeader[7] = uiRtpTime & 0xFF;
+    pHeader[8] = uiSsrc >> 24;
+    pHeader[9] = (uiSsrc >> 16) & 0xFF;
+    pHeader[10] = (uiSsrc >> 8) & 0xFF;
+    pHeader[11] = uiSsrc & 0xFF;
+  }
+  /**
+   * @brief setMarker updates the marker bit of the RTP header
+   */
+  void setMarker(bool bMarker)
+  {
+    assert(m_uiHeaderSize >= RTP_HEADER_SIZE);
+    m_header[1] = bMarker ? (m_header[1] | 0x80) : (m_header[1] & 0x7F);
+  }
+  bool isMarkerSet() const { return (m_header[1] & 0x80) != 0; }
+  uint8_t getPayloadType() const { return m_header[1] & 0x7F; }
+  uint16_t getSequenceNumber() const { return (m_header[2] << 8) | m_header[3]; }
+  uint32_t getRtpTime() const { return (m_header[4] << 24) | (m_header[5] << 16) | (m_header[6] << 8) | m_header[7]; }
+  uint32_t getSsrc() const { return (m_header[8] << 24) | (m_header[9] << 16) | (m_header[10] << 8) | m_header[11]; }
+  /**
+   * @brief addHeader reserves uiSize bytes of header space at the end of the packet
+   * @return a pointer to the reserved space which the caller must fill
+   */
+  uint8_t* addHeader(uint32_t uiSize)
+  {
+    assert(m_uiHeaderSize + uiSize <= MAX_HEADER_BYTES);
+    uint8_t* pHeader = m_header + m_uiHeaderSize;
+    // extend the previous segment if it is the header space just before this one
+    if (m_uiSegmentCount > 0 && !m_segments[m_uiSegmentCount - 1].Data &&
+        m_segments[m_uiSegmentCount - 1].Offset + m_segments[m_uiSegmentCount - 1].Size == m_uiHeaderSize)
+    {
+      m_segments[m_uiSegmentCount - 1].Size += uiSize;
+    }
+    else
+    {
+      assert(m_uiSegmentCount < MAX_SEGMENTS);
+      Segment segment = { 0, m_uiHeaderSize, uiSize };
+      m_segments[m_uiSegmentCount++] = segment;
+    }
+    m_uiHeaderSize += uiSize;
+    return pHeader;
+  }
+  /**
+   * @brief addPayload appends a reference to payload data
+   */
+  void addPayload(const uint8_t* pData, uint32_t uiSize)
+  {
+    assert(m_uiSegmentCount < MAX_SEGMENTS);
+    Segment segment = { pData, 0, uiSize };
+    m_segments[m_uiSegmentCount++] = segment;
+    m_uiPayloadSize += uiSize;
+  }
+
+  uint32_t getSegmentCount() const { return m_uiSegmentCount; }
+  const uint8_t* getSegmentData(uint32_t uiIndex) const
+  {
+    return m_segments[uiIndex].Data ? m_segments[uiIndex].Data : m_header + m_segments[uiIndex].Offset;
+  }
+  uint32_t getSegmentSize(uint32_t uiIndex) const { return m_segments[uiIndex].Size; }
+  /**
+   * @brief getHeaderSize returns the RTP header and payload format overhead in bytes
+   */
+  uint32_t getHeaderSize() const { return m_uiHeaderSize; }
+  /**
+   * @brief getPayloadSize returns the number of media bytes referenced by the packet
+   */
+  uint32_t getPayloadSize() const { return m_uiPayloadSize; }
+  uint32_t getSize() const { return m_uiHeaderSize + m_uiPayloadSize; }
+  /**
+   * @brief serialise copies the packet into a contiguous buffer
+   */
+  void serialise(std::vector<uint8_t>& vPacket) const
+  {
+    vPacket.resize(getSize());
+    size_t uiPos = 0;
+    for (uint32_t i = 0; i < m_uiSegmentCount; ++i)
+    {
+      memcpy(&vPacket[uiPos], getSegmentData(i), m_segments[i].Size);
+      uiPos += m_segments[i].Size;
+    }
+  }
+
+private:
+  struct Segment
+  {
+    /// payload data or null for header space at Offset
+    const uint8_t* Data;
+    uint32_t Offset;
+    uint32_t Size;
+  };
+
+  uint8_t m_header[MAX_HEADER_BYTES];
+  uint32_t m_uiHeaderSize;
+  Segment m_segments[MAX_SEGMENTS];
+  uint32_t m_uiSegmentCount;
+  uint32_t m_uiPayloadSize;
+};
+
+} // rtp_plus_plus
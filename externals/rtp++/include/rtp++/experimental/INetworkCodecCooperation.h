@@ -44,14 +44,36 @@ public:
 #endif
 
   virtual boost::system::error_code setBitrate(uint32_t uiTargetBitrateKbps) = 0;
+  /**
+   * @brief startIntraRefresh starts refreshing the picture: codecs with intra refresh spread the
+   * intra coded macroblocks over the refresh period, others fall back to an IDR
+   */
+  virtual boost::system::error_code startIntraRefresh() = 0;
+  /**
+   * @brief generateIdr requests that the next frame is coded as an IDR
+   */
+  virtual boost::system::error_code generateIdr() = 0;
+  /**
+   * @brief updateReferencePicture stops the codec from predicting from frames that did not reach
+   * the receiver. Codecs that can not invalidate references fall back to a cheaper refresh or an IDR.
+   * @param uiFirstLostFrame The index of the first lost input frame counting from 0
+   */
+  virtual boost::system::error_code updateReferencePicture(uint32_t uiFirstLostFrame) = 0;
+  /**
+   * @brief setMaxFrameSize caps the size of each encoded frame using the native tool of the codec
+   * e.g. the VBV buffer size. Codecs that can not honour the cap may skip frames or exceed it.
+   * @param uiMaxFrameSizeBytes The maximum encoded frame size in bytes. 0 removes the cap.
+   */
+  virtual boost::system::error_code setMaxFrameSize(uint32_t uiMaxFrameSizeBytes) = 0;
+  /**
+   * @brief setFramerate changes the rate at which frames are passed to the codec so that rate control
+   * spreads the target bitrate over fewer or more frames. Dropping frames is left to the caller.
+   * @param dFramerate The frame rate in frames per second
+   */
+  virtual boost::system::error_code setFramerate(double dFramerate) = 0;
 #if 0
   virtual boost::system::error_code switchBitrate(uint32_t uiSwitchType) = 0;
-  virtual boost::system::error_code generateIdr() = 0;
-  virtual boost::system::error_code setMaxFrameSize(uint32_t uiMaxSizeBytesBytes) = 0;
-  virtual boost::system::error_code setFramerate(uint32_t uiFramerate) = 0;
-  virtual boost::system::error_code changeFramerate(uint32_t uiFramerate) = 0;
   virtual boost::system::error_code changeGopStructure() = 0;
-  virtual boost::system::error_code updateReferencePicture() = 0;
 #endif
 
 private:
@@ -0,0 +1,164 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <chrono>
+#include <deque>
+#include <map>
+#include <boost/function.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <rtp++/media/FrameBatch.h>
+#include <rtp++/media/IVideoCodecTransform.h>
+
+namespace rtp_plus_plus
+{
+namespace media
+{
+
+/**
+ * @brief The output of a frame passed to AsyncVideoEncoder::submit()
+ */
+struct CompletedFrame
+{
+  CompletedFrame()
+    :Tag(0),
+    LatencyUs(0),
+    DelayFrames(0)
+  {
+  }
+  /// the tag passed to submit() e.g. the source frame index
+  uint32_t Tag;
+  /// no samples if the encoder dropped the frame
+  EncodedFrame Frame;
+  /// time from submit() to the output of the frame
+  uint64_t LatencyUs;
+  /// frames submitted after this one before it was output: lookahead, frame threads and B-frames
+  uint32_t DelayFrames;
+};
+
+/**
+ * @brief The AsyncVideoEncoder class is an asynchronous front end to an IVideoCodecTransform.
+ * submit() returns as soon as the frame is queued and the codec is driven from a background
+ * thread, so that encoders with frame threads or lookahead run at full parallelism while the
+ * caller reads the next frames. Every submitted frame completes exactly once through the
+ * completion handler, in output order and tagged with the tag it was submitted with: the
+ * codec reports the input frame of each output, or of a skipped frame, in FrameStats::InputFrame.
+ * Skipped frames complete without samples. Frames held back by the encoder complete when
+ * drain() flushes it.
+ *
+ * The handler is called on the encoding thread. The codec must not be used by anyone else
+ * while the AsyncVideoEncoder exists.
+ */
+class AsyncVideoEncoder
+{
+public:
+  typedef boost::function<void (const boost::system::error_code& ec, const CompletedFrame& completedFrame)> CompletionHandler;
+
+  /// default number of frames queued for the codec: submit() blocks when they are all in use
+  static const size_t DEFAULT_MAX_QUEUED_FRAMES = 8;
+
+  AsyncVideoEncoder(IVideoCodecTransform& codec, CompletionHandler handler, size_t uiMaxQueuedFrames = DEFAULT_MAX_QUEUED_FRAMES);
+  ~AsyncVideoEncoder();
+  AsyncVideoEncoder(const AsyncVideoEncoder&) = delete;
+  AsyncVideoEncoder& operator=(const AsyncVideoEncoder&) = delete;
+
+  /**
+   * @brief submit queues a frame for encoding and blocks only while the queue is full. The bitrate
+   * switch of the frame is applied before it is encoded. Returns operation_not_permitted after
+   * drain() and the first encoding error once the codec has failed.
+   */
+  boost::system::error_code submit(const BatchFrame& frame, uint32_t uiTag);
+  /**
+   * @brief drain encodes the queued frames, flushes the codec and blocks until every submitted
+   * frame has completed. Frames that the encoder never output complete without samples.
+   */
+  boost::system::error_code drain();
+  /**
+   * @brief getFramesInFlight returns the number of submitted frames that have not completed
+   */
+  size_t getFramesInFlight() const;
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Submission
+  {
+    BatchFrame Frame;
+    uint32_t Tag;
+    Clock::time_point Submitted;
+    // number of frames submitted before this one
+    uint32_t Index;
+  };
+
+  struct PendingFrame
+  {
+    uint32_t Tag;
+    Clock::time_point Submitted;
+    uint32_t Index;
+    boost::system::error_code BitrateResult;
+  };
+
+  /**
+   * @brief encodeInBackground is the entry point of the encoding thread
+   */
+  void encodeInBackground();
+  /**
+   * @brief complete calls the handler for the pending frame with the codec input index iInputFrame.
+   * Codecs that do not report the input frame output frames in order.
+   */
+  void complete(int32_t iInputFrame, EncodedFrame& encodedFrame);
+  /**
+   * @brief deliver calls the handler and updates the frames in flight
+   */
+  void deliver(const PendingFrame& pending, EncodedFrame& encodedFrame, const boost::system::error_code& ec);
+  /**
+   * @brief setError records the first encoding error and completes the pending frames with it
+   */
+  void setError(const boost::system::error_code& ec);
+  /**
+   * @brief flushCodec outputs the frames held back by the codec and completes the remaining ones
+   */
+  void flushCodec();
+
+  IVideoCodecTransform& m_codec;
+  CompletionHandler m_handler;
+  size_t m_uiMaxQueuedFrames;
+
+  mutable boost::mutex m_lock;
+  boost::condition_variable m_condPending;
+  boost::condition_variable m_condFree;
+  boost::condition_variable m_condDrained;
+  std::deque<Submission> m_qSubmissions;
+  bool m_bDrain;
+  bool m_bDrained;
+  boost::system::error_code m_error;
+  uint32_t m_uiSubmitted;
+  size_t m_uiInFlight;
+  boost::thread m_thread;
+
+  // only accessed by the encoding thread: frames passed to the codec by codec input index
+  std::map<int32_t, PendingFrame> m_pending;
+  int32_t m_iCodecFrames;
+};
+
+} // media
+} // rtp_plus_plus
@@ -0,0 +1,68 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <cstddef>
+#include <boost/cstdint.hpp>
+#include <rtp++/util/Buffer.h>
+
+namespace rtp_plus_plus
+{
+namespace media
+{
+
+/**
+ * @brief getMaxEbspSize returns the worst case size of the EBSP for an RBSP of uiRbspSize bytes
+ */
+inline size_t getMaxEbspSize(size_t uiRbspSize)
+{
+  return uiRbspSize + (uiRbspSize >> 1) + 1;
+}
+
+/**
+ * @brief insertEmulationPrevention converts an H.264/H.265 RBSP to an EBSP by inserting
+ * emulation_prevention_three_byte after every 0x0000 that is followed by a byte <= 0x03
+ * and after a trailing 0x0000.
+ * @param pRbsp The RBSP
+ * @param uiSize The size of the RBSP
+ * @param pEbsp The destination which must hold at least getMaxEbspSize(uiSize) bytes and may not overlap pRbsp
+ * @return The size of the EBSP
+ */
+size_t insertEmulationPrevention(const uint8_t* pRbsp, size_t uiSize, uint8_t* pEbsp);
+/**
+ * @brief insertEmulationPrevention Buffer version of the above
+ */
+Buffer insertEmulationPrevention(const Buffer& rbsp);
+/**
+ * @brief removeEmulationPrevention converts an EBSP to an RBSP by removing
+ * emulation_prevention_three_byte
+ * @param pEbsp The EBSP
+ * @param uiSize The size of the EBSP
+ * @param pRbsp The destination which must hold at least uiSize bytes. pRbsp may equal pEbsp
+ * for in-place conversion.
+ * @return The size of the RBSP
+ */
+size_t removeEmulationPrevention(const uint8_t* pEbsp, size_t uiSize, uint8_t* pRbsp);
+/**
+ * @brief removeEmulationPrevention Buffer version of the above
+ */
+Buffer removeEmulationPrevention(const Buffer& ebsp);
+
+} // media
+} // rtp_plus_plus
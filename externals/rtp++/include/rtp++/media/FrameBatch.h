@@ -0,0 +1,72 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <vector>
+#include <boost/system/error_code.hpp>
+#include <rtp++/media/FrameStats.h>
+#include <rtp++/media/MediaSample.h>
+
+namespace rtp_plus_plus
+{
+namespace media
+{
+
+/**
+ * @brief A source frame of a batch passed to IVideoCodecTransform::transformBatch
+ */
+struct BatchFrame
+{
+  BatchFrame()
+    :TargetBitrateKbps(0)
+  {
+  }
+  BatchFrame(const MediaSample& frame, uint32_t uiTargetBitrateKbps = 0)
+    :Frame(frame),
+    TargetBitrateKbps(uiTargetBitrateKbps)
+  {
+  }
+  /// YUV 4:2:0 source frame
+  MediaSample Frame;
+  /// the bitrate is switched before the frame is encoded: 0 keeps the current bitrate
+  uint32_t TargetBitrateKbps;
+};
+
+/**
+ * @brief The output of one frame of a batch. Encoders with lookahead or frame threads
+ * output nothing for the first frames of a stream and later output earlier frames:
+ * Stats.InputFrame is the input frame that the samples belong to.
+ */
+struct EncodedFrame
+{
+  EncodedFrame()
+    :Size(0)
+  {
+  }
+  /// NAL units output while encoding the frame
+  std::vector<MediaSample> Samples;
+  /// total size of the samples in bytes
+  uint32_t Size;
+  FrameStats Stats;
+  /// result of the bitrate switch requested by the frame
+  boost::system::error_code BitrateResult;
+};
+
+} // media
+} // rtp_plus_plus
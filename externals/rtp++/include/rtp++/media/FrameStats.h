@@ -0,0 +1,69 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <rtp++/media/SliceHeaderInfo.h>
+
+namespace rtp_plus_plus
+{
+namespace media
+{
+
+/**
+ * @brief Statistics of an encoded frame as reported by the encoder itself so that
+ * quality can be tracked without decoding. Values that an encoder does not report
+ * are negative.
+ */
+struct FrameStats
+{
+  FrameStats()
+    :Encoded(false),
+    Type(ST_UNKNOWN),
+    Idr(false),
+    Qp(-1.0),
+    Bits(0),
+    PsnrY(-1.0),
+    PsnrU(-1.0),
+    PsnrV(-1.0),
+    Ssim(-1.0),
+    InputFrame(-1)
+  {
+  }
+  /// false if the encoder did not output a frame
+  bool Encoded;
+  SliceType Type;
+  bool Idr;
+  /// average QP of the frame
+  double Qp;
+  uint32_t Bits;
+  /// in dB: only computed if enabled in the encoder
+  double PsnrY;
+  double PsnrU;
+  double PsnrV;
+  /// luma SSIM: only computed if enabled in the encoder
+  double Ssim;
+  /// index of the input frame counting from 0 that the output belongs to: encoders with lookahead,
+  /// frame threads or B-frames output frames late and out of order. Encoders without delay also
+  /// set it when they skip a frame (Encoded is false) so that the frame completes without output.
+  /// -1 if the call did not complete an input frame.
+  int32_t InputFrame;
+};
+
+} // media
+} // rtp_plus_plus
@@ -18,7 +18,10 @@ along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
 // "CSIR"
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #pragma once
+#include <utility>
 #include <rtp++/experimental/INetworkCodecCooperation.h>
+#include <rtp++/media/FrameBatch.h>
+#include <rtp++/media/FrameStats.h>
 #include <rtp++/media/IMediaTransform.h>
 
 namespace rtp_plus_plus {
@@ -27,7 +30,44 @@ namespace media {
 class IVideoCodecTransform : public IMediaTransform,
                              public experimental::INetworkCodecCooperation
 {
-
+public:
+  /**
+   * @brief getFrameStats returns the statistics of the last frame encoded by transform() or transformBatch()
+   */
+  virtual FrameStats getFrameStats() const = 0;
+  /**
+   * @brief transformBatch encodes several frames per call and returns one EncodedFrame per input
+   * frame so that the output can still be split per frame. EncodedFrame i holds the output of
+   * encoding in[i]: encoders with delay output an earlier frame, identified by Stats.InputFrame,
+   * or nothing. Bitrate switches in the batch are applied before the frame that carries them:
+   * a refused switch does not stop the batch and is reported in EncodedFrame i. On error the
+   * frames encoded so far are in out.
+   */
+  virtual boost::system::error_code transformBatch(const std::vector<BatchFrame>& in, std::vector<EncodedFrame>& out)
+  {
+    out.reserve(out.size() + in.size());
+    std::vector<MediaSample> frame(1);
+    for (const BatchFrame& batchFrame : in)
+    {
+      EncodedFrame encodedFrame;
+      if (batchFrame.TargetBitrateKbps > 0)
+        encodedFrame.BitrateResult = setBitrate(batchFrame.TargetBitrateKbps);
+      frame[0] = batchFrame.Frame;
+      boost::system::error_code ec = transform(frame, encodedFrame.Samples, encodedFrame.Size);
+      if (ec) return ec;
+      encodedFrame.Stats = getFrameStats();
+      out.push_back(std::move(encodedFrame));
+    }
+    return boost::system::error_code();
+  }
+  /**
+   * @brief flush outputs the frames held back by the encoder e.g. for lookahead or frame threads
+   * at the end of the stream. Encoders without delay output nothing.
+   */
+  virtual boost::system::error_code flush(std::vector<EncodedFrame>& out)
+  {
+    return boost::system::error_code();
+  }
 };
 
 } // media
@@ -43,7 +43,8 @@ public:
      m_iDecodingOrderNumber(-1),
      m_iFlowIdHint(-1),
      m_iStartCodeLengthHint(-1),
-     m_bNaluContainsStartCode(false)
+     m_bNaluContainsStartCode(false),
+     m_uiTemporalId(0)
   {
 
   }
@@ -133,6 +134,14 @@ public:
    * @brief Setter for NALU contains start code 
    */
   void setNaluContainsStartCode(bool bNaluContainsStartCode) { m_bNaluContainsStartCode = bNaluContainsStartCode; }
+  /**
+   * @brief Getter for temporal id
+   */
+  uint8_t getTemporalId() const { return m_uiTemporalId; }
+  /**
+   * @brief Setter for temporal id
+   */
+  void setTemporalId(uint8_t uiTemporalId) { m_uiTemporalId = uiTemporalId; }
   
 private:  
   /// start time of media sample
@@ -154,6 +163,8 @@ private:
   int32_t m_iStartCodeLengthHint;
   /// to handle encoders that create NAL units with start code
   bool m_bNaluContainsStartCode;
+  /// temporal layer of scalable streams, 0 for the base layer and non-scalable streams
+  uint8_t m_uiTemporalId;
 };
 
 } // media
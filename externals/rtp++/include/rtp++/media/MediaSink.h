@@ -18,9 +18,16 @@ along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
 // "CSIR"
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #pragma once
+#include <cassert>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include <rtp++/media/MediaSample.h>
 
 namespace rtp_plus_plus
@@ -28,20 +35,114 @@ namespace rtp_plus_plus
 namespace media
 {
 
+/**
+ * @brief The MediaSink class writes media samples to a file or stdout.
+ *
+ * Samples are copied into large aligned buffers which are handed to a background thread
+ * once full, so that the encoding thread never blocks on file I/O and each flushed buffer
+ * results in a single write to the unbuffered output stream. All state is per instance
+ * so that several sinks can be used from different threads at the same time.
+ */
 class MediaSink
 {
 public:
+  /// default size of each output buffer
+  static const size_t DEFAULT_SINK_BUFFER_SIZE = 1024 * 1024;
+  /// default number of output buffers: the writer blocks when all of them are queued
+  static const size_t DEFAULT_SINK_BUFFER_COUNT = 4;
+  /// alignment of the output buffers
+  static const size_t BUFFER_ALIGNMENT = 4096;
 
-  MediaSink(const std::string& sDest);
+  MediaSink(const std::string& sDest, size_t uiBufferSize = DEFAULT_SINK_BUFFER_SIZE, size_t uiBufferCount = DEFAULT_SINK_BUFFER_COUNT);
   virtual ~MediaSink();
 
   virtual void write(const MediaSample& mediaSample);
   virtual void writeAu(const std::vector<MediaSample>& mediaSamples);
+  /**
+   * @brief flush hands the partially filled buffer to the flush thread and
+   * blocks until all data written so far has reached the output stream
+   */
+  void flush();
+  /**
+   * @brief getBytesWritten returns the number of bytes that have reached the output stream
+   */
+  uint64_t getBytesWritten() const;
+  /**
+   * @brief getFlushCount returns the number of writes made to the output stream
+   */
+  uint32_t getFlushCount() const;
 
 protected:
+  /**
+   * @brief append copies data into the current output buffer
+   */
+  void append(const uint8_t* pData, size_t uiSize)
+  {
+    if (uiSize <= m_uiBufferSize - m_uiCurrentSize)
+    {
+      memcpy(m_pCurrent + m_uiCurrentSize, pData, uiSize);
+      m_uiCurrentSize += uiSize;
+    }
+    else
+    {
+      appendAcrossBuffers(pData, uiSize);
+    }
+  }
+  /**
+   * @brief appendStartCode appends a 3 or 4 byte Annex B start code
+   */
+  void appendStartCode(uint32_t uiLength)
+  {
+    static const uint8_t startcode[4] = { 0, 0, 0, 1 };
+    assert(uiLength == 3 || uiLength == 4);
+    append(startcode + 4 - uiLength, uiLength);
+  }
+  /**
+   * @brief appendSample appends the payload of the media sample
+   */
+  void appendSample(const MediaSample& mediaSample)
+  {
+    append(mediaSample.getDataBuffer().data(), mediaSample.getDataBuffer().getSize());
+  }
+
+private:
+  struct OutputBuffer
+  {
+    uint8_t* Data;
+    size_t Size;
+  };
+
+  void appendAcrossBuffers(const uint8_t* pData, size_t uiSize);
+  /**
+   * @brief queueCurrentBuffer queues the current buffer for flushing and waits for a free one
+   */
+  void queueCurrentBuffer();
+  /**
+   * @brief flushInBackground is the entry point of the flush thread
+   */
+  void flushInBackground();
 
   std::ofstream* m_pFileOut;
   std::ostream* m_out;
+
+  size_t m_uiBufferSize;
+  // owns all buffers
+  std::vector<uint8_t*> m_vBuffers;
+  // buffer currently being filled: only accessed by the writing thread
+  uint8_t* m_pCurrent;
+  size_t m_uiCurrentSize;
+
+  mutable boost::mutex m_lock;
+  boost::condition_variable m_condPending;
+  boost::condition_variable m_condFree;
+  std::deque<OutputBuffer> m_qPending;
+  std::deque<uint8_t*> m_qFree;
+  bool m_bWriting;
+  bool m_bShutdown;
+  bool m_bWriteFailed;
+  uint64_t m_uiBytesWritten;
+  uint32_t m_uiFlushCount;
+  boost::thread m_flushThread;
 };
 
 } // media
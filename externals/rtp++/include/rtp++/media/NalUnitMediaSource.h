@@ -18,9 +18,13 @@ along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
 // "CSIR"
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #pragma once
+#include <atomic>
 #include <fstream>
 #include <string>
 #include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include <rtp++/media/h264/H264NalUnitTypes.h>
 #include <rtp++/media/h265/H265NalUnitTypes.h>
 #include <rtp++/media/MediaSample.h>
@@ -46,9 +50,15 @@ namespace media {
  * The file is parsed on startup and the starting positions for each NAL unit are
  * stored in a vector. This is a simper, more reliable and efficient way then the
  * AsyncStreamMediaApproach used previously.
+ *
+ * The parsed layout can optionally be persisted to an index file next to the stream
+ * (<<filename>>.auidx) which is reused on subsequent runs if the size and modification
+ * time of the stream still match. In lazy mode the stream is indexed ahead of the
+ * read cursor by a background thread so that the first AU is available immediately.
  */
 class NalUnitMediaSource : public MediaSource
 {
+  /// starting index - start code length - starting index of NAL unit header - NAL unit length (without start code)
   typedef std::tuple<size_t, uint32_t, size_t, uint32_t> NalUnitInfo_t;
   typedef std::vector<NalUnitInfo_t> AccessUnitInfo_t;
 
@@ -61,8 +71,13 @@ public:
    * @param uiLoopCount Configures the number of times the source is looped
    * IFF bLoopSource is true. A value of 0 means that the source will loop
    * indefinitely
+   * @param bUseIndexFile Loads the AU index from <<sFilename>>.auidx if it is valid and
+   * writes it after parsing otherwise
+   * @param bLazyIndexing Indexes the stream ahead of the read cursor in a background
+   * thread instead of scanning the whole file in the constructor
    */
-  NalUnitMediaSource(const std::string& sFilename, const std::string& sMediaType, bool bLoopSource, uint32_t uiLoopCount, uint32_t uiInitialBufferSize = 20000);
+  NalUnitMediaSource(const std::string& sFilename, const std::string& sMediaType, bool bLoopSource, uint32_t uiLoopCount, uint32_t uiInitialBufferSize = 20000,
+                     bool bUseIndexFile = false, bool bLazyIndexing = false);
   /**
    * @brief NalUnitMediaSource
    * @param in1 A reference to the istream that has opened the Annex B stream
@@ -72,6 +87,10 @@ public:
    * indefinitely
    */
   NalUnitMediaSource(std::istream& in1, const std::string& sMediaType, bool bLoopSource, uint32_t uiLoopCount, uint32_t uiInitialBufferSize = 20000);
+  /**
+   * @brief Destructor stops the background indexer if running
+   */
+  ~NalUnitMediaSource();
   /**
    * @brief isGood This method can be used to check if NAL units can be read. If the end of
    * stream is reached and the source is not configured to loop or if the maximum loop count
@@ -91,16 +110,49 @@ public:
    * @return The next access unit in the source and an empty vector if isGood() == false
    */
   std::vector<MediaSample> getNextAccessUnit();
+  /**
+   * @brief getIndexFilename returns the name of the AU index file for sFilename
+   */
+  static std::string getIndexFilename(const std::string& sFilename);
 
 private:
+  /**
+   * @brief setMediaType maps the media type identifier to m_eType
+   */
+  void setMediaType(const std::string& sMediaType);
   /**
    * @brief checkInputStream makes sure that the stream is in a good state and otherwise updates m_bEos
    */
   void checkInputStream();
   /**
    * @brief parseAnnexBStream parses the stream and extracts the NAL unit and access unit info
+   * @param in The stream to be parsed. This may differ from m_rIn in lazy mode.
+   */
+  void parseAnnexBStream(std::istream& in);
+  /**
+   * @brief indexInBackground is the entry point of the lazy indexing thread
+   */
+  void indexInBackground();
+  /**
+   * @brief onStartCode processes a start code found while parsing
+   * @param uiIndex global offset of the start code
+   * @param uiStartCodeLen 3 or 4
+   * @param pHeader pointer to the first three bytes of the NAL unit header
    */
-  void parseAnnexBStream();
+  void onStartCode(size_t uiIndex, uint32_t uiStartCodeLen, const uint8_t* pHeader);
+  /**
+   * @brief onIndexComplete stores the final AU and wakes up a waiting reader
+   */
+  void onIndexComplete(size_t uiTotalFileSize);
+  /**
+   * @brief loadIndexFile tries to load the index file. Fails if the file does not
+   * exist, is corrupt or does not match the size or modification time of the stream.
+   */
+  bool loadIndexFile();
+  /**
+   * @brief saveIndexFile writes the current index to the index file
+   */
+  bool saveIndexFile() const;
   /**
    * @brief readMediaSamples
    * @param auInfo
@@ -111,6 +163,10 @@ private:
    * @brief finaliseAu Stores the NAL units collected so far as an AU
    */
   void finaliseAu(AccessUnitInfo_t& vCurrentAccessUnit);
+  /**
+   * @brief handleEndOfIndex updates the loop or EOS state once the cursor has passed the last AU
+   */
+  void handleEndOfIndex();
 private:
 
   // stream handle when reading from file
@@ -141,20 +197,34 @@ private:
   // buffer to read data into
   Buffer m_buffer;
 
-  /// starting index - start code length - starting index of NAL unit header - NAL unit length (without start code)
-  // vector to store the starting indices of all start codes
-  std::vector<NalUnitInfo_t> m_vStartCodeInfo;
   // vector to store all AU info
-  std::vector<AccessUnitInfo_t> m_vAccessUnitInfo; 
+  std::vector<AccessUnitInfo_t> m_vAccessUnitInfo;
+  // NAL unit header type per NAL unit in decoding order: only needed for the index file
+  std::vector<uint8_t> m_vNalUnitTypes;
 
-  Buffer m_temporaryNalUnitBuffer;
-
-  // members for keeping AU state
+  // members for keeping AU state while parsing
+  AccessUnitInfo_t m_vCurrentAccessUnit;
+  size_t m_uiPreviousNalUnitIndex;
   // H264 SVC
   bool m_bCurrentLayerIsBaseLayer;
+  // H264 streams without AUDs
+  bool m_bH264AudPresent;
+  bool m_bH264AuHasVcl;
   // HEVC
   bool m_bFirstH265NalUnit;
   h265::NalUnitType m_ePrevH265Type;
+
+  // index file and lazy indexing
+  bool m_bUseIndexFile;
+  bool m_bLazyIndexing;
+  // set once all AUs are stored in m_vAccessUnitInfo
+  bool m_bIndexComplete;
+  // set to stop the background indexer
+  std::atomic<bool> m_bStopIndexing;
+  // protects m_vAccessUnitInfo and m_bIndexComplete in lazy mode
+  mutable boost::mutex m_indexLock;
+  boost::condition_variable m_condAccessUnitIndexed;
+  boost::thread m_indexThread;
 };
 
 } // media
@@ -0,0 +1,118 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <rtp++/RtpPacket.h>
+#include <rtp++/media/MediaSample.h>
+
+namespace rtp_plus_plus {
+namespace media {
+
+/**
+ * @brief The NalUnitPacketiser class turns the NAL units of an access unit into RTP packets
+ * no larger than the maximum packet size in non-interleaved mode.
+ *
+ * NAL units that fit are aggregated with the NAL units that follow them into an aggregation
+ * packet or sent as single NAL unit packets, larger NAL units are split into fragmentation
+ * units. The payload format specific headers are written by the subclasses. Payloads are
+ * referenced and not copied: the access unit must outlive the packets.
+ */
+class NalUnitPacketiser
+{
+public:
+  /// maximum number of NAL units in an aggregation packet
+  static const uint32_t MAX_AGGREGATED_NAL_UNITS = 16;
+
+  NalUnitPacketiser(uint32_t uiMaxPacketSize, uint8_t uiPayloadType, uint32_t uiSsrc, uint16_t uiSequenceNumber);
+  virtual ~NalUnitPacketiser();
+
+  uint32_t getMaxPacketSize() const { return m_uiMaxPacketSize; }
+  uint16_t getNextSequenceNumber() const { return m_uiSequenceNumber; }
+  /**
+   * @brief packetise appends the RTP packets of the access unit to packets
+   * The RTP timestamp is taken from the first media sample and the marker
+   * bit is set on the last packet of the access unit.
+   */
+  void packetise(const std::vector<MediaSample>& accessUnit, std::vector<RtpPacket>& packets);
+  /**
+   * @brief depacketise reassembles the NAL units carried by the received packets of an
+   * access unit. Fragmented NAL units with missing fragments are discarded. Unlike
+   * packetise the NAL units are copied.
+   */
+  void depacketise(const std::vector<RtpPacket>& packets, std::vector<MediaSample>& nalUnits);
+
+protected:
+  struct NalUnit
+  {
+    const uint8_t* Data;
+    uint32_t Size;
+  };
+
+  /**
+   * @brief getNalUnitHeaderSize returns the size of the NAL unit header
+   */
+  virtual uint32_t getNalUnitHeaderSize() const = 0;
+  /**
+   * @brief getAggregationHeaderSize returns the size of the aggregation packet payload header
+   */
+  virtual uint32_t getAggregationHeaderSize() const = 0;
+  /**
+   * @brief writeAggregationHeader writes the aggregation packet payload header
+   */
+  virtual void writeAggregationHeader(uint8_t* pHeader, const NalUnit* pNalUnits, uint32_t uiCount) const = 0;
+  /**
+   * @brief getFragmentationHeaderSize returns the size of the payload and FU headers of a fragmentation unit
+   */
+  virtual uint32_t getFragmentationHeaderSize() const = 0;
+  /**
+   * @brief writeFragmentationHeader writes the payload and FU headers of a fragment of the NAL unit
+   */
+  virtual void writeFragmentationHeader(uint8_t* pHeader, const uint8_t* pNalUnit, bool bStart, bool bEnd) const = 0;
+  /**
+   * @brief isAggregationPacket returns whether the RTP payload is an aggregation packet
+   */
+  virtual bool isAggregationPacket(const uint8_t* pPayload) const = 0;
+  /**
+   * @brief isFragmentationUnit returns whether the RTP payload is a fragmentation unit
+   */
+  virtual bool isFragmentationUnit(const uint8_t* pPayload) const = 0;
+  /**
+   * @brief writeNalUnitHeader restores the NAL unit header from the headers of a fragmentation unit
+   */
+  virtual void writeNalUnitHeader(uint8_t* pNalUnit, const uint8_t* pPayload) const = 0;
+
+private:
+  RtpPacket& addPacket(std::vector<RtpPacket>& packets, uint32_t uiRtpTime);
+  void fragment(const NalUnit& nalUnit, uint32_t uiRtpTime, std::vector<RtpPacket>& packets);
+  void addNalUnit(const uint8_t* pData, uint32_t uiSize, uint32_t uiRtpTime, std::vector<MediaSample>& nalUnits) const;
+
+  uint32_t m_uiMaxPacketSize;
+  uint8_t m_uiPayloadType;
+  uint32_t m_uiSsrc;
+  uint16_t m_uiSequenceNumber;
+  // reused between access units
+  std::vector<NalUnit> m_vNalUnits;
+  std::vector<uint8_t> m_vPacket;
+  std::vector<uint8_t> m_vFragments;
+};
+
+} // media
+} // rtp_plus_plus
@@ -0,0 +1,97 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <string>
+#include <boost/cstdint.hpp>
+
+namespace rtp_plus_plus
+{
+namespace media
+{
+
+/**
+ * @brief Codec independent slice types
+ */
+enum SliceType
+{
+  ST_P,
+  ST_B,
+  ST_I,
+  ST_SP,
+  ST_SI,
+  ST_UNKNOWN
+};
+
+/**
+ * @brief Utility method to return a one letter representation of the slice type
+ */
+inline std::string toString(SliceType eType)
+{
+  switch (eType)
+  {
+    case ST_P: return "P";
+    case ST_B: return "B";
+    case ST_I: return "I";
+    case ST_SP: return "SP";
+    case ST_SI: return "SI";
+    default: return "?";
+  }
+}
+
+/**
+ * @brief Fields of an H.264 slice header or H.265 slice segment header
+ * that are of interest for bitstream analysis
+ */
+struct SliceHeaderInfo
+{
+  SliceHeaderInfo()
+    :NalUnitType(0),
+    Type(ST_UNKNOWN),
+    FirstSliceInPicture(false),
+    Idr(false),
+    Reference(false),
+    TemporalId(0),
+    FrameNum(0),
+    PicOrderCnt(0),
+    SliceQpDelta(0),
+    SliceQp(0)
+  {
+
+  }
+
+  uint32_t NalUnitType;
+  SliceType Type;
+  /// first_mb_in_slice == 0 for H.264, first_slice_segment_in_pic_flag for H.265
+  bool FirstSliceInPicture;
+  /// IDR for H.264, IRAP for H.265
+  bool Idr;
+  /// nal_ref_idc != 0 for H.264, not a sub-layer non-reference picture for H.265
+  bool Reference;
+  uint32_t TemporalId;
+  /// frame_num: H.264 only
+  uint32_t FrameNum;
+  int32_t PicOrderCnt;
+  int32_t SliceQpDelta;
+  /// 26 + init_qp_minus26 + slice_qp_delta
+  int32_t SliceQp;
+};
+
+} // media
+} // rtp_plus_plus
@@ -0,0 +1,78 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <deque>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <rtp++/media/MediaSample.h>
+
+namespace rtp_plus_plus
+{
+namespace media
+{
+
+/**
+ * @brief The TemporalLayerPruner class serves rate steps by dropping upper temporal layers instead of
+ * re-targeting the encoder. The layer rates are measured over the most recent second of frames.
+ */
+class TemporalLayerPruner
+{
+public:
+  /**
+   * @brief Constructor
+   * @param uiTemporalLayers The number of temporal layers of the stream. Initially all layers are kept.
+   */
+  TemporalLayerPruner(uint32_t uiTemporalLayers);
+  /**
+   * @brief addFrame records the size of each temporal layer of an encoded frame
+   */
+  void addFrame(const std::vector<MediaSample>& accessUnit, double dFps);
+  /**
+   * @brief getLayerKbps returns the rate of the temporal layers up to and including uiMaxTemporalId
+   */
+  double getLayerKbps(uint32_t uiMaxTemporalId, double dFps) const;
+  /**
+   * @brief setTargetBitrate keeps the most temporal layers that fit into the target bitrate. The base layer is always kept.
+   * @return the highest temporal id that is kept
+   */
+  uint32_t setTargetBitrate(double dKbps, double dFps);
+  /**
+   * @brief prune removes the NAL units above the highest kept temporal id. A frame that lies
+   * entirely in the dropped layers is left empty and counted as a dropped frame: the caller
+   * must not write, packetise or decode it.
+   * @return the size of the remaining NAL units
+   */
+  uint32_t prune(std::vector<MediaSample>& accessUnit);
+  uint32_t getMaxTemporalId() const { return m_uiMaxTemporalId; }
+  uint64_t getDroppedFrames() const { return m_uiDroppedFrames; }
+  uint64_t getDroppedNalUnits() const { return m_uiDroppedNalUnits; }
+  uint64_t getDroppedBytes() const { return m_uiDroppedBytes; }
+
+private:
+  uint32_t m_uiTemporalLayers;
+  uint32_t m_uiMaxTemporalId;
+  std::deque<std::vector<uint32_t> > m_recentFrames;
+  uint64_t m_uiDroppedFrames;
+  uint64_t m_uiDroppedNalUnits;
+  uint64_t m_uiDroppedBytes;
+};
+
+} // media
+} // rtp_plus_plus
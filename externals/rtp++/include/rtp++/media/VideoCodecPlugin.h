@@ -0,0 +1,98 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/system/error_code.hpp>
+#include <rtp++/media/IVideoCodecTransform.h>
+#include <rtp++/util/CpuFeatures.h>
+
+/**
+ * @def VIDEO_CODEC_PLUGIN_API_VERSION is incremented whenever IVideoCodecTransform or the types
+ * that it passes change: plugins built against another version are not loaded.
+ */
+#define VIDEO_CODEC_PLUGIN_API_VERSION 1
+
+#ifdef _WIN32
+#define VIDEO_CODEC_PLUGIN_EXPORT extern "C" __declspec(dllexport)
+#else
+#define VIDEO_CODEC_PLUGIN_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+/**
+ * @def DEFINE_VIDEO_CODEC_PLUGIN defines the entry points of a codec plugin that creates CodecClass
+ * for the video codec szCodecFormat e.g. "H264". Used once per plugin in a source file of its own.
+ */
+#define DEFINE_VIDEO_CODEC_PLUGIN(CodecClass, szCodecFormat) \
+  VIDEO_CODEC_PLUGIN_EXPORT uint32_t getVideoCodecPluginApiVersion() \
+  { \
+    return VIDEO_CODEC_PLUGIN_API_VERSION; \
+  } \
+  VIDEO_CODEC_PLUGIN_EXPORT rtp_plus_plus::media::IVideoCodecTransform* createVideoCodecTransform(const char* szFormat) \
+  { \
+    return strcmp(szFormat, szCodecFormat) == 0 ? new CodecClass() : 0; \
+  }
+
+namespace rtp_plus_plus {
+namespace media {
+
+/**
+ * @brief A codec plugin file in a plugin directory
+ */
+struct VideoCodecPluginFile
+{
+  VideoCodecPluginFile()
+    :Isa(cpu::ISA_BASELINE)
+  {
+  }
+  /// lower case codec implementation name e.g. "x264"
+  std::string Codec;
+  /// instruction set the plugin was built for
+  cpu::IsaLevel Isa;
+  std::string Path;
+};
+
+/**
+ * @brief getVideoCodecPluginFilename returns the file name of the plugin of sCodec built for eIsa:
+ * codec_<codec>.so for the baseline build and codec_<codec>_<isa>.so otherwise (.dll on Windows).
+ */
+std::string getVideoCodecPluginFilename(const std::string& sCodec, cpu::IsaLevel eIsa);
+
+/**
+ * @brief findVideoCodecPlugins lists the plugin files in sDirectory by file name. The plugins are
+ * not loaded.
+ */
+std::vector<VideoCodecPluginFile> findVideoCodecPlugins(const std::string& sDirectory);
+
+/**
+ * @brief loadVideoCodecPlugin loads the plugin of sCodec from sDirectory and creates a codec for
+ * sFormat e.g. "H264". The build for the highest instruction set up to eMaxIsa that the CPU supports
+ * is loaded: a build that is missing or fails to load falls back to the next lower one. Plugins are
+ * never unloaded since codecs created by them may outlive any handle.
+ */
+std::unique_ptr<IVideoCodecTransform> loadVideoCodecPlugin(const std::string& sDirectory, const std::string& sCodec,
+                                                           const std::string& sFormat, cpu::IsaLevel eMaxIsa,
+                                                           boost::system::error_code& ec);
+
+} // media
+} // rtp_plus_plus
@@ -18,7 +18,6 @@ along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
 // "CSIR"
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #pragma once
-#include <ostream>
 #include <rtp++/media/MediaSample.h>
 #include <rtp++/media/MediaSink.h>
 #include <rtp++/media/h264/H264NalUnitTypes.h>
@@ -33,12 +32,14 @@ public:
   /**
    * @brief Writes H.264 NAL units to file
    */
-  H264AnnexBStreamWriter(const std::string& sDest, bool bPrependParameterSets, /*bool bStreamContainsStartCodes = false, */bool bInsertAUDsIfNotPresent = false)
-    :MediaSink(sDest),
+  H264AnnexBStreamWriter(const std::string& sDest, bool bPrependParameterSets, /*bool bStreamContainsStartCodes = false, */bool bInsertAUDsIfNotPresent = false,
+                         size_t uiBufferSize = DEFAULT_SINK_BUFFER_SIZE, size_t uiBufferCount = DEFAULT_SINK_BUFFER_COUNT)
+    :MediaSink(sDest, uiBufferSize, uiBufferCount),
       m_bPrependParameterSets(bPrependParameterSets),
       //m_bStreamContainsStartCodes(bStreamContainsStartCodes),
       m_bInsertAUDsIfNotPresent(bInsertAUDsIfNotPresent),
-      m_bPrepended(false)
+      m_bPrepended(false),
+      m_bFirstSample(true)
   {
 
   }
@@ -51,11 +52,16 @@ public:
 
   virtual void write(const MediaSample& mediaSample)
   {
-    writeMediaSampleNaluToStream(mediaSample, *m_out, true);
+    writeMediaSampleNaluToStream(mediaSample, true);
   }
 
   virtual void writeAu(const std::vector<MediaSample>& mediaSamples)
   {
+    // a skipped frame has no NAL units: there is no access unit to delimit
+    if (mediaSamples.empty())
+    {
+      return;
+    }
     if (m_bPrependParameterSets)
     {
       // only write once for now: later prepend to each IDR
@@ -74,11 +80,10 @@ public:
           if (!m_sSps.empty() && !m_sPps.empty())
           {
             VLOG(2) << "Prepending parameter sets to h264 stream";
-            const int8_t startcode[4] = {0, 0, 0, 1};
-            m_out->write((const char*) startcode, 4);
-            m_out->write(m_sSps.c_str(), m_sSps.length());
-            m_out->write((const char*) startcode, 4);
-            m_out->write(m_sPps.c_str(), m_sPps.length());
+            appendStartCode(4);
+            append((const uint8_t*) m_sSps.c_str(), m_sSps.length());
+            appendStartCode(4);
+            append((const uint8_t*) m_sPps.c_str(), m_sPps.length());
           }
         }
       }
@@ -91,16 +96,19 @@ public:
 
     for (const MediaSample& mediaSample : mediaSamples)
     {
-      writeMediaSampleNaluToStream(mediaSample, *m_out, true);
+      writeMediaSampleNaluToStream(mediaSample, true);
     }
   }
 
-  static void writeMediaSampleNaluToStream(const MediaSample& mediaSample, std::ostream& out, bool useTiming = false)
+  void writeMediaSampleNaluToStream(const MediaSample& mediaSample, bool useTiming = false)
   {
-    static boost::posix_time::ptime previousSampletime = mediaSample.getPresentationTime();
+    if (m_bFirstSample)
+    {
+      m_tPreviousSampleTime = mediaSample.getPresentationTime();
+      m_bFirstSample = false;
+    }
 
     // HACK: use start code length from media sample if set
-    const int8_t startcode[4] = { 0, 0, 0, 1 };
     if (!useTiming)
     {
       if (!mediaSample.doesNaluContainsStartCode())
@@ -117,12 +125,12 @@ public:
             case NUT_PICTURE_PARAMETER_SET:
             case NUT_ACCESS_UNIT_DELIMITER:
             {
-              out.write((const char*)startcode, 4);
+              appendStartCode(4);
               break;
             }
             default:
             {
-              out.write((const char*)startcode + 1, 3);
+              appendStartCode(3);
               break;
             }
           }
@@ -130,22 +138,10 @@ public:
         else
         {
           assert(iStartCodeLength == 3 || iStartCodeLength == 4);
-          switch (iStartCodeLength)
-          {
-            case 3:
-            {
-              out.write((const char*)startcode + 1, 3);
-              break;
-            }
-            case 4:
-            {
-              out.write((const char*)startcode, 4);
-              break;
-            }
-          }
+          appendStartCode(iStartCodeLength);
         }
         // this will write the start code if contained in sample
-        out.write((const char*)mediaSample.getDataBuffer().data(), mediaSample.getDataBuffer().getSize());
+        appendSample(mediaSample);
       }
     }
     else
@@ -159,24 +155,24 @@ public:
           case NUT_PICTURE_PARAMETER_SET:
           case NUT_ACCESS_UNIT_DELIMITER:
           {
-            out.write((const char*)startcode, 4);
+            appendStartCode(4);
             break;
           }
           default:
           {
-            if (previousSampletime != mediaSample.getPresentationTime()){
-              previousSampletime = mediaSample.getPresentationTime();
-              out.write((const char*)startcode, 4);
+            if (m_tPreviousSampleTime != mediaSample.getPresentationTime()){
+              m_tPreviousSampleTime = mediaSample.getPresentationTime();
+              appendStartCode(4);
               break;
             }
             else{
-              out.write((const char*)startcode + 1, 3);
+              appendStartCode(3);
               break;
             }
           }
         }
       }
-      out.write((const char*)mediaSample.getDataBuffer().data(), mediaSample.getDataBuffer().getSize());
+      appendSample(mediaSample);
     }
   }
 
@@ -186,14 +182,18 @@ private:
     if (!doSamplesContainAud(mediaSamples))
     {
       // WARNING: this is not a valid AUD, an actual AUD contains type information about the following NALUs
-      const int8_t startcodeWithAud[6] = { 0, 0, 0, 1, 9, 47 };
-      m_out->write((const char*)startcodeWithAud, 6);
+      const uint8_t startcodeWithAud[6] = { 0, 0, 0, 1, 9, 47 };
+      append(startcodeWithAud, 6);
     }
   }
 
   bool doSamplesContainAud(const std::vector<MediaSample>& mediaSamples)
   {
     bool bSampleContainsAud = false;
+    if (mediaSamples.empty())
+    {
+      return bSampleContainsAud;
+    }
     // check if first media sample contains AUD
     const MediaSample& mediaSample = mediaSamples[0];
     //if (m_bStreamContainsStartCodes)
@@ -222,6 +222,9 @@ private:
   bool m_bPrepended;
   std::string m_sSps;
   std::string m_sPps;
+  // presentation time of the previous sample: used to select the start code length
+  bool m_bFirstSample;
+  boost::posix_time::ptime m_tPreviousSampleTime;
 };
 
 } // h264
@@ -0,0 +1,127 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <map>
+#include <vector>
+#include <rtp++/media/MediaSample.h>
+#include <rtp++/media/SliceHeaderInfo.h>
+#include <rtp++/util/IBitStream.h>
+
+namespace rtp_plus_plus
+{
+namespace media
+{
+namespace h264
+{
+
+/**
+ * @brief Subset of the sequence parameter set required to parse slice headers
+ */
+struct SequenceParameterSet
+{
+  uint32_t ProfileIdc;
+  uint32_t ChromaArrayType;
+  bool SeparateColourPlane;
+  uint32_t Log2MaxFrameNum;
+  uint32_t PicOrderCntType;
+  uint32_t Log2MaxPicOrderCntLsb;
+  bool DeltaPicOrderAlwaysZero;
+  int32_t OffsetForNonRefPic;
+  int32_t OffsetForTopToBottomField;
+  std::vector<int32_t> OffsetForRefFrame;
+  bool FrameMbsOnly;
+  uint32_t WidthInMbs;
+  uint32_t HeightInMapUnits;
+};
+
+/**
+ * @brief Subset of the picture parameter set required to parse slice headers
+ */
+struct PictureParameterSet
+{
+  uint32_t SpsId;
+  bool EntropyCodingMode;
+  bool BottomFieldPicOrderInFramePresent;
+  uint32_t NumSliceGroups;
+  uint32_t SliceGroupMapType;
+  uint32_t SliceGroupChangeRate;
+  uint32_t NumRefIdxL0DefaultActive;
+  uint32_t NumRefIdxL1DefaultActive;
+  bool WeightedPred;
+  uint32_t WeightedBipredIdc;
+  int32_t PicInitQp;
+  bool DeblockingFilterControlPresent;
+  bool RedundantPicCntPresent;
+};
+
+/**
+ * @brief Parses H.264 parameter sets and slice headers up to slice_qp_delta
+ * and derives the picture order count (8.2.1).
+ *
+ * Only the emulation prevented bytes that are needed are converted to RBSP
+ * so that streams can be scanned at close to I/O speed.
+ */
+class H264SliceHeaderParser
+{
+public:
+  H264SliceHeaderParser();
+  /**
+   * @brief parseNalUnit stores parameter sets and parses the header of coded slices
+   * (NAL unit types 1 and 5).
+   * @param pNalUnit NAL unit without start code
+   * @param uiSize Size of the NAL unit
+   * @param info Slice header info which is only valid if the method returns true
+   * @return true if the NAL unit was a slice whose header could be parsed
+   */
+  bool parseNalUnit(const uint8_t* pNalUnit, size_t uiSize, SliceHeaderInfo& info);
+  /**
+   * @brief parseAccessUnit parses the NAL units of an encoded access unit with or without start codes
+   * @param accessUnit The NAL units of the access unit
+   * @param info Slice header info of the first slice
+   * @param dAverageQp The average slice QP of the access unit
+   * @param uiFirst Index of the first NAL unit of the access unit in accessUnit: earlier ones are ignored
+   * @return the number of slices whose header could be parsed: info and dAverageQp are only valid if > 0
+   */
+  uint32_t parseAccessUnit(const std::vector<MediaSample>& accessUnit, SliceHeaderInfo& info, double& dAverageQp, size_t uiFirst = 0);
+
+private:
+  Buffer toRbsp(const uint8_t* pNalUnit, size_t uiSize, size_t uiMaxSize);
+  bool parseSps(IBitStream& in);
+  bool parsePps(IBitStream& in);
+  bool parseSliceHeader(IBitStream& in, uint32_t uiNalRefIdc, uint32_t uiNalUnitType, SliceHeaderInfo& info, bool& bMmco5);
+  void derivePicOrderCnt(const SequenceParameterSet& sps, uint32_t uiNalRefIdc, bool bIdr,
+                         uint32_t uiFrameNum, uint32_t uiPicOrderCntLsb, int32_t iDeltaPicOrderCntBottom,
+                         int32_t iDeltaPicOrderCnt0, bool bMmco5, SliceHeaderInfo& info);
+
+  std::map<uint32_t, SequenceParameterSet> m_mSps;
+  std::map<uint32_t, PictureParameterSet> m_mPps;
+  // picture order count state of the previous picture
+  int32_t m_iPrevPicOrderCntMsb;
+  int32_t m_iPrevPicOrderCntLsb;
+  uint32_t m_uiPrevFrameNumOffset;
+  uint32_t m_uiPrevFrameNum;
+  // the last parsed picture: subsequent slices of the same picture reuse the POC
+  bool m_bHaveCurrentPicture;
+  SliceHeaderInfo m_currentPicture;
+};
+
+} // h264
+} // media
+} // rtp_plus_plus
@@ -18,7 +18,6 @@ along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
 // "CSIR"
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #pragma once
-#include <ostream>
 #include <rtp++/media/MediaSample.h>
 #include <rtp++/media/MediaSink.h>
 #include <rtp++/media/h265/H265NalUnitTypes.h>
@@ -30,32 +29,38 @@ namespace h265 {
 class H265AnnexBStreamWriter : public MediaSink
 {
 public:
-  H265AnnexBStreamWriter(const std::string& sDest, bool bPrependParameterSets)
-    :MediaSink(sDest),
-      m_bPrependParameterSets(bPrependParameterSets)
+  H265AnnexBStreamWriter(const std::string& sDest, bool bPrependParameterSets,
+                         size_t uiBufferSize = DEFAULT_SINK_BUFFER_SIZE, size_t uiBufferCount = DEFAULT_SINK_BUFFER_COUNT)
+    :MediaSink(sDest, uiBufferSize, uiBufferCount),
+      m_bPrependParameterSets(bPrependParameterSets),
+      m_bFirstSample(true),
+      m_uiPreviousSampleTime(0)
   {
 
   }
 
   virtual void write(const MediaSample& mediaSample)
   {
-    writeMediaSampleNaluToStream(mediaSample, *m_out, true);
+    writeMediaSampleNaluToStream(mediaSample, true);
   }
 
   virtual void writeAu(const std::vector<MediaSample>& mediaSamples)
   {
     for (const MediaSample& mediaSample : mediaSamples)
     {
-      writeMediaSampleNaluToStream(mediaSample, *m_out, true);
+      writeMediaSampleNaluToStream(mediaSample, true);
     }
   }
 
-  static void writeMediaSampleNaluToStream(const MediaSample& mediaSample, std::ostream& out, bool useTiming = false)
+  void writeMediaSampleNaluToStream(const MediaSample& mediaSample, bool useTiming = false)
   {
     // HACK FOR NOW: test H.264 file writing: This code relies on there being AUDs in the stream to
     // write the start codes correctly
-    static uint32_t previousSampletime = mediaSample.getRtpTime();
-    const int8_t startcode[4] = {0, 0, 0, 1};
+    if (m_bFirstSample)
+    {
+      m_uiPreviousSampleTime = mediaSample.getRtpTime();
+      m_bFirstSample = false;
+    }
     if(!useTiming){
       int32_t iStartCodeLength = mediaSample.getStartCodeLengthHint();
       if (iStartCodeLength == -1)
@@ -70,34 +75,22 @@ public:
           case NUT_PPS:
           case NUT_AUD:
           {
-            out.write((const char*) startcode, 4);
+            appendStartCode(4);
             break;
           }
           default:
           {
-            out.write((const char*) startcode + 1, 3);
+            appendStartCode(3);
             break;
           }
         }
-        out.write((const char*) mediaSample.getDataBuffer().data(), mediaSample.getDataBuffer().getSize());
+        appendSample(mediaSample);
       }
       else
       {
         assert(iStartCodeLength == 3 || iStartCodeLength == 4);
-        switch (iStartCodeLength)
-        {
-          case 3:
-          {
-            out.write((const char*) startcode + 1, 3);
-            break;
-          }
-          case 4:
-          {
-            out.write((const char*) startcode, 4);
-            break;
-          }
-        }
-        out.write((const char*) mediaSample.getDataBuffer().data(), mediaSample.getDataBuffer().getSize());
+        appendStartCode(iStartCodeLength);
+        appendSample(mediaSample);
       }
     }else{
       NalUnitType eType = getNalUnitType(mediaSample);
@@ -108,28 +101,31 @@ public:
         case NUT_PPS:
         case NUT_AUD:
         {
-          out.write((const char*) startcode, 4);
+          appendStartCode(4);
           break;
         }
         default:
         {
-          if(previousSampletime!=mediaSample.getRtpTime()){
-            previousSampletime = mediaSample.getRtpTime();
-            out.write((const char*) startcode, 4);
+          if(m_uiPreviousSampleTime!=mediaSample.getRtpTime()){
+            m_uiPreviousSampleTime = mediaSample.getRtpTime();
+            appendStartCode(4);
             break;
           }else{
-            out.write((const char*) startcode + 1, 3);
+            appendStartCode(3);
             break;
           }
         }
       }
-      out.write((const char*) mediaSample.getDataBuffer().data(), mediaSample.getDataBuffer().getSize());
+      appendSample(mediaSample);
     }
 
   }
 
 protected:
   bool m_bPrependParameterSets;
+  // RTP time of the previous sample: used to select the start code length
+  bool m_bFirstSample;
+  uint32_t m_uiPreviousSampleTime;
 };
 
 } // h265
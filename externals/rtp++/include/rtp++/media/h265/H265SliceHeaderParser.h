@@ -0,0 +1,123 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <map>
+#include <vector>
+#include <rtp++/media/SliceHeaderInfo.h>
+#include <rtp++/util/IBitStream.h>
+
+namespace rtp_plus_plus
+{
+namespace media
+{
+namespace h265
+{
+
+/**
+ * @brief Short-term reference picture set: only the counts are needed to parse slice headers
+ */
+struct ShortTermRefPicSet
+{
+  ShortTermRefPicSet()
+    :NumDeltaPocs(0),
+    NumUsedByCurrPic(0)
+  {
+  }
+  uint32_t NumDeltaPocs;
+  uint32_t NumUsedByCurrPic;
+};
+
+/**
+ * @brief Subset of the sequence parameter set required to parse slice segment headers
+ */
+struct SequenceParameterSet
+{
+  uint32_t ChromaArrayType;
+  bool SeparateColourPlane;
+  uint32_t PicSizeInCtbsY;
+  uint32_t Log2MaxPicOrderCntLsb;
+  std::vector<ShortTermRefPicSet> ShortTermRefPicSets;
+  bool LongTermRefPicsPresent;
+  uint32_t NumLongTermRefPicsSps;
+  std::vector<bool> UsedByCurrPicLtSps;
+  bool TemporalMvpEnabled;
+  bool SampleAdaptiveOffsetEnabled;
+};
+
+/**
+ * @brief Subset of the picture parameter set required to parse slice segment headers
+ */
+struct PictureParameterSet
+{
+  uint32_t SpsId;
+  bool DependentSliceSegmentsEnabled;
+  bool OutputFlagPresent;
+  uint32_t NumExtraSliceHeaderBits;
+  bool CabacInitPresent;
+  uint32_t NumRefIdxL0DefaultActive;
+  uint32_t NumRefIdxL1DefaultActive;
+  int32_t InitQp;
+  bool WeightedPred;
+  bool WeightedBipred;
+  bool ListsModificationPresent;
+};
+
+/**
+ * @brief Parses H.265 parameter sets and slice segment headers up to slice_qp_delta
+ * and derives the picture order count (8.3.1).
+ *
+ * Only the emulation prevented bytes that are needed are converted to RBSP
+ * so that streams can be scanned at close to I/O speed.
+ */
+class H265SliceHeaderParser
+{
+public:
+  H265SliceHeaderParser();
+  /**
+   * @brief parseNalUnit stores parameter sets and parses the header of VCL NAL units
+   * @param pNalUnit NAL unit without start code
+   * @param uiSize Size of the NAL unit
+   * @param info Slice header info which is only valid if the method returns true.
+   * Dependent slice segments return the info of the preceding independent slice segment.
+   * @return true if the NAL unit was a slice segment whose header could be parsed
+   */
+  bool parseNalUnit(const uint8_t* pNalUnit, size_t uiSize, SliceHeaderInfo& info);
+
+private:
+  Buffer toRbsp(const uint8_t* pNalUnit, size_t uiSize, size_t uiMaxSize);
+  bool parseSps(IBitStream& in);
+  bool parsePps(IBitStream& in);
+  bool parseSliceSegmentHeader(IBitStream& in, uint32_t uiNalUnitType, uint32_t uiTemporalId, SliceHeaderInfo& info);
+  bool parseShortTermRefPicSet(IBitStream& in, uint32_t uiIndex, const std::vector<ShortTermRefPicSet>& vSets, ShortTermRefPicSet& rps);
+
+  std::map<uint32_t, SequenceParameterSet> m_mSps;
+  std::map<uint32_t, PictureParameterSet> m_mPps;
+  // picture order count state of prevTid0Pic
+  int32_t m_iPrevTid0PicOrderCntMsb;
+  int32_t m_iPrevTid0PicOrderCntLsb;
+  bool m_bFirstPicture;
+  // the last independent slice segment
+  bool m_bHaveCurrentPicture;
+  SliceHeaderInfo m_currentPicture;
+};
+
+} // h265
+} // media
+} // rtp_plus_plus
@@ -0,0 +1,123 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+
+namespace rtp_plus_plus {
+namespace network {
+
+/**
+ * @brief The LossModel class is the base class of the seeded channel loss models.
+ *
+ * Random numbers are taken directly from std::mt19937 whose output sequence is fixed by
+ * the standard, so that a seed reproduces the same loss pattern on every platform.
+ */
+class LossModel
+{
+public:
+  /**
+   * @brief create creates a loss model from a descriptor
+   *
+   * bernoulli:<loss rate>
+   * ge:<loss rate>:<mean burst length>[:<loss rate in good state>:<loss rate in bad state>]
+   *
+   * @return a null pointer if the descriptor is invalid or the loss rate can not be reached
+   * with the mean burst length
+   */
+  static std::unique_ptr<LossModel> create(const std::string& sDescriptor, uint32_t uiSeed);
+
+  virtual ~LossModel();
+  /**
+   * @brief isLost advances the channel by one packet
+   * @return true if the packet is lost
+   */
+  bool isLost()
+  {
+    ++m_uiPacketCount;
+    bool bLost = nextLoss();
+    if (bLost) ++m_uiLossCount;
+    return bLost;
+  }
+
+  uint64_t getPacketCount() const { return m_uiPacketCount; }
+  uint64_t getLossCount() const { return m_uiLossCount; }
+
+protected:
+  explicit LossModel(uint32_t uiSeed);
+
+  virtual bool nextLoss() = 0;
+  /**
+   * @brief nextUniform returns a uniformly distributed number in [0, 1)
+   */
+  double nextUniform() { return m_generator() / 4294967296.0; }
+
+private:
+  std::mt19937 m_generator;
+  uint64_t m_uiPacketCount;
+  uint64_t m_uiLossCount;
+};
+
+/**
+ * @brief The BernoulliLossModel class loses each packet independently
+ */
+class BernoulliLossModel : public LossModel
+{
+public:
+  BernoulliLossModel(uint32_t uiSeed, double dLossRate);
+
+protected:
+  virtual bool nextLoss();
+
+private:
+  double m_dLossRate;
+};
+
+/**
+ * @brief The GilbertElliottLossModel class is a two state Markov loss model.
+ *
+ * The transition probabilities are derived from the average loss rate and the mean
+ * number of consecutive packets spent in the bad state. By default all packets in the
+ * bad state and none in the good state are lost (the simple Gilbert model).
+ */
+class GilbertElliottLossModel : public LossModel
+{
+public:
+  GilbertElliottLossModel(uint32_t uiSeed, double dLossRate, double dMeanBurstLength,
+                          double dLossRateGood = 0.0, double dLossRateBad = 1.0);
+
+  double getGoodToBadProbability() const { return m_dGoodToBad; }
+  double getBadToGoodProbability() const { return m_dBadToGood; }
+
+protected:
+  virtual bool nextLoss();
+
+private:
+  double m_dGoodToBad;
+  double m_dBadToGood;
+  double m_dLossRateGood;
+  double m_dLossRateBad;
+  bool m_bBad;
+};
+
+} // network
+} // rtp_plus_plus
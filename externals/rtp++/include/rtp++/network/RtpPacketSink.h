@@ -0,0 +1,85 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <rtp++/RtpPacket.h>
+
+namespace rtp_plus_plus {
+namespace network {
+
+/**
+ * @brief The RtpPacketSink class is the base class for RTP packet sinks and
+ * counts the packets and bytes sent. The base class itself discards the packets.
+ */
+class RtpPacketSink
+{
+public:
+  /**
+   * @brief create creates a sink from a descriptor of the form null or udp:<host>:<port>
+   * @return a null pointer if the descriptor is invalid
+   */
+  static std::unique_ptr<RtpPacketSink> create(const std::string& sDescriptor);
+
+  RtpPacketSink();
+  virtual ~RtpPacketSink();
+  /**
+   * @brief send sends the packets in order
+   */
+  void send(const std::vector<RtpPacket>& packets);
+
+  uint64_t getPacketCount() const { return m_uiPacketCount; }
+  uint64_t getByteCount() const { return m_uiByteCount; }
+  uint64_t getHeaderByteCount() const { return m_uiHeaderByteCount; }
+
+protected:
+  virtual void doSend(const RtpPacket& /*packet*/) {}
+
+private:
+  uint64_t m_uiPacketCount;
+  uint64_t m_uiByteCount;
+  uint64_t m_uiHeaderByteCount;
+};
+
+/**
+ * @brief The UdpRtpPacketSink class sends each packet as one UDP datagram, gathering
+ * the header and payload segments of the packet without copying them.
+ */
+class UdpRtpPacketSink : public RtpPacketSink
+{
+public:
+  UdpRtpPacketSink(const std::string& sHost, uint16_t uiPort);
+
+protected:
+  virtual void doSend(const RtpPacket& packet);
+
+private:
+  boost::asio::io_service m_ioService;
+  boost::asio::ip::udp::socket m_socket;
+  std::vector<boost::asio::const_buffer> m_vBuffers;
+  bool m_bSendFailed;
+};
+
+} // network
+} // rtp_plus_plus
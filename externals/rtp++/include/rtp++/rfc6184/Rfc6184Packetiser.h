@@ -0,0 +1,52 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <rtp++/media/NalUnitPacketiser.h>
+
+namespace rtp_plus_plus {
+namespace rfc6184 {
+
+/// STAP-A NAL unit type
+static const uint8_t STAP_A = 24;
+/// FU-A NAL unit type
+static const uint8_t FU_A = 28;
+
+/**
+ * @brief The Rfc6184Packetiser class packetises H.264 access units into single NAL unit,
+ * STAP-A and FU-A packets (RFC 6184 non-interleaved mode)
+ */
+class Rfc6184Packetiser : public media::NalUnitPacketiser
+{
+public:
+  Rfc6184Packetiser(uint32_t uiMaxPacketSize, uint8_t uiPayloadType, uint32_t uiSsrc, uint16_t uiSequenceNumber);
+
+protected:
+  virtual uint32_t getNalUnitHeaderSize() const { return 1; }
+  virtual uint32_t getAggregationHeaderSize() const { return 1; }
+  virtual void writeAggregationHeader(uint8_t* pHeader, const NalUnit* pNalUnits, uint32_t uiCount) const;
+  virtual uint32_t getFragmentationHeaderSize() const { return 2; }
+  virtual void writeFragmentationHeader(uint8_t* pHeader, const uint8_t* pNalUnit, bool bStart, bool bEnd) const;
+  virtual bool isAggregationPacket(const uint8_t* pPayload) const { return (pPayload[0] & 0x1F) == STAP_A; }
+  virtual bool isFragmentationUnit(const uint8_t* pPayload) const { return (pPayload[0] & 0x1F) == FU_A; }
+  virtual void writeNalUnitHeader(uint8_t* pNalUnit, const uint8_t* pPayload) const;
+};
+
+} // rfc6184
+} // rtp_plus_plus
@@ -0,0 +1,57 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <string>
+
+namespace rtp_plus_plus {
+namespace cpu {
+
+/**
+ * @brief Instruction set levels of the per ISA codec builds in increasing order
+ */
+enum IsaLevel
+{
+  ISA_BASELINE,
+  // AVX2, FMA and BMI2: Haswell and Zen and later
+  ISA_AVX2,
+  // AVX-512 F, BW, DQ and VL: Skylake-SP, Ice Lake and Zen 4 and later
+  ISA_AVX512,
+  ISA_COUNT
+};
+
+/**
+ * @brief getName returns the name of the level used in plugin file names e.g. "avx2"
+ */
+const char* getName(IsaLevel eLevel);
+
+/**
+ * @brief parseIsaLevel converts a name returned by getName. Returns false if sName is unknown.
+ */
+bool parseIsaLevel(const std::string& sName, IsaLevel& eLevel);
+
+/**
+ * @brief getIsaLevel returns the highest level that the CPU and the OS support. The OS must
+ * save the AVX and AVX-512 register state on context switches: this is checked with XGETBV.
+ * Always ISA_BASELINE on CPUs other than x86.
+ */
+IsaLevel getIsaLevel();
+
+} // cpu
+} // rtp_plus_plus
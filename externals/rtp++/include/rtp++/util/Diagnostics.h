@@ -0,0 +1,239 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <boost/thread/thread.hpp>
+#include <glog/logging.h>
+#include <rtp++/util/LockFreeRing.h>
+
+/**
+ * @def DIAG_IS_ON Returns whether diagnostics of the verbose level are enabled. This costs
+ * the same single branch as VLOG when the level is disabled.
+ */
+#define DIAG_IS_ON(verboselevel) VLOG_IS_ON(verboselevel)
+
+/**
+ * @def DIAG_EVENT Declares a diagnostics event named var. Values streamed into the event are
+ * stored raw and formatted by the drain thread when the event goes out of scope.
+ * Must only be used once DIAG_IS_ON has returned true.
+ */
+#define DIAG_EVENT(var, format) ::rtp_plus_plus::diagnostics::Event var(__FILE__, __LINE__, format)
+
+/**
+ * @def DIAG Logs a diagnostics event in a single statement if the verbose level is enabled
+ * e.g. DIAG(2, "Frame {} size: {}") << uiFrame << uiSize;
+ */
+#define DIAG(verboselevel, format) \
+  !DIAG_IS_ON(verboselevel) ? (void) 0 : ::rtp_plus_plus::diagnostics::Voidify() & ::rtp_plus_plus::diagnostics::Event(__FILE__, __LINE__, format)
+
+namespace rtp_plus_plus {
+namespace diagnostics {
+
+/**
+ * @brief The Record struct is the fixed-size representation of an event in the ring.
+ *
+ * Format is a string literal: each "{}" is replaced by the next value and a single "{*}"
+ * is replaced by all values not consumed by the other placeholders, each preceded by a space.
+ * Values beyond MAX_VALUES are stored in continuation records chained through Next: these are
+ * allocated by the event that overflows and freed by the drain thread once formatted.
+ */
+struct Record
+{
+  static const uint32_t MAX_VALUES = 32;
+
+  enum ValueType
+  {
+    VT_INT,
+    VT_UINT,
+    VT_DOUBLE
+  };
+
+  union Value
+  {
+    int64_t Int;
+    uint64_t UInt;
+    double Double;
+  };
+
+  const char* File;
+  int Line;
+  const char* Format;
+  uint32_t Count;
+  Record* Next;
+  uint8_t Types[MAX_VALUES];
+  Value Values[MAX_VALUES];
+};
+
+/**
+ * @brief format expands the placeholders in the format of the record and its continuation records
+ */
+std::string format(const Record& record);
+
+/**
+ * @brief freeContinuations deletes the continuation records chained to record
+ */
+void freeContinuations(Record& record);
+
+/**
+ * @brief The Event class collects the values of one record on the stack and
+ * submits it to the ring on destruction. Only events with more than Record::MAX_VALUES
+ * values allocate, one continuation record per Record::MAX_VALUES values.
+ */
+class Event
+{
+public:
+  Event(const char* szFile, int iLine, const char* szFormat)
+  {
+    m_record.File = szFile;
+    m_record.Line = iLine;
+    m_record.Format = szFormat;
+    m_record.Count = 0;
+    m_record.Next = 0;
+    m_pLast = &m_record;
+  }
+  ~Event();
+
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, Event&>::type operator<<(T iValue)
+  {
+    return addInt(iValue);
+  }
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, Event&>::type operator<<(T uiValue)
+  {
+    return addUInt(uiValue);
+  }
+  Event& operator<<(double dValue)
+  {
+    Record& record = reserve();
+    record.Types[record.Count] = Record::VT_DOUBLE;
+    record.Values[record.Count++].Double = dValue;
+    return *this;
+  }
+  /**
+   * @brief getRecord returns the values collected so far: the continuation records are owned
+   * by the event until it is submitted
+   */
+  const Record& getRecord() const { return m_record; }
+
+private:
+  Event(const Event&);
+  Event& operator=(const Event&);
+
+  Record& reserve()
+  {
+    if (m_pLast->Count == Record::MAX_VALUES)
+    {
+      Record* pNext = new Record;
+      pNext->File = m_record.File;
+      pNext->Line = m_record.Line;
+      pNext->Format = m_record.Format;
+      pNext->Count = 0;
+      pNext->Next = 0;
+      m_pLast->Next = pNext;
+      m_pLast = pNext;
+    }
+    return *m_pLast;
+  }
+  Event& addInt(int64_t iValue)
+  {
+    Record& record = reserve();
+    record.Types[record.Count] = Record::VT_INT;
+    record.Values[record.Count++].Int = iValue;
+    return *this;
+  }
+  Event& addUInt(uint64_t uiValue)
+  {
+    Record& record = reserve();
+    record.Types[record.Count] = Record::VT_UINT;
+    record.Values[record.Count++].UInt = uiValue;
+    return *this;
+  }
+
+  Record m_record;
+  // the record that the next value is added to
+  Record* m_pLast;
+};
+
+/**
+ * @brief Used in the DIAG macro to give both branches of the conditional the type void
+ */
+struct Voidify
+{
+  void operator&(const Event&) {}
+};
+
+/**
+ * @brief The Drain class owns the ring and the background thread that formats
+ * records and writes them to the glog INFO log with the file and line of the event.
+ * When the ring is full producers yield until space is available so that no
+ * event is lost: the number of such stalls is reported when the drain is stopped.
+ */
+class Drain
+{
+public:
+  static const size_t DEFAULT_CAPACITY = 8192;
+
+  static Drain& get();
+
+  ~Drain();
+  /**
+   * @brief submit copies the record into the ring
+   */
+  void submit(const Record& record);
+  /**
+   * @brief flush blocks until all records submitted so far have been written
+   */
+  void flush();
+  /**
+   * @brief getStallCount returns the number of times a producer found the ring full
+   */
+  uint64_t getStallCount() const { return m_uiStalls.load(std::memory_order_relaxed); }
+
+private:
+  Drain(size_t uiCapacity);
+  void drainInBackground();
+
+  LockFreeRing<Record> m_ring;
+  std::atomic<uint64_t> m_uiSubmitted;
+  std::atomic<uint64_t> m_uiWritten;
+  std::atomic<uint64_t> m_uiStalls;
+  std::atomic<bool> m_bShutdown;
+  boost::thread m_drainThread;
+};
+
+inline Event::~Event()
+{
+  Drain::get().submit(m_record);
+}
+
+/**
+ * @brief flush blocks until all diagnostics submitted so far have been logged
+ */
+inline void flush()
+{
+  Drain::get().flush();
+}
+
+} // diagnostics
+} // rtp_plus_plus
@@ -18,12 +18,68 @@ along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
 // "CSIR"
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #pragma once
+#include <cassert>
+#include <cstring>
 #include "Buffer.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace rtp_plus_plus {
 
+namespace bitstream {
+
+/**
+ * @brief loadBigEndian64 loads 8 bytes in network byte order
+ */
+inline uint64_t loadBigEndian64(const uint8_t* pData)
+{
+  uint64_t uiValue;
+  memcpy(&uiValue, pData, sizeof(uiValue));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  return uiValue;
+#elif defined(_MSC_VER)
+  return _byteswap_uint64(uiValue);
+#else
+  return __builtin_bswap64(uiValue);
+#endif
+}
+
+/**
+ * @brief countLeadingZeros64 The result is undefined for 0
+ */
+inline uint32_t countLeadingZeros64(uint64_t uiValue)
+{
+  assert(uiValue != 0);
+#if defined(_MSC_VER) && defined(_M_X64)
+  unsigned long uiIndex;
+  _BitScanReverse64(&uiIndex, uiValue);
+  return 63 - uiIndex;
+#elif defined(_MSC_VER)
+  unsigned long uiIndex;
+  if (_BitScanReverse(&uiIndex, static_cast<uint32_t>(uiValue >> 32)))
+    return 31 - uiIndex;
+  _BitScanReverse(&uiIndex, static_cast<uint32_t>(uiValue));
+  return 63 - uiIndex;
+#else
+  return __builtin_clzll(uiValue);
+#endif
+}
+
+} // bitstream
+
 /**
  * @brief Class to read from a bitstream
+ *
+ * The next bits of the stream are kept MSB-aligned in a 64-bit cache that is
+ * refilled with big endian word loads, so that reads of up to 32 bits
+ * only touch memory once every few calls.
+ *
+ * The read() overloads check the bits remaining and return false on failure.
+ * The readBits(), readUE() and readSE() methods are intended for parsing
+ * bitstream syntax and don't check each call: reading past the end returns 0
+ * and sets a sticky error flag that can be checked with hasError() once the
+ * syntax structure has been parsed.
  */
 class IBitStream
 {
@@ -32,161 +88,146 @@ class IBitStream
 public:
   IBitStream(Buffer buffer)
     :m_buffer(buffer),
-    m_uiBitsRemaining(buffer.getSize() << 3),
-    m_uiBitsInCurrentByte(8),
-    m_uiCurrentBytePos(0)
+    m_pData(buffer.data()),
+    m_uiSize(static_cast<uint32_t>(buffer.getSize())),
+    m_uiBitsRemaining(static_cast<uint32_t>(buffer.getSize() << 3)),
+    m_uiCache(0),
+    m_uiBitsInCache(0),
+    m_uiNextBytePos(0),
+    m_bError(false)
   {
 
   }
 
   uint32_t getBitsRemaining() const { return m_uiBitsRemaining; }
   uint32_t getBytesRemaining() const { return (m_uiBitsRemaining >> 3); }
+  /**
+   * @brief isByteAligned returns if the read position is on a byte boundary
+   */
+  bool isByteAligned() const { return (m_uiBitsRemaining & 0x07) == 0; }
+  /**
+   * @brief hasError returns true if a readBits(), readUE() or readSE() call read past the end of the stream
+   */
+  bool hasError() const { return m_bError; }
 
   bool read(uint64_t& uiValue, uint32_t uiBits)
   {
-    if (uiBits > m_uiBitsRemaining)
+    if (uiBits > 64 || uiBits > m_uiBitsRemaining)
     {
       return false;
     }
-
-    uiValue = 0;
-    uint32_t uiBitsRemaining = uiBits;
-    while (uiBitsRemaining > 0)
+    if (uiBits > 32)
     {
-      uint32_t uiBitsToReadInCurrentByte = std::min(m_uiBitsInCurrentByte, uiBitsRemaining);
-      // preserve old value
-      uiValue <<= uiBitsToReadInCurrentByte;
-      // bits to shift by
-      uint32_t uiBitsToShiftBy = m_uiBitsInCurrentByte - uiBitsToReadInCurrentByte;
-      uint8_t uiMask = (2 << (uiBitsToReadInCurrentByte - 1)) - 1;
-      uiValue |= ((m_buffer[m_uiCurrentBytePos] >> uiBitsToShiftBy) & uiMask);
-
-      m_uiBitsInCurrentByte -= uiBitsToReadInCurrentByte;
-      if (m_uiBitsInCurrentByte == 0)
-      {
-        m_uiBitsInCurrentByte = 8;
-        ++m_uiCurrentBytePos;
-      }
-      uiBitsRemaining -= uiBitsToReadInCurrentByte;
+      uint64_t uiHigh = readBits(uiBits - 32);
+      uiValue = (uiHigh << 32) | readBits(32);
+    }
+    else
+    {
+      uiValue = readBits(uiBits);
     }
-    // update total
-    m_uiBitsRemaining -= uiBits;
     return true;
   }
 
   bool read(uint32_t& uiValue, uint32_t uiBits)
   {
-    if (uiBits > m_uiBitsRemaining)
-    {
-      return false;
-    }
-
-    uiValue = 0;
-    uint32_t uiBitsRemaining = uiBits;
-    while (uiBitsRemaining > 0)
-    {
-      uint32_t uiBitsToReadInCurrentByte = std::min(m_uiBitsInCurrentByte, uiBitsRemaining);
-      // preserve old value
-      uiValue <<= uiBitsToReadInCurrentByte;
-      // bits to shift by
-      uint32_t uiBitsToShiftBy = m_uiBitsInCurrentByte - uiBitsToReadInCurrentByte;
-      uint8_t uiMask = (2 << (uiBitsToReadInCurrentByte - 1)) - 1;
-      uiValue |= ((m_buffer[m_uiCurrentBytePos] >> uiBitsToShiftBy) & uiMask);
-
-      m_uiBitsInCurrentByte -= uiBitsToReadInCurrentByte;
-      if (m_uiBitsInCurrentByte == 0)
-      {
-        m_uiBitsInCurrentByte = 8;
-        ++m_uiCurrentBytePos;
-      }
-      uiBitsRemaining -= uiBitsToReadInCurrentByte;
-    }
-    // update total
-    m_uiBitsRemaining -= uiBits;
-    return true;
+    return readChecked(uiValue, uiBits, 32);
   }
 
   // This method can only read 8 bits at a time
   bool read(uint8_t& uiValue, uint32_t uiBits)
   {
-    if (uiBits > 8 || (uiBits > m_uiBitsRemaining))
-    {
-      return false;
-    }
+    return readChecked(uiValue, uiBits, 8);
+  }
 
-    uiValue = 0;
-    uint32_t uiBitsRemaining = uiBits;
-    while (uiBitsRemaining > 0)
+  // This method can only read 16 bits at a time
+  bool read(uint16_t& uiValue, uint32_t uiBits)
+  {
+    return readChecked(uiValue, uiBits, 16);
+  }
+  /**
+   * @brief readBits reads up to 32 bits
+   */
+  uint32_t readBits(uint32_t uiBits)
+  {
+    assert(uiBits <= 32);
+    if (uiBits == 0) return 0;
+    if (uiBits > m_uiBitsInCache)
     {
-      uint32_t uiBitsToReadInCurrentByte = std::min(m_uiBitsInCurrentByte, uiBitsRemaining);
-      // preserve old value
-      uiValue <<= uiBitsToReadInCurrentByte;
-      // bits to shift by
-      uint32_t uiBitsToShiftBy = m_uiBitsInCurrentByte - uiBitsToReadInCurrentByte;
-      uint8_t uiMask = (2 << (uiBitsToReadInCurrentByte - 1)) - 1;
-      uiValue |= ((m_buffer[m_uiCurrentBytePos] >> uiBitsToShiftBy) & uiMask);
-
-      m_uiBitsInCurrentByte -= uiBitsToReadInCurrentByte;
-      if (m_uiBitsInCurrentByte == 0)
+      refill();
+      if (uiBits > m_uiBitsInCache)
       {
-        m_uiBitsInCurrentByte = 8;
-        ++m_uiCurrentBytePos;
+        return overrun();
       }
-      uiBitsRemaining -= uiBitsToReadInCurrentByte;
     }
-    // update total
-    m_uiBitsRemaining -= uiBits;
-    return true;
+    uint32_t uiValue = static_cast<uint32_t>(m_uiCache >> (64 - uiBits));
+    consume(uiBits);
+    return uiValue;
   }
-
-  // This method can only read 16 bits at a time
-  bool read(uint16_t& uiValue, uint32_t uiBits)
+  /**
+   * @brief peekBits returns the next bits (up to 32) without consuming them.
+   * Bits past the end of the stream are returned as zero.
+   */
+  uint32_t peekBits(uint32_t uiBits)
   {
-    if (uiBits > 16 || (uiBits > m_uiBitsRemaining))
+    assert(uiBits <= 32);
+    if (uiBits == 0) return 0;
+    if (uiBits > m_uiBitsInCache) refill();
+    // the cache is zero padded past the end of the stream
+    return static_cast<uint32_t>(m_uiCache >> (64 - uiBits));
+  }
+  /**
+   * @brief readFlag reads a single bit
+   */
+  bool readFlag()
+  {
+    return readBits(1) != 0;
+  }
+  /**
+   * @brief readUE reads an unsigned Exp-Golomb code ue(v)
+   */
+  uint32_t readUE()
+  {
+    if (m_uiBitsInCache < 32) refill();
+    // the codeword of values up to 2^32 - 2 consists of at most 31 leading zeros
+    if ((m_uiCache >> 32) == 0)
     {
-      return false;
+      return overrun();
     }
-
-    uiValue = 0;
-    uint32_t uiBitsRemaining = uiBits;
-    while (uiBitsRemaining > 0)
+    uint32_t uiLeadingZeros = bitstream::countLeadingZeros64(m_uiCache);
+    uint32_t uiCodewordLength = (uiLeadingZeros << 1) + 1;
+    if (uiCodewordLength <= m_uiBitsInCache)
     {
-      uint32_t uiBitsToReadInCurrentByte = std::min(m_uiBitsInCurrentByte, uiBitsRemaining);
-      // preserve old value
-      uiValue <<= uiBitsToReadInCurrentByte;
-      // bits to shift by
-      uint32_t uiBitsToShiftBy = m_uiBitsInCurrentByte - uiBitsToReadInCurrentByte;
-      uint8_t uiMask = (2 << (uiBitsToReadInCurrentByte - 1)) - 1;
-      uiValue |= ((m_buffer[m_uiCurrentBytePos] >> uiBitsToShiftBy) & uiMask);
-
-      m_uiBitsInCurrentByte -= uiBitsToReadInCurrentByte;
-      if (m_uiBitsInCurrentByte == 0)
-      {
-        m_uiBitsInCurrentByte = 8;
-        ++m_uiCurrentBytePos;
-      }
-      uiBitsRemaining -= uiBitsToReadInCurrentByte;
+      uint64_t uiCodeword = m_uiCache >> (64 - uiCodewordLength);
+      consume(uiCodewordLength);
+      return static_cast<uint32_t>(uiCodeword - 1);
     }
-    // update total
-    m_uiBitsRemaining -= uiBits;
-    return true;
+    // near the end of the buffer
+    consume(uiLeadingZeros);
+    return static_cast<uint32_t>((static_cast<uint64_t>(1) << uiLeadingZeros) - 1 + (readBits(uiLeadingZeros + 1) & ~(1u << uiLeadingZeros)));
+  }
+  /**
+   * @brief readSE reads a signed Exp-Golomb code se(v)
+   */
+  int32_t readSE()
+  {
+    uint32_t uiCodeNum = readUE();
+    return (uiCodeNum & 1) ? static_cast<int32_t>((uiCodeNum >> 1) + 1) : -static_cast<int32_t>(uiCodeNum >> 1);
   }
 
   // this method can only be called on byte boundaries
   bool readBytes(uint8_t*& rDestination, uint32_t uiBytes)
   {
     uint32_t uiBits = uiBytes << 3;
-    if ((m_uiBitsInCurrentByte != 8) || 
+    if (!isByteAligned() ||
         (uiBits > m_uiBitsRemaining)
        )
     {
       return false;
     }
 
-    memcpy(rDestination, &m_buffer[m_uiCurrentBytePos], uiBytes);
-    // update total
-    m_uiBitsRemaining -= uiBits;
-    m_uiCurrentBytePos += uiBytes;
+    uint32_t uiBytePos = getBitPosition() >> 3;
+    memcpy(rDestination, m_pData + uiBytePos, uiBytes);
+    seek(getBitPosition() + uiBits);
     return true;
   }
 
@@ -197,47 +238,125 @@ public:
       return false;
     }
 
-    uint32_t uiBitsRemaining = uiBits;
-    while (uiBitsRemaining)
+    if (uiBits <= m_uiBitsInCache)
     {
-      uint32_t uiBitsToReadInCurrentByte = std::min(m_uiBitsInCurrentByte, uiBitsRemaining);
-      // preserve old value
-      m_uiBitsInCurrentByte -= uiBitsToReadInCurrentByte;
-      if (m_uiBitsInCurrentByte == 0)
-      {
-        m_uiBitsInCurrentByte = 8;
-        ++m_uiCurrentBytePos;
-      }
-      uiBitsRemaining -= uiBitsToReadInCurrentByte;
+      consume(uiBits);
+    }
+    else
+    {
+      seek(getBitPosition() + uiBits);
     }
-    m_uiBitsRemaining -= uiBits;
     return true;
   }
 
   bool skipBytes(uint32_t uiBytes)
   {
     uint32_t uiBits = uiBytes << 3;
-    if ((m_uiBitsInCurrentByte != 8) || 
+    if (!isByteAligned() ||
       (uiBits > m_uiBitsRemaining)
       )
     {
       return false;
     }
 
-    m_uiBitsRemaining -= uiBits;
-    m_uiCurrentBytePos += uiBytes;
-    return true;
+    return skipBits(uiBits);
   }
    
   uint8_t peekAtCurrentByte() const
   {
-    return m_buffer[m_uiCurrentBytePos];
+    return m_pData[getBitPosition() >> 3];
   }
+
 private:
+  template <typename T>
+  bool readChecked(T& uiValue, uint32_t uiBits, uint32_t uiMaxBits)
+  {
+    if (uiBits > uiMaxBits || (uiBits > m_uiBitsRemaining))
+    {
+      return false;
+    }
+    uiValue = static_cast<T>(readBits(uiBits));
+    return true;
+  }
+
+  uint32_t getBitPosition() const
+  {
+    return (m_uiSize << 3) - m_uiBitsRemaining;
+  }
+
+  void consume(uint32_t uiBits)
+  {
+    assert(uiBits <= m_uiBitsInCache && uiBits < 64);
+    m_uiCache <<= uiBits;
+    m_uiBitsInCache -= uiBits;
+    m_uiBitsRemaining -= uiBits;
+  }
+
+  /**
+   * @brief refill tops up the cache to at least 57 bits if enough data is left.
+   * Bits loaded past m_uiBitsInCache always hold the following stream bits, so
+   * OR-ing them in again on the next refill is harmless.
+   */
+  void refill()
+  {
+    uint32_t uiBytesLeft = m_uiSize - m_uiNextBytePos;
+    if (uiBytesLeft >= 8)
+    {
+      m_uiCache |= bitstream::loadBigEndian64(m_pData + m_uiNextBytePos) >> m_uiBitsInCache;
+      uint32_t uiBytes = (64 - m_uiBitsInCache) >> 3;
+      m_uiNextBytePos += uiBytes;
+      m_uiBitsInCache += uiBytes << 3;
+    }
+    else
+    {
+      while (m_uiBitsInCache <= 56 && m_uiNextBytePos < m_uiSize)
+      {
+        m_uiCache |= static_cast<uint64_t>(m_pData[m_uiNextBytePos++]) << (56 - m_uiBitsInCache);
+        m_uiBitsInCache += 8;
+      }
+    }
+  }
+
+  /**
+   * @brief seek moves the read position to an absolute bit offset
+   */
+  void seek(uint32_t uiBitPos)
+  {
+    assert(uiBitPos <= (m_uiSize << 3));
+    m_uiBitsRemaining = (m_uiSize << 3) - uiBitPos;
+    m_uiNextBytePos = uiBitPos >> 3;
+    m_uiCache = 0;
+    m_uiBitsInCache = 0;
+    uint32_t uiBitOffset = uiBitPos & 0x07;
+    if (uiBitOffset)
+    {
+      refill();
+      m_uiCache <<= uiBitOffset;
+      m_uiBitsInCache -= uiBitOffset;
+    }
+  }
+
+  uint32_t overrun()
+  {
+    m_bError = true;
+    m_uiBitsRemaining = 0;
+    m_uiBitsInCache = 0;
+    m_uiCache = 0;
+    m_uiNextBytePos = m_uiSize;
+    return 0;
+  }
+
   Buffer m_buffer;
+  const uint8_t* m_pData;
+  uint32_t m_uiSize;
   uint32_t m_uiBitsRemaining;
-  uint32_t m_uiBitsInCurrentByte;
-  uint32_t m_uiCurrentBytePos;
+  // next bits of the stream, MSB-aligned
+  uint64_t m_uiCache;
+  // number of valid bits in m_uiCache
+  uint32_t m_uiBitsInCache;
+  // next byte to be loaded into the cache
+  uint32_t m_uiNextBytePos;
+  bool m_bError;
 };
 
 } // rtp_plus_plus
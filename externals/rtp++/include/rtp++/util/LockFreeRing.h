@@ -0,0 +1,137 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+
+namespace rtp_plus_plus {
+
+/**
+ * @brief The LockFreeRing class is a bounded multi-producer queue based on D. Vyukov's
+ * bounded MPMC queue. Each cell carries a sequence number which tells producers and the
+ * consumer whether the cell is free or published, so that neither side ever takes a lock
+ * or makes a system call. The capacity must be a power of two.
+ */
+template <typename T>
+class LockFreeRing
+{
+public:
+  explicit LockFreeRing(size_t uiCapacity)
+    :m_pCells(new Cell[uiCapacity]),
+      m_uiMask(uiCapacity - 1),
+      m_uiEnqueuePos(0),
+      m_uiDequeuePos(0)
+  {
+    assert(uiCapacity >= 2 && (uiCapacity & (uiCapacity - 1)) == 0);
+    for (size_t i = 0; i < uiCapacity; ++i)
+    {
+      m_pCells[i].Sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  size_t capacity() const { return m_uiMask + 1; }
+  /**
+   * @brief tryPush copies value into the ring
+   * @return false if the ring is full
+   */
+  bool tryPush(const T& value)
+  {
+    size_t uiPos = m_uiEnqueuePos.load(std::memory_order_relaxed);
+    Cell* pCell;
+    while (true)
+    {
+      pCell = &m_pCells[uiPos & m_uiMask];
+      size_t uiSequence = pCell->Sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t iDiff = (std::ptrdiff_t)uiSequence - (std::ptrdiff_t)uiPos;
+      if (iDiff == 0)
+      {
+        if (m_uiEnqueuePos.compare_exchange_weak(uiPos, uiPos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (iDiff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        uiPos = m_uiEnqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    pCell->Data = value;
+    pCell->Sequence.store(uiPos + 1, std::memory_order_release);
+    return true;
+  }
+  /**
+   * @brief tryPop moves the oldest published value out of the ring
+   * @return false if the ring is empty
+   */
+  bool tryPop(T& value)
+  {
+    size_t uiPos = m_uiDequeuePos.load(std::memory_order_relaxed);
+    Cell* pCell;
+    while (true)
+    {
+      pCell = &m_pCells[uiPos & m_uiMask];
+      size_t uiSequence = pCell->Sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t iDiff = (std::ptrdiff_t)uiSequence - (std::ptrdiff_t)(uiPos + 1);
+      if (iDiff == 0)
+      {
+        if (m_uiDequeuePos.compare_exchange_weak(uiPos, uiPos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (iDiff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        uiPos = m_uiDequeuePos.load(std::memory_order_relaxed);
+      }
+    }
+    value = pCell->Data;
+    pCell->Sequence.store(uiPos + m_uiMask + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  LockFreeRing(const LockFreeRing&);
+  LockFreeRing& operator=(const LockFreeRing&);
+
+  static const size_t CACHE_LINE_SIZE = 64;
+
+  struct Cell
+  {
+    std::atomic<size_t> Sequence;
+    T Data;
+  };
+
+  std::unique_ptr<Cell[]> m_pCells;
+  const size_t m_uiMask;
+  // keep producer and consumer positions on separate cache lines
+  char m_pad0[CACHE_LINE_SIZE];
+  std::atomic<size_t> m_uiEnqueuePos;
+  char m_pad1[CACHE_LINE_SIZE];
+  std::atomic<size_t> m_uiDequeuePos;
+  char m_pad2[CACHE_LINE_SIZE];
+};
+
+} // rtp_plus_plus
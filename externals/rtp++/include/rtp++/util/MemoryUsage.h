@@ -0,0 +1,113 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace rtp_plus_plus {
+namespace memory {
+
+/**
+ * @brief Memory usage of the process in kB: -1 marks a value that is not available
+ */
+struct MemorySnapshot
+{
+  MemorySnapshot()
+    :RssKb(-1), PssKb(-1), AnonymousKb(-1), PeakRssKb(-1)
+  {
+  }
+  int64_t RssKb;
+  int64_t PssKb;
+  // private heap and stack pages: the part of the RSS that grows with encoder state
+  int64_t AnonymousKb;
+  // high water mark of the RSS since start or the last resetPeakRss()
+  int64_t PeakRssKb;
+};
+
+/**
+ * @brief getMemorySnapshot reads /proc/self/smaps_rollup and the peak RSS from /proc/self/status.
+ * Only the RSS is available on kernels without smaps_rollup.
+ */
+MemorySnapshot getMemorySnapshot();
+
+/**
+ * @brief resetPeakRss resets the peak RSS to the current RSS so that the peak of a phase
+ * e.g. encoding can be measured. Returns false if not supported.
+ */
+bool resetPeakRss();
+
+/**
+ * @brief Process wide allocation counts since start
+ */
+struct AllocationCounts
+{
+  AllocationCounts()
+    :Allocations(0), Frees(0), AllocatedBytes(0), FreedBytes(0)
+  {
+  }
+  uint64_t Allocations;
+  uint64_t Frees;
+  uint64_t AllocatedBytes;
+  uint64_t FreedBytes;
+};
+
+/**
+ * @brief returns the per count difference
+ */
+AllocationCounts operator-(const AllocationCounts& end, const AllocationCounts& start);
+
+/**
+ * @brief setAllocationCounting turns the counting of the allocator hook on or off. Counting is off
+ * by default: the hook then only checks isAllocationCountingEnabled. Blocks allocated before
+ * counting is turned on are counted when they are freed.
+ */
+void setAllocationCounting(bool bEnabled);
+
+/**
+ * @brief isAllocationCountingEnabled returns if onAllocate and onFree count
+ */
+bool isAllocationCountingEnabled();
+
+/**
+ * @brief isAllocationHookInstalled returns true if an allocator hook has reported to onAllocate
+ * while counting is enabled. The hook is an executable level decision: applications that want
+ * allocation counts interpose malloc and friends and forward the usable size of each block.
+ */
+bool isAllocationHookInstalled();
+
+/**
+ * @brief getAllocationCounts returns the counts reported by the allocator hook: the sum of the
+ * per thread counts
+ */
+AllocationCounts getAllocationCounts();
+
+/**
+ * @brief onAllocate is called by the allocator hook: must not allocate. Counts in a slot of
+ * the calling thread.
+ */
+void onAllocate(size_t uiBytes);
+
+/**
+ * @brief onFree is called by the allocator hook: must not allocate
+ */
+void onFree(size_t uiBytes);
+
+} // memory
+} // rtp_plus_plus
@@ -18,6 +18,7 @@ along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
 // "CSIR"
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #pragma once
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <vector>
@@ -29,12 +30,29 @@ along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
 #define DEFAULT_BUFFER_SIZE 1024
 #define PRE_BUFFER_SIZE 0
 
-/// DEBUG_OBITSTREAM for outputting debug info
-
 namespace rtp_plus_plus {
 
+namespace bitstream {
+
+/**
+ * @brief storeBigEndian32 stores 4 bytes in network byte order
+ */
+inline void storeBigEndian32(uint8_t* pData, uint32_t uiValue)
+{
+  pData[0] = static_cast<uint8_t>(uiValue >> 24);
+  pData[1] = static_cast<uint8_t>(uiValue >> 16);
+  pData[2] = static_cast<uint8_t>(uiValue >> 8);
+  pData[3] = static_cast<uint8_t>(uiValue);
+}
+
+} // bitstream
+
 /**
  * @brief Class to write to a bitstream
+ *
+ * Bits are collected in a 64-bit accumulator and stored 32 bits at a time.
+ * Fewer than 32 bits are pending in the accumulator between calls: methods
+ * that operate on whole bytes flush the pending whole bytes first.
  */
 class OBitStream
 {
@@ -46,13 +64,14 @@ public:
    * @param uiPreBufferSize
    */
   explicit OBitStream(const uint32_t uiSize = DEFAULT_BUFFER_SIZE, const uint32_t uiPreBufferSize = PRE_BUFFER_SIZE, bool bConservative = true)
-    :m_uiBufferSize(uiSize),
-    m_buffer(new uint8_t[uiSize], uiSize, uiPreBufferSize, 0), // allocating 4 bytes of prebuffer
-    m_uiBitsLeft(8),
+    :m_buffer(new uint8_t[uiSize], uiSize, uiPreBufferSize, 0),
+    m_uiBufferSize(static_cast<uint32_t>(m_buffer.getSize())),
+    m_pData(const_cast<uint8_t*>(m_buffer.data())),
+    m_uiAccumulator(0),
+    m_uiBitsInAccumulator(0),
     m_uiCurrentBytePos(0),
     m_bConservative(bConservative)
   {
-    memset(m_buffer.getBuffer().get(), 0, m_uiBufferSize);
   }
   /**
    * @brief OBitStream
@@ -60,13 +79,14 @@ public:
    * @param bConservative
    */
   explicit OBitStream(Buffer buffer, bool bConservative = true)
-    :m_uiBufferSize(buffer.getSize()),
-    m_buffer(buffer),
-    m_uiBitsLeft(8),
+    :m_buffer(buffer),
+    m_uiBufferSize(static_cast<uint32_t>(buffer.getSize())),
+    m_pData(const_cast<uint8_t*>(m_buffer.data())),
+    m_uiAccumulator(0),
+    m_uiBitsInAccumulator(0),
     m_uiCurrentBytePos(0),
     m_bConservative(bConservative)
   {
-    memset(m_buffer.getBuffer().get(), 0, m_uiBufferSize);
   }
   /**
    * @brief reset resets the write pointers inside the class
@@ -75,9 +95,9 @@ public:
    */
   void reset()
   {
-    m_uiBitsLeft = 8;
+    m_uiAccumulator = 0;
+    m_uiBitsInAccumulator = 0;
     m_uiCurrentBytePos = 0;
-    memset(m_buffer.getBuffer().get(), 0, m_uiBufferSize);
   }
   /**
    * @brief write8Bits
@@ -85,152 +105,86 @@ public:
    */
   void write8Bits(uint8_t uiValue)
   {
-    if (totalBitsLeft() < 8)
-    {
-      increaseBufferSize(m_uiBufferSize << 1);
-    }
-    // check if we're writing on byte boundary
-    if (m_uiBitsLeft == 8)
-    {
-      m_buffer[m_uiCurrentBytePos++] = uiValue;
-    }
-    else
-    {
-      write(uiValue, 8);
-    }
+    write(uiValue, 8);
   }
   /**
-   * @brief write
+   * @brief write writes the uiBits least significant bits of uiValue
    * @param uiValue
-   * @param uiBits
+   * @param uiBits Up to 32 bits
    */
   void write(uint32_t uiValue, uint32_t uiBits)
   {
-    // check if enough memory has been allocated
-    if ( totalBitsLeft() < uiBits )
+    assert(uiBits <= 32);
+    if (uiBits == 0) return;
+    uint64_t uiMask = (static_cast<uint64_t>(1) << uiBits) - 1;
+    m_uiAccumulator = (m_uiAccumulator << uiBits) | (uiValue & uiMask);
+    m_uiBitsInAccumulator += uiBits;
+    if (m_uiBitsInAccumulator >= 32)
     {
-      // reallocate more than enough memory:
-      uint32_t uiBytes = uiBits >> 3;
-      uint32_t uiNewSize = std::max(m_uiBufferSize << 1, (m_uiBufferSize + uiBytes) << 1 );
-      increaseBufferSize(uiNewSize);
+      ensureCapacity(4);
+      m_uiBitsInAccumulator -= 32;
+      bitstream::storeBigEndian32(m_pData + m_uiCurrentBytePos, static_cast<uint32_t>(m_uiAccumulator >> m_uiBitsInAccumulator));
+      m_uiCurrentBytePos += 4;
     }
-
-    // check if we can do a fast copy: on byte boundaries where uiBits is a multiple of 8
-    // is % maybe faster?
-    if (m_uiBitsLeft == 8 && (uiBits == 8 ||  uiBits == 16 || uiBits == 24 || uiBits == 32))
+  }
+  /**
+   * @brief writeFlag writes a single bit
+   */
+  void writeFlag(bool bFlag)
+  {
+    write(bFlag ? 1 : 0, 1);
+  }
+  /**
+   * @brief writeUE writes an unsigned Exp-Golomb code ue(v)
+   */
+  void writeUE(uint32_t uiValue)
+  {
+    uint64_t uiCodeNum = static_cast<uint64_t>(uiValue) + 1;
+    uint32_t uiLength = 64 - bitstream::countLeadingZeros64(uiCodeNum);
+    uint32_t uiCodewordLength = (uiLength << 1) - 1;
+    if (uiCodewordLength <= 32)
     {
-      // TODO: check endianness of machine
-      bool bLittleEndian = true;
-      if (bLittleEndian)
-      {
-        switch (uiBits)
-        {
-          case 32:
-          {
-#ifdef DEBUG_OBITSTREAM
-            DLOG(INFO) << 32;
-#endif
-            m_buffer[m_uiCurrentBytePos++] = ((uiValue >> 24) & 0xff); 
-          }
-          case 24:
-          {
-#ifdef DEBUG_OBITSTREAM
-            DLOG(INFO) << 24;
-#endif
-            m_buffer[m_uiCurrentBytePos++] = ((uiValue >> 16) & 0xff);
-          }
-          case 16:
-          {
-#ifdef DEBUG_OBITSTREAM
-            DLOG(INFO) << 16;
-#endif
-            m_buffer[m_uiCurrentBytePos++] = ((uiValue >> 8) & 0xff);
-          }
-          case 8:
-          {
-#ifdef DEBUG_OBITSTREAM
-            DLOG(INFO) << 8;
-#endif
-            m_buffer[m_uiCurrentBytePos++] = uiValue;
-            break;
-          }
-        }
-      }
-      else
-      {
-        //memcpy(&m_buffers[m_uiCurrentBufferPos][m_uiCurrentBytePos],  );
-        assert(false);
-      }
+      // the leading zeros are implied by the value
+      write(static_cast<uint32_t>(uiCodeNum), uiCodewordLength);
     }
     else
     {
-      // calculate mask: (2^bits - 1) is a mask for uiBits number of bits
-      // can only write a maximum of m_uiBitsLeft at a time
-      uint32_t uiBitsLeftToWrite = uiBits;
-      uint32_t uiValueCopy = uiValue;
-      while (uiBitsLeftToWrite)
-      {
-        // write max of m_uiBitsLeft bits
-        uint8_t uiBitsToWrite = std::min(uiBitsLeftToWrite, m_uiBitsLeft);
-        // calculate mask for bits
-        uint8_t uiMask = (2 << (uiBitsToWrite - 1)) -1; 
-        // calculate bits to written in next write if current byte has insufficient space
-        uint8_t uiOverflowBits = (uiBitsLeftToWrite > m_uiBitsLeft)? uiBitsLeftToWrite - m_uiBitsLeft : 0;
-        // align value to the right
-        uint8_t uiOffsetByteValue = ((uiValueCopy >> uiOverflowBits) & uiMask);
-        // now shift value to correct position within target byte
-        uiOffsetByteValue = uiOffsetByteValue << (m_uiBitsLeft - uiBitsToWrite);
-        // combine value in buffer with new written bits
-        m_buffer[m_uiCurrentBytePos] = m_buffer[m_uiCurrentBytePos] | uiOffsetByteValue;
-        
-        uiBitsLeftToWrite -= uiBitsToWrite;
-        m_uiBitsLeft -= uiBitsToWrite;
-        if (m_uiBitsLeft == 0)
-        {
-          m_uiBitsLeft = 8;
-          ++m_uiCurrentBytePos;
-        }
-        // subtract written bits from value 
-        uiValueCopy = uiValueCopy - (uiOffsetByteValue << uiOverflowBits);
-      }
-
-#if 0
-      //
-      //
-      uint8_t uiBitsToUse = std::min(uiBits, m_uiBitsLeft);
-      uint8_t uiMask = (2 << (uiBits - 1)); 
-      uint8_t uiMaskedValue = uiValue & uiMask;
-      LOG_INFO(rLogger, LOG_FUNCTION, "Mask: %1% Masked Val: %2%", (int)uiMask, (int)uiMaskedValue);
-      // current value at posi
-      // check if we have enough bits for all value
-      if (uiBits <= m_uiBitsLeft)
+      write(0, uiLength - 1);
+      if (uiLength > 32)
       {
-        LOG_INFO(rLogger, LOG_FUNCTION, "Before: %1% After shift: %2%", (int)m_buffer[m_uiCurrentBytePos] , (int)(m_buffer[m_uiCurrentBytePos] << uiBits) );
-     
-        m_buffer[m_uiCurrentBytePos] = (m_buffer[m_uiCurrentBytePos] << uiBits) | uiMaskedValue;
-        m_uiBitsLeft -= uiBits;
-        LOG_INFO(rLogger, LOG_FUNCTION, "New: %1% Bits left: %2%", (int)m_buffer[m_uiCurrentBytePos] , m_uiBitsLeft);
-        if (m_uiBitsLeft == 0)
-        {
-          m_uiBitsLeft = 8;
-          ++m_uiCurrentBytePos;
-        }
+        write(static_cast<uint32_t>(uiCodeNum >> 32), uiLength - 32);
+        write(static_cast<uint32_t>(uiCodeNum), 32);
       }
       else
       {
-        uint32_t uiRemainderBits = uiBits - m_uiBitsLeft;
-        // fill up current byte
-        m_buffer[m_uiCurrentBytePos]  = (m_buffer[m_uiCurrentBytePos]  << m_uiBitsLeft) | (uiMaskedValue >> uiRemainderBits);
-        m_uiBitsLeft = 8;
-        ++m_uiCurrentBytePos;
-        // write remainder
-        uiMask = (2 << uiRemainderBits) - 1;
-        m_buffer[m_uiCurrentBytePos]  = uiMaskedValue & uiMask; // the new mask will get rid of the other bits
-        m_uiBitsLeft = 8 - uiRemainderBits;
+        write(static_cast<uint32_t>(uiCodeNum), uiLength);
       }
-#endif
     }
   }
+  /**
+   * @brief writeSE writes a signed Exp-Golomb code se(v)
+   */
+  void writeSE(int32_t iValue)
+  {
+    int64_t iValue64 = iValue;
+    writeUE(static_cast<uint32_t>(iValue64 > 0 ? (iValue64 << 1) - 1 : -(iValue64 << 1)));
+  }
+  /**
+   * @brief writeRbspTrailingBits writes the stop bit followed by alignment zero bits
+   */
+  void writeRbspTrailingBits()
+  {
+    write(1, 1);
+    uint32_t uiAlignmentBits = (8 - (m_uiBitsInAccumulator & 0x07)) & 0x07;
+    write(0, uiAlignmentBits);
+  }
+  /**
+   * @brief isByteAligned returns if the write position is on a byte boundary
+   */
+  bool isByteAligned() const
+  {
+    return (m_uiBitsInAccumulator & 0x07) == 0;
+  }
   /**
    * @brief writeBytes
    * @param rSrc
@@ -240,11 +194,10 @@ public:
    */
   bool writeBytes(const uint8_t*& rSrc, uint32_t uiBytes)
   {
-    if ((m_uiBitsLeft != 8) || // check byte boundary
-        ((m_uiBufferSize - m_uiCurrentBytePos) < uiBytes) // check buffer size
-       ) 
-         return false;
-    memcpy(&m_buffer[m_uiCurrentBytePos], rSrc, uiBytes);
+    if (!isByteAligned()) return false;
+    flushBytes();
+    ensureCapacity(uiBytes);
+    memcpy(m_pData + m_uiCurrentBytePos, rSrc, uiBytes);
     m_uiCurrentBytePos += uiBytes;
     return true;
   }
@@ -257,72 +210,34 @@ public:
    */
   bool write(IBitStream& in)
   {
-      if (m_uiBitsLeft != 8) return false;
-      // get remaining bytes
-      if (in.m_uiBitsRemaining % 8 != 0) return false;
-
-      // this code only works if all the pointers are byte aligned!!!
-      if (m_uiCurrentBytePos >= m_uiBufferSize)
-      {
-          LOG(WARNING) << "WARN: Byte pos: " << m_uiCurrentBytePos << " Size: " << m_uiBufferSize;
-      }
-      assert (m_uiCurrentBytePos <= m_uiBufferSize);
-      uint32_t uiBytesLeft = m_uiBufferSize - m_uiCurrentBytePos;
-
-      uint32_t uiBytesToCopy = in.getBytesRemaining();
-      if (uiBytesToCopy > uiBytesLeft)
-      {
-        // conservative for now:
-        uint32_t uiNewSize = m_bConservative ? m_uiCurrentBytePos + uiBytesToCopy : m_uiBufferSize * 2;
-        increaseBufferSize(uiNewSize);
-      }
-      // increase buffer size if necessary
-      uint8_t* pDestination = const_cast<uint8_t*>(m_buffer.data()) + m_uiCurrentBytePos;
-      // bool bRes = in.readBytes(&m_buffer[m_uiCurrentBytePos], uiBytesToCopy);
-      bool bRes = in.readBytes(pDestination, uiBytesToCopy);
-      assert (bRes);
-      m_uiCurrentBytePos += uiBytesToCopy;
-      return bRes;
+    return write(in, in.getBytesRemaining());
   }
   /**
    * @brief write
    * @param in
    * @param uiBytesToCopy
    * @return
-   * this method writes all bytes remaining in the IBitStream to the output stream
+   * this method writes uiBytesToCopy bytes of the IBitStream to the output stream
    * TODO: make this method handle non-byte boundary data
    */
   bool write(IBitStream& in, uint32_t uiBytesToCopy)
   {
-#if 0
-      VLOG(5) << "bits left: " << m_uiBitsLeft << " bits remaining: " << in.m_uiBitsRemaining << " Bytes: " << in.getBytesRemaining() << " To copy: " << uiBytesToCopy;
-#endif
-      if (m_uiBitsLeft != 8) return false;
-      // get remaining bytes
-      if (in.m_uiBitsRemaining % 8 != 0) return false;
-      if (in.getBytesRemaining() < uiBytesToCopy) return false;
-
-      // this code only works if all the pointers are byte aligned!!!
-      if (m_uiCurrentBytePos >= m_uiBufferSize)
-      {
-          LOG(WARNING) << "WARN: Byte pos: " << m_uiCurrentBytePos << " Size: " << m_uiBufferSize;
-      }
-      assert (m_uiCurrentBytePos <= m_uiBufferSize);
-      uint32_t uiBytesLeft = m_uiBufferSize - m_uiCurrentBytePos;
+    if (!isByteAligned()) return false;
+    // get remaining bytes
+    if (in.m_uiBitsRemaining % 8 != 0) return false;
+    if (in.getBytesRemaining() < uiBytesToCopy) return false;
 
-      if (uiBytesToCopy > uiBytesLeft)
-      {
-        // conservative for now:
-        uint32_t uiNewSize = m_uiCurrentBytePos + uiBytesToCopy;
-        increaseBufferSize(uiNewSize);
-      }
-      // increase buffer size if necessary
-      uint8_t* pDestination = const_cast<uint8_t*>(m_buffer.data()) + m_uiCurrentBytePos;
-      // bool bRes = in.readBytes(&m_buffer[m_uiCurrentBytePos], uiBytesToCopy);
-      bool bRes = in.readBytes(pDestination, uiBytesToCopy);
-      assert (bRes);
-      m_uiCurrentBytePos += uiBytesToCopy;
-      return bRes;
+    flushBytes();
+    if (uiBytesToCopy > m_uiBufferSize - m_uiCurrentBytePos)
+    {
+      uint32_t uiNewSize = m_bConservative ? m_uiCurrentBytePos + uiBytesToCopy : std::max(m_uiBufferSize << 1, m_uiCurrentBytePos + uiBytesToCopy);
+      increaseBufferSize(uiNewSize);
+    }
+    uint8_t* pDestination = m_pData + m_uiCurrentBytePos;
+    bool bRes = in.readBytes(pDestination, uiBytesToCopy);
+    assert (bRes);
+    m_uiCurrentBytePos += uiBytesToCopy;
+    return bRes;
   }
   /**
    * @brief bytesUsed
@@ -330,7 +245,7 @@ public:
    */
   uint32_t bytesUsed() const 
   {
-    return m_uiCurrentBytePos + (m_uiBitsLeft == 8 ? 0 : 1);
+    return m_uiCurrentBytePos + ((m_uiBitsInAccumulator + 7) >> 3);
   }
   /**
    * @brief totalBitsLeft
@@ -338,7 +253,7 @@ public:
    */
   uint32_t totalBitsLeft() const
   {
-    return  m_uiBitsLeft + 8 * (m_uiBufferSize - m_uiCurrentBytePos - 1);
+    return ((m_uiBufferSize - m_uiCurrentBytePos) << 3) - m_uiBitsInAccumulator;
   }
   /**
    * @brief str
@@ -353,7 +268,19 @@ public:
     if (uiSize)
     {
       buffer.setData(new uint8_t[uiSize], uiSize);
-      memcpy(&buffer[0], &m_buffer[0], uiSize); 
+      memcpy(&buffer[0], m_pData, m_uiCurrentBytePos);
+      // pending bits are padded with zeros
+      uint32_t uiBits = m_uiBitsInAccumulator;
+      uint32_t uiPos = m_uiCurrentBytePos;
+      while (uiBits >= 8)
+      {
+        uiBits -= 8;
+        buffer[uiPos++] = static_cast<uint8_t>(m_uiAccumulator >> uiBits);
+      }
+      if (uiBits)
+      {
+        buffer[uiPos] = static_cast<uint8_t>(m_uiAccumulator << (8 - uiBits));
+      }
     }
     return buffer;
   }
@@ -367,63 +294,48 @@ public:
   }
 
 private:
-  void increaseBufferSize(uint32_t uiNewSize)
-  {
-    // respect old pre buffer
-    uint32_t uiOldPreBuffer = m_buffer.getPrebufferSize();
-    uint32_t uiOldPostBuffer = m_buffer.getPostbufferSize();
-    Buffer buffer = Buffer(new uint8_t[uiNewSize], uiNewSize, uiOldPreBuffer, uiOldPostBuffer);
-    memset(&buffer[0], 0, uiNewSize);
-    memcpy(&buffer[0], &m_buffer[0], m_uiBufferSize );
-    m_buffer = buffer;
-    m_uiBufferSize = uiNewSize;
-  }
-  void doWrite(uint32_t uiValue, uint32_t uiBits)
+  /**
+   * @brief flushBytes stores the whole bytes pending in the accumulator
+   */
+  void flushBytes()
   {
-    // calculate mask: (2^bits - 1) is a mask for uiBits number of bits
-    uint8_t uiMask = (2 << (uiBits - 1)) - 1;
-    uint8_t uiMaskedValue = uiValue & uiMask;
-#if 0
-    LOG_INFO(rLogger, LOG_FUNCTION, "Mask: %1% Masked Val: %2%", (int)uiMask, (int)uiMaskedValue);
-#endif
-    // current value at posi
-    // check if we have enough bits for all value
-    if (uiBits <= m_uiBitsLeft)
+    ensureCapacity(4);
+    while (m_uiBitsInAccumulator >= 8)
     {
-#if 0
-      LOG_INFO(rLogger, LOG_FUNCTION, "Before: %1% After shift: %2%", (int)m_buffer[m_uiCurrentBytePos] , (int)(m_buffer[m_uiCurrentBytePos] << uiBits) );
-#endif
-
-      m_buffer[m_uiCurrentBytePos] = (m_buffer[m_uiCurrentBytePos] << uiBits) | uiMaskedValue;
-      m_uiBitsLeft -= uiBits;
-#if 0
-      LOG_INFO(rLogger, LOG_FUNCTION, "New: %1% Bits left: %2%", (int)m_buffer[m_uiCurrentBytePos] , m_uiBitsLeft);
-#endif
-      if (m_uiBitsLeft == 0)
-      {
-        m_uiBitsLeft = 8;
-        ++m_uiCurrentBytePos;
-      }
+      m_uiBitsInAccumulator -= 8;
+      m_pData[m_uiCurrentBytePos++] = static_cast<uint8_t>(m_uiAccumulator >> m_uiBitsInAccumulator);
     }
-    else
+  }
+
+  void ensureCapacity(uint32_t uiBytes)
+  {
+    if (m_uiCurrentBytePos + uiBytes > m_uiBufferSize)
     {
-      uint32_t uiRemainderBits = uiBits - m_uiBitsLeft;
-      // fill up current byte
-      m_buffer[m_uiCurrentBytePos]  = (m_buffer[m_uiCurrentBytePos]  << m_uiBitsLeft) & (uiMaskedValue >> uiRemainderBits);
-      m_uiBitsLeft = 8;
-      ++m_uiCurrentBytePos;
-      // write remainder
-      uiMask = (2 << uiRemainderBits) - 1;
-      m_buffer[m_uiCurrentBytePos]  = uiMaskedValue & uiMask; // the new mask will get rid of the other bits
-      m_uiBitsLeft = 8 - uiRemainderBits;
+      // reallocate more than enough memory
+      increaseBufferSize(std::max(m_uiBufferSize << 1, (m_uiCurrentBytePos + uiBytes) << 1));
     }
   }
 
-  uint32_t m_uiBufferSize;
+  void increaseBufferSize(uint32_t uiNewSize)
+  {
+    // respect old pre buffer
+    uint32_t uiOldPreBuffer = static_cast<uint32_t>(m_buffer.getPrebufferSize());
+    uint32_t uiOldPostBuffer = static_cast<uint32_t>(m_buffer.getPostbufferSize());
+    uint32_t uiTotalSize = uiNewSize + uiOldPreBuffer + uiOldPostBuffer;
+    Buffer buffer = Buffer(new uint8_t[uiTotalSize], uiTotalSize, uiOldPreBuffer, uiOldPostBuffer);
+    memcpy(&buffer[0], m_pData, m_uiCurrentBytePos);
+    m_buffer = buffer;
+    m_uiBufferSize = uiNewSize;
+    m_pData = const_cast<uint8_t*>(m_buffer.data());
+  }
+
   Buffer m_buffer;
+  uint32_t m_uiBufferSize;
+  uint8_t* m_pData;
 
-  ///< Bits left in current byte
-  uint32_t m_uiBitsLeft;
+  ///< Bits not yet stored in the buffer: only the m_uiBitsInAccumulator least significant bits are valid
+  uint64_t m_uiAccumulator;
+  uint32_t m_uiBitsInAccumulator;
 
   ///< Current position in the buffer  
   uint32_t m_uiCurrentBytePos;
@@ -0,0 +1,115 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <cstdint>
+
+namespace rtp_plus_plus {
+namespace perf {
+
+/**
+ * @brief The counters opened by PerfCounters
+ */
+enum Counter
+{
+  PC_CYCLES,
+  PC_INSTRUCTIONS,
+  PC_LLC_MISSES,
+  PC_BRANCH_MISSES,
+  // nanoseconds
+  PC_TASK_CLOCK,
+  PC_COUNT
+};
+
+/**
+ * @brief getName returns the short name of the counter e.g. "llc-misses"
+ */
+const char* getName(Counter eCounter);
+
+/**
+ * @brief Counter values: -1 marks a counter that is not available
+ */
+struct CounterValues
+{
+  CounterValues()
+  {
+    for (int i = 0; i < PC_COUNT; ++i) Values[i] = -1;
+  }
+  int64_t operator[](int i) const { return Values[i]; }
+
+  int64_t Values[PC_COUNT];
+};
+
+/**
+ * @brief returns the per counter difference: unavailable counters stay at -1
+ */
+CounterValues operator-(const CounterValues& end, const CounterValues& start);
+
+/**
+ * @brief The CounterTotals class accumulates the counter deltas of a stage
+ */
+class CounterTotals
+{
+public:
+  CounterTotals();
+  void add(const CounterValues& delta);
+  uint32_t getSamples() const { return m_uiSamples; }
+  /**
+   * @brief getTotal returns the sum over all samples or -1 if the counter is not available
+   */
+  int64_t getTotal(Counter eCounter) const { return m_values.Values[eCounter]; }
+
+private:
+  uint32_t m_uiSamples;
+  CounterValues m_values;
+};
+
+/**
+ * @brief The PerfCounters class reads cycles, instructions, LLC misses, branch misses and the
+ * task clock with perf_event_open in counting mode. User space only is counted so that the
+ * default perf_event_paranoid setting suffices. Counters that can not be opened, e.g. hardware
+ * counters in a VM or on platforms other than Linux, read as -1.
+ *
+ * By default only the calling thread is counted. With bInherit the counters also count threads
+ * created after construction, e.g. the worker threads of an encoder opened later.
+ */
+class PerfCounters
+{
+public:
+  explicit PerfCounters(bool bInherit = false);
+  ~PerfCounters();
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  bool isAvailable(Counter eCounter) const { return m_fds[eCounter] != -1; }
+  /**
+   * @brief isAvailable returns true if at least one counter could be opened
+   */
+  bool isAvailable() const;
+  /**
+   * @brief read returns the current counts scaled for the time the counters were multiplexed out
+   */
+  CounterValues read() const;
+
+private:
+  int m_fds[PC_COUNT];
+};
+
+} // perf
+} // rtp_plus_plus
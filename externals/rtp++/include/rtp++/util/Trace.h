@@ -0,0 +1,195 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+/**
+ * @def TRACE_IS_ON Returns whether tracing has been started. This is a single relaxed load.
+ */
+#define TRACE_IS_ON() ::rtp_plus_plus::trace::isEnabled()
+
+/**
+ * @def TRACE_SCOPE Records the enclosing scope as a complete event in the trace of the calling thread
+ * e.g. TRACE_SCOPE("encode"); The name must be a string literal.
+ */
+#define TRACE_SCOPE(name) ::rtp_plus_plus::trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+namespace rtp_plus_plus {
+namespace trace {
+
+/**
+ * @brief The Record struct is a complete event: a named interval on one thread
+ */
+struct Record
+{
+  const char* Name;
+  int64_t StartUs;
+  int64_t DurationUs;
+};
+
+/**
+ * @brief The ThreadBuffer class is the fixed-size event buffer of one thread. Only the owning
+ * thread appends: the count is published with release semantics so that the buffer can be
+ * written while the thread is still running. Events beyond the capacity are counted and dropped.
+ */
+class ThreadBuffer
+{
+public:
+  static const size_t CAPACITY = 1 << 16;
+
+  ThreadBuffer(uint32_t uiThreadId)
+    :m_uiThreadId(uiThreadId),
+      m_records(new Record[CAPACITY]),
+      m_uiCount(0),
+      m_uiDropped(0)
+  {
+  }
+  void add(const char* szName, int64_t iStartUs, int64_t iDurationUs)
+  {
+    size_t uiCount = m_uiCount.load(std::memory_order_relaxed);
+    if (uiCount == CAPACITY)
+    {
+      m_uiDropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    Record& record = m_records[uiCount];
+    record.Name = szName;
+    record.StartUs = iStartUs;
+    record.DurationUs = iDurationUs;
+    m_uiCount.store(uiCount + 1, std::memory_order_release);
+  }
+  uint32_t getThreadId() const { return m_uiThreadId; }
+  size_t getCount() const { return m_uiCount.load(std::memory_order_acquire); }
+  const Record& getRecord(size_t uiIndex) const { return m_records[uiIndex]; }
+  uint64_t getDropped() const { return m_uiDropped.load(std::memory_order_relaxed); }
+
+private:
+  ThreadBuffer(const ThreadBuffer&);
+  ThreadBuffer& operator=(const ThreadBuffer&);
+
+  uint32_t m_uiThreadId;
+  std::unique_ptr<Record[]> m_records;
+  std::atomic<size_t> m_uiCount;
+  std::atomic<uint64_t> m_uiDropped;
+};
+
+/**
+ * @brief The Tracer class owns the buffers of all threads that recorded events. Buffers are
+ * created on the first event of a thread and outlive the thread so that the trace can be
+ * written once the pipeline has stopped.
+ */
+class Tracer
+{
+public:
+  static Tracer& get();
+  /**
+   * @brief start enables tracing: timestamps are relative to the first start
+   */
+  void start();
+  /**
+   * @brief stop disables tracing: events recorded so far are kept
+   */
+  void stop();
+  /**
+   * @brief getBuffer returns the buffer of the calling thread
+   */
+  ThreadBuffer& getBuffer();
+  /**
+   * @brief setThreadName names the calling thread in the trace
+   */
+  void setThreadName(const std::string& sName);
+  /**
+   * @brief write writes the events as Chrome trace JSON which can be opened in Perfetto or chrome://tracing
+   * @return false if the file could not be written
+   */
+  bool write(const std::string& sFilename);
+  /**
+   * @brief now returns the microseconds since tracing was started
+   */
+  int64_t now() const
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_tStart).count();
+  }
+
+  static std::atomic<bool> s_bEnabled;
+
+private:
+  Tracer();
+
+  std::chrono::steady_clock::time_point m_tStart;
+  bool m_bStarted;
+  boost::mutex m_lock;
+  std::vector<std::unique_ptr<ThreadBuffer> > m_vBuffers;
+  std::vector<std::pair<uint32_t, std::string> > m_vThreadNames;
+};
+
+inline bool isEnabled()
+{
+  return Tracer::s_bEnabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief The Scope class records the interval between its construction and destruction
+ * if tracing was enabled at construction.
+ */
+class Scope
+{
+public:
+  explicit Scope(const char* szName)
+    :m_szName(isEnabled() ? szName : nullptr),
+      m_iStartUs(m_szName ? Tracer::get().now() : 0)
+  {
+  }
+  ~Scope()
+  {
+    if (m_szName)
+    {
+      Tracer& tracer = Tracer::get();
+      tracer.getBuffer().add(m_szName, m_iStartUs, tracer.now() - m_iStartUs);
+    }
+  }
+
+private:
+  Scope(const Scope&);
+  Scope& operator=(const Scope&);
+
+  const char* m_szName;
+  int64_t m_iStartUs;
+};
+
+/**
+ * @brief setThreadName names the calling thread in the trace if tracing is enabled
+ */
+inline void setThreadName(const std::string& sName)
+{
+  if (isEnabled()) Tracer::get().setThreadName(sName);
+}
+
+} // trace
+} // rtp_plus_plus
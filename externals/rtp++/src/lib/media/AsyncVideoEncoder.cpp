@@ -0,0 +1,233 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <algorithm>
+#include <rtp++/media/AsyncVideoEncoder.h>
+#include <rtp++/util/Trace.h>
+
+namespace rtp_plus_plus
+{
+namespace media
+{
+
+AsyncVideoEncoder::AsyncVideoEncoder(IVideoCodecTransform& codec, CompletionHandler handler, size_t uiMaxQueuedFrames)
+  :m_codec(codec),
+  m_handler(handler),
+  m_uiMaxQueuedFrames(std::max(uiMaxQueuedFrames, static_cast<size_t>(1))),
+  m_bDrain(false),
+  m_bDrained(false),
+  m_uiSubmitted(0),
+  m_uiInFlight(0),
+  m_iCodecFrames(0)
+{
+  m_thread = boost::thread(&AsyncVideoEncoder::encodeInBackground, this);
+}
+
+AsyncVideoEncoder::~AsyncVideoEncoder()
+{
+  drain();
+  if (m_thread.joinable()) m_thread.join();
+}
+
+boost::system::error_code AsyncVideoEncoder::submit(const BatchFrame& frame, uint32_t uiTag)
+{
+  boost::mutex::scoped_lock l(m_lock);
+  if (m_bDrain)
+  {
+    return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+  }
+  if (m_error) return m_error;
+  while (m_qSubmissions.size() >= m_uiMaxQueuedFrames)
+  {
+    m_condFree.wait(l);
+  }
+  Submission submission;
+  submission.Frame = frame;
+  submission.Tag = uiTag;
+  submission.Submitted = Clock::now();
+  submission.Index = m_uiSubmitted++;
+  m_qSubmissions.push_back(submission);
+  ++m_uiInFlight;
+  m_condPending.notify_one();
+  return boost::system::error_code();
+}
+
+boost::system::error_code AsyncVideoEncoder::drain()
+{
+  boost::mutex::scoped_lock l(m_lock);
+  if (!m_bDrain)
+  {
+    m_bDrain = true;
+    m_condPending.notify_one();
+  }
+  while (!m_bDrained)
+  {
+    m_condDrained.wait(l);
+  }
+  return m_error;
+}
+
+size_t AsyncVideoEncoder::getFramesInFlight() const
+{
+  boost::mutex::scoped_lock l(m_lock);
+  return m_uiInFlight;
+}
+
+void AsyncVideoEncoder::encodeInBackground()
+{
+  trace::setThreadName("async encoder");
+  std::vector<MediaSample> frame(1);
+  while (true)
+  {
+    Submission submission;
+    boost::system::error_code error;
+    {
+      boost::mutex::scoped_lock l(m_lock);
+      while (m_qSubmissions.empty() && !m_bDrain)
+      {
+        m_condPending.wait(l);
+      }
+      if (m_qSubmissions.empty()) break;
+      submission = m_qSubmissions.front();
+      m_qSubmissions.pop_front();
+      error = m_error;
+    }
+    m_condFree.notify_one();
+
+    PendingFrame pending;
+    pending.Tag = submission.Tag;
+    pending.Submitted = submission.Submitted;
+    pending.Index = submission.Index;
+    if (error)
+    {
+      // frames queued before the codec failed are not encoded
+      EncodedFrame encodedFrame;
+      deliver(pending, encodedFrame, error);
+      continue;
+    }
+    if (submission.Frame.TargetBitrateKbps > 0)
+    {
+      TRACE_SCOPE("setBitrate");
+      pending.BitrateResult = m_codec.setBitrate(submission.Frame.TargetBitrateKbps);
+    }
+    const int32_t iInputFrame = m_iCodecFrames++;
+    m_pending[iInputFrame] = pending;
+
+    frame[0] = submission.Frame.Frame;
+    EncodedFrame encodedFrame;
+    boost::system::error_code ec;
+    {
+      TRACE_SCOPE("encode");
+      ec = m_codec.transform(frame, encodedFrame.Samples, encodedFrame.Size);
+    }
+    if (ec)
+    {
+      setError(ec);
+      continue;
+    }
+    encodedFrame.Stats = m_codec.getFrameStats();
+    if (encodedFrame.Stats.InputFrame >= 0 || !encodedFrame.Samples.empty())
+      complete(encodedFrame.Stats.InputFrame, encodedFrame);
+  }
+  flushCodec();
+  {
+    boost::mutex::scoped_lock l(m_lock);
+    m_bDrained = true;
+  }
+  m_condDrained.notify_all();
+}
+
+void AsyncVideoEncoder::complete(int32_t iInputFrame, EncodedFrame& encodedFrame)
+{
+  if (m_pending.empty())
+  {
+    LOG(WARNING) << "Output without a pending input frame";
+    return;
+  }
+  auto it = iInputFrame >= 0 ? m_pending.find(iInputFrame) : m_pending.begin();
+  if (it == m_pending.end())
+  {
+    LOG(WARNING) << "Output for unknown input frame " << iInputFrame;
+    return;
+  }
+  PendingFrame pending = it->second;
+  m_pending.erase(it);
+  deliver(pending, encodedFrame, boost::system::error_code());
+}
+
+void AsyncVideoEncoder::deliver(const PendingFrame& pending, EncodedFrame& encodedFrame, const boost::system::error_code& ec)
+{
+  CompletedFrame completedFrame;
+  completedFrame.Tag = pending.Tag;
+  completedFrame.LatencyUs = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - pending.Submitted).count();
+  {
+    boost::mutex::scoped_lock l(m_lock);
+    completedFrame.DelayFrames = m_uiSubmitted - pending.Index - 1;
+  }
+  completedFrame.Frame = std::move(encodedFrame);
+  completedFrame.Frame.BitrateResult = pending.BitrateResult;
+  m_handler(ec, completedFrame);
+  boost::mutex::scoped_lock l(m_lock);
+  --m_uiInFlight;
+}
+
+void AsyncVideoEncoder::setError(const boost::system::error_code& ec)
+{
+  LOG(WARNING) << "Asynchronous encode failed: " << ec.message();
+  {
+    boost::mutex::scoped_lock l(m_lock);
+    if (!m_error) m_error = ec;
+  }
+  for (auto& pending : m_pending)
+  {
+    EncodedFrame encodedFrame;
+    deliver(pending.second, encodedFrame, ec);
+  }
+  m_pending.clear();
+}
+
+void AsyncVideoEncoder::flushCodec()
+{
+  if (!m_pending.empty())
+  {
+    TRACE_SCOPE("flush");
+    std::vector<EncodedFrame> flushed;
+    boost::system::error_code ec = m_codec.flush(flushed);
+    for (EncodedFrame& encodedFrame : flushed)
+    {
+      complete(encodedFrame.Stats.InputFrame, encodedFrame);
+    }
+    if (ec)
+    {
+      setError(ec);
+      return;
+    }
+  }
+  // frames the encoder dropped
+  for (auto& pending : m_pending)
+  {
+    EncodedFrame encodedFrame;
+    deliver(pending.second, encodedFrame, boost::system::error_code());
+  }
+  m_pending.clear();
+}
+
+} // media
+} // rtp_plus_plus
@@ -0,0 +1,143 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <rtp++/media/EmulationPrevention.h>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RTP_PLUS_PLUS_EP_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define RTP_PLUS_PLUS_EP_NEON
+#endif
+
+namespace rtp_plus_plus
+{
+namespace media
+{
+
+#if defined(RTP_PLUS_PLUS_EP_SSE2) || defined(RTP_PLUS_PLUS_EP_NEON)
+#define RTP_PLUS_PLUS_EP_SIMD
+static const size_t SIMD_BLOCK = 16;
+/**
+ * @brief hasZeroPair returns if a 0x0000 pair starts at any of p[0..15].
+ * Reads p[0..16].
+ */
+static inline bool hasZeroPair(const uint8_t* p)
+{
+#ifdef RTP_PLUS_PLUS_EP_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+  __m128i pairs = _mm_and_si128(_mm_cmpeq_epi8(v0, zero), _mm_cmpeq_epi8(v1, zero));
+  return _mm_movemask_epi8(pairs) != 0;
+#else
+  uint8x16_t v0 = vld1q_u8(p);
+  uint8x16_t v1 = vld1q_u8(p + 1);
+  uint8x16_t pairs = vandq_u8(vceqzq_u8(v0), vceqzq_u8(v1));
+  return vmaxvq_u8(pairs) != 0;
+#endif
+}
+#endif
+
+size_t insertEmulationPrevention(const uint8_t* pRbsp, size_t uiSize, uint8_t* pEbsp)
+{
+  size_t uiOut = 0;
+  uint32_t uiZeros = 0;
+  size_t i = 0;
+  while (i < uiSize)
+  {
+#ifdef RTP_PLUS_PLUS_EP_SIMD
+    // copy blocks without 0x0000 in one go: the block after a zero byte is handled
+    // byte-wise so that pairs spanning blocks are found
+    if (uiZeros == 0 && i + SIMD_BLOCK < uiSize && !hasZeroPair(pRbsp + i))
+    {
+      memcpy(pEbsp + uiOut, pRbsp + i, SIMD_BLOCK);
+      uiOut += SIMD_BLOCK;
+      i += SIMD_BLOCK;
+      uiZeros = (pRbsp[i - 1] == 0) ? 1 : 0;
+      continue;
+    }
+#endif
+    uint8_t uiByte = pRbsp[i++];
+    if (uiZeros == 2 && uiByte <= 0x03)
+    {
+      pEbsp[uiOut++] = 0x03;
+      uiZeros = 0;
+    }
+    pEbsp[uiOut++] = uiByte;
+    uiZeros = (uiByte == 0) ? uiZeros + 1 : 0;
+  }
+  // the NAL unit may not end with a zero byte: this only happens for cabac_zero_words
+  if (uiZeros == 2)
+  {
+    pEbsp[uiOut++] = 0x03;
+  }
+  return uiOut;
+}
+
+Buffer insertEmulationPrevention(const Buffer& rbsp)
+{
+  size_t uiMaxSize = getMaxEbspSize(rbsp.getSize());
+  uint8_t* pEbsp = new uint8_t[uiMaxSize];
+  size_t uiSize = insertEmulationPrevention(rbsp.data(), rbsp.getSize(), pEbsp);
+  return Buffer(pEbsp, uiSize);
+}
+
+size_t removeEmulationPrevention(const uint8_t* pEbsp, size_t uiSize, uint8_t* pRbsp)
+{
+  size_t uiOut = 0;
+  uint32_t uiZeros = 0;
+  size_t i = 0;
+  while (i < uiSize)
+  {
+#ifdef RTP_PLUS_PLUS_EP_SIMD
+    if (uiZeros == 0 && i + SIMD_BLOCK < uiSize && !hasZeroPair(pEbsp + i))
+    {
+      // the output never runs ahead of the input
+      if (pRbsp + uiOut != pEbsp + i)
+        memmove(pRbsp + uiOut, pEbsp + i, SIMD_BLOCK);
+      uiOut += SIMD_BLOCK;
+      i += SIMD_BLOCK;
+      uiZeros = (pEbsp[i - 1] == 0) ? 1 : 0;
+      continue;
+    }
+#endif
+    uint8_t uiByte = pEbsp[i++];
+    if (uiZeros == 2 && uiByte == 0x03)
+    {
+      uiZeros = 0;
+      continue;
+    }
+    pRbsp[uiOut++] = uiByte;
+    uiZeros = (uiByte == 0) ? uiZeros + 1 : 0;
+  }
+  return uiOut;
+}
+
+Buffer removeEmulationPrevention(const Buffer& ebsp)
+{
+  uint8_t* pRbsp = new uint8_t[ebsp.getSize()];
+  size_t uiSize = removeEmulationPrevention(ebsp.data(), ebsp.getSize(), pRbsp);
+  return Buffer(pRbsp, uiSize);
+}
+
+} // media
+} // rtp_plus_plus
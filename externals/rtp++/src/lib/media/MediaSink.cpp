@@ -18,44 +18,186 @@ along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
 // "CSIR"
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #include "stdafx.h"
+#include <algorithm>
+#include <boost/align/aligned_alloc.hpp>
 #include <rtp++/media/MediaSink.h>
+#include <rtp++/util/Trace.h>
 
 namespace rtp_plus_plus
 {
 namespace media
 {
 
-MediaSink::MediaSink(const std::string& sDest)
+MediaSink::MediaSink(const std::string& sDest, size_t uiBufferSize, size_t uiBufferCount)
   :m_pFileOut(0),
-    m_out(&std::cout)
+    m_out(&std::cout),
+    m_uiBufferSize(uiBufferSize),
+    m_pCurrent(0),
+    m_uiCurrentSize(0),
+    m_bWriting(false),
+    m_bShutdown(false),
+    m_bWriteFailed(false),
+    m_uiBytesWritten(0),
+    m_uiFlushCount(0)
 {
+  assert(uiBufferSize > 0 && uiBufferCount > 0);
   VLOG(2) << "Writing incoming media to " << sDest;
   if (sDest != "cout")
   {
-    m_pFileOut = new std::ofstream(sDest.c_str(), std::ofstream::binary);
+    m_pFileOut = new std::ofstream();
+    // the sink does its own buffering: each flushed buffer results in a single write
+    m_pFileOut->rdbuf()->pubsetbuf(0, 0);
+    m_pFileOut->open(sDest.c_str(), std::ofstream::binary);
     m_out = m_pFileOut;
   }
+
+  for (size_t i = 0; i < uiBufferCount; ++i)
+  {
+    uint8_t* pBuffer = static_cast<uint8_t*>(boost::alignment::aligned_alloc(BUFFER_ALIGNMENT, m_uiBufferSize));
+    if (!pBuffer) throw std::bad_alloc();
+    m_vBuffers.push_back(pBuffer);
+    m_qFree.push_back(pBuffer);
+  }
+  m_pCurrent = m_qFree.front();
+  m_qFree.pop_front();
+
+  m_flushThread = boost::thread(&MediaSink::flushInBackground, this);
 }
 
 MediaSink::~MediaSink()
 {
+  flush();
+  {
+    boost::mutex::scoped_lock l(m_lock);
+    m_bShutdown = true;
+  }
+  m_condPending.notify_one();
+  m_flushThread.join();
+
   if (m_pFileOut)
   {
     m_pFileOut->close();
     delete m_pFileOut;
   }
+  for (uint8_t* pBuffer : m_vBuffers)
+  {
+    boost::alignment::aligned_free(pBuffer);
+  }
 }
 
 void MediaSink::write(const MediaSample& mediaSample)
 {
-  m_out->write((const char*) mediaSample.getDataBuffer().data(), mediaSample.getDataBuffer().getSize());
+  appendSample(mediaSample);
 }
 
 void MediaSink::writeAu(const std::vector<MediaSample>& mediaSamples)
 {
   for (const MediaSample& mediaSample : mediaSamples)
   {
-    m_out->write((const char*) mediaSample.getDataBuffer().data(), mediaSample.getDataBuffer().getSize());
+    appendSample(mediaSample);
+  }
+}
+
+void MediaSink::flush()
+{
+  if (m_uiCurrentSize > 0)
+  {
+    queueCurrentBuffer();
+  }
+  boost::mutex::scoped_lock l(m_lock);
+  while (!m_qPending.empty() || m_bWriting)
+  {
+    m_condFree.wait(l);
+  }
+  m_out->flush();
+}
+
+uint64_t MediaSink::getBytesWritten() const
+{
+  boost::mutex::scoped_lock l(m_lock);
+  return m_uiBytesWritten;
+}
+
+uint32_t MediaSink::getFlushCount() const
+{
+  boost::mutex::scoped_lock l(m_lock);
+  return m_uiFlushCount;
+}
+
+void MediaSink::appendAcrossBuffers(const uint8_t* pData, size_t uiSize)
+{
+  while (uiSize > 0)
+  {
+    if (m_uiCurrentSize == m_uiBufferSize)
+    {
+      queueCurrentBuffer();
+    }
+    size_t uiToCopy = std::min(uiSize, m_uiBufferSize - m_uiCurrentSize);
+    memcpy(m_pCurrent + m_uiCurrentSize, pData, uiToCopy);
+    m_uiCurrentSize += uiToCopy;
+    pData += uiToCopy;
+    uiSize -= uiToCopy;
+  }
+}
+
+void MediaSink::queueCurrentBuffer()
+{
+  // includes the wait for a free buffer when the flush thread falls behind
+  TRACE_SCOPE("sink queue");
+  boost::mutex::scoped_lock l(m_lock);
+  OutputBuffer buffer = { m_pCurrent, m_uiCurrentSize };
+  m_qPending.push_back(buffer);
+  m_condPending.notify_one();
+  while (m_qFree.empty())
+  {
+    m_condFree.wait(l);
+  }
+  m_pCurrent = m_qFree.front();
+  m_qFree.pop_front();
+  m_uiCurrentSize = 0;
+}
+
+void MediaSink::flushInBackground()
+{
+  trace::setThreadName("media sink");
+  boost::mutex::scoped_lock l(m_lock);
+  while (true)
+  {
+    while (m_qPending.empty() && !m_bShutdown)
+    {
+      m_condPending.wait(l);
+    }
+    if (m_qPending.empty())
+    {
+      // shutdown and nothing left to write
+      break;
+    }
+    OutputBuffer buffer = m_qPending.front();
+    m_qPending.pop_front();
+    m_bWriting = true;
+    l.unlock();
+
+    bool bFailed = false;
+    {
+      TRACE_SCOPE("sink write");
+      m_out->write((const char*)buffer.Data, buffer.Size);
+      bFailed = !m_out->good();
+    }
+
+    l.lock();
+    if (bFailed && !m_bWriteFailed)
+    {
+      LOG(WARNING) << "Failed to write " << buffer.Size << " bytes to media sink";
+      m_bWriteFailed = true;
+    }
+    else if (!bFailed)
+    {
+      m_uiBytesWritten += buffer.Size;
+    }
+    ++m_uiFlushCount;
+    m_bWriting = false;
+    m_qFree.push_back(buffer.Data);
+    m_condFree.notify_all();
   }
 }
 
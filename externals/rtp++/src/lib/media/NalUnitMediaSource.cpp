@@ -19,6 +19,7 @@ along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #include "stdafx.h"
 #include <numeric>
+#include <boost/filesystem.hpp>
 #include <rtp++/media/NalUnitMediaSource.h>
 #include <rtp++/media/h264/H264NalUnitTypes.h>
 #include <rtp++/media/h265/H265NalUnitTypes.h>
@@ -42,41 +43,77 @@ namespace rfchevc {
 
 namespace media {
 
-const size_t READ_SIZE=20000u;
+// size of the chunks read while scanning for start codes
+const size_t READ_SIZE=1u << 20;
+// bytes carried over between chunks: the byte preceding a start code
+// (4 byte start code check), the 3 byte start code and the 2 byte H.265 header
+// plus the first byte of the slice segment header
+const size_t CARRY_SIZE=6u;
 
-NalUnitMediaSource::NalUnitMediaSource(const std::string& sFilename, const std::string& sMediaType, bool bLoopSource, uint32_t uiLoopCount, uint32_t uiInitialBufferSize)
+// AU index file
+const char INDEX_FILE_MAGIC[8] = { 'A', 'U', 'I', 'D', 'X', '0', '0', '2' };
+const std::string INDEX_FILE_EXTENSION = ".auidx";
+
+template <typename T>
+static void writeField(std::ostream& out, T value)
+{
+  out.write((const char*)&value, sizeof(T));
+}
+
+template <typename T>
+static bool readField(std::istream& in, T& value)
+{
+  in.read((char*)&value, sizeof(T));
+  return static_cast<size_t>(in.gcount()) == sizeof(T);
+}
+
+NalUnitMediaSource::NalUnitMediaSource(const std::string& sFilename, const std::string& sMediaType, bool bLoopSource, uint32_t uiLoopCount, uint32_t uiInitialBufferSize,
+                                       bool bUseIndexFile, bool bLazyIndexing)
   :m_in(sFilename.c_str() , std::ifstream::in | std::ifstream::binary),
     m_rIn(m_in),
+    m_Filename(sFilename),
     m_bEos(false),
     m_bLoopSource(bLoopSource),
     m_uiLoopCount(uiLoopCount),
     m_uiCurrentLoop(0),
     m_uiCurrentAccessUnit(0),
     m_buffer(new uint8_t[uiInitialBufferSize], uiInitialBufferSize),
-    m_temporaryNalUnitBuffer(new uint8_t[1000], 1000),
-    m_bFirstH265NalUnit(true)
+    m_uiPreviousNalUnitIndex(0),
+    m_bCurrentLayerIsBaseLayer(true),
+    m_bH264AudPresent(false),
+    m_bH264AuHasVcl(false),
+    m_bFirstH265NalUnit(true),
+    m_ePrevH265Type(h265::NUT_TRAIL_N),
+    m_bUseIndexFile(bUseIndexFile),
+    m_bLazyIndexing(bLazyIndexing),
+    m_bIndexComplete(false),
+    m_bStopIndexing(false)
 {
-  if (sMediaType == rfc6184::H264 || sMediaType == rfc6190::H264_SVC)
+  setMediaType(sMediaType);
+  checkInputStream();
+  if (m_bEos) return;
+
+  if (m_bUseIndexFile && loadIndexFile())
   {
-    m_eType = MT_H264;
-    VLOG(5) << "H264 Nal unit source";
+    VLOG(2) << "Loaded " << m_vAccessUnitInfo.size() << " AUs from " << getIndexFilename(m_Filename);
+    return;
   }
-  else if (sMediaType == rfchevc::H265)
+
+  if (m_bLazyIndexing)
   {
-    m_eType = MT_H265;
-    VLOG(5) << "H265 Nal unit source";
+    VLOG(2) << "Indexing " << m_Filename << " in background";
+    m_indexThread = boost::thread(&NalUnitMediaSource::indexInBackground, this);
+    return;
   }
-  else
+
+  parseAnnexBStream(m_rIn);
+  if (m_bUseIndexFile && !m_vAccessUnitInfo.empty())
   {
-    LOG(WARNING) << "Unsupported Nal unit source";
-    m_bEos = true;
+    if (!saveIndexFile())
+      LOG(WARNING) << "Failed to write index file " << getIndexFilename(m_Filename);
   }
-  checkInputStream();
-  parseAnnexBStream();
 }
 
-
-
 NalUnitMediaSource::NalUnitMediaSource(std::istream& in1, const std::string& sMediaType, bool bLoopSource, uint32_t uiLoopCount, uint32_t uiInitialBufferSize)
   :m_rIn(in1),
     m_bEos(false),
@@ -84,12 +121,56 @@ NalUnitMediaSource::NalUnitMediaSource(std::istream& in1, const std::string& sMe
     m_uiLoopCount(uiLoopCount),
     m_uiCurrentLoop(0),
     m_uiCurrentAccessUnit(0),
-    m_buffer(new uint8_t[uiInitialBufferSize], uiInitialBufferSize)
+    m_buffer(new uint8_t[uiInitialBufferSize], uiInitialBufferSize),
+    m_uiPreviousNalUnitIndex(0),
+    m_bCurrentLayerIsBaseLayer(true),
+    m_bH264AudPresent(false),
+    m_bH264AuHasVcl(false),
+    m_bFirstH265NalUnit(true),
+    m_ePrevH265Type(h265::NUT_TRAIL_N),
+    m_bUseIndexFile(false),
+    m_bLazyIndexing(false),
+    m_bIndexComplete(false),
+    m_bStopIndexing(false)
 {
+  setMediaType(sMediaType);
   checkInputStream();
-  parseAnnexBStream();
+  if (m_bEos) return;
+  parseAnnexBStream(m_rIn);
+}
+
+NalUnitMediaSource::~NalUnitMediaSource()
+{
+  if (m_indexThread.joinable())
+  {
+    m_bStopIndexing = true;
+    m_indexThread.join();
+  }
+}
+
+std::string NalUnitMediaSource::getIndexFilename(const std::string& sFilename)
+{
+  return sFilename + INDEX_FILE_EXTENSION;
 }
 
+void NalUnitMediaSource::setMediaType(const std::string& sMediaType)
+{
+  if (sMediaType == rfc6184::H264 || sMediaType == rfc6190::H264_SVC)
+  {
+    m_eType = MT_H264;
+    VLOG(5) << "H264 Nal unit source";
+  }
+  else if (sMediaType == rfchevc::H265)
+  {
+    m_eType = MT_H265;
+    VLOG(5) << "H265 Nal unit source";
+  }
+  else
+  {
+    LOG(WARNING) << "Unsupported Nal unit source";
+    m_bEos = true;
+  }
+}
 
 bool NalUnitMediaSource::isGood() const
 {
@@ -105,43 +186,63 @@ boost::optional<MediaSample> NalUnitMediaSource::getNextMediaSample()
 
 std::vector<MediaSample> NalUnitMediaSource::getNextAccessUnit()
 {
-  if (m_uiCurrentAccessUnit < m_vAccessUnitInfo.size())
+  if (m_bEos) return std::vector<MediaSample>();
+
+  AccessUnitInfo_t auInfo;
   {
-    AccessUnitInfo_t& auInfo = m_vAccessUnitInfo[m_uiCurrentAccessUnit];
-    std::vector<MediaSample> vAu = readMediaSamples(auInfo);
-    // set marker bit
-    vAu[vAu.size() - 1].setMarker(true);
-    ++m_uiCurrentAccessUnit;
-    if (m_bLoopSource)
+    boost::mutex::scoped_lock l(m_indexLock);
+    // in lazy mode the indexer may not have reached the cursor yet
+    while (m_uiCurrentAccessUnit >= m_vAccessUnitInfo.size() && !m_bIndexComplete)
     {
-      if (m_uiCurrentAccessUnit == m_vAccessUnitInfo.size())
-      {
-        if (m_uiLoopCount != 0 && m_uiCurrentLoop < m_uiLoopCount)
-        {
-          m_uiCurrentAccessUnit = 0;
-          ++m_uiCurrentLoop;
-        }
-        else if (m_uiLoopCount == 0)
-        {
-          m_uiCurrentAccessUnit = 0;
-        }
-        else
-        {
-          m_bEos = true;
-        }
-      }
+      m_condAccessUnitIndexed.wait(l);
     }
-    else
+    if (m_uiCurrentAccessUnit >= m_vAccessUnitInfo.size())
     {
-      if (m_uiCurrentAccessUnit == m_vAccessUnitInfo.size())
+      // in lazy mode the last AU may have been read before indexing completed
+      if (m_vAccessUnitInfo.empty())
         m_bEos = true;
+      else
+        handleEndOfIndex();
+      if (m_bEos) return std::vector<MediaSample>();
     }
+    // copy since the vector may grow while reading
+    auInfo = m_vAccessUnitInfo[m_uiCurrentAccessUnit];
+  }
+
+  std::vector<MediaSample> vAu = readMediaSamples(auInfo);
+  // set marker bit
+  vAu[vAu.size() - 1].setMarker(true);
+  ++m_uiCurrentAccessUnit;
+
+  boost::mutex::scoped_lock l(m_indexLock);
+  if (m_bIndexComplete && m_uiCurrentAccessUnit == m_vAccessUnitInfo.size())
+  {
+    handleEndOfIndex();
+  }
+  return vAu;
+}
 
-    return vAu;
+void NalUnitMediaSource::handleEndOfIndex()
+{
+  if (m_bLoopSource)
+  {
+    if (m_uiLoopCount != 0 && m_uiCurrentLoop < m_uiLoopCount)
+    {
+      m_uiCurrentAccessUnit = 0;
+      ++m_uiCurrentLoop;
+    }
+    else if (m_uiLoopCount == 0)
+    {
+      m_uiCurrentAccessUnit = 0;
+    }
+    else
+    {
+      m_bEos = true;
+    }
   }
   else
   {
-    return std::vector<MediaSample>();
+    m_bEos = true;
   }
 }
 
@@ -172,6 +273,8 @@ std::vector<MediaSample> NalUnitMediaSource::readMediaSamples(const AccessUnitIn
     m_buffer.setData(new uint8_t[uiAuLength + 1000], uiAuLength + 1000);
   }
 
+  // the stream may be at EOF after a previous read
+  m_rIn.clear();
   m_rIn.seekg(uiStartCodeIndex, std::ios_base::beg);
   m_rIn.read((char*) m_buffer.data(), uiAuLength);
   size_t count = static_cast<size_t>(m_rIn.gcount());
@@ -199,176 +302,223 @@ std::vector<MediaSample> NalUnitMediaSource::readMediaSamples(const AccessUnitIn
   return vAu;
 }
 
-void NalUnitMediaSource::parseAnnexBStream()
+void NalUnitMediaSource::indexInBackground()
 {
-  // only search for 3 byte start code
-  char startCode[3] = {0, 0, 1};
+  // use a separate handle so that the reader can seek independently
+  std::ifstream in(m_Filename.c_str(), std::ifstream::in | std::ifstream::binary);
+  parseAnnexBStream(in);
+  if (m_bStopIndexing) return;
 
-  m_rIn.seekg(0, std::ios_base::end);
-  size_t uiTotalFileSize = m_rIn.tellg();
-  m_rIn.seekg(0, std::ios_base::beg);
+  if (m_bUseIndexFile && !m_vAccessUnitInfo.empty())
+  {
+    if (!saveIndexFile())
+      LOG(WARNING) << "Failed to write index file " << getIndexFilename(m_Filename);
+  }
+}
+
+void NalUnitMediaSource::parseAnnexBStream(std::istream& in)
+{
+  in.seekg(0, std::ios_base::end);
+  size_t uiTotalFileSize = in.tellg();
+  in.seekg(0, std::ios_base::beg);
+
+  // the scan buffer is separate from m_buffer which is used by the reader
+  Buffer buffer(new uint8_t[READ_SIZE + CARRY_SIZE], READ_SIZE + CARRY_SIZE);
+  uint8_t* pBuffer = const_cast<uint8_t*>(buffer.data());
 
-  size_t uiPreviouslyProcessedData = 0;
+  // global offset of pBuffer[0]
+  size_t uiBufferOffset = 0;
   size_t uiDataFromPreviousRead = 0;
-  // NB: index to NAL unit, not start code
-  size_t uiPreviousNalUnitIndex = 0;
-  
-  uint32_t uiMaxSize = 0;
-  while (m_rIn.good())
-  {
-    size_t uiRead = std::min(READ_SIZE, m_buffer.getSize() - uiDataFromPreviousRead);
-    m_rIn.read((char*) m_buffer.data() + uiDataFromPreviousRead, uiRead);
+  // the first byte of the carried over data has already been scanned
+  size_t uiScanStart = 0;
 
-    size_t count = static_cast<size_t>(m_rIn.gcount());
+  while (in.good() && !m_bStopIndexing)
+  {
+    in.read((char*) pBuffer + uiDataFromPreviousRead, READ_SIZE);
+    size_t count = static_cast<size_t>(in.gcount());
     size_t uiTotalDataInBuffer = uiDataFromPreviousRead + count;
-
-    // go through read data and search for start codes
-    // end at -3 since there might be a scenario where there
-    // is a 4 or a 3 byte start code starting in the last 3 bytes. 
-    // In the case of the 4 byte start code, we would only be able 
-    // to match this after the next read
-    for (size_t i = 0; i < uiTotalDataInBuffer - 3; ++i)
+    if (uiTotalDataInBuffer < CARRY_SIZE) break;
+
+    // go through read data and search for start codes. Only positions that have
+    // the complete start code and NAL unit header in the buffer are scanned, the
+    // rest is carried over to the next read.
+    const size_t uiScanEnd = uiTotalDataInBuffer - (CARRY_SIZE - 1);
+    size_t i = uiScanStart;
+    while (i < uiScanEnd)
     {
-      if (memcmp(&m_buffer[i], startCode, 3) == 0)
+      // a start code can't begin at i, i + 1 or i + 2 if the third byte is neither 0 nor 1
+      if (pBuffer[i + 2] > 1)
+      {
+        i += 3;
+      }
+      else if (pBuffer[i + 2] == 1 && pBuffer[i + 1] == 0 && pBuffer[i] == 0)
       {
-        size_t index;
-        uint32_t uiStartCodeLen;
-
         // check if this is a 3 byte or 4 byte start code
-        if ( i > 0 && m_buffer[i-1] == 0)
+        if (i > 0 && pBuffer[i - 1] == 0)
         {
-          // map to global offset
-          index = i-1 + uiPreviouslyProcessedData;
-          uiStartCodeLen = 4;
+          onStartCode(uiBufferOffset + i - 1, 4, pBuffer + i + 3);
         }
         else
         {
-          // map to global offset
-          index = i + uiPreviouslyProcessedData;
-          uiStartCodeLen = 3;
+          onStartCode(uiBufferOffset + i, 3, pBuffer + i + 3);
         }
-
-        size_t uiNalUnitIndex = index + uiStartCodeLen;
-
-        // update size in previously stored info
-        if (!m_vStartCodeInfo.empty())
-        {
-          size_t uiSize = uiNalUnitIndex - uiPreviousNalUnitIndex - uiStartCodeLen;
-          std::get<3>(m_vStartCodeInfo[m_vStartCodeInfo.size() - 1 ]) = uiSize; 
-          if (uiSize > uiMaxSize) uiMaxSize = uiSize;
-        }
-        // store current NAL unit
-        m_vStartCodeInfo.push_back(std::make_tuple(index, uiStartCodeLen, uiNalUnitIndex, 0));
-        
-        uiPreviousNalUnitIndex = uiNalUnitIndex;
+        i += 3;
+      }
+      else
+      {
+        ++i;
       }
     }
-    // shift data, but leave last 3 bytes in case there is a start code to be matched
-    // this means that the last 3 bytes of the file will not be checked for a start code
-    // but that's ok since that wouldn't make sense anyway
-    uiPreviouslyProcessedData += (uiTotalDataInBuffer - 3);
-    uiDataFromPreviousRead = 3;
-    memmove(&m_buffer[0], &m_buffer[uiTotalDataInBuffer-3], 3);
+
+    // keep the unscanned tail as well as the byte before it for the 4 byte start code check
+    size_t uiCarry = std::min(CARRY_SIZE, uiTotalDataInBuffer);
+    size_t uiScanned = std::max(uiScanEnd, i);
+    memmove(pBuffer, pBuffer + uiTotalDataInBuffer - uiCarry, uiCarry);
+    uiBufferOffset += uiTotalDataInBuffer - uiCarry;
+    uiDataFromPreviousRead = uiCarry;
+    uiScanStart = uiScanned - (uiTotalDataInBuffer - uiCarry);
   }
 
-  if (m_vStartCodeInfo.empty())
+  if (m_bStopIndexing) return;
+  onIndexComplete(uiTotalFileSize);
+}
+
+/**
+ * @brief isFirstNalUnitOfH264AccessUnit returns if the NAL unit following a VCL NAL unit
+ * starts a new access unit (7.4.1.2.3). Arbitrary slice order is not supported: a slice
+ * with first_mb_in_slice equal to 0 is assumed to start a new picture.
+ */
+static bool isFirstNalUnitOfH264AccessUnit(h264::NalUnitType eType, const uint8_t* pHeader)
+{
+  switch (eType)
   {
-    m_bEos = true;
-    return;
+    case h264::NUT_CODED_SLICE_OF_A_NON_IDR_PICTURE:
+    case h264::NUT_CODED_SLICE_DATA_PARTITION_A:
+    case h264::NUT_CODED_SLICE_OF_AN_IDR_PICTURE:
+      // first_mb_in_slice is ue(v) coded: 0 is a single 1 bit
+      return (pHeader[1] & 0x80) != 0;
+    case h264::NUT_SUPPLEMENTAL_ENHANCEMENT_INFORMATION_SEI:
+    case h264::NUT_SEQUENCE_PARAMETER_SET:
+    case h264::NUT_PICTURE_PARAMETER_SET:
+    case h264::NUT_SUBSET_SEQUENCE_PARAMETER_SET:
+      return true;
+    default:
+      return false;
   }
+}
 
-  // update size of final NAL unit
-  uint32_t uiSize = uiTotalFileSize - uiPreviousNalUnitIndex;
-  std::get<3>(m_vStartCodeInfo[m_vStartCodeInfo.size() - 1 ]) = uiSize; 
-
-  // adjust temp buffer
-  if (uiSize > uiMaxSize) uiMaxSize = uiSize; 
-  if (uiMaxSize > m_temporaryNalUnitBuffer.getSize())
-    m_temporaryNalUnitBuffer.setData(new uint8_t[uiMaxSize], uiMaxSize);
+void NalUnitMediaSource::onStartCode(size_t uiIndex, uint32_t uiStartCodeLen, const uint8_t* pHeader)
+{
+  size_t uiNalUnitIndex = uiIndex + uiStartCodeLen;
 
-  m_rIn.clear();
+  // update size in previously stored info: this completes the previous NAL unit
+  if (!m_vCurrentAccessUnit.empty())
+  {
+    std::get<3>(m_vCurrentAccessUnit[m_vCurrentAccessUnit.size() - 1]) = uiIndex - m_uiPreviousNalUnitIndex;
+  }
+  m_uiPreviousNalUnitIndex = uiNalUnitIndex;
 
-  AccessUnitInfo_t vCurrentAccessUnit;
-  for (size_t i = 0; i < m_vStartCodeInfo.size(); ++i)
+  NalUnitInfo_t info = std::make_tuple(uiIndex, uiStartCodeLen, uiNalUnitIndex, 0);
+  switch (m_eType)
   {
-    NalUnitInfo_t& info = m_vStartCodeInfo[i];
-    // read NAL unit from file
-    size_t uiIndex = std::get<2>(info);
-    uint32_t uiSize = std::get<3>(info);
-    m_rIn.seekg(uiIndex, std::ios_base::beg);
-    m_rIn.read((char*) m_temporaryNalUnitBuffer.data(), uiSize);
-    size_t count = static_cast<size_t>(m_rIn.gcount());
-    assert(count == uiSize);
-
-    switch (m_eType)
-    {
-      // At this time H264 AU detection is based on AUDs, and in the case of SVC on NAL unit types only
+    // H264 AU detection is based on AUDs, and in the case of SVC on NAL unit types only.
+    // Streams without AUDs are split on the first NAL unit of a new primary coded picture.
     case MT_H264:
-      {
-        using h264::NalUnitType;
-        NalUnitType eType = h264::getNalUnitType(m_temporaryNalUnitBuffer[0]);
-
-        if (eType == media::h264::NUT_ACCESS_UNIT_DELIMITER ||
-            (!m_bCurrentLayerIsBaseLayer && (eType != media::h264::NUT_CODED_SLICE_EXT && eType != media::h264::NUT_RESERVED_21) ) )
-        {
-          finaliseAu(vCurrentAccessUnit);
-          m_bCurrentLayerIsBaseLayer = true;
-        }
-        else if(eType == media::h264::NUT_CODED_SLICE_EXT || eType == media::h264::NUT_RESERVED_21)
-        {
-          m_bCurrentLayerIsBaseLayer = false;
-        }
+    {
+      using h264::NalUnitType;
+      NalUnitType eType = h264::getNalUnitType(pHeader[0]);
 
-        // add AU to current AU
-        vCurrentAccessUnit.push_back(info);
-        break;
+      if (eType == media::h264::NUT_ACCESS_UNIT_DELIMITER)
+      {
+        m_bH264AudPresent = true;
       }
-    case MT_H265:
+      if (eType == media::h264::NUT_ACCESS_UNIT_DELIMITER ||
+          (!m_bCurrentLayerIsBaseLayer && (eType != media::h264::NUT_CODED_SLICE_EXT && eType != media::h264::NUT_RESERVED_21) ) ||
+          (!m_bH264AudPresent && m_bH264AuHasVcl && isFirstNalUnitOfH264AccessUnit(eType, pHeader)))
       {
-        using h265::NalUnitType;
-        NalUnitType eType;
-        uint32_t uiLayerId = 0, uiTemporalId = 0;
-        bool bFirstCTB = false;
-        h265::getNalUnitInfo(&m_temporaryNalUnitBuffer[0], eType, uiLayerId, uiTemporalId, bFirstCTB);
+        finaliseAu(m_vCurrentAccessUnit);
+        m_bCurrentLayerIsBaseLayer = true;
+        m_bH264AuHasVcl = false;
+      }
+      else if(eType == media::h264::NUT_CODED_SLICE_EXT || eType == media::h264::NUT_RESERVED_21)
+      {
+        m_bCurrentLayerIsBaseLayer = false;
+      }
+      if (eType >= media::h264::NUT_CODED_SLICE_OF_A_NON_IDR_PICTURE && eType <= media::h264::NUT_CODED_SLICE_OF_AN_IDR_PICTURE)
+      {
+        m_bH264AuHasVcl = true;
+      }
+
+      // add NAL unit to current AU
+      m_vCurrentAccessUnit.push_back(info);
+      m_vNalUnitTypes.push_back(static_cast<uint8_t>(eType));
+      break;
+    }
+    case MT_H265:
+    {
+      using h265::NalUnitType;
+      NalUnitType eType;
+      uint32_t uiLayerId = 0, uiTemporalId = 0;
+      bool bFirstCTB = false;
+      h265::getNalUnitInfo(pHeader, eType, uiLayerId, uiTemporalId, bFirstCTB);
 #if 0
-        VLOG(5) << "DBG: NALU Type: " << media::h265::toString(eType);
+      VLOG(5) << "DBG: NALU Type: " << media::h265::toString(eType);
 #endif
-        if (eType == media::h265::NUT_AUD  ||
-            m_bFirstH265NalUnit ||
-            (bFirstCTB && uiLayerId == 0 &&
-            (m_ePrevH265Type != media::h265::NUT_PPS &&
-             m_ePrevH265Type != media::h265::NUT_SPS &&
-             m_ePrevH265Type != media::h265::NUT_VPS))
-           )
-        {
-          VLOG(5) << "Finalising AU NALU Type: " << media::h265::toString(eType)
-                  << " first: " << m_bFirstH265NalUnit
-                  << " first CTB: " << bFirstCTB
-                  << " uiLayerId: " << uiLayerId
-                  << " previous type: " << media::h265::toString(m_ePrevH265Type);
+      if (eType == media::h265::NUT_AUD  ||
+          m_bFirstH265NalUnit ||
+          (bFirstCTB && uiLayerId == 0 &&
+          (m_ePrevH265Type != media::h265::NUT_PPS &&
+           m_ePrevH265Type != media::h265::NUT_SPS &&
+           m_ePrevH265Type != media::h265::NUT_VPS))
+         )
+      {
+        VLOG(5) << "Finalising AU NALU Type: " << media::h265::toString(eType)
+                << " first: " << m_bFirstH265NalUnit
+                << " first CTB: " << bFirstCTB
+                << " uiLayerId: " << uiLayerId
+                << " previous type: " << media::h265::toString(m_ePrevH265Type);
 
-          finaliseAu(vCurrentAccessUnit);
-        }
-        else
-        {
-          VLOG(5) << "Not finalising AU NALU Type: " << media::h265::toString(eType)
-                  << " first: " << m_bFirstH265NalUnit
-                  << " first CTB: " << bFirstCTB
-                  << " uiLayerId: " << uiLayerId
-                  << " previous type: " << media::h265::toString(m_ePrevH265Type);
-        }
-        // add AU to current AU
-        vCurrentAccessUnit.push_back(info);
-        // store for next pass
-        m_bFirstH265NalUnit = false;
-        m_ePrevH265Type = eType;
-        break;
+        finaliseAu(m_vCurrentAccessUnit);
+      }
+      else
+      {
+        VLOG(5) << "Not finalising AU NALU Type: " << media::h265::toString(eType)
+                << " first: " << m_bFirstH265NalUnit
+                << " first CTB: " << bFirstCTB
+                << " uiLayerId: " << uiLayerId
+                << " previous type: " << media::h265::toString(m_ePrevH265Type);
       }
+      // add NAL unit to current AU
+      m_vCurrentAccessUnit.push_back(info);
+      m_vNalUnitTypes.push_back(static_cast<uint8_t>(eType));
+      // store for next pass
+      m_bFirstH265NalUnit = false;
+      m_ePrevH265Type = eType;
+      break;
     }
   }
+}
 
+void NalUnitMediaSource::onIndexComplete(size_t uiTotalFileSize)
+{
+  // update size of final NAL unit
+  if (!m_vCurrentAccessUnit.empty())
+  {
+    std::get<3>(m_vCurrentAccessUnit[m_vCurrentAccessUnit.size() - 1]) = uiTotalFileSize - m_uiPreviousNalUnitIndex;
+  }
   // store final AU
-  finaliseAu(vCurrentAccessUnit);
+  finaliseAu(m_vCurrentAccessUnit);
+
+  boost::mutex::scoped_lock l(m_indexLock);
+  m_bIndexComplete = true;
+  if (m_vAccessUnitInfo.empty())
+  {
+    LOG(WARNING) << "No NAL units found in stream";
+    // the reader sets m_bEos in lazy mode
+    if (!m_bLazyIndexing) m_bEos = true;
+  }
+  VLOG(2) << "Indexed " << m_vAccessUnitInfo.size() << " AUs (" << m_vNalUnitTypes.size() << " NAL units)";
+  m_condAccessUnitIndexed.notify_all();
 }
 
 void NalUnitMediaSource::finaliseAu(AccessUnitInfo_t& vCurrentAccessUnit)
@@ -376,10 +526,144 @@ void NalUnitMediaSource::finaliseAu(AccessUnitInfo_t& vCurrentAccessUnit)
   // new AU: store previously seen AUs
   if (!vCurrentAccessUnit.empty()) // the first will be empty
   {
+    boost::mutex::scoped_lock l(m_indexLock);
     m_vAccessUnitInfo.push_back(vCurrentAccessUnit);
+    m_condAccessUnitIndexed.notify_one();
   }
   vCurrentAccessUnit.clear();
 }
 
+bool NalUnitMediaSource::loadIndexFile()
+{
+  const std::string sIndexFile = getIndexFilename(m_Filename);
+  boost::system::error_code ec;
+  if (!boost::filesystem::exists(sIndexFile, ec)) return false;
+
+  uint64_t uiFileSize = boost::filesystem::file_size(m_Filename, ec);
+  if (ec) return false;
+  int64_t iModificationTime = static_cast<int64_t>(boost::filesystem::last_write_time(m_Filename, ec));
+  if (ec) return false;
+
+  std::ifstream in(sIndexFile.c_str(), std::ifstream::in | std::ifstream::binary);
+  char magic[sizeof(INDEX_FILE_MAGIC)];
+  in.read(magic, sizeof(magic));
+  if (static_cast<size_t>(in.gcount()) != sizeof(magic) || memcmp(magic, INDEX_FILE_MAGIC, sizeof(magic)) != 0)
+  {
+    LOG(WARNING) << "Invalid index file: " << sIndexFile;
+    return false;
+  }
+
+  uint64_t uiIndexedFileSize = 0;
+  int64_t iIndexedModificationTime = 0;
+  uint32_t uiMediaType = 0;
+  uint64_t uiAuCount = 0;
+  uint64_t uiNalCount = 0;
+  if (!readField(in, uiIndexedFileSize) || !readField(in, iIndexedModificationTime) ||
+      !readField(in, uiMediaType) || !readField(in, uiAuCount) || !readField(in, uiNalCount))
+  {
+    LOG(WARNING) << "Truncated index file: " << sIndexFile;
+    return false;
+  }
+
+  if (uiIndexedFileSize != uiFileSize || iIndexedModificationTime != iModificationTime || uiMediaType != static_cast<uint32_t>(m_eType))
+  {
+    VLOG(2) << "Stale index file: " << sIndexFile;
+    return false;
+  }
+
+  std::vector<AccessUnitInfo_t> vAccessUnitInfo;
+  std::vector<uint8_t> vNalUnitTypes;
+  vAccessUnitInfo.reserve(uiAuCount);
+  vNalUnitTypes.reserve(uiNalCount);
+  for (uint64_t i = 0; i < uiAuCount; ++i)
+  {
+    uint32_t uiNalUnitsInAu = 0;
+    if (!readField(in, uiNalUnitsInAu)) return false;
+    AccessUnitInfo_t au;
+    au.reserve(uiNalUnitsInAu);
+    for (uint32_t j = 0; j < uiNalUnitsInAu; ++j)
+    {
+      uint64_t uiOffset = 0;
+      uint8_t uiStartCodeLen = 0;
+      uint8_t uiNalUnitType = 0;
+      uint32_t uiNalUnitLength = 0;
+      if (!readField(in, uiOffset) || !readField(in, uiStartCodeLen) ||
+          !readField(in, uiNalUnitType) || !readField(in, uiNalUnitLength))
+      {
+        LOG(WARNING) << "Truncated index file: " << sIndexFile;
+        return false;
+      }
+      if ((uiStartCodeLen != 3 && uiStartCodeLen != 4) || uiOffset + uiStartCodeLen + uiNalUnitLength > uiFileSize)
+      {
+        LOG(WARNING) << "Corrupt index file: " << sIndexFile;
+        return false;
+      }
+      au.push_back(std::make_tuple(static_cast<size_t>(uiOffset), static_cast<uint32_t>(uiStartCodeLen),
+                                   static_cast<size_t>(uiOffset + uiStartCodeLen), uiNalUnitLength));
+      vNalUnitTypes.push_back(uiNalUnitType);
+    }
+    vAccessUnitInfo.push_back(au);
+  }
+
+  if (vNalUnitTypes.size() != uiNalCount || vAccessUnitInfo.empty())
+  {
+    LOG(WARNING) << "Corrupt index file: " << sIndexFile;
+    return false;
+  }
+
+  boost::mutex::scoped_lock l(m_indexLock);
+  m_vAccessUnitInfo.swap(vAccessUnitInfo);
+  m_vNalUnitTypes.swap(vNalUnitTypes);
+  m_bIndexComplete = true;
+  return true;
+}
+
+bool NalUnitMediaSource::saveIndexFile() const
+{
+  const std::string sIndexFile = getIndexFilename(m_Filename);
+  boost::system::error_code ec;
+  uint64_t uiFileSize = boost::filesystem::file_size(m_Filename, ec);
+  if (ec) return false;
+  int64_t iModificationTime = static_cast<int64_t>(boost::filesystem::last_write_time(m_Filename, ec));
+  if (ec) return false;
+
+  // write to a temporary file first so that a concurrent run never sees a partial index
+  const std::string sTempFile = sIndexFile + ".tmp";
+  {
+    std::ofstream out(sTempFile.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    if (!out.good()) return false;
+
+    boost::mutex::scoped_lock l(m_indexLock);
+    out.write(INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC));
+    writeField<uint64_t>(out, uiFileSize);
+    writeField<int64_t>(out, iModificationTime);
+    writeField<uint32_t>(out, static_cast<uint32_t>(m_eType));
+    writeField<uint64_t>(out, m_vAccessUnitInfo.size());
+    writeField<uint64_t>(out, m_vNalUnitTypes.size());
+    size_t uiNalUnit = 0;
+    for (const AccessUnitInfo_t& au : m_vAccessUnitInfo)
+    {
+      writeField<uint32_t>(out, au.size());
+      for (const NalUnitInfo_t& info : au)
+      {
+        writeField<uint64_t>(out, std::get<0>(info));
+        writeField<uint8_t>(out, std::get<1>(info));
+        writeField<uint8_t>(out, m_vNalUnitTypes[uiNalUnit++]);
+        writeField<uint32_t>(out, std::get<3>(info));
+      }
+    }
+    if (!out.good()) return false;
+  }
+
+  boost::filesystem::rename(sTempFile, sIndexFile, ec);
+  if (ec)
+  {
+    boost::filesystem::remove(sTempFile, ec);
+    return false;
+  }
+  VLOG(2) << "Wrote index file " << sIndexFile;
+  return true;
+}
+
 } // media
 } // rtp_plus_plus
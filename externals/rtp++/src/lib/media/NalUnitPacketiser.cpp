@@ -0,0 +1,218 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <algorithm>
+#include <rtp++/media/NalUnitPacketiser.h>
+
+namespace rtp_plus_plus {
+namespace media {
+
+NalUnitPacketiser::NalUnitPacketiser(uint32_t uiMaxPacketSize, uint8_t uiPayloadType, uint32_t uiSsrc, uint16_t uiSequenceNumber)
+  :m_uiMaxPacketSize(uiMaxPacketSize),
+    m_uiPayloadType(uiPayloadType),
+    m_uiSsrc(uiSsrc),
+    m_uiSequenceNumber(uiSequenceNumber)
+{
+  // leave room for at least one byte of each fragment
+  assert(uiMaxPacketSize > RtpPacket::RTP_HEADER_SIZE + 3);
+}
+
+NalUnitPacketiser::~NalUnitPacketiser()
+{
+
+}
+
+/**
+ * @brief skips the start code of encoders that include it in the NAL unit
+ */
+static void skipStartCode(const uint8_t*& pData, uint32_t& uiSize)
+{
+  uint32_t uiPos = 0;
+  while (uiPos < uiSize && pData[uiPos] == 0) ++uiPos;
+  if (uiPos >= 2 && uiPos < uiSize && pData[uiPos] == 1)
+  {
+    pData += uiPos + 1;
+    uiSize -= uiPos + 1;
+  }
+}
+
+void NalUnitPacketiser::packetise(const std::vector<MediaSample>& accessUnit, std::vector<RtpPacket>& packets)
+{
+  m_vNalUnits.clear();
+  for (const MediaSample& mediaSample : accessUnit)
+  {
+    NalUnit nalUnit = { mediaSample.getDataBuffer().data(), (uint32_t)mediaSample.getDataBuffer().getSize() };
+    if (mediaSample.doesNaluContainsStartCode())
+    {
+      skipStartCode(nalUnit.Data, nalUnit.Size);
+    }
+    if (nalUnit.Size > getNalUnitHeaderSize())
+    {
+      m_vNalUnits.push_back(nalUnit);
+    }
+  }
+  if (m_vNalUnits.empty()) return;
+
+  const uint32_t uiRtpTime = accessUnit[0].getRtpTime();
+  const size_t uiFirstPacket = packets.size();
+  size_t i = 0;
+  while (i < m_vNalUnits.size())
+  {
+    const NalUnit& nalUnit = m_vNalUnits[i];
+    if (RtpPacket::RTP_HEADER_SIZE + nalUnit.Size > m_uiMaxPacketSize)
+    {
+      fragment(nalUnit, uiRtpTime, packets);
+      ++i;
+      continue;
+    }
+
+    // aggregate as many of the following NAL units as fit
+    uint32_t uiAggregatedSize = RtpPacket::RTP_HEADER_SIZE + getAggregationHeaderSize() + 2 + nalUnit.Size;
+    size_t j = i + 1;
+    while (j < m_vNalUnits.size() && j - i < MAX_AGGREGATED_NAL_UNITS &&
+           uiAggregatedSize + 2 + m_vNalUnits[j].Size <= m_uiMaxPacketSize)
+    {
+      uiAggregatedSize += 2 + m_vNalUnits[j].Size;
+      ++j;
+    }
+
+    RtpPacket& packet = addPacket(packets, uiRtpTime);
+    if (j - i == 1)
+    {
+      packet.addPayload(nalUnit.Data, nalUnit.Size);
+    }
+    else
+    {
+      writeAggregationHeader(packet.addHeader(getAggregationHeaderSize()), &m_vNalUnits[i], (uint32_t)(j - i));
+      for (size_t k = i; k < j; ++k)
+      {
+        uint8_t* pLength = packet.addHeader(2);
+        pLength[0] = m_vNalUnits[k].Size >> 8;
+        pLength[1] = m_vNalUnits[k].Size & 0xFF;
+        packet.addPayload(m_vNalUnits[k].Data, m_vNalUnits[k].Size);
+      }
+    }
+    i = j;
+  }
+  if (packets.size() > uiFirstPacket)
+  {
+    packets.back().setMarker(true);
+  }
+}
+
+RtpPacket& NalUnitPacketiser::addPacket(std::vector<RtpPacket>& packets, uint32_t uiRtpTime)
+{
+  packets.resize(packets.size() + 1);
+  RtpPacket& packet = packets.back();
+  packet.writeRtpHeader(false, m_uiPayloadType, m_uiSequenceNumber++, uiRtpTime, m_uiSsrc);
+  return packet;
+}
+
+void NalUnitPacketiser::fragment(const NalUnit& nalUnit, uint32_t uiRtpTime, std::vector<RtpPacket>& packets)
+{
+  const uint32_t uiHeaderSize = getNalUnitHeaderSize();
+  const uint32_t uiMaxFragmentSize = m_uiMaxPacketSize - RtpPacket::RTP_HEADER_SIZE - getFragmentationHeaderSize();
+  // the NAL unit header is carried in the payload and FU headers
+  const uint8_t* pData = nalUnit.Data + uiHeaderSize;
+  uint32_t uiRemaining = nalUnit.Size - uiHeaderSize;
+  bool bStart = true;
+  while (uiRemaining > 0)
+  {
+    uint32_t uiFragmentSize = std::min(uiRemaining, uiMaxFragmentSize);
+    bool bEnd = uiFragmentSize == uiRemaining;
+    RtpPacket& packet = addPacket(packets, uiRtpTime);
+    writeFragmentationHeader(packet.addHeader(getFragmentationHeaderSize()), nalUnit.Data, bStart, bEnd);
+    packet.addPayload(pData, uiFragmentSize);
+    pData += uiFragmentSize;
+    uiRemaining -= uiFragmentSize;
+    bStart = false;
+  }
+}
+
+void NalUnitPacketiser::depacketise(const std::vector<RtpPacket>& packets, std::vector<MediaSample>& nalUnits)
+{
+  const uint32_t uiHeaderSize = getNalUnitHeaderSize();
+  const uint32_t uiFuHeaderSize = getFragmentationHeaderSize();
+  bool bInFragment = false;
+  uint16_t uiExpectedSequenceNumber = 0;
+  for (const RtpPacket& packet : packets)
+  {
+    packet.serialise(m_vPacket);
+    if (m_vPacket.size() <= RtpPacket::RTP_HEADER_SIZE + uiHeaderSize) continue;
+    const uint8_t* pPayload = &m_vPacket[RtpPacket::RTP_HEADER_SIZE];
+    const uint32_t uiSize = (uint32_t)m_vPacket.size() - RtpPacket::RTP_HEADER_SIZE;
+
+    if (isFragmentationUnit(pPayload))
+    {
+      if (uiSize <= uiFuHeaderSize) continue;
+      const uint8_t uiFuHeader = pPayload[uiFuHeaderSize - 1];
+      if (uiFuHeader & 0x80)
+      {
+        // start: discards any incomplete fragmented NAL unit
+        m_vFragments.resize(uiHeaderSize);
+        writeNalUnitHeader(&m_vFragments[0], pPayload);
+        bInFragment = true;
+      }
+      else if (!bInFragment || packet.getSequenceNumber() != uiExpectedSequenceNumber)
+      {
+        bInFragment = false;
+        continue;
+      }
+      m_vFragments.insert(m_vFragments.end(), pPayload + uiFuHeaderSize, pPayload + uiSize);
+      uiExpectedSequenceNumber = packet.getSequenceNumber() + 1;
+      if (uiFuHeader & 0x40)
+      {
+        addNalUnit(&m_vFragments[0], (uint32_t)m_vFragments.size(), packet.getRtpTime(), nalUnits);
+        bInFragment = false;
+      }
+      continue;
+    }
+
+    bInFragment = false;
+    if (isAggregationPacket(pPayload))
+    {
+      uint32_t uiPos = getAggregationHeaderSize();
+      while (uiPos + 2 <= uiSize)
+      {
+        uint32_t uiLength = (pPayload[uiPos] << 8) | pPayload[uiPos + 1];
+        if (uiPos + 2 + uiLength > uiSize) break;
+        addNalUnit(pPayload + uiPos + 2, uiLength, packet.getRtpTime(), nalUnits);
+        uiPos += 2 + uiLength;
+      }
+    }
+    else
+    {
+      addNalUnit(pPayload, uiSize, packet.getRtpTime(), nalUnits);
+    }
+  }
+}
+
+void NalUnitPacketiser::addNalUnit(const uint8_t* pData, uint32_t uiSize, uint32_t uiRtpTime, std::vector<MediaSample>& nalUnits) const
+{
+  uint8_t* pNalUnit = new uint8_t[uiSize];
+  memcpy(pNalUnit, pData, uiSize);
+  MediaSample mediaSample;
+  mediaSample.setData(pNalUnit, uiSize);
+  mediaSample.setRtpTime(uiRtpTime);
+  nalUnits.push_back(mediaSample);
+}
+
+} // media
+} // rtp_plus_plus
@@ -0,0 +1,90 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <rtp++/media/TemporalLayerPruner.h>
+#include <algorithm>
+#include <numeric>
+
+namespace rtp_plus_plus
+{
+namespace media
+{
+
+TemporalLayerPruner::TemporalLayerPruner(uint32_t uiTemporalLayers)
+  :m_uiTemporalLayers(std::max<uint32_t>(1, uiTemporalLayers)),
+    m_uiMaxTemporalId(m_uiTemporalLayers - 1),
+    m_uiDroppedFrames(0),
+    m_uiDroppedNalUnits(0),
+    m_uiDroppedBytes(0)
+{
+
+}
+
+void TemporalLayerPruner::addFrame(const std::vector<MediaSample>& accessUnit, double dFps)
+{
+  std::vector<uint32_t> vLayerBytes(m_uiTemporalLayers, 0);
+  for (const MediaSample& nalu : accessUnit)
+    vLayerBytes[std::min<uint32_t>(nalu.getTemporalId(), m_uiTemporalLayers - 1)] += nalu.getPayloadSize();
+  m_recentFrames.push_back(vLayerBytes);
+  while (m_recentFrames.size() > std::max<uint32_t>(1, static_cast<uint32_t>(dFps + 0.5)))
+    m_recentFrames.pop_front();
+}
+
+double TemporalLayerPruner::getLayerKbps(uint32_t uiMaxTemporalId, double dFps) const
+{
+  if (m_recentFrames.empty()) return 0.0;
+  const uint32_t uiLayers = std::min(uiMaxTemporalId + 1, m_uiTemporalLayers);
+  uint64_t uiBytes = 0;
+  for (const std::vector<uint32_t>& vLayerBytes : m_recentFrames)
+    uiBytes += std::accumulate(vLayerBytes.begin(), vLayerBytes.begin() + uiLayers, 0u);
+  return uiBytes * 8.0 * dFps / (1000.0 * m_recentFrames.size());
+}
+
+uint32_t TemporalLayerPruner::setTargetBitrate(double dKbps, double dFps)
+{
+  m_uiMaxTemporalId = 0;
+  while (m_uiMaxTemporalId + 1 < m_uiTemporalLayers && getLayerKbps(m_uiMaxTemporalId + 1, dFps) <= dKbps)
+    ++m_uiMaxTemporalId;
+  return m_uiMaxTemporalId;
+}
+
+uint32_t TemporalLayerPruner::prune(std::vector<MediaSample>& accessUnit)
+{
+  uint32_t uiSize = 0;
+  std::vector<MediaSample> kept;
+  for (const MediaSample& nalu : accessUnit)
+  {
+    if (nalu.getTemporalId() > m_uiMaxTemporalId)
+    {
+      ++m_uiDroppedNalUnits;
+      m_uiDroppedBytes += nalu.getPayloadSize();
+      continue;
+    }
+    uiSize += nalu.getPayloadSize();
+    kept.push_back(nalu);
+  }
+  if (!accessUnit.empty() && kept.empty())
+    ++m_uiDroppedFrames;
+  accessUnit.swap(kept);
+  return uiSize;
+}
+
+} // media
+} // rtp_plus_plus
@@ -0,0 +1,166 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <rtp++/media/VideoCodecPlugin.h>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+namespace rtp_plus_plus {
+namespace media {
+
+#ifdef _WIN32
+static const char* const PLUGIN_EXTENSION = ".dll";
+#else
+static const char* const PLUGIN_EXTENSION = ".so";
+#endif
+static const char* const PLUGIN_PREFIX = "codec_";
+
+typedef uint32_t (*GetApiVersion)();
+typedef IVideoCodecTransform* (*CreateVideoCodecTransform)(const char*);
+
+/**
+ * @brief openLibrary loads the shared object or DLL: returns 0 and the reason in sError on failure
+ */
+static void* openLibrary(const std::string& sPath, std::string& sError)
+{
+#ifdef _WIN32
+  HMODULE hModule = LoadLibraryA(sPath.c_str());
+  if (!hModule) sError = "LoadLibrary error " + std::to_string(GetLastError());
+  return hModule;
+#else
+  // local: the entry points of the builds of different codecs have the same names
+  void* pHandle = dlopen(sPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!pHandle) sError = dlerror();
+  return pHandle;
+#endif
+}
+
+static void* findSymbol(void* pHandle, const char* szName)
+{
+#ifdef _WIN32
+  return reinterpret_cast<void*>(GetProcAddress(static_cast<HMODULE>(pHandle), szName));
+#else
+  return dlsym(pHandle, szName);
+#endif
+}
+
+std::string getVideoCodecPluginFilename(const std::string& sCodec, cpu::IsaLevel eIsa)
+{
+  std::string sFilename = PLUGIN_PREFIX + boost::to_lower_copy(sCodec);
+  if (eIsa != cpu::ISA_BASELINE)
+    sFilename += std::string("_") + cpu::getName(eIsa);
+  return sFilename + PLUGIN_EXTENSION;
+}
+
+std::vector<VideoCodecPluginFile> findVideoCodecPlugins(const std::string& sDirectory)
+{
+  std::vector<VideoCodecPluginFile> plugins;
+  boost::system::error_code ec;
+  boost::filesystem::directory_iterator it(sDirectory, ec);
+  if (ec)
+  {
+    LOG(WARNING) << "Failed to list codec plugin directory " << sDirectory << ": " << ec.message();
+    return plugins;
+  }
+  for (; it != boost::filesystem::directory_iterator(); it.increment(ec))
+  {
+    const std::string sFilename = it->path().filename().string();
+    if (!boost::starts_with(sFilename, PLUGIN_PREFIX) || !boost::ends_with(sFilename, PLUGIN_EXTENSION))
+      continue;
+    // codec_<codec>[_<isa>]<extension>
+    std::string sName = sFilename.substr(strlen(PLUGIN_PREFIX), sFilename.size() - strlen(PLUGIN_PREFIX) - strlen(PLUGIN_EXTENSION));
+    VideoCodecPluginFile plugin;
+    size_t uiSeparator = sName.rfind('_');
+    if (uiSeparator != std::string::npos)
+    {
+      if (!cpu::parseIsaLevel(sName.substr(uiSeparator + 1), plugin.Isa))
+      {
+        VLOG(2) << "Ignoring " << sFilename << ": unknown instruction set";
+        continue;
+      }
+      sName = sName.substr(0, uiSeparator);
+    }
+    if (sName.empty()) continue;
+    plugin.Codec = boost::to_lower_copy(sName);
+    plugin.Path = it->path().string();
+    plugins.push_back(plugin);
+  }
+  std::sort(plugins.begin(), plugins.end(), [](const VideoCodecPluginFile& lhs, const VideoCodecPluginFile& rhs)
+  {
+    return lhs.Codec != rhs.Codec ? lhs.Codec < rhs.Codec : lhs.Isa < rhs.Isa;
+  });
+  return plugins;
+}
+
+std::unique_ptr<IVideoCodecTransform> loadVideoCodecPlugin(const std::string& sDirectory, const std::string& sCodec,
+                                                           const std::string& sFormat, cpu::IsaLevel eMaxIsa,
+                                                           boost::system::error_code& ec)
+{
+  const cpu::IsaLevel eCpuIsa = cpu::getIsaLevel();
+  const int iFirstIsa = std::min(static_cast<int>(eMaxIsa), static_cast<int>(eCpuIsa));
+  for (int i = iFirstIsa; i >= cpu::ISA_BASELINE; --i)
+  {
+    const cpu::IsaLevel eIsa = static_cast<cpu::IsaLevel>(i);
+    const std::string sPath = (boost::filesystem::path(sDirectory) / getVideoCodecPluginFilename(sCodec, eIsa)).string();
+    if (!boost::filesystem::exists(sPath)) continue;
+
+    std::string sError;
+    void* pHandle = openLibrary(sPath, sError);
+    if (!pHandle)
+    {
+      LOG(WARNING) << "Failed to load codec plugin " << sPath << ": " << sError;
+      continue;
+    }
+    GetApiVersion getApiVersion = reinterpret_cast<GetApiVersion>(findSymbol(pHandle, "getVideoCodecPluginApiVersion"));
+    CreateVideoCodecTransform create = reinterpret_cast<CreateVideoCodecTransform>(findSymbol(pHandle, "createVideoCodecTransform"));
+    if (!getApiVersion || !create)
+    {
+      LOG(WARNING) << "Not a codec plugin: " << sPath;
+      continue;
+    }
+    if (getApiVersion() != VIDEO_CODEC_PLUGIN_API_VERSION)
+    {
+      LOG(WARNING) << "Codec plugin " << sPath << " has API version " << getApiVersion() << " expected " << VIDEO_CODEC_PLUGIN_API_VERSION;
+      continue;
+    }
+    std::unique_ptr<IVideoCodecTransform> pCodec(create(sFormat.c_str()));
+    if (!pCodec)
+    {
+      LOG(WARNING) << "Codec plugin " << sPath << " does not support " << sFormat;
+      ec = boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+      return pCodec;
+    }
+    LOG(INFO) << "Loaded codec plugin " << sPath << " (" << cpu::getName(eIsa) << " build, CPU supports "
+              << cpu::getName(eCpuIsa) << ")";
+    ec = boost::system::error_code();
+    return pCodec;
+  }
+  LOG(WARNING) << "No loadable " << getVideoCodecPluginFilename(sCodec, cpu::ISA_BASELINE) << " build up to "
+               << cpu::getName(static_cast<cpu::IsaLevel>(iFirstIsa)) << " in " << sDirectory;
+  ec = boost::system::error_code(boost::system::errc::no_such_file_or_directory, boost::system::generic_category());
+  return std::unique_ptr<IVideoCodecTransform>();
+}
+
+} // media
+} // rtp_plus_plus
@@ -0,0 +1,575 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <rtp++/media/h264/H264SliceHeaderParser.h>
+#include <algorithm>
+#include <rtp++/media/EmulationPrevention.h>
+#include <rtp++/media/h264/H264NalUnitTypes.h>
+
+namespace rtp_plus_plus {
+namespace media {
+namespace h264 {
+
+// slice headers up to slice_qp_delta almost always fit: the remainder of the NAL unit is only converted if they don't
+static const size_t MAX_SLICE_HEADER_BYTES = 128;
+
+static bool hasChromaFormatIdc(uint32_t uiProfileIdc)
+{
+  switch (uiProfileIdc)
+  {
+    case 100: case 110: case 122: case 244: case 44: case 83:
+    case 86: case 118: case 128: case 138: case 139: case 134: case 135:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static void skipScalingList(IBitStream& in, uint32_t uiSize)
+{
+  int32_t iLastScale = 8;
+  int32_t iNextScale = 8;
+  for (uint32_t j = 0; j < uiSize; ++j)
+  {
+    if (iNextScale != 0)
+    {
+      int32_t iDeltaScale = in.readSE();
+      iNextScale = (iLastScale + iDeltaScale + 256) % 256;
+    }
+    iLastScale = (iNextScale == 0) ? iLastScale : iNextScale;
+  }
+}
+
+static uint32_t ceilLog2(uint32_t uiValue)
+{
+  uint32_t uiBits = 0;
+  while ((1u << uiBits) < uiValue) ++uiBits;
+  return uiBits;
+}
+
+static SliceType toSliceType(uint32_t uiSliceType)
+{
+  switch (uiSliceType % 5)
+  {
+    case 0: return ST_P;
+    case 1: return ST_B;
+    case 2: return ST_I;
+    case 3: return ST_SP;
+    default: return ST_SI;
+  }
+}
+
+H264SliceHeaderParser::H264SliceHeaderParser()
+  :m_iPrevPicOrderCntMsb(0),
+  m_iPrevPicOrderCntLsb(0),
+  m_uiPrevFrameNumOffset(0),
+  m_uiPrevFrameNum(0),
+  m_bHaveCurrentPicture(false)
+{
+
+}
+
+bool H264SliceHeaderParser::parseNalUnit(const uint8_t* pNalUnit, size_t uiSize, SliceHeaderInfo& info)
+{
+  if (uiSize < 2) return false;
+  uint32_t uiNalRefIdc = (pNalUnit[0] >> 5) & 0x03;
+  NalUnitType eType = getNalUnitType(pNalUnit[0]);
+  switch (eType)
+  {
+    case NUT_SEQUENCE_PARAMETER_SET:
+    {
+      IBitStream in(toRbsp(pNalUnit + 1, uiSize - 1, uiSize - 1));
+      parseSps(in);
+      return false;
+    }
+    case NUT_PICTURE_PARAMETER_SET:
+    {
+      IBitStream in(toRbsp(pNalUnit + 1, uiSize - 1, uiSize - 1));
+      parsePps(in);
+      return false;
+    }
+    case NUT_CODED_SLICE_OF_A_NON_IDR_PICTURE:
+    case NUT_CODED_SLICE_OF_AN_IDR_PICTURE:
+    {
+      bool bMmco5 = false;
+      IBitStream in(toRbsp(pNalUnit + 1, uiSize - 1, MAX_SLICE_HEADER_BYTES));
+      if (parseSliceHeader(in, uiNalRefIdc, eType, info, bMmco5))
+        return true;
+      if (uiSize - 1 <= MAX_SLICE_HEADER_BYTES)
+        return false;
+      // very long slice header: retry with the complete NAL unit
+      IBitStream full(toRbsp(pNalUnit + 1, uiSize - 1, uiSize - 1));
+      bMmco5 = false;
+      return parseSliceHeader(full, uiNalRefIdc, eType, info, bMmco5);
+    }
+    default:
+    {
+      return false;
+    }
+  }
+}
+
+uint32_t H264SliceHeaderParser::parseAccessUnit(const std::vector<MediaSample>& accessUnit, SliceHeaderInfo& info, double& dAverageQp, size_t uiFirst)
+{
+  uint32_t uiSlices = 0;
+  int32_t iQpSum = 0;
+  for (size_t i = uiFirst; i < accessUnit.size(); ++i)
+  {
+    const MediaSample& mediaSample = accessUnit[i];
+    const uint8_t* pNalUnit = mediaSample.getDataBuffer().data();
+    size_t uiSize = mediaSample.getPayloadSize();
+    // skip a three or four byte start code
+    size_t uiOffset = 0;
+    while (uiOffset < uiSize && uiOffset < 3 && pNalUnit[uiOffset] == 0) ++uiOffset;
+    if (uiOffset >= 2 && uiOffset < uiSize && pNalUnit[uiOffset] == 1)
+    {
+      pNalUnit += uiOffset + 1;
+      uiSize -= uiOffset + 1;
+    }
+    SliceHeaderInfo slice;
+    if (parseNalUnit(pNalUnit, uiSize, slice))
+    {
+      if (uiSlices == 0) info = slice;
+      iQpSum += slice.SliceQp;
+      ++uiSlices;
+    }
+  }
+  if (uiSlices > 0)
+    dAverageQp = iQpSum / static_cast<double>(uiSlices);
+  return uiSlices;
+}
+
+Buffer H264SliceHeaderParser::toRbsp(const uint8_t* pNalUnit, size_t uiSize, size_t uiMaxSize)
+{
+  size_t uiEbspSize = std::min(uiSize, uiMaxSize);
+  uint8_t* pRbsp = new uint8_t[uiEbspSize];
+  size_t uiRbspSize = removeEmulationPrevention(pNalUnit, uiEbspSize, pRbsp);
+  return Buffer(pRbsp, uiRbspSize);
+}
+
+bool H264SliceHeaderParser::parseSps(IBitStream& in)
+{
+  SequenceParameterSet sps;
+  sps.ProfileIdc = in.readBits(8);
+  // constraint flags and level_idc
+  in.readBits(16);
+  uint32_t uiSpsId = in.readUE();
+  sps.ChromaArrayType = 1;
+  sps.SeparateColourPlane = false;
+  if (hasChromaFormatIdc(sps.ProfileIdc))
+  {
+    uint32_t uiChromaFormatIdc = in.readUE();
+    if (uiChromaFormatIdc == 3)
+    {
+      sps.SeparateColourPlane = in.readFlag();
+    }
+    sps.ChromaArrayType = sps.SeparateColourPlane ? 0 : uiChromaFormatIdc;
+    // bit_depth_luma_minus8, bit_depth_chroma_minus8
+    in.readUE();
+    in.readUE();
+    // qpprime_y_zero_transform_bypass_flag
+    in.readFlag();
+    if (in.readFlag())
+    {
+      uint32_t uiLists = (uiChromaFormatIdc != 3) ? 8 : 12;
+      for (uint32_t i = 0; i < uiLists; ++i)
+      {
+        if (in.readFlag())
+          skipScalingList(in, i < 6 ? 16 : 64);
+      }
+    }
+  }
+  sps.Log2MaxFrameNum = in.readUE() + 4;
+  sps.PicOrderCntType = in.readUE();
+  sps.Log2MaxPicOrderCntLsb = 0;
+  sps.DeltaPicOrderAlwaysZero = false;
+  sps.OffsetForNonRefPic = 0;
+  sps.OffsetForTopToBottomField = 0;
+  if (sps.PicOrderCntType == 0)
+  {
+    sps.Log2MaxPicOrderCntLsb = in.readUE() + 4;
+  }
+  else if (sps.PicOrderCntType == 1)
+  {
+    sps.DeltaPicOrderAlwaysZero = in.readFlag();
+    sps.OffsetForNonRefPic = in.readSE();
+    sps.OffsetForTopToBottomField = in.readSE();
+    uint32_t uiCycle = in.readUE();
+    if (uiCycle > 255) return false;
+    for (uint32_t i = 0; i < uiCycle; ++i)
+      sps.OffsetForRefFrame.push_back(in.readSE());
+  }
+  // max_num_ref_frames, gaps_in_frame_num_value_allowed_flag
+  in.readUE();
+  in.readFlag();
+  sps.WidthInMbs = in.readUE() + 1;
+  sps.HeightInMapUnits = in.readUE() + 1;
+  sps.FrameMbsOnly = in.readFlag();
+
+  if (in.hasError() || uiSpsId > 31 || sps.Log2MaxFrameNum > 16 || sps.PicOrderCntType > 2 || sps.Log2MaxPicOrderCntLsb > 16)
+  {
+    LOG(WARNING) << "Invalid SPS";
+    return false;
+  }
+  m_mSps[uiSpsId] = sps;
+  return true;
+}
+
+bool H264SliceHeaderParser::parsePps(IBitStream& in)
+{
+  PictureParameterSet pps;
+  uint32_t uiPpsId = in.readUE();
+  pps.SpsId = in.readUE();
+  pps.EntropyCodingMode = in.readFlag();
+  pps.BottomFieldPicOrderInFramePresent = in.readFlag();
+  pps.NumSliceGroups = in.readUE() + 1;
+  pps.SliceGroupMapType = 0;
+  pps.SliceGroupChangeRate = 1;
+  if (pps.NumSliceGroups > 8)
+  {
+    LOG(WARNING) << "Invalid PPS";
+    return false;
+  }
+  if (pps.NumSliceGroups > 1)
+  {
+    pps.SliceGroupMapType = in.readUE();
+    if (pps.SliceGroupMapType == 0)
+    {
+      for (uint32_t i = 0; i < pps.NumSliceGroups; ++i)
+        in.readUE();
+    }
+    else if (pps.SliceGroupMapType == 2)
+    {
+      for (uint32_t i = 0; i < pps.NumSliceGroups - 1; ++i)
+      {
+        in.readUE();
+        in.readUE();
+      }
+    }
+    else if (pps.SliceGroupMapType >= 3 && pps.SliceGroupMapType <= 5)
+    {
+      in.readFlag();
+      pps.SliceGroupChangeRate = in.readUE() + 1;
+    }
+    else if (pps.SliceGroupMapType == 6)
+    {
+      uint32_t uiPicSizeInMapUnits = in.readUE() + 1;
+      uint32_t uiBits = ceilLog2(pps.NumSliceGroups);
+      for (uint32_t i = 0; i < uiPicSizeInMapUnits && !in.hasError(); ++i)
+        in.readBits(uiBits);
+    }
+  }
+  pps.NumRefIdxL0DefaultActive = in.readUE() + 1;
+  pps.NumRefIdxL1DefaultActive = in.readUE() + 1;
+  pps.WeightedPred = in.readFlag();
+  pps.WeightedBipredIdc = in.readBits(2);
+  pps.PicInitQp = 26 + in.readSE();
+  // pic_init_qs_minus26, chroma_qp_index_offset
+  in.readSE();
+  in.readSE();
+  pps.DeblockingFilterControlPresent = in.readFlag();
+  // constrained_intra_pred_flag
+  in.readFlag();
+  pps.RedundantPicCntPresent = in.readFlag();
+
+  if (in.hasError() || uiPpsId > 255 || pps.SpsId > 31)
+  {
+    LOG(WARNING) << "Invalid PPS";
+    return false;
+  }
+  m_mPps[uiPpsId] = pps;
+  return true;
+}
+
+static void skipRefPicListModification(IBitStream& in)
+{
+  if (in.readFlag())
+  {
+    uint32_t uiIdc = 0;
+    do
+    {
+      uiIdc = in.readUE();
+      if (uiIdc <= 2)
+        in.readUE();
+    } while (uiIdc != 3 && !in.hasError());
+  }
+}
+
+static void skipPredWeightTable(IBitStream& in, uint32_t uiChromaArrayType, uint32_t uiNumRefIdxActive)
+{
+  for (uint32_t i = 0; i < uiNumRefIdxActive && !in.hasError(); ++i)
+  {
+    if (in.readFlag())
+    {
+      in.readSE();
+      in.readSE();
+    }
+    if (uiChromaArrayType != 0 && in.readFlag())
+    {
+      for (uint32_t j = 0; j < 2; ++j)
+      {
+        in.readSE();
+        in.readSE();
+      }
+    }
+  }
+}
+
+bool H264SliceHeaderParser::parseSliceHeader(IBitStream& in, uint32_t uiNalRefIdc, uint32_t uiNalUnitType, SliceHeaderInfo& info, bool& bMmco5)
+{
+  bool bIdr = (uiNalUnitType == NUT_CODED_SLICE_OF_AN_IDR_PICTURE);
+  uint32_t uiFirstMbInSlice = in.readUE();
+  uint32_t uiSliceType = in.readUE();
+  uint32_t uiPpsId = in.readUE();
+  auto itPps = m_mPps.find(uiPpsId);
+  if (itPps == m_mPps.end())
+  {
+    VLOG(2) << "Slice refers to unknown PPS " << uiPpsId;
+    return false;
+  }
+  const PictureParameterSet& pps = itPps->second;
+  auto itSps = m_mSps.find(pps.SpsId);
+  if (itSps == m_mSps.end())
+  {
+    VLOG(2) << "PPS refers to unknown SPS " << pps.SpsId;
+    return false;
+  }
+  const SequenceParameterSet& sps = itSps->second;
+
+  SliceType eSliceType = toSliceType(uiSliceType);
+  if (sps.SeparateColourPlane)
+  {
+    // colour_plane_id
+    in.readBits(2);
+  }
+  uint32_t uiFrameNum = in.readBits(sps.Log2MaxFrameNum);
+  bool bFieldPic = false;
+  if (!sps.FrameMbsOnly)
+  {
+    bFieldPic = in.readFlag();
+    if (bFieldPic)
+    {
+      // bottom_field_flag
+      in.readFlag();
+    }
+  }
+  if (bIdr)
+  {
+    // idr_pic_id
+    in.readUE();
+  }
+  uint32_t uiPicOrderCntLsb = 0;
+  int32_t iDeltaPicOrderCntBottom = 0;
+  int32_t iDeltaPicOrderCnt0 = 0;
+  if (sps.PicOrderCntType == 0)
+  {
+    uiPicOrderCntLsb = in.readBits(sps.Log2MaxPicOrderCntLsb);
+    if (pps.BottomFieldPicOrderInFramePresent && !bFieldPic)
+      iDeltaPicOrderCntBottom = in.readSE();
+  }
+  if (sps.PicOrderCntType == 1 && !sps.DeltaPicOrderAlwaysZero)
+  {
+    iDeltaPicOrderCnt0 = in.readSE();
+    if (pps.BottomFieldPicOrderInFramePresent && !bFieldPic)
+      in.readSE();
+  }
+  if (pps.RedundantPicCntPresent)
+  {
+    // redundant_pic_cnt
+    in.readUE();
+  }
+  if (eSliceType == ST_B)
+  {
+    // direct_spatial_mv_pred_flag
+    in.readFlag();
+  }
+  uint32_t uiNumRefIdxL0Active = pps.NumRefIdxL0DefaultActive;
+  uint32_t uiNumRefIdxL1Active = pps.NumRefIdxL1DefaultActive;
+  if (eSliceType == ST_P || eSliceType == ST_SP || eSliceType == ST_B)
+  {
+    if (in.readFlag())
+    {
+      uiNumRefIdxL0Active = in.readUE() + 1;
+      if (eSliceType == ST_B)
+        uiNumRefIdxL1Active = in.readUE() + 1;
+    }
+  }
+  if (uiNumRefIdxL0Active > 32 || uiNumRefIdxL1Active > 32)
+  {
+    return false;
+  }
+  if (eSliceType != ST_I && eSliceType != ST_SI)
+  {
+    skipRefPicListModification(in);
+    if (eSliceType == ST_B)
+      skipRefPicListModification(in);
+  }
+  if ((pps.WeightedPred && (eSliceType == ST_P || eSliceType == ST_SP)) ||
+      (pps.WeightedBipredIdc == 1 && eSliceType == ST_B))
+  {
+    // luma_log2_weight_denom
+    in.readUE();
+    if (sps.ChromaArrayType != 0)
+      in.readUE();
+    skipPredWeightTable(in, sps.ChromaArrayType, uiNumRefIdxL0Active);
+    if (eSliceType == ST_B)
+      skipPredWeightTable(in, sps.ChromaArrayType, uiNumRefIdxL1Active);
+  }
+  if (uiNalRefIdc != 0)
+  {
+    // dec_ref_pic_marking
+    if (bIdr)
+    {
+      // no_output_of_prior_pics_flag, long_term_reference_flag
+      in.readBits(2);
+    }
+    else if (in.readFlag())
+    {
+      uint32_t uiMmco = 0;
+      do
+      {
+        uiMmco = in.readUE();
+        if (uiMmco == 1 || uiMmco == 3) in.readUE();
+        if (uiMmco == 2) in.readUE();
+        if (uiMmco == 3 || uiMmco == 6) in.readUE();
+        if (uiMmco == 4) in.readUE();
+        if (uiMmco == 5) bMmco5 = true;
+      } while (uiMmco != 0 && !in.hasError());
+    }
+  }
+  if (pps.EntropyCodingMode && eSliceType != ST_I && eSliceType != ST_SI)
+  {
+    // cabac_init_idc
+    in.readUE();
+  }
+  int32_t iSliceQpDelta = in.readSE();
+  if (in.hasError())
+  {
+    return false;
+  }
+
+  info = SliceHeaderInfo();
+  info.NalUnitType = uiNalUnitType;
+  info.Type = eSliceType;
+  info.FirstSliceInPicture = (uiFirstMbInSlice == 0);
+  info.Idr = bIdr;
+  info.Reference = (uiNalRefIdc != 0);
+  info.FrameNum = uiFrameNum;
+  info.SliceQpDelta = iSliceQpDelta;
+  info.SliceQp = pps.PicInitQp + iSliceQpDelta;
+
+  if (!info.FirstSliceInPicture && m_bHaveCurrentPicture && m_currentPicture.FrameNum == uiFrameNum)
+  {
+    // the state has already been updated for this picture
+    info.PicOrderCnt = m_currentPicture.PicOrderCnt;
+  }
+  else
+  {
+    derivePicOrderCnt(sps, uiNalRefIdc, bIdr, uiFrameNum, uiPicOrderCntLsb, iDeltaPicOrderCntBottom, iDeltaPicOrderCnt0, bMmco5, info);
+    m_currentPicture = info;
+    m_bHaveCurrentPicture = true;
+  }
+  return true;
+}
+
+void H264SliceHeaderParser::derivePicOrderCnt(const SequenceParameterSet& sps, uint32_t uiNalRefIdc, bool bIdr,
+                                              uint32_t uiFrameNum, uint32_t uiPicOrderCntLsb, int32_t iDeltaPicOrderCntBottom,
+                                              int32_t iDeltaPicOrderCnt0, bool bMmco5, SliceHeaderInfo& info)
+{
+  // frames only: the picture order count is the minimum of the top and bottom field order counts
+  if (sps.PicOrderCntType == 0)
+  {
+    if (bIdr)
+    {
+      m_iPrevPicOrderCntMsb = 0;
+      m_iPrevPicOrderCntLsb = 0;
+    }
+    int32_t iMaxPicOrderCntLsb = 1 << sps.Log2MaxPicOrderCntLsb;
+    int32_t iLsb = static_cast<int32_t>(uiPicOrderCntLsb);
+    int32_t iMsb = m_iPrevPicOrderCntMsb;
+    if (iLsb < m_iPrevPicOrderCntLsb && (m_iPrevPicOrderCntLsb - iLsb) >= iMaxPicOrderCntLsb / 2)
+      iMsb = m_iPrevPicOrderCntMsb + iMaxPicOrderCntLsb;
+    else if (iLsb > m_iPrevPicOrderCntLsb && (iLsb - m_iPrevPicOrderCntLsb) > iMaxPicOrderCntLsb / 2)
+      iMsb = m_iPrevPicOrderCntMsb - iMaxPicOrderCntLsb;
+    int32_t iTop = iMsb + iLsb;
+    info.PicOrderCnt = std::min(iTop, iTop + iDeltaPicOrderCntBottom);
+    if (uiNalRefIdc != 0)
+    {
+      if (bMmco5)
+      {
+        m_iPrevPicOrderCntMsb = 0;
+        m_iPrevPicOrderCntLsb = iTop - info.PicOrderCnt;
+      }
+      else
+      {
+        m_iPrevPicOrderCntMsb = iMsb;
+        m_iPrevPicOrderCntLsb = iLsb;
+      }
+    }
+  }
+  else
+  {
+    uint32_t uiMaxFrameNum = 1u << sps.Log2MaxFrameNum;
+    uint32_t uiFrameNumOffset = 0;
+    if (!bIdr)
+    {
+      uiFrameNumOffset = (m_uiPrevFrameNum > uiFrameNum) ? m_uiPrevFrameNumOffset + uiMaxFrameNum : m_uiPrevFrameNumOffset;
+    }
+    if (sps.PicOrderCntType == 1)
+    {
+      uint32_t uiCycle = static_cast<uint32_t>(sps.OffsetForRefFrame.size());
+      int64_t iAbsFrameNum = (uiCycle != 0) ? static_cast<int64_t>(uiFrameNumOffset) + uiFrameNum : 0;
+      if (uiNalRefIdc == 0 && iAbsFrameNum > 0)
+        --iAbsFrameNum;
+      int64_t iExpectedPicOrderCnt = 0;
+      if (iAbsFrameNum > 0)
+      {
+        int64_t iExpectedDeltaPerCycle = 0;
+        for (int32_t iOffset : sps.OffsetForRefFrame)
+          iExpectedDeltaPerCycle += iOffset;
+        int64_t iCycleCnt = (iAbsFrameNum - 1) / uiCycle;
+        int64_t iFrameNumInCycle = (iAbsFrameNum - 1) % uiCycle;
+        iExpectedPicOrderCnt = iCycleCnt * iExpectedDeltaPerCycle;
+        for (int64_t i = 0; i <= iFrameNumInCycle; ++i)
+          iExpectedPicOrderCnt += sps.OffsetForRefFrame[static_cast<size_t>(i)];
+      }
+      if (uiNalRefIdc == 0)
+        iExpectedPicOrderCnt += sps.OffsetForNonRefPic;
+      int32_t iTop = static_cast<int32_t>(iExpectedPicOrderCnt) + iDeltaPicOrderCnt0;
+      int32_t iBottom = iTop + sps.OffsetForTopToBottomField;
+      info.PicOrderCnt = std::min(iTop, iBottom);
+    }
+    else
+    {
+      if (bIdr)
+        info.PicOrderCnt = 0;
+      else if (uiNalRefIdc == 0)
+        info.PicOrderCnt = 2 * static_cast<int32_t>(uiFrameNumOffset + uiFrameNum) - 1;
+      else
+        info.PicOrderCnt = 2 * static_cast<int32_t>(uiFrameNumOffset + uiFrameNum);
+    }
+    m_uiPrevFrameNumOffset = bMmco5 ? 0 : uiFrameNumOffset;
+    m_uiPrevFrameNum = bMmco5 ? 0 : uiFrameNum;
+  }
+}
+
+} // h264
+} // media
+} // rtp_plus_plus
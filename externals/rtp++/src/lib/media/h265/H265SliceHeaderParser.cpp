@@ -0,0 +1,607 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <rtp++/media/h265/H265SliceHeaderParser.h>
+#include <algorithm>
+#include <rtp++/media/EmulationPrevention.h>
+#include <rtp++/media/h265/H265NalUnitTypes.h>
+
+namespace rtp_plus_plus {
+namespace media {
+namespace h265 {
+
+// slice segment headers up to slice_qp_delta almost always fit: the remainder of the NAL unit is only converted if they don't
+static const size_t MAX_SLICE_HEADER_BYTES = 256;
+
+static uint32_t ceilLog2(uint32_t uiValue)
+{
+  uint32_t uiBits = 0;
+  while ((1u << uiBits) < uiValue) ++uiBits;
+  return uiBits;
+}
+
+static void skipProfileTierLevel(IBitStream& in, uint32_t uiMaxSubLayersMinus1)
+{
+  // general profile space, tier, profile idc, compatibility flags, constraint flags and level idc
+  in.skipBits(96);
+  std::vector<bool> vProfilePresent(uiMaxSubLayersMinus1);
+  std::vector<bool> vLevelPresent(uiMaxSubLayersMinus1);
+  for (uint32_t i = 0; i < uiMaxSubLayersMinus1; ++i)
+  {
+    vProfilePresent[i] = in.readFlag();
+    vLevelPresent[i] = in.readFlag();
+  }
+  if (uiMaxSubLayersMinus1 > 0)
+  {
+    for (uint32_t i = uiMaxSubLayersMinus1; i < 8; ++i)
+      in.readBits(2);
+  }
+  for (uint32_t i = 0; i < uiMaxSubLayersMinus1; ++i)
+  {
+    if (vProfilePresent[i]) in.skipBits(88);
+    if (vLevelPresent[i]) in.skipBits(8);
+  }
+}
+
+static void skipScalingListData(IBitStream& in)
+{
+  for (uint32_t uiSizeId = 0; uiSizeId < 4; ++uiSizeId)
+  {
+    for (uint32_t uiMatrixId = 0; uiMatrixId < 6; uiMatrixId += (uiSizeId == 3) ? 3 : 1)
+    {
+      if (!in.readFlag())
+      {
+        // scaling_list_pred_matrix_id_delta
+        in.readUE();
+      }
+      else
+      {
+        uint32_t uiCoefNum = std::min(64u, 1u << (4 + (uiSizeId << 1)));
+        if (uiSizeId > 1)
+          in.readSE();
+        for (uint32_t i = 0; i < uiCoefNum; ++i)
+          in.readSE();
+      }
+    }
+  }
+}
+
+static SliceType toSliceType(uint32_t uiSliceType)
+{
+  switch (uiSliceType)
+  {
+    case 0: return ST_B;
+    case 1: return ST_P;
+    case 2: return ST_I;
+    default: return ST_UNKNOWN;
+  }
+}
+
+static bool isSubLayerNonReference(uint32_t uiNalUnitType)
+{
+  return uiNalUnitType <= NUT_RSV_VCL_N14 && (uiNalUnitType % 2) == 0;
+}
+
+H265SliceHeaderParser::H265SliceHeaderParser()
+  :m_iPrevTid0PicOrderCntMsb(0),
+  m_iPrevTid0PicOrderCntLsb(0),
+  m_bFirstPicture(true),
+  m_bHaveCurrentPicture(false)
+{
+
+}
+
+bool H265SliceHeaderParser::parseNalUnit(const uint8_t* pNalUnit, size_t uiSize, SliceHeaderInfo& info)
+{
+  if (uiSize < 3) return false;
+  uint32_t uiNalUnitType = (pNalUnit[0] >> 1) & 0x3F;
+  uint32_t uiLayerId = ((pNalUnit[0] & 0x01) << 5) | (pNalUnit[1] >> 3);
+  uint32_t uiTemporalId = (pNalUnit[1] & 0x07);
+  if (uiTemporalId == 0) return false;
+  --uiTemporalId;
+  // only the base layer is analysed
+  if (uiLayerId != 0) return false;
+
+  switch (uiNalUnitType)
+  {
+    case NUT_SPS:
+    {
+      IBitStream in(toRbsp(pNalUnit + 2, uiSize - 2, uiSize - 2));
+      parseSps(in);
+      return false;
+    }
+    case NUT_PPS:
+    {
+      IBitStream in(toRbsp(pNalUnit + 2, uiSize - 2, uiSize - 2));
+      parsePps(in);
+      return false;
+    }
+    case NUT_EOS:
+    {
+      m_bFirstPicture = true;
+      return false;
+    }
+    default:
+    {
+      // VCL NAL units: reserved types are skipped
+      if (uiNalUnitType > NUT_CRA || (uiNalUnitType >= NUT_RSV_VCL_N10 && uiNalUnitType <= NUT_RSV_VCL_R15))
+        return false;
+      IBitStream in(toRbsp(pNalUnit + 2, uiSize - 2, MAX_SLICE_HEADER_BYTES));
+      if (parseSliceSegmentHeader(in, uiNalUnitType, uiTemporalId, info))
+        return true;
+      if (uiSize - 2 <= MAX_SLICE_HEADER_BYTES)
+        return false;
+      // very long slice segment header: retry with the complete NAL unit
+      IBitStream full(toRbsp(pNalUnit + 2, uiSize - 2, uiSize - 2));
+      return parseSliceSegmentHeader(full, uiNalUnitType, uiTemporalId, info);
+    }
+  }
+}
+
+Buffer H265SliceHeaderParser::toRbsp(const uint8_t* pNalUnit, size_t uiSize, size_t uiMaxSize)
+{
+  size_t uiEbspSize = std::min(uiSize, uiMaxSize);
+  uint8_t* pRbsp = new uint8_t[uiEbspSize];
+  size_t uiRbspSize = removeEmulationPrevention(pNalUnit, uiEbspSize, pRbsp);
+  return Buffer(pRbsp, uiRbspSize);
+}
+
+bool H265SliceHeaderParser::parseShortTermRefPicSet(IBitStream& in, uint32_t uiIndex, const std::vector<ShortTermRefPicSet>& vSets, ShortTermRefPicSet& rps)
+{
+  bool bInterRefPicSetPrediction = (uiIndex != 0) ? in.readFlag() : false;
+  if (bInterRefPicSetPrediction)
+  {
+    uint32_t uiDeltaIdx = 1;
+    // the set in the slice header has index num_short_term_ref_pic_sets
+    if (uiIndex == vSets.size())
+      uiDeltaIdx = in.readUE() + 1;
+    if (uiDeltaIdx > uiIndex) return false;
+    // delta_rps_sign, abs_delta_rps_minus1
+    in.readFlag();
+    in.readUE();
+    const ShortTermRefPicSet& ref = vSets[uiIndex - uiDeltaIdx];
+    for (uint32_t j = 0; j <= ref.NumDeltaPocs; ++j)
+    {
+      bool bUsedByCurrPic = in.readFlag();
+      bool bUseDelta = bUsedByCurrPic ? true : in.readFlag();
+      if (bUseDelta) ++rps.NumDeltaPocs;
+      if (bUsedByCurrPic) ++rps.NumUsedByCurrPic;
+    }
+  }
+  else
+  {
+    uint32_t uiNumNegativePics = in.readUE();
+    uint32_t uiNumPositivePics = in.readUE();
+    if (uiNumNegativePics > 16 || uiNumPositivePics > 16) return false;
+    for (uint32_t i = 0; i < uiNumNegativePics + uiNumPositivePics; ++i)
+    {
+      // delta_poc_sX_minus1, used_by_curr_pic_sX_flag
+      in.readUE();
+      if (in.readFlag()) ++rps.NumUsedByCurrPic;
+    }
+    rps.NumDeltaPocs = uiNumNegativePics + uiNumPositivePics;
+  }
+  return !in.hasError();
+}
+
+bool H265SliceHeaderParser::parseSps(IBitStream& in)
+{
+  SequenceParameterSet sps;
+  // sps_video_parameter_set_id
+  in.readBits(4);
+  uint32_t uiMaxSubLayersMinus1 = in.readBits(3);
+  // sps_temporal_id_nesting_flag
+  in.readFlag();
+  skipProfileTierLevel(in, uiMaxSubLayersMinus1);
+  uint32_t uiSpsId = in.readUE();
+  uint32_t uiChromaFormatIdc = in.readUE();
+  sps.SeparateColourPlane = false;
+  if (uiChromaFormatIdc == 3)
+    sps.SeparateColourPlane = in.readFlag();
+  sps.ChromaArrayType = sps.SeparateColourPlane ? 0 : uiChromaFormatIdc;
+  uint32_t uiWidth = in.readUE();
+  uint32_t uiHeight = in.readUE();
+  if (in.readFlag())
+  {
+    // conformance window offsets
+    for (uint32_t i = 0; i < 4; ++i) in.readUE();
+  }
+  // bit_depth_luma_minus8, bit_depth_chroma_minus8
+  in.readUE();
+  in.readUE();
+  sps.Log2MaxPicOrderCntLsb = in.readUE() + 4;
+  bool bSubLayerOrderingInfoPresent = in.readFlag();
+  for (uint32_t i = bSubLayerOrderingInfoPresent ? 0 : uiMaxSubLayersMinus1; i <= uiMaxSubLayersMinus1; ++i)
+  {
+    in.readUE();
+    in.readUE();
+    in.readUE();
+  }
+  uint32_t uiLog2MinCbSize = in.readUE() + 3;
+  uint32_t uiLog2CtbSize = uiLog2MinCbSize + in.readUE();
+  // transform block sizes and hierarchy depths
+  for (uint32_t i = 0; i < 4; ++i) in.readUE();
+  if (in.readFlag())
+  {
+    // sps_scaling_list_data_present_flag
+    if (in.readFlag())
+      skipScalingListData(in);
+  }
+  // amp_enabled_flag
+  in.readFlag();
+  sps.SampleAdaptiveOffsetEnabled = in.readFlag();
+  if (in.readFlag())
+  {
+    // pcm sample bit depths, pcm coding block sizes, pcm_loop_filter_disabled_flag
+    in.readBits(8);
+    in.readUE();
+    in.readUE();
+    in.readFlag();
+  }
+  uint32_t uiNumShortTermRefPicSets = in.readUE();
+  if (uiNumShortTermRefPicSets > 64 || in.hasError() || uiLog2CtbSize > 6)
+  {
+    LOG(WARNING) << "Invalid SPS";
+    return false;
+  }
+  for (uint32_t i = 0; i < uiNumShortTermRefPicSets; ++i)
+  {
+    ShortTermRefPicSet rps;
+    if (!parseShortTermRefPicSet(in, i, sps.ShortTermRefPicSets, rps))
+    {
+      LOG(WARNING) << "Invalid short term reference picture set in SPS";
+      return false;
+    }
+    sps.ShortTermRefPicSets.push_back(rps);
+  }
+  sps.LongTermRefPicsPresent = in.readFlag();
+  sps.NumLongTermRefPicsSps = 0;
+  if (sps.LongTermRefPicsPresent)
+  {
+    sps.NumLongTermRefPicsSps = in.readUE();
+    if (sps.NumLongTermRefPicsSps > 32) return false;
+    for (uint32_t i = 0; i < sps.NumLongTermRefPicsSps; ++i)
+    {
+      in.readBits(sps.Log2MaxPicOrderCntLsb);
+      sps.UsedByCurrPicLtSps.push_back(in.readFlag());
+    }
+  }
+  sps.TemporalMvpEnabled = in.readFlag();
+
+  uint32_t uiCtbSize = 1u << uiLog2CtbSize;
+  sps.PicSizeInCtbsY = ((uiWidth + uiCtbSize - 1) >> uiLog2CtbSize) * ((uiHeight + uiCtbSize - 1) >> uiLog2CtbSize);
+  if (in.hasError() || uiSpsId > 15 || sps.Log2MaxPicOrderCntLsb > 16)
+  {
+    LOG(WARNING) << "Invalid SPS";
+    return false;
+  }
+  m_mSps[uiSpsId] = sps;
+  return true;
+}
+
+bool H265SliceHeaderParser::parsePps(IBitStream& in)
+{
+  PictureParameterSet pps;
+  uint32_t uiPpsId = in.readUE();
+  pps.SpsId = in.readUE();
+  pps.DependentSliceSegmentsEnabled = in.readFlag();
+  pps.OutputFlagPresent = in.readFlag();
+  pps.NumExtraSliceHeaderBits = in.readBits(3);
+  // sign_data_hiding_enabled_flag
+  in.readFlag();
+  pps.CabacInitPresent = in.readFlag();
+  pps.NumRefIdxL0DefaultActive = in.readUE() + 1;
+  pps.NumRefIdxL1DefaultActive = in.readUE() + 1;
+  pps.InitQp = 26 + in.readSE();
+  // constrained_intra_pred_flag, transform_skip_enabled_flag
+  in.readBits(2);
+  if (in.readFlag())
+  {
+    // diff_cu_qp_delta_depth
+    in.readUE();
+  }
+  // pps_cb_qp_offset, pps_cr_qp_offset
+  in.readSE();
+  in.readSE();
+  // pps_slice_chroma_qp_offsets_present_flag
+  in.readFlag();
+  pps.WeightedPred = in.readFlag();
+  pps.WeightedBipred = in.readFlag();
+  // transquant_bypass_enabled_flag
+  in.readFlag();
+  bool bTilesEnabled = in.readFlag();
+  // entropy_coding_sync_enabled_flag
+  in.readFlag();
+  if (bTilesEnabled)
+  {
+    uint32_t uiColumns = in.readUE() + 1;
+    uint32_t uiRows = in.readUE() + 1;
+    if (uiColumns > 64 || uiRows > 64) return false;
+    if (!in.readFlag())
+    {
+      for (uint32_t i = 0; i < uiColumns - 1; ++i) in.readUE();
+      for (uint32_t i = 0; i < uiRows - 1; ++i) in.readUE();
+    }
+    // loop_filter_across_tiles_enabled_flag
+    in.readFlag();
+  }
+  // pps_loop_filter_across_slices_enabled_flag
+  in.readFlag();
+  if (in.readFlag())
+  {
+    // deblocking_filter_override_enabled_flag
+    in.readFlag();
+    if (!in.readFlag())
+    {
+      in.readSE();
+      in.readSE();
+    }
+  }
+  if (in.readFlag())
+    skipScalingListData(in);
+  pps.ListsModificationPresent = in.readFlag();
+
+  if (in.hasError() || uiPpsId > 63 || pps.SpsId > 15)
+  {
+    LOG(WARNING) << "Invalid PPS";
+    return false;
+  }
+  m_mPps[uiPpsId] = pps;
+  return true;
+}
+
+static void skipPredWeightTable(IBitStream& in, uint32_t uiChromaArrayType, uint32_t uiNumRefIdxActive)
+{
+  std::vector<bool> vLuma(uiNumRefIdxActive);
+  std::vector<bool> vChroma(uiNumRefIdxActive, false);
+  for (uint32_t i = 0; i < uiNumRefIdxActive; ++i)
+    vLuma[i] = in.readFlag();
+  if (uiChromaArrayType != 0)
+  {
+    for (uint32_t i = 0; i < uiNumRefIdxActive; ++i)
+      vChroma[i] = in.readFlag();
+  }
+  for (uint32_t i = 0; i < uiNumRefIdxActive && !in.hasError(); ++i)
+  {
+    if (vLuma[i])
+    {
+      in.readSE();
+      in.readSE();
+    }
+    if (vChroma[i])
+    {
+      for (uint32_t j = 0; j < 2; ++j)
+      {
+        in.readSE();
+        in.readSE();
+      }
+    }
+  }
+}
+
+bool H265SliceHeaderParser::parseSliceSegmentHeader(IBitStream& in, uint32_t uiNalUnitType, uint32_t uiTemporalId, SliceHeaderInfo& info)
+{
+  bool bIrap = (uiNalUnitType >= NUT_BLA_W_LP && uiNalUnitType <= NUT_RSV_IRAP_VCL23);
+  bool bIdr = (uiNalUnitType == NUT_IDR_W_RADL || uiNalUnitType == NUT_IDR_N_LP);
+  bool bFirstSliceSegmentInPic = in.readFlag();
+  if (bIrap)
+  {
+    // no_output_of_prior_pics_flag
+    in.readFlag();
+  }
+  uint32_t uiPpsId = in.readUE();
+  auto itPps = m_mPps.find(uiPpsId);
+  if (itPps == m_mPps.end())
+  {
+    VLOG(2) << "Slice refers to unknown PPS " << uiPpsId;
+    return false;
+  }
+  const PictureParameterSet& pps = itPps->second;
+  auto itSps = m_mSps.find(pps.SpsId);
+  if (itSps == m_mSps.end())
+  {
+    VLOG(2) << "PPS refers to unknown SPS " << pps.SpsId;
+    return false;
+  }
+  const SequenceParameterSet& sps = itSps->second;
+
+  if (!bFirstSliceSegmentInPic)
+  {
+    bool bDependentSliceSegment = false;
+    if (pps.DependentSliceSegmentsEnabled)
+      bDependentSliceSegment = in.readFlag();
+    // slice_segment_address
+    in.readBits(ceilLog2(sps.PicSizeInCtbsY));
+    if (bDependentSliceSegment)
+    {
+      if (!m_bHaveCurrentPicture || in.hasError()) return false;
+      info = m_currentPicture;
+      info.FirstSliceInPicture = false;
+      return true;
+    }
+  }
+
+  in.readBits(pps.NumExtraSliceHeaderBits);
+  SliceType eSliceType = toSliceType(in.readUE());
+  if (pps.OutputFlagPresent)
+  {
+    // pic_output_flag
+    in.readFlag();
+  }
+  if (sps.SeparateColourPlane)
+  {
+    // colour_plane_id
+    in.readBits(2);
+  }
+  uint32_t uiPicOrderCntLsb = 0;
+  bool bTemporalMvpEnabled = false;
+  uint32_t uiNumPicTotalCurr = 0;
+  if (!bIdr)
+  {
+    uiPicOrderCntLsb = in.readBits(sps.Log2MaxPicOrderCntLsb);
+    ShortTermRefPicSet rps;
+    uint32_t uiNumSets = static_cast<uint32_t>(sps.ShortTermRefPicSets.size());
+    if (!in.readFlag())
+    {
+      if (!parseShortTermRefPicSet(in, uiNumSets, sps.ShortTermRefPicSets, rps))
+        return false;
+    }
+    else if (uiNumSets > 0)
+    {
+      uint32_t uiIdx = (uiNumSets > 1) ? in.readBits(ceilLog2(uiNumSets)) : 0;
+      if (uiIdx >= uiNumSets) return false;
+      rps = sps.ShortTermRefPicSets[uiIdx];
+    }
+    uiNumPicTotalCurr = rps.NumUsedByCurrPic;
+    if (sps.LongTermRefPicsPresent)
+    {
+      uint32_t uiNumLongTermSps = (sps.NumLongTermRefPicsSps > 0) ? in.readUE() : 0;
+      uint32_t uiNumLongTermPics = in.readUE();
+      if (uiNumLongTermSps > sps.NumLongTermRefPicsSps || uiNumLongTermPics > 32) return false;
+      for (uint32_t i = 0; i < uiNumLongTermSps + uiNumLongTermPics; ++i)
+      {
+        if (i < uiNumLongTermSps)
+        {
+          uint32_t uiLtIdx = (sps.NumLongTermRefPicsSps > 1) ? in.readBits(ceilLog2(sps.NumLongTermRefPicsSps)) : 0;
+          if (uiLtIdx < sps.UsedByCurrPicLtSps.size() && sps.UsedByCurrPicLtSps[uiLtIdx]) ++uiNumPicTotalCurr;
+        }
+        else
+        {
+          in.readBits(sps.Log2MaxPicOrderCntLsb);
+          if (in.readFlag()) ++uiNumPicTotalCurr;
+        }
+        // delta_poc_msb_present_flag
+        if (in.readFlag())
+          in.readUE();
+      }
+    }
+    if (sps.TemporalMvpEnabled)
+      bTemporalMvpEnabled = in.readFlag();
+  }
+  if (sps.SampleAdaptiveOffsetEnabled)
+  {
+    // slice_sao_luma_flag, slice_sao_chroma_flag
+    in.readFlag();
+    if (sps.ChromaArrayType != 0)
+      in.readFlag();
+  }
+  if (eSliceType == ST_P || eSliceType == ST_B)
+  {
+    uint32_t uiNumRefIdxL0Active = pps.NumRefIdxL0DefaultActive;
+    uint32_t uiNumRefIdxL1Active = (eSliceType == ST_B) ? pps.NumRefIdxL1DefaultActive : 0;
+    if (in.readFlag())
+    {
+      uiNumRefIdxL0Active = in.readUE() + 1;
+      if (eSliceType == ST_B)
+        uiNumRefIdxL1Active = in.readUE() + 1;
+    }
+    if (uiNumRefIdxL0Active > 16 || uiNumRefIdxL1Active > 16) return false;
+    if (pps.ListsModificationPresent && uiNumPicTotalCurr > 1)
+    {
+      uint32_t uiBits = ceilLog2(uiNumPicTotalCurr);
+      if (in.readFlag())
+        for (uint32_t i = 0; i < uiNumRefIdxL0Active; ++i) in.readBits(uiBits);
+      if (eSliceType == ST_B && in.readFlag())
+        for (uint32_t i = 0; i < uiNumRefIdxL1Active; ++i) in.readBits(uiBits);
+    }
+    if (eSliceType == ST_B)
+    {
+      // mvd_l1_zero_flag
+      in.readFlag();
+    }
+    if (pps.CabacInitPresent)
+    {
+      // cabac_init_flag
+      in.readFlag();
+    }
+    if (bTemporalMvpEnabled)
+    {
+      bool bCollocatedFromL0 = true;
+      if (eSliceType == ST_B)
+        bCollocatedFromL0 = in.readFlag();
+      if ((bCollocatedFromL0 && uiNumRefIdxL0Active > 1) || (!bCollocatedFromL0 && uiNumRefIdxL1Active > 1))
+        in.readUE();
+    }
+    if ((pps.WeightedPred && eSliceType == ST_P) || (pps.WeightedBipred && eSliceType == ST_B))
+    {
+      // luma_log2_weight_denom, delta_chroma_log2_weight_denom
+      in.readUE();
+      if (sps.ChromaArrayType != 0)
+        in.readSE();
+      skipPredWeightTable(in, sps.ChromaArrayType, uiNumRefIdxL0Active);
+      if (eSliceType == ST_B)
+        skipPredWeightTable(in, sps.ChromaArrayType, uiNumRefIdxL1Active);
+    }
+    // five_minus_max_num_merge_cand
+    in.readUE();
+  }
+  int32_t iSliceQpDelta = in.readSE();
+  if (in.hasError())
+  {
+    return false;
+  }
+
+  info = SliceHeaderInfo();
+  info.NalUnitType = uiNalUnitType;
+  info.Type = eSliceType;
+  info.FirstSliceInPicture = bFirstSliceSegmentInPic;
+  info.Idr = bIrap;
+  info.Reference = !isSubLayerNonReference(uiNalUnitType);
+  info.TemporalId = uiTemporalId;
+  info.SliceQpDelta = iSliceQpDelta;
+  info.SliceQp = pps.InitQp + iSliceQpDelta;
+
+  if (!bFirstSliceSegmentInPic && m_bHaveCurrentPicture)
+  {
+    info.PicOrderCnt = m_currentPicture.PicOrderCnt;
+  }
+  else
+  {
+    // 8.3.1: IDR and BLA pictures and the first picture after the start or an end of sequence have NoRaslOutputFlag = 1
+    bool bNoRaslOutputFlag = bIdr || (uiNalUnitType <= NUT_BLA_N_LD && uiNalUnitType >= NUT_BLA_W_LP) || m_bFirstPicture;
+    int32_t iMaxPicOrderCntLsb = 1 << sps.Log2MaxPicOrderCntLsb;
+    int32_t iLsb = static_cast<int32_t>(uiPicOrderCntLsb);
+    int32_t iMsb = 0;
+    if (!(bIrap && bNoRaslOutputFlag))
+    {
+      if (iLsb < m_iPrevTid0PicOrderCntLsb && (m_iPrevTid0PicOrderCntLsb - iLsb) >= iMaxPicOrderCntLsb / 2)
+        iMsb = m_iPrevTid0PicOrderCntMsb + iMaxPicOrderCntLsb;
+      else if (iLsb > m_iPrevTid0PicOrderCntLsb && (iLsb - m_iPrevTid0PicOrderCntLsb) > iMaxPicOrderCntLsb / 2)
+        iMsb = m_iPrevTid0PicOrderCntMsb - iMaxPicOrderCntLsb;
+      else
+        iMsb = m_iPrevTid0PicOrderCntMsb;
+    }
+    info.PicOrderCnt = iMsb + iLsb;
+    bool bRaslOrRadl = (uiNalUnitType >= NUT_RADL_N && uiNalUnitType <= NUT_RASL_R);
+    if (uiTemporalId == 0 && !bRaslOrRadl && !isSubLayerNonReference(uiNalUnitType))
+    {
+      m_iPrevTid0PicOrderCntMsb = iMsb;
+      m_iPrevTid0PicOrderCntLsb = iLsb;
+    }
+    m_bFirstPicture = false;
+    m_currentPicture = info;
+    m_bHaveCurrentPicture = true;
+  }
+  return true;
+}
+
+} // h265
+} // media
+} // rtp_plus_plus
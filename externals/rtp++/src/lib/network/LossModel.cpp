@@ -0,0 +1,137 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <rtp++/network/LossModel.h>
+#include <rtp++/util/Conversion.h>
+#include <rtp++/util/StringTokenizer.h>
+
+namespace rtp_plus_plus {
+namespace network {
+
+/**
+ * @brief returns the good to bad transition probability of the Gilbert-Elliott model for which
+ * the stationary loss rate is dLossRate when the mean sojourn time in the bad state is dMeanBurstLength
+ */
+static double deriveGoodToBadProbability(double dLossRate, double dMeanBurstLength, double dLossRateGood, double dLossRateBad)
+{
+  // stationary probability of the bad state: pi_b * h_b + (1 - pi_b) * h_g = loss rate
+  double dBadProbability = (dLossRate - dLossRateGood) / (dLossRateBad - dLossRateGood);
+  // the sojourn time in the bad state is geometric with mean 1/r
+  return (1.0 / dMeanBurstLength) * dBadProbability / (1.0 - dBadProbability);
+}
+
+std::unique_ptr<LossModel> LossModel::create(const std::string& sDescriptor, uint32_t uiSeed)
+{
+  std::vector<std::string> vParts = StringTokenizer::tokenize(sDescriptor, ":", true, true);
+  std::vector<double> vValues;
+  for (size_t i = 1; i < vParts.size(); ++i)
+  {
+    bool bSuccess = false;
+    vValues.push_back(convert<double>(vParts[i], bSuccess));
+    if (!bSuccess)
+    {
+      LOG(WARNING) << "Invalid loss model parameter: " << vParts[i];
+      return std::unique_ptr<LossModel>();
+    }
+  }
+
+  if (!vParts.empty() && vParts[0] == "bernoulli" && vValues.size() == 1 &&
+      vValues[0] >= 0.0 && vValues[0] <= 1.0)
+  {
+    return std::unique_ptr<LossModel>(new BernoulliLossModel(uiSeed, vValues[0]));
+  }
+  if (!vParts.empty() && vParts[0] == "ge" && (vValues.size() == 2 || vValues.size() == 4))
+  {
+    double dLossRateGood = vValues.size() == 4 ? vValues[2] : 0.0;
+    double dLossRateBad = vValues.size() == 4 ? vValues[3] : 1.0;
+    // the loss rate must be reachable from the per state loss rates
+    if (vValues[1] >= 1.0 && dLossRateGood >= 0.0 && dLossRateBad <= 1.0 &&
+        dLossRateGood <= vValues[0] && vValues[0] < dLossRateBad)
+    {
+      // short bursts can not add up to a high loss rate: the good state would have to be left
+      // with a probability above 1
+      double dGoodToBad = deriveGoodToBadProbability(vValues[0], vValues[1], dLossRateGood, dLossRateBad);
+      if (dGoodToBad > 1.0)
+      {
+        LOG(WARNING) << "Unreachable loss model: " << sDescriptor << " requires p(good to bad) " << dGoodToBad << " > 1";
+        return std::unique_ptr<LossModel>();
+      }
+      return std::unique_ptr<LossModel>(new GilbertElliottLossModel(uiSeed, vValues[0], vValues[1], dLossRateGood, dLossRateBad));
+    }
+  }
+  LOG(WARNING) << "Invalid loss model: " << sDescriptor;
+  return std::unique_ptr<LossModel>();
+}
+
+LossModel::LossModel(uint32_t uiSeed)
+  :m_generator(uiSeed),
+    m_uiPacketCount(0),
+    m_uiLossCount(0)
+{
+
+}
+
+LossModel::~LossModel()
+{
+
+}
+
+BernoulliLossModel::BernoulliLossModel(uint32_t uiSeed, double dLossRate)
+  :LossModel(uiSeed),
+    m_dLossRate(dLossRate)
+{
+  VLOG(2) << "Bernoulli loss model: loss rate " << dLossRate << " seed " << uiSeed;
+}
+
+bool BernoulliLossModel::nextLoss()
+{
+  return nextUniform() < m_dLossRate;
+}
+
+GilbertElliottLossModel::GilbertElliottLossModel(uint32_t uiSeed, double dLossRate, double dMeanBurstLength,
+                                                 double dLossRateGood, double dLossRateBad)
+  :LossModel(uiSeed),
+    m_dLossRateGood(dLossRateGood),
+    m_dLossRateBad(dLossRateBad),
+    m_bBad(false)
+{
+  m_dBadToGood = 1.0 / dMeanBurstLength;
+  m_dGoodToBad = deriveGoodToBadProbability(dLossRate, dMeanBurstLength, dLossRateGood, dLossRateBad);
+  VLOG(2) << "Gilbert-Elliott loss model: loss rate " << dLossRate << " mean burst " << dMeanBurstLength
+          << " p " << m_dGoodToBad << " r " << m_dBadToGood
+          << " h " << dLossRateGood << "/" << dLossRateBad << " seed " << uiSeed;
+}
+
+bool GilbertElliottLossModel::nextLoss()
+{
+  // state transition before each packet
+  if (m_bBad)
+  {
+    if (nextUniform() < m_dBadToGood) m_bBad = false;
+  }
+  else
+  {
+    if (nextUniform() < m_dGoodToBad) m_bBad = true;
+  }
+  return nextUniform() < (m_bBad ? m_dLossRateBad : m_dLossRateGood);
+}
+
+} // network
+} // rtp_plus_plus
@@ -0,0 +1,110 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <boost/asio/buffer.hpp>
+#include <rtp++/network/RtpPacketSink.h>
+#include <rtp++/util/Conversion.h>
+#include <rtp++/util/StringTokenizer.h>
+
+namespace rtp_plus_plus {
+namespace network {
+
+std::unique_ptr<RtpPacketSink> RtpPacketSink::create(const std::string& sDescriptor)
+{
+  if (sDescriptor == "null")
+  {
+    return std::unique_ptr<RtpPacketSink>(new RtpPacketSink());
+  }
+  std::vector<std::string> vParts = StringTokenizer::tokenize(sDescriptor, ":");
+  if (vParts.size() == 3 && vParts[0] == "udp")
+  {
+    bool bSuccess = false;
+    uint16_t uiPort = convert<uint16_t>(vParts[2], bSuccess);
+    if (bSuccess)
+    {
+      try
+      {
+        return std::unique_ptr<RtpPacketSink>(new UdpRtpPacketSink(vParts[1], uiPort));
+      }
+      catch (boost::system::system_error& e)
+      {
+        LOG(WARNING) << "Failed to create UDP RTP sink " << sDescriptor << ": " << e.what();
+        return std::unique_ptr<RtpPacketSink>();
+      }
+    }
+  }
+  LOG(WARNING) << "Invalid RTP sink: " << sDescriptor;
+  return std::unique_ptr<RtpPacketSink>();
+}
+
+RtpPacketSink::RtpPacketSink()
+  :m_uiPacketCount(0),
+    m_uiByteCount(0),
+    m_uiHeaderByteCount(0)
+{
+
+}
+
+RtpPacketSink::~RtpPacketSink()
+{
+
+}
+
+void RtpPacketSink::send(const std::vector<RtpPacket>& packets)
+{
+  for (const RtpPacket& packet : packets)
+  {
+    doSend(packet);
+    ++m_uiPacketCount;
+    m_uiByteCount += packet.getSize();
+    m_uiHeaderByteCount += packet.getHeaderSize();
+  }
+}
+
+UdpRtpPacketSink::UdpRtpPacketSink(const std::string& sHost, uint16_t uiPort)
+  :m_socket(m_ioService),
+    m_bSendFailed(false)
+{
+  boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::address::from_string(sHost), uiPort);
+  m_socket.open(endpoint.protocol());
+  m_socket.connect(endpoint);
+  m_vBuffers.reserve(RtpPacket::MAX_SEGMENTS);
+  VLOG(2) << "Sending RTP to " << sHost << ":" << uiPort;
+}
+
+void UdpRtpPacketSink::doSend(const RtpPacket& packet)
+{
+  m_vBuffers.clear();
+  for (uint32_t i = 0; i < packet.getSegmentCount(); ++i)
+  {
+    m_vBuffers.push_back(boost::asio::buffer(packet.getSegmentData(i), packet.getSegmentSize(i)));
+  }
+  boost::system::error_code ec;
+  m_socket.send(m_vBuffers, 0, ec);
+  if (ec && !m_bSendFailed)
+  {
+    // e.g. ICMP port unreachable on loopback without a receiver
+    LOG(WARNING) << "Failed to send RTP packet: " << ec.message();
+    m_bSendFailed = true;
+  }
+}
+
+} // network
+} // rtp_plus_plus
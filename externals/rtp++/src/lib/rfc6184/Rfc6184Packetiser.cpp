@@ -0,0 +1,61 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <algorithm>
+#include <rtp++/rfc6184/Rfc6184Packetiser.h>
+
+namespace rtp_plus_plus {
+namespace rfc6184 {
+
+Rfc6184Packetiser::Rfc6184Packetiser(uint32_t uiMaxPacketSize, uint8_t uiPayloadType, uint32_t uiSsrc, uint16_t uiSequenceNumber)
+  :NalUnitPacketiser(uiMaxPacketSize, uiPayloadType, uiSsrc, uiSequenceNumber)
+{
+
+}
+
+void Rfc6184Packetiser::writeAggregationHeader(uint8_t* pHeader, const NalUnit* pNalUnits, uint32_t uiCount) const
+{
+  // F is the OR and NRI the maximum of the aggregated NAL units
+  uint8_t uiF = 0;
+  uint8_t uiNri = 0;
+  for (uint32_t i = 0; i < uiCount; ++i)
+  {
+    uiF |= pNalUnits[i].Data[0] & 0x80;
+    uiNri = std::max<uint8_t>(uiNri, pNalUnits[i].Data[0] & 0x60);
+  }
+  pHeader[0] = uiF | uiNri | STAP_A;
+}
+
+void Rfc6184Packetiser::writeFragmentationHeader(uint8_t* pHeader, const uint8_t* pNalUnit, bool bStart, bool bEnd) const
+{
+  // FU indicator
+  pHeader[0] = (pNalUnit[0] & 0xE0) | FU_A;
+  // FU header
+  pHeader[1] = (bStart ? 0x80 : 0x00) | (bEnd ? 0x40 : 0x00) | (pNalUnit[0] & 0x1F);
+}
+
+void Rfc6184Packetiser::writeNalUnitHeader(uint8_t* pNalUnit, const uint8_t* pPayload) const
+{
+  // F and NRI from the FU indicator, type from the FU header
+  pNalUnit[0] = (pPayload[0] & 0xE0) | (pPayload[1] & 0x1F);
+}
+
+} // rfc6184
+} // rtp_plus_plus
@@ -0,0 +1,67 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <algorithm>
+#include <rtp++/rfchevc/RfchevcPacketiser.h>
+
+namespace rtp_plus_plus {
+namespace rfchevc {
+
+RfchevcPacketiser::RfchevcPacketiser(uint32_t uiMaxPacketSize, uint8_t uiPayloadType, uint32_t uiSsrc, uint16_t uiSequenceNumber)
+  :NalUnitPacketiser(uiMaxPacketSize, uiPayloadType, uiSsrc, uiSequenceNumber)
+{
+
+}
+
+void RfchevcPacketiser::writeAggregationHeader(uint8_t* pHeader, const NalUnit* pNalUnits, uint32_t uiCount) const
+{
+  // F is the OR, LayerId and TID the minimum of the aggregated NAL units
+  uint8_t uiF = 0;
+  uint8_t uiLayerId = 0x3F;
+  uint8_t uiTid = 0x07;
+  for (uint32_t i = 0; i < uiCount; ++i)
+  {
+    const uint8_t* pNalUnit = pNalUnits[i].Data;
+    uiF |= pNalUnit[0] & 0x80;
+    uiLayerId = std::min<uint8_t>(uiLayerId, ((pNalUnit[0] & 0x01) << 5) | (pNalUnit[1] >> 3));
+    uiTid = std::min<uint8_t>(uiTid, pNalUnit[1] & 0x07);
+  }
+  pHeader[0] = uiF | (AP << 1) | (uiLayerId >> 5);
+  pHeader[1] = ((uiLayerId & 0x1F) << 3) | uiTid;
+}
+
+void RfchevcPacketiser::writeFragmentationHeader(uint8_t* pHeader, const uint8_t* pNalUnit, bool bStart, bool bEnd) const
+{
+  // payload header: NAL unit header with the type replaced
+  pHeader[0] = (pNalUnit[0] & 0x81) | (FU << 1);
+  pHeader[1] = pNalUnit[1];
+  // FU header
+  pHeader[2] = (bStart ? 0x80 : 0x00) | (bEnd ? 0x40 : 0x00) | ((pNalUnit[0] >> 1) & 0x3F);
+}
+
+void RfchevcPacketiser::writeNalUnitHeader(uint8_t* pNalUnit, const uint8_t* pPayload) const
+{
+  // F, LayerId and TID from the payload header, type from the FU header
+  pNalUnit[0] = (pPayload[0] & 0x81) | ((pPayload[2] & 0x3F) << 1);
+  pNalUnit[1] = pPayload[1];
+}
+
+} // rfchevc
+} // rtp_plus_plus
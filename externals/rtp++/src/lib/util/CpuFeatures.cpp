@@ -0,0 +1,131 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <cstdint>
+#include <rtp++/util/CpuFeatures.h>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define RTP_PLUS_PLUS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace rtp_plus_plus {
+namespace cpu {
+
+const char* getName(IsaLevel eLevel)
+{
+  switch (eLevel)
+  {
+    case ISA_BASELINE: return "baseline";
+    case ISA_AVX2: return "avx2";
+    case ISA_AVX512: return "avx512";
+    default: return "unknown";
+  }
+}
+
+bool parseIsaLevel(const std::string& sName, IsaLevel& eLevel)
+{
+  for (int i = 0; i < ISA_COUNT; ++i)
+  {
+    if (sName == getName(static_cast<IsaLevel>(i)))
+    {
+      eLevel = static_cast<IsaLevel>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+#ifdef RTP_PLUS_PLUS_X86
+/**
+ * @brief cpuid returns EAX, EBX, ECX and EDX of leaf uiLeaf and sub-leaf uiSubLeaf
+ */
+static void cpuid(uint32_t uiLeaf, uint32_t uiSubLeaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuidex(info, static_cast<int>(uiLeaf), static_cast<int>(uiSubLeaf));
+  for (int i = 0; i < 4; ++i) regs[i] = static_cast<uint32_t>(info[i]);
+#else
+  __cpuid_count(uiLeaf, uiSubLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/**
+ * @brief xgetbv returns the XCR0 register: the register state saved by the OS
+ */
+static uint64_t xgetbv()
+{
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  uint32_t uiEax = 0, uiEdx = 0;
+  __asm__ volatile("xgetbv" : "=a"(uiEax), "=d"(uiEdx) : "c"(0));
+  return (static_cast<uint64_t>(uiEdx) << 32) | uiEax;
+#endif
+}
+
+static IsaLevel detectIsaLevel()
+{
+  uint32_t regs[4];
+  cpuid(0, 0, regs);
+  const uint32_t uiMaxLeaf = regs[0];
+  if (uiMaxLeaf < 7) return ISA_BASELINE;
+
+  cpuid(1, 0, regs);
+  const bool bOsXsave = (regs[2] & (1u << 27)) != 0;
+  const bool bAvx = (regs[2] & (1u << 28)) != 0;
+  const bool bFma = (regs[2] & (1u << 12)) != 0;
+  if (!bOsXsave || !bAvx || !bFma) return ISA_BASELINE;
+  // SSE and AVX state
+  const uint64_t uiXcr0 = xgetbv();
+  if ((uiXcr0 & 0x6) != 0x6) return ISA_BASELINE;
+
+  cpuid(7, 0, regs);
+  const uint32_t uiEbx = regs[1];
+  const bool bAvx2 = (uiEbx & (1u << 5)) != 0;
+  const bool bBmi2 = (uiEbx & (1u << 8)) != 0;
+  if (!bAvx2 || !bBmi2) return ISA_BASELINE;
+
+  const bool bAvx512 = (uiEbx & (1u << 16)) != 0 // F
+      && (uiEbx & (1u << 17)) != 0 // DQ
+      && (uiEbx & (1u << 30)) != 0 // BW
+      && (uiEbx & (1u << 31)) != 0; // VL
+  // opmask and upper ZMM state
+  if (bAvx512 && (uiXcr0 & 0xE6) == 0xE6) return ISA_AVX512;
+  return ISA_AVX2;
+}
+#endif
+
+IsaLevel getIsaLevel()
+{
+#ifdef RTP_PLUS_PLUS_X86
+  static const IsaLevel eLevel = detectIsaLevel();
+  return eLevel;
+#else
+  return ISA_BASELINE;
+#endif
+}
+
+} // cpu
+} // rtp_plus_plus
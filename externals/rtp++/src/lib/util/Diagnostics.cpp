@@ -0,0 +1,194 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <cstring>
+#include <sstream>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <rtp++/util/Diagnostics.h>
+
+namespace rtp_plus_plus {
+namespace diagnostics {
+
+static const char* const PLACEHOLDER = "{}";
+static const char* const LIST_PLACEHOLDER = "{*}";
+
+static void formatValue(std::ostream& ostr, const std::vector<const Record*>& chain, uint32_t uiIndex)
+{
+  const Record& record = *chain[uiIndex / Record::MAX_VALUES];
+  uiIndex %= Record::MAX_VALUES;
+  switch (record.Types[uiIndex])
+  {
+    case Record::VT_INT:
+      ostr << record.Values[uiIndex].Int;
+      break;
+    case Record::VT_UINT:
+      ostr << record.Values[uiIndex].UInt;
+      break;
+    case Record::VT_DOUBLE:
+      ostr << record.Values[uiIndex].Double;
+      break;
+  }
+}
+
+static uint32_t countTrailingPlaceholders(const char* szFormat)
+{
+  const char* szList = strstr(szFormat, LIST_PLACEHOLDER);
+  uint32_t uiTrailing = 0;
+  if (szList)
+  {
+    for (const char* p = strstr(szList, PLACEHOLDER); p; p = strstr(p + 2, PLACEHOLDER))
+      ++uiTrailing;
+  }
+  return uiTrailing;
+}
+
+std::string format(const Record& record)
+{
+  // values after the list belong to the placeholders following it
+  const char* szList = strstr(record.Format, LIST_PLACEHOLDER);
+  const uint32_t uiTrailing = countTrailingPlaceholders(record.Format);
+  // every record but the last of the chain is full
+  std::vector<const Record*> chain;
+  uint32_t uiCount = 0;
+  for (const Record* pRecord = &record; pRecord; pRecord = pRecord->Next)
+  {
+    chain.push_back(pRecord);
+    uiCount += pRecord->Count;
+  }
+
+  std::ostringstream ostr;
+  uint32_t uiIndex = 0;
+  const char* p = record.Format;
+  while (*p)
+  {
+    if (p == szList)
+    {
+      uint32_t uiListEnd = (uiCount > uiIndex + uiTrailing) ? uiCount - uiTrailing : uiIndex;
+      for (; uiIndex < uiListEnd; ++uiIndex)
+      {
+        ostr << " ";
+        formatValue(ostr, chain, uiIndex);
+      }
+      p += 3;
+    }
+    else if (p[0] == '{' && p[1] == '}')
+    {
+      if (uiIndex < uiCount)
+        formatValue(ostr, chain, uiIndex++);
+      else
+        ostr << "?";
+      p += 2;
+    }
+    else
+    {
+      ostr << *p++;
+    }
+  }
+  return ostr.str();
+}
+
+void freeContinuations(Record& record)
+{
+  Record* pNext = record.Next;
+  record.Next = 0;
+  while (pNext)
+  {
+    Record* pRecord = pNext;
+    pNext = pRecord->Next;
+    delete pRecord;
+  }
+}
+
+Drain& Drain::get()
+{
+  static Drain drain(DEFAULT_CAPACITY);
+  return drain;
+}
+
+Drain::Drain(size_t uiCapacity)
+  :m_ring(uiCapacity),
+    m_uiSubmitted(0),
+    m_uiWritten(0),
+    m_uiStalls(0),
+    m_bShutdown(false)
+{
+  m_drainThread = boost::thread(&Drain::drainInBackground, this);
+}
+
+Drain::~Drain()
+{
+  m_bShutdown.store(true);
+  m_drainThread.join();
+  uint64_t uiStalls = getStallCount();
+  if (uiStalls > 0)
+  {
+    LOG(WARNING) << "Diagnostics ring was full " << uiStalls << " times";
+  }
+}
+
+void Drain::submit(const Record& record)
+{
+  m_uiSubmitted.fetch_add(1, std::memory_order_relaxed);
+  if (!m_ring.tryPush(record))
+  {
+    m_uiStalls.fetch_add(1, std::memory_order_relaxed);
+    do
+    {
+      boost::this_thread::yield();
+    } while (!m_ring.tryPush(record));
+  }
+}
+
+void Drain::flush()
+{
+  uint64_t uiSubmitted = m_uiSubmitted.load();
+  while (m_uiWritten.load() < uiSubmitted)
+  {
+    boost::this_thread::sleep(boost::posix_time::microseconds(100));
+  }
+}
+
+void Drain::drainInBackground()
+{
+  Record record;
+  while (true)
+  {
+    if (m_ring.tryPop(record))
+    {
+      google::LogMessage(record.File, record.Line).stream() << format(record);
+      freeContinuations(record);
+      m_uiWritten.fetch_add(1);
+    }
+    else if (m_bShutdown.load())
+    {
+      // producers have stopped: the ring is empty
+      break;
+    }
+    else
+    {
+      // polling keeps producers free of any wake-up system call
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+  }
+}
+
+} // diagnostics
+} // rtp_plus_plus
@@ -0,0 +1,191 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <rtp++/util/MemoryUsage.h>
+
+namespace rtp_plus_plus {
+namespace memory {
+
+/**
+ * @brief The allocation counts of one thread: only the owning thread writes them so that counting
+ * needs no atomic read-modify-write. Readers sum the counts of all threads.
+ */
+struct alignas(64) ThreadAllocationCounts
+{
+  std::atomic<uint64_t> Allocations;
+  std::atomic<uint64_t> Frees;
+  std::atomic<uint64_t> AllocatedBytes;
+  std::atomic<uint64_t> FreedBytes;
+};
+
+// threads keep their slot after they exit so that their counts are not lost. Threads beyond
+// the last slot share it and count with atomic adds.
+static const uint32_t MAX_COUNTED_THREADS = 256;
+
+// zero initialised before any constructor runs: the hook may be called before main
+static std::atomic<bool> g_bCountingEnabled(false);
+static std::atomic<bool> g_bHookInstalled(false);
+static ThreadAllocationCounts g_threadCounts[MAX_COUNTED_THREADS];
+static std::atomic<uint32_t> g_uiThreads(0);
+// the slot of the calling thread: a trivial thread local needs no allocation
+static thread_local ThreadAllocationCounts* t_pCounts = nullptr;
+
+static inline void add(std::atomic<uint64_t>& count, uint64_t uiValue, bool bShared)
+{
+  if (bShared)
+    count.fetch_add(uiValue, std::memory_order_relaxed);
+  else
+    count.store(count.load(std::memory_order_relaxed) + uiValue, std::memory_order_relaxed);
+}
+
+/**
+ * @brief getThreadCounts returns the slot of the calling thread and if it is shared with other threads
+ */
+static inline ThreadAllocationCounts& getThreadCounts(bool& bShared)
+{
+  if (!t_pCounts)
+  {
+    uint32_t uiSlot = g_uiThreads.fetch_add(1, std::memory_order_relaxed);
+    t_pCounts = &g_threadCounts[std::min(uiSlot, MAX_COUNTED_THREADS - 1)];
+  }
+  bShared = (t_pCounts == &g_threadCounts[MAX_COUNTED_THREADS - 1]);
+  return *t_pCounts;
+}
+
+/**
+ * @brief reads the "<key>: <value> kB" lines of sFilename that are in keys
+ */
+static void readKbValues(const std::string& sFilename, const char* const keys[], int64_t* values[], size_t uiKeys)
+{
+  std::ifstream in(sFilename.c_str());
+  std::string sLine;
+  while (std::getline(in, sLine))
+  {
+    size_t uiColon = sLine.find(':');
+    if (uiColon == std::string::npos) continue;
+    const std::string sKey = sLine.substr(0, uiColon);
+    for (size_t i = 0; i < uiKeys; ++i)
+    {
+      if (sKey == keys[i])
+      {
+        std::istringstream value(sLine.substr(uiColon + 1));
+        int64_t iValue = 0;
+        if (value >> iValue) *values[i] = iValue;
+      }
+    }
+  }
+}
+
+MemorySnapshot getMemorySnapshot()
+{
+  MemorySnapshot snapshot;
+#ifdef __linux__
+  // smaps_rollup: Linux 4.14 and later
+  const char* const rollupKeys[] = { "Rss", "Pss", "Anonymous" };
+  int64_t* rollupValues[] = { &snapshot.RssKb, &snapshot.PssKb, &snapshot.AnonymousKb };
+  readKbValues("/proc/self/smaps_rollup", rollupKeys, rollupValues, 3);
+  int64_t iVmRssKb = -1;
+  const char* const statusKeys[] = { "VmRSS", "VmHWM" };
+  int64_t* statusValues[] = { &iVmRssKb, &snapshot.PeakRssKb };
+  readKbValues("/proc/self/status", statusKeys, statusValues, 2);
+  if (snapshot.RssKb == -1) snapshot.RssKb = iVmRssKb;
+#endif
+  return snapshot;
+}
+
+bool resetPeakRss()
+{
+#ifdef __linux__
+  // Linux 4.0 and later
+  std::ofstream out("/proc/self/clear_refs");
+  out << "5";
+  out.flush();
+  return out.good();
+#else
+  return false;
+#endif
+}
+
+AllocationCounts operator-(const AllocationCounts& end, const AllocationCounts& start)
+{
+  AllocationCounts delta;
+  delta.Allocations = end.Allocations - start.Allocations;
+  delta.Frees = end.Frees - start.Frees;
+  delta.AllocatedBytes = end.AllocatedBytes - start.AllocatedBytes;
+  delta.FreedBytes = end.FreedBytes - start.FreedBytes;
+  return delta;
+}
+
+void setAllocationCounting(bool bEnabled)
+{
+  g_bCountingEnabled.store(bEnabled, std::memory_order_relaxed);
+}
+
+bool isAllocationCountingEnabled()
+{
+  return g_bCountingEnabled.load(std::memory_order_relaxed);
+}
+
+bool isAllocationHookInstalled()
+{
+  return g_bHookInstalled.load(std::memory_order_relaxed);
+}
+
+AllocationCounts getAllocationCounts()
+{
+  AllocationCounts counts;
+  const uint32_t uiThreads = std::min(g_uiThreads.load(std::memory_order_relaxed), MAX_COUNTED_THREADS);
+  for (uint32_t i = 0; i < uiThreads; ++i)
+  {
+    counts.Allocations += g_threadCounts[i].Allocations.load(std::memory_order_relaxed);
+    counts.Frees += g_threadCounts[i].Frees.load(std::memory_order_relaxed);
+    counts.AllocatedBytes += g_threadCounts[i].AllocatedBytes.load(std::memory_order_relaxed);
+    counts.FreedBytes += g_threadCounts[i].FreedBytes.load(std::memory_order_relaxed);
+  }
+  return counts;
+}
+
+void onAllocate(size_t uiBytes)
+{
+  if (!g_bCountingEnabled.load(std::memory_order_relaxed)) return;
+  if (!g_bHookInstalled.load(std::memory_order_relaxed))
+    g_bHookInstalled.store(true, std::memory_order_relaxed);
+  bool bShared = false;
+  ThreadAllocationCounts& counts = getThreadCounts(bShared);
+  add(counts.Allocations, 1, bShared);
+  add(counts.AllocatedBytes, uiBytes, bShared);
+}
+
+void onFree(size_t uiBytes)
+{
+  if (!g_bCountingEnabled.load(std::memory_order_relaxed)) return;
+  bool bShared = false;
+  ThreadAllocationCounts& counts = getThreadCounts(bShared);
+  add(counts.Frees, 1, bShared);
+  add(counts.FreedBytes, uiBytes, bShared);
+}
+
+} // memory
+} // rtp_plus_plus
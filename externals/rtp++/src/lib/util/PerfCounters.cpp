@@ -0,0 +1,161 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <cerrno>
+#include <cstring>
+#include <glog/logging.h>
+#include <rtp++/util/PerfCounters.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace rtp_plus_plus {
+namespace perf {
+
+const char* getName(Counter eCounter)
+{
+  switch (eCounter)
+  {
+    case PC_CYCLES: return "cycles";
+    case PC_INSTRUCTIONS: return "instructions";
+    case PC_LLC_MISSES: return "llc-misses";
+    case PC_BRANCH_MISSES: return "branch-misses";
+    case PC_TASK_CLOCK: return "task-clock";
+    default: return "unknown";
+  }
+}
+
+CounterValues operator-(const CounterValues& end, const CounterValues& start)
+{
+  CounterValues delta;
+  for (int i = 0; i < PC_COUNT; ++i)
+  {
+    if (end.Values[i] != -1 && start.Values[i] != -1)
+      delta.Values[i] = end.Values[i] - start.Values[i];
+  }
+  return delta;
+}
+
+CounterTotals::CounterTotals()
+  :m_uiSamples(0)
+{
+  for (int i = 0; i < PC_COUNT; ++i) m_values.Values[i] = 0;
+}
+
+void CounterTotals::add(const CounterValues& delta)
+{
+  ++m_uiSamples;
+  for (int i = 0; i < PC_COUNT; ++i)
+  {
+    // a counter that is unavailable once stays unavailable
+    if (delta.Values[i] == -1 || m_values.Values[i] == -1)
+      m_values.Values[i] = -1;
+    else
+      m_values.Values[i] += delta.Values[i];
+  }
+}
+
+#ifdef __linux__
+static int openCounter(Counter eCounter, uint32_t uiType, uint64_t uiConfig, bool bInherit)
+{
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = uiType;
+  attr.config = uiConfig;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.inherit = bInherit ? 1 : 0;
+  // the enabled and running times scale the count if the PMU is multiplexed
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+  if (fd == -1)
+  {
+    LOG(WARNING) << "Counter " << getName(eCounter) << " is not available: " << strerror(errno);
+  }
+  return fd;
+}
+#endif
+
+PerfCounters::PerfCounters(bool bInherit)
+{
+  for (int i = 0; i < PC_COUNT; ++i) m_fds[i] = -1;
+#ifdef __linux__
+  m_fds[PC_CYCLES] = openCounter(PC_CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, bInherit);
+  m_fds[PC_INSTRUCTIONS] = openCounter(PC_INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, bInherit);
+  // the generic cache miss event is the last level cache on x86 and ARM
+  m_fds[PC_LLC_MISSES] = openCounter(PC_LLC_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, bInherit);
+  m_fds[PC_BRANCH_MISSES] = openCounter(PC_BRANCH_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, bInherit);
+  m_fds[PC_TASK_CLOCK] = openCounter(PC_TASK_CLOCK, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, bInherit);
+#else
+  (void)bInherit;
+  LOG(WARNING) << "Hardware performance counters are only supported on Linux";
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+  for (int i = 0; i < PC_COUNT; ++i)
+  {
+    if (m_fds[i] != -1) close(m_fds[i]);
+  }
+#endif
+}
+
+bool PerfCounters::isAvailable() const
+{
+  for (int i = 0; i < PC_COUNT; ++i)
+  {
+    if (m_fds[i] != -1) return true;
+  }
+  return false;
+}
+
+CounterValues PerfCounters::read() const
+{
+  CounterValues values;
+#ifdef __linux__
+  for (int i = 0; i < PC_COUNT; ++i)
+  {
+    if (m_fds[i] == -1) continue;
+    // value, time enabled, time running
+    uint64_t data[3];
+    if (::read(m_fds[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))) continue;
+    if (data[2] == 0)
+    {
+      // never scheduled on the PMU
+      values.Values[i] = 0;
+    }
+    else
+    {
+      values.Values[i] = data[2] < data[1]
+          ? static_cast<int64_t>(static_cast<double>(data[0]) * data[1] / data[2])
+          : static_cast<int64_t>(data[0]);
+    }
+  }
+#endif
+  return values;
+}
+
+} // perf
+} // rtp_plus_plus
@@ -0,0 +1,130 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <fstream>
+#include <glog/logging.h>
+#include <rtp++/util/Trace.h>
+
+namespace rtp_plus_plus {
+namespace trace {
+
+std::atomic<bool> Tracer::s_bEnabled(false);
+
+// the buffer of the calling thread: owned by the tracer
+static thread_local ThreadBuffer* t_pBuffer = nullptr;
+
+static void writeEscaped(std::ostream& ostr, const std::string& sValue)
+{
+  for (char c : sValue)
+  {
+    if (c == '"' || c == '\\') ostr << '\\';
+    ostr << c;
+  }
+}
+
+Tracer& Tracer::get()
+{
+  static Tracer tracer;
+  return tracer;
+}
+
+Tracer::Tracer()
+  :m_tStart(std::chrono::steady_clock::now()),
+    m_bStarted(false)
+{
+}
+
+void Tracer::start()
+{
+  boost::mutex::scoped_lock l(m_lock);
+  if (!m_bStarted)
+  {
+    m_tStart = std::chrono::steady_clock::now();
+    m_bStarted = true;
+  }
+  s_bEnabled.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::stop()
+{
+  s_bEnabled.store(false, std::memory_order_relaxed);
+}
+
+ThreadBuffer& Tracer::getBuffer()
+{
+  if (!t_pBuffer)
+  {
+    boost::mutex::scoped_lock l(m_lock);
+    m_vBuffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer(static_cast<uint32_t>(m_vBuffers.size() + 1))));
+    t_pBuffer = m_vBuffers.back().get();
+  }
+  return *t_pBuffer;
+}
+
+void Tracer::setThreadName(const std::string& sName)
+{
+  uint32_t uiThreadId = getBuffer().getThreadId();
+  boost::mutex::scoped_lock l(m_lock);
+  m_vThreadNames.push_back(std::make_pair(uiThreadId, sName));
+}
+
+bool Tracer::write(const std::string& sFilename)
+{
+  std::ofstream out(sFilename.c_str());
+  if (!out)
+  {
+    LOG(WARNING) << "Failed to open trace file " << sFilename;
+    return false;
+  }
+  boost::mutex::scoped_lock l(m_lock);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool bFirst = true;
+  for (auto& threadName : m_vThreadNames)
+  {
+    out << (bFirst ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadName.first << ",\"args\":{\"name\":\"";
+    writeEscaped(out, threadName.second);
+    out << "\"}}";
+    bFirst = false;
+  }
+  uint64_t uiEvents = 0;
+  uint64_t uiDropped = 0;
+  for (auto& pBuffer : m_vBuffers)
+  {
+    const size_t uiCount = pBuffer->getCount();
+    for (size_t i = 0; i < uiCount; ++i)
+    {
+      const Record& record = pBuffer->getRecord(i);
+      out << (bFirst ? "" : ",") << "\n{\"name\":\"";
+      writeEscaped(out, record.Name);
+      out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << pBuffer->getThreadId()
+          << ",\"ts\":" << record.StartUs << ",\"dur\":" << record.DurationUs << "}";
+      bFirst = false;
+    }
+    uiEvents += uiCount;
+    uiDropped += pBuffer->getDropped();
+  }
+  out << "\n]}\n";
+  LOG(INFO) << "Wrote " << uiEvents << " trace events of " << m_vBuffers.size() << " threads to " << sFilename
+            << " (" << uiDropped << " dropped)";
+  return static_cast<bool>(out);
+}
+
+} // trace
+} // rtp_plus_plus
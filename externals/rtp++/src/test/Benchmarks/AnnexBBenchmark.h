@@ -0,0 +1,230 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <rtp++/media/EmulationPrevention.h>
+#include <rtp++/media/MediaSample.h>
+#include <rtp++/media/NalUnitMediaSource.h>
+#include <rtp++/media/h264/H264AnnexBStreamParser.h>
+#include <rtp++/media/h264/H264AnnexBStreamWriter.h>
+#include <rtp++/media/h265/H265AnnexBStreamParser.h>
+#include <rtp++/media/h265/H265AnnexBStreamWriter.h>
+#include "Benchmark.h"
+
+namespace rtp_plus_plus {
+namespace benchmark {
+
+/**
+ * @brief Synthetic Annex B stream shared by the parser, source and writer benchmarks
+ */
+struct AnnexBFixture
+{
+  // the byte stream with start codes
+  std::string Stream;
+  // the same NAL units without start codes grouped into access units
+  std::vector<std::vector<media::MediaSample> > AccessUnits;
+  uint32_t NalUnits;
+  // sum of the NAL unit sizes without start codes
+  uint64_t NalUnitBytes;
+};
+
+inline void appendNalUnit(AnnexBFixture& fixture, const std::vector<uint8_t>& nalUnit, bool bLongStartCode)
+{
+  static const char startCode[4] = { 0, 0, 0, 1 };
+  fixture.Stream.append(bLongStartCode ? startCode : startCode + 1, bLongStartCode ? 4 : 3);
+  fixture.Stream.append(reinterpret_cast<const char*>(&nalUnit[0]), nalUnit.size());
+  uint8_t* pData = new uint8_t[nalUnit.size()];
+  memcpy(pData, &nalUnit[0], nalUnit.size());
+  media::MediaSample mediaSample;
+  mediaSample.setData(pData, static_cast<uint32_t>(nalUnit.size()));
+  fixture.AccessUnits.back().push_back(mediaSample);
+  ++fixture.NalUnits;
+  fixture.NalUnitBytes += nalUnit.size();
+}
+
+/**
+ * @brief creates a NAL unit of the given header followed by uiPayloadSize random bytes with
+ * emulation prevention applied. The first payload bit is set so that the slice is the first
+ * of its picture and the last byte carries the RBSP stop bit.
+ */
+inline std::vector<uint8_t> createNalUnit(const std::vector<uint8_t>& header, size_t uiPayloadSize)
+{
+  std::vector<uint8_t> rbsp(uiPayloadSize);
+  for (size_t i = 0; i < uiPayloadSize; ++i) rbsp[i] = static_cast<uint8_t>(rand());
+  rbsp[0] |= 0x80;
+  rbsp[uiPayloadSize - 1] = 0x80;
+  std::vector<uint8_t> nalUnit(header);
+  nalUnit.resize(header.size() + media::getMaxEbspSize(uiPayloadSize));
+  size_t uiSize = media::insertEmulationPrevention(&rbsp[0], uiPayloadSize, &nalUnit[header.size()]);
+  nalUnit.resize(header.size() + uiSize);
+  return nalUnit;
+}
+
+/**
+ * @brief creates uiFrames access units in the layout of a typical encoder output: an AUD per
+ * access unit, parameter sets and an IDR every 30 frames and P slices of varying size.
+ */
+inline AnnexBFixture createAnnexBFixture(bool bH265, uint32_t uiFrames)
+{
+  AnnexBFixture fixture;
+  fixture.NalUnits = 0;
+  fixture.NalUnitBytes = 0;
+  srand(bH265 ? 265 : 264);
+  // NAL unit headers: H.265 uses two bytes with nuh_temporal_id_plus1 = 1
+  typedef std::vector<uint8_t> Header;
+  const Header aud = bH265 ? Header{ 35 << 1, 1 } : Header{ 0x09 };
+  const Header idr = bH265 ? Header{ 19 << 1, 1 } : Header{ 0x65 };
+  const Header trail = bH265 ? Header{ 1 << 1, 1 } : Header{ 0x41 };
+  std::vector<Header> parameterSets;
+  if (bH265) parameterSets.push_back(Header{ 32 << 1, 1 });
+  parameterSets.push_back(bH265 ? Header{ 33 << 1, 1 } : Header{ 0x67 });
+  parameterSets.push_back(bH265 ? Header{ 34 << 1, 1 } : Header{ 0x68 });
+
+  for (uint32_t i = 0; i < uiFrames; ++i)
+  {
+    fixture.AccessUnits.push_back(std::vector<media::MediaSample>());
+    std::vector<uint8_t> audNalUnit(aud);
+    audNalUnit.push_back(bH265 ? 0x50 : 0xF0);
+    appendNalUnit(fixture, audNalUnit, true);
+    if (i % 30 == 0)
+    {
+      for (const Header& header : parameterSets)
+        appendNalUnit(fixture, createNalUnit(header, 8 + rand() % 16), true);
+      appendNalUnit(fixture, createNalUnit(idr, 40000 + rand() % 10000), false);
+    }
+    else
+    {
+      appendNalUnit(fixture, createNalUnit(trail, 1000 + rand() % 8000), false);
+    }
+  }
+  return fixture;
+}
+
+/**
+ * @brief extracts all NAL units from the stream and returns the sum of their sizes
+ */
+template <typename Parser>
+uint64_t parseAnnexBStream(const std::string& sStream)
+{
+  Parser parser;
+  const uint8_t* pData = reinterpret_cast<const uint8_t*>(sStream.data());
+  const uint32_t uiSize = static_cast<uint32_t>(sStream.size());
+  uint32_t uiOffset = 0;
+  uint64_t uiBytes = 0;
+  while (true)
+  {
+    int32_t iSampleSize = 0;
+    boost::optional<media::MediaSample> mediaSample = parser.extract(pData + uiOffset, uiSize - uiOffset, iSampleSize, false);
+    if (mediaSample) uiBytes += mediaSample->getPayloadSize();
+    if (iSampleSize <= 0) break;
+    uiOffset += iSampleSize;
+  }
+  for (const media::MediaSample& mediaSample : parser.flush())
+    uiBytes += mediaSample.getPayloadSize();
+  return uiBytes;
+}
+
+inline std::string getNullDevice()
+{
+#ifdef _WIN32
+  return "NUL";
+#else
+  return "/dev/null";
+#endif
+}
+
+/**
+ * @brief benchmarks the start code search of the stream parsers, NalUnitMediaSource indexing and
+ * reading and the Annex B writers on uiFrames synthetic access units per codec
+ */
+inline bool runAnnexBBenchmarks(uint32_t uiIterations, uint32_t uiFrames)
+{
+  bool bSuccess = true;
+  for (bool bH265 : { false, true })
+  {
+    AnnexBFixture fixture = createAnnexBFixture(bH265, uiFrames);
+    const std::string sCodec = bH265 ? "H265" : "H264";
+    const uint64_t uiStreamSize = fixture.Stream.size();
+
+    uint64_t uiParsed = runBenchmark(sCodec + "AnnexBStreamParser::extract", uiIterations, fixture.NalUnits, uiStreamSize, [&fixture, bH265]()
+    {
+      return bH265 ? parseAnnexBStream<media::h265::H265AnnexBStreamParser>(fixture.Stream)
+                   : parseAnnexBStream<media::h264::H264AnnexBStreamParser>(fixture.Stream);
+    });
+    if (uiParsed != fixture.NalUnitBytes * static_cast<uint64_t>(uiIterations))
+    {
+      std::cout << sCodec << " parser extracted " << uiParsed / std::max(uiIterations, 1u) << " bytes, expected " << fixture.NalUnitBytes << std::endl;
+      bSuccess = false;
+    }
+
+    // the source reads the stream from the start on every iteration
+    std::istringstream in(fixture.Stream);
+    const std::string& sMediaType = bH265 ? rfchevc::H265 : rfc6184::H264;
+    runBenchmark("NalUnitMediaSource " + sCodec + " index", uiIterations, fixture.NalUnits, uiStreamSize, [&in, &sMediaType]()
+    {
+      in.clear();
+      in.seekg(0, std::ios_base::beg);
+      media::NalUnitMediaSource source(in, sMediaType, false, 0);
+      return static_cast<uint64_t>(source.isGood());
+    });
+    uint64_t uiRead = runBenchmark("NalUnitMediaSource " + sCodec + " index+read", uiIterations, fixture.NalUnits, uiStreamSize, [&in, &sMediaType]()
+    {
+      in.clear();
+      in.seekg(0, std::ios_base::beg);
+      media::NalUnitMediaSource source(in, sMediaType, false, 0);
+      uint64_t uiBytes = 0;
+      while (source.isGood())
+      {
+        for (const media::MediaSample& mediaSample : source.getNextAccessUnit())
+          uiBytes += mediaSample.getPayloadSize();
+      }
+      return uiBytes;
+    });
+    if (uiRead != fixture.NalUnitBytes * static_cast<uint64_t>(uiIterations))
+    {
+      std::cout << "NalUnitMediaSource " << sCodec << " read " << uiRead / std::max(uiIterations, 1u) << " bytes, expected " << fixture.NalUnitBytes << std::endl;
+      bSuccess = false;
+    }
+
+    // the writers flush to the null device in the background: the destructor waits for the last write
+    runBenchmark(sCodec + "AnnexBStreamWriter::writeAu", uiIterations, fixture.NalUnits, uiStreamSize, [&fixture, bH265]()
+    {
+      std::unique_ptr<media::MediaSink> pWriter;
+      if (bH265)
+        pWriter.reset(new media::h265::H265AnnexBStreamWriter(getNullDevice(), false));
+      else
+        pWriter.reset(new media::h264::H264AnnexBStreamWriter(getNullDevice(), false));
+      for (const std::vector<media::MediaSample>& accessUnit : fixture.AccessUnits)
+        pWriter->writeAu(accessUnit);
+      pWriter->flush();
+      return pWriter->getBytesWritten();
+    });
+  }
+  return bSuccess;
+}
+
+} // benchmark
+} // rtp_plus_plus
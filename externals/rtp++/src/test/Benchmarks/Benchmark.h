@@ -0,0 +1,215 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace rtp_plus_plus {
+namespace benchmark {
+
+/**
+ * @brief Result of a single benchmark run
+ */
+struct BenchmarkResult
+{
+  std::string Name;
+  uint32_t Iterations;
+  // operations (fields, NAL units, frames, ...) per iteration
+  uint64_t Ops;
+  // bytes processed per iteration
+  uint64_t Bytes;
+  double NsPerOp;
+  // CPU time of the process per op: above NsPerOp when helper threads do part of the work
+  double CpuNsPerOp;
+  double GBps;
+  uint64_t Checksum;
+};
+
+/**
+ * @brief results of all benchmarks run so far in the order they were run
+ */
+inline std::vector<BenchmarkResult>& getResults()
+{
+  static std::vector<BenchmarkResult> results;
+  return results;
+}
+
+/**
+ * @brief returns the CPU time used by all threads of the process in ns
+ */
+inline double getProcessCpuNs()
+{
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+    return 0.0;
+  ULARGE_INTEGER uiKernel, uiUser;
+  uiKernel.LowPart = kernel.dwLowDateTime;
+  uiKernel.HighPart = kernel.dwHighDateTime;
+  uiUser.LowPart = user.dwLowDateTime;
+  uiUser.HighPart = user.dwHighDateTime;
+  // 100 ns units
+  return static_cast<double>(uiKernel.QuadPart + uiUser.QuadPart) * 100.0;
+#else
+  timespec ts;
+  if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0)
+    return 0.0;
+  return static_cast<double>(ts.tv_sec) * 1e9 + ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief runs fRun once to warm up and then uiIterations times, prints ns per op and GB/s
+ * and records the result. fRun returns a checksum that keeps the work from being optimised away.
+ */
+template <typename F>
+uint64_t runBenchmark(const std::string& sName, uint32_t uiIterations, uint64_t uiOps, uint64_t uiBytes, F fRun)
+{
+  fRun();
+  uint64_t uiChecksum = 0;
+  const double dCpuStart = getProcessCpuNs();
+  auto start = std::chrono::high_resolution_clock::now();
+  for (uint32_t i = 0; i < uiIterations; ++i)
+  {
+    uiChecksum += fRun();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  const double dCpuNs = getProcessCpuNs() - dCpuStart;
+  double dNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+  BenchmarkResult result;
+  result.Name = sName;
+  result.Iterations = uiIterations;
+  result.Ops = uiOps;
+  result.Bytes = uiBytes;
+  result.NsPerOp = dNs / (static_cast<double>(uiIterations) * uiOps);
+  result.CpuNsPerOp = dCpuNs / (static_cast<double>(uiIterations) * uiOps);
+  result.GBps = static_cast<double>(uiBytes) * uiIterations / dNs;
+  result.Checksum = uiChecksum;
+  getResults().push_back(result);
+
+  std::cout << std::left << std::setw(36) << sName
+            << std::right << std::fixed << std::setprecision(2)
+            << std::setw(12) << result.NsPerOp << " ns/op "
+            << std::setprecision(3)
+            << std::setw(8) << result.GBps << " GB/s"
+            << "  checksum " << uiChecksum << std::endl;
+  return uiChecksum;
+}
+
+/**
+ * @brief returns the CPU model from /proc/cpuinfo or an empty string
+ */
+inline std::string getCpuModel()
+{
+  std::ifstream in("/proc/cpuinfo");
+  std::string sLine;
+  while (std::getline(in, sLine))
+  {
+    if (sLine.compare(0, 10, "model name") == 0)
+    {
+      size_t uiPos = sLine.find(':');
+      if (uiPos != std::string::npos && uiPos + 2 <= sLine.size())
+        return sLine.substr(uiPos + 2);
+    }
+  }
+  return "";
+}
+
+inline void writeJsonString(std::ostream& out, const std::string& sValue)
+{
+  out << '"';
+  for (char c : sValue)
+  {
+    if (c == '"' || c == '\\') out << '\\';
+    out << c;
+  }
+  out << '"';
+}
+
+/**
+ * @brief writes the recorded results to sFilename. The layout follows the Google Benchmark
+ * JSON output so that its compare.py can diff two runs: real_time is the wall-clock time
+ * and cpu_time the process CPU time per op.
+ * @param sLabel identifies the run e.g. the commit
+ */
+inline bool writeJson(const std::string& sFilename, const std::string& sLabel)
+{
+  std::ofstream out(sFilename.c_str());
+  if (!out)
+  {
+    std::cout << "Failed to open " << sFilename << std::endl;
+    return false;
+  }
+  out << "{\n  \"context\": {\n    \"date\": ";
+  writeJsonString(out, boost::posix_time::to_iso_extended_string(boost::posix_time::second_clock::universal_time()));
+  out << ",\n    \"label\": ";
+  writeJsonString(out, sLabel);
+  out << ",\n    \"cpu_model\": ";
+  writeJsonString(out, getCpuModel());
+  out << ",\n    \"num_cpus\": " << std::thread::hardware_concurrency()
+      << ",\n    \"compiler\": ";
+#if defined(__VERSION__)
+  writeJsonString(out, __VERSION__);
+#else
+  writeJsonString(out, "");
+#endif
+  out << ",\n    \"library_build_type\": "
+#ifdef NDEBUG
+      << "\"release\""
+#else
+      << "\"debug\""
+#endif
+      << "\n  },\n  \"benchmarks\": [";
+  const std::vector<BenchmarkResult>& results = getResults();
+  out << std::setprecision(6);
+  for (size_t i = 0; i < results.size(); ++i)
+  {
+    const BenchmarkResult& result = results[i];
+    out << (i == 0 ? "" : ",") << "\n    {\"name\": ";
+    writeJsonString(out, result.Name);
+    out << ", \"run_type\": \"iteration\", \"iterations\": " << result.Iterations
+        << ", \"ops\": " << result.Ops
+        << ", \"bytes\": " << result.Bytes
+        << ", \"real_time\": " << result.NsPerOp
+        << ", \"cpu_time\": " << result.CpuNsPerOp
+        << ", \"time_unit\": \"ns\""
+        << ", \"bytes_per_second\": " << result.GBps * 1e9
+        << ", \"checksum\": " << result.Checksum << "}";
+  }
+  out << "\n  ]\n}\n";
+  return static_cast<bool>(out);
+}
+
+} // benchmark
+} // rtp_plus_plus
@@ -0,0 +1,145 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <rtp++/util/IBitStream.h>
+#include <rtp++/util/OBitStream.h>
+#include "Benchmark.h"
+#include "LegacyIBitStream.h"
+
+namespace rtp_plus_plus {
+namespace benchmark {
+
+/**
+ * @brief Bitstream generated once and shared by all reader benchmarks
+ */
+struct BitStreamFixture
+{
+  // random fixed length fields of 1 to 32 bits
+  Buffer FixedLength;
+  std::vector<uint32_t> FieldWidths;
+  // ue(v) codes with a distribution typical of slice headers
+  Buffer ExpGolomb;
+  uint32_t ExpGolombCount;
+};
+
+inline void writeUE(OBitStream& out, uint32_t uiValue)
+{
+  uint64_t uiCodeNum = static_cast<uint64_t>(uiValue) + 1;
+  uint32_t uiBits = 0;
+  while ((uiCodeNum >> uiBits) > 1) ++uiBits;
+  for (uint32_t i = 0; i < uiBits; ++i) out.write(0, 1);
+  out.write(1, 1);
+  if (uiBits > 0)
+    out.write(static_cast<uint32_t>(uiCodeNum & ((static_cast<uint64_t>(1) << uiBits) - 1)), uiBits);
+}
+
+inline BitStreamFixture createBitStreamFixture(uint32_t uiFields)
+{
+  BitStreamFixture fixture;
+  srand(42);
+  OBitStream fixed(uiFields * 4);
+  for (uint32_t i = 0; i < uiFields; ++i)
+  {
+    uint32_t uiBits = 1 + rand() % 32;
+    fixture.FieldWidths.push_back(uiBits);
+    fixed.write(static_cast<uint32_t>(rand()), uiBits);
+  }
+  fixture.FixedLength = fixed.data();
+
+  OBitStream golomb(uiFields * 4);
+  for (uint32_t i = 0; i < uiFields; ++i)
+  {
+    // mostly small values with the occasional large one
+    uint32_t uiValue = (rand() % 8 == 0) ? static_cast<uint32_t>(rand() % 100000) : static_cast<uint32_t>(rand() % 16);
+    writeUE(golomb, uiValue);
+  }
+  fixture.ExpGolomb = golomb.data();
+  fixture.ExpGolombCount = uiFields;
+  return fixture;
+}
+
+/**
+ * @brief compares LegacyIBitStream and IBitStream on fixed length and ue(v) fields
+ */
+inline bool runBitStreamBenchmarks(uint32_t uiIterations, uint32_t uiFields)
+{
+  BitStreamFixture fixture = createBitStreamFixture(uiFields);
+
+  uint64_t uiLegacy = runBenchmark("LegacyIBitStream::read", uiIterations, uiFields, fixture.FixedLength.getSize(), [&fixture]()
+  {
+    LegacyIBitStream in(fixture.FixedLength);
+    uint64_t uiSum = 0;
+    uint32_t uiValue = 0;
+    for (uint32_t uiBits : fixture.FieldWidths)
+    {
+      in.read(uiValue, uiBits);
+      uiSum += uiValue;
+    }
+    return uiSum;
+  });
+
+  uint64_t uiCached = runBenchmark("IBitStream::readBits", uiIterations, uiFields, fixture.FixedLength.getSize(), [&fixture]()
+  {
+    IBitStream in(fixture.FixedLength);
+    uint64_t uiSum = 0;
+    for (uint32_t uiBits : fixture.FieldWidths)
+    {
+      uiSum += in.readBits(uiBits);
+    }
+    return uiSum;
+  });
+
+  uint64_t uiLegacyUE = runBenchmark("LegacyIBitStream::readUE", uiIterations, fixture.ExpGolombCount, fixture.ExpGolomb.getSize(), [&fixture]()
+  {
+    LegacyIBitStream in(fixture.ExpGolomb);
+    uint64_t uiSum = 0;
+    uint32_t uiValue = 0;
+    for (uint32_t i = 0; i < fixture.ExpGolombCount; ++i)
+    {
+      in.readUE(uiValue);
+      uiSum += uiValue;
+    }
+    return uiSum;
+  });
+
+  uint64_t uiCachedUE = runBenchmark("IBitStream::readUE", uiIterations, fixture.ExpGolombCount, fixture.ExpGolomb.getSize(), [&fixture]()
+  {
+    IBitStream in(fixture.ExpGolomb);
+    uint64_t uiSum = 0;
+    for (uint32_t i = 0; i < fixture.ExpGolombCount; ++i)
+    {
+      uiSum += in.readUE();
+    }
+    return uiSum;
+  });
+
+  if (uiLegacy != uiCached || uiLegacyUE != uiCachedUE)
+  {
+    std::cout << "Checksum mismatch between bitstream readers" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // benchmark
+} // rtp_plus_plus
@@ -0,0 +1,85 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <string>
+#include <vector>
+#include <rtp++/media/MediaSample.h>
+#include <rtp++/util/Buffer.h>
+#include "Benchmark.h"
+
+namespace rtp_plus_plus {
+namespace benchmark {
+
+/**
+ * @brief benchmarks Buffer allocation at packet and frame sizes and the cost of sharing
+ * buffers and access units by reference count
+ */
+inline bool runBufferBenchmarks(uint32_t uiIterations)
+{
+  const uint32_t uiOps = 10000;
+  // an RTP payload and a 720p YUV 4:2:0 frame
+  for (size_t uiSize : { static_cast<size_t>(1400), static_cast<size_t>(1280 * 720 * 3 / 2) })
+  {
+    const uint32_t uiAllocations = uiSize > 65536 ? uiOps / 100 : uiOps;
+    runBenchmark("Buffer allocate " + std::to_string(uiSize) + " bytes", uiIterations, uiAllocations, 0, [uiSize, uiAllocations]()
+    {
+      uint64_t uiSum = 0;
+      for (uint32_t i = 0; i < uiAllocations; ++i)
+      {
+        Buffer buffer(new uint8_t[uiSize], uiSize);
+        // touch the buffer so that the allocation is not elided
+        buffer[0] = static_cast<uint8_t>(i);
+        uiSum += buffer.getSize() + buffer[0];
+      }
+      return uiSum;
+    });
+  }
+
+  Buffer source(new uint8_t[1400], 1400);
+  runBenchmark("Buffer copy", uiIterations, uiOps, 0, [&source, uiOps]()
+  {
+    uint64_t uiSum = 0;
+    for (uint32_t i = 0; i < uiOps; ++i)
+    {
+      Buffer copy(source);
+      uiSum += copy.getBuffer().use_count();
+    }
+    return uiSum;
+  });
+
+  // an access unit of an AUD, parameter sets and a slice
+  std::vector<media::MediaSample> accessUnit(4);
+  for (media::MediaSample& mediaSample : accessUnit)
+    mediaSample.setData(new uint8_t[64], 64);
+  runBenchmark("MediaSample access unit copy", uiIterations, uiOps, 0, [&accessUnit, uiOps]()
+  {
+    uint64_t uiSum = 0;
+    for (uint32_t i = 0; i < uiOps; ++i)
+    {
+      std::vector<media::MediaSample> copy(accessUnit);
+      uiSum += copy.size();
+    }
+    return uiSum;
+  });
+  return true;
+}
+
+} // benchmark
+} // rtp_plus_plus
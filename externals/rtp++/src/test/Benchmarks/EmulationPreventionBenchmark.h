@@ -0,0 +1,109 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <cstdlib>
+#include <vector>
+#include <rtp++/media/EmulationPrevention.h>
+#include "BitStreamBenchmark.h"
+
+namespace rtp_plus_plus {
+namespace benchmark {
+
+/**
+ * @brief byte-wise emulation prevention used as the reference for the benchmarks
+ */
+inline size_t insertEmulationPreventionByteWise(const uint8_t* pRbsp, size_t uiSize, uint8_t* pEbsp)
+{
+  size_t uiOut = 0;
+  uint32_t uiZeros = 0;
+  for (size_t i = 0; i < uiSize; ++i)
+  {
+    if (uiZeros == 2 && pRbsp[i] <= 0x03)
+    {
+      pEbsp[uiOut++] = 0x03;
+      uiZeros = 0;
+    }
+    pEbsp[uiOut++] = pRbsp[i];
+    uiZeros = (pRbsp[i] == 0) ? uiZeros + 1 : 0;
+  }
+  if (uiZeros == 2) pEbsp[uiOut++] = 0x03;
+  return uiOut;
+}
+
+inline size_t removeEmulationPreventionByteWise(const uint8_t* pEbsp, size_t uiSize, uint8_t* pRbsp)
+{
+  size_t uiOut = 0;
+  uint32_t uiZeros = 0;
+  for (size_t i = 0; i < uiSize; ++i)
+  {
+    if (uiZeros == 2 && pEbsp[i] == 0x03)
+    {
+      uiZeros = 0;
+      continue;
+    }
+    pRbsp[uiOut++] = pEbsp[i];
+    uiZeros = (pEbsp[i] == 0) ? uiZeros + 1 : 0;
+  }
+  return uiOut;
+}
+
+/**
+ * @brief compares byte-wise and vectorised RBSP <-> EBSP conversion on 1 MB of
+ * entropy coded-like data where 0x0000 is rare
+ */
+inline bool runEmulationPreventionBenchmarks(uint32_t uiIterations)
+{
+  const size_t uiSize = 1 << 20;
+  std::vector<uint8_t> vRbsp(uiSize);
+  srand(7);
+  for (size_t i = 0; i < uiSize; ++i) vRbsp[i] = static_cast<uint8_t>(rand());
+  std::vector<uint8_t> vEbsp(media::getMaxEbspSize(uiSize));
+  std::vector<uint8_t> vOut(uiSize);
+  size_t uiEbspSize = media::insertEmulationPrevention(&vRbsp[0], uiSize, &vEbsp[0]);
+  // approximate the number of fields as the number of bytes
+  uint32_t uiFields = static_cast<uint32_t>(uiSize);
+
+  uint64_t uiByteWiseInsert = runBenchmark("insertEmulationPrevention bytes", uiIterations, uiFields, uiSize, [&]()
+  {
+    return static_cast<uint64_t>(insertEmulationPreventionByteWise(&vRbsp[0], uiSize, &vEbsp[0]));
+  });
+  uint64_t uiSimdInsert = runBenchmark("insertEmulationPrevention simd", uiIterations, uiFields, uiSize, [&]()
+  {
+    return static_cast<uint64_t>(media::insertEmulationPrevention(&vRbsp[0], uiSize, &vEbsp[0]));
+  });
+  uint64_t uiByteWiseRemove = runBenchmark("removeEmulationPrevention bytes", uiIterations, uiFields, uiEbspSize, [&]()
+  {
+    return static_cast<uint64_t>(removeEmulationPreventionByteWise(&vEbsp[0], uiEbspSize, &vOut[0]));
+  });
+  uint64_t uiSimdRemove = runBenchmark("removeEmulationPrevention simd", uiIterations, uiFields, uiEbspSize, [&]()
+  {
+    return static_cast<uint64_t>(media::removeEmulationPrevention(&vEbsp[0], uiEbspSize, &vOut[0]));
+  });
+
+  if (uiByteWiseInsert != uiSimdInsert || uiByteWiseRemove != uiSimdRemove || memcmp(&vOut[0], &vRbsp[0], uiSize) != 0)
+  {
+    std::cout << "Mismatch between emulation prevention implementations" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // benchmark
+} // rtp_plus_plus
@@ -0,0 +1,104 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <rtp++/util/Buffer.h>
+
+namespace rtp_plus_plus {
+namespace benchmark {
+
+/**
+ * @brief Byte-wise bitstream reader as used by rtp++ before IBitStream
+ * switched to a 64-bit cache. Kept as the reference for the benchmarks.
+ */
+class LegacyIBitStream
+{
+public:
+  LegacyIBitStream(Buffer buffer)
+    :m_buffer(buffer),
+    m_uiBitsRemaining(buffer.getSize() << 3),
+    m_uiBitsInCurrentByte(8),
+    m_uiCurrentBytePos(0)
+  {
+
+  }
+
+  uint32_t getBitsRemaining() const { return m_uiBitsRemaining; }
+
+  bool read(uint32_t& uiValue, uint32_t uiBits)
+  {
+    if (uiBits > m_uiBitsRemaining)
+    {
+      return false;
+    }
+
+    uiValue = 0;
+    uint32_t uiBitsRemaining = uiBits;
+    while (uiBitsRemaining > 0)
+    {
+      uint32_t uiBitsToReadInCurrentByte = std::min(m_uiBitsInCurrentByte, uiBitsRemaining);
+      // preserve old value
+      uiValue <<= uiBitsToReadInCurrentByte;
+      // bits to shift by
+      uint32_t uiBitsToShiftBy = m_uiBitsInCurrentByte - uiBitsToReadInCurrentByte;
+      uint8_t uiMask = (2 << (uiBitsToReadInCurrentByte - 1)) - 1;
+      uiValue |= ((m_buffer[m_uiCurrentBytePos] >> uiBitsToShiftBy) & uiMask);
+
+      m_uiBitsInCurrentByte -= uiBitsToReadInCurrentByte;
+      if (m_uiBitsInCurrentByte == 0)
+      {
+        m_uiBitsInCurrentByte = 8;
+        ++m_uiCurrentBytePos;
+      }
+      uiBitsRemaining -= uiBitsToReadInCurrentByte;
+    }
+    // update total
+    m_uiBitsRemaining -= uiBits;
+    return true;
+  }
+  /**
+   * @brief readUE decodes ue(v) one bit at a time as the existing parsers did
+   */
+  bool readUE(uint32_t& uiValue)
+  {
+    uint32_t uiLeadingZeros = 0;
+    uint32_t uiBit = 0;
+    while (true)
+    {
+      if (!read(uiBit, 1)) return false;
+      if (uiBit) break;
+      ++uiLeadingZeros;
+    }
+    uint32_t uiSuffix = 0;
+    if (uiLeadingZeros > 0 && !read(uiSuffix, uiLeadingZeros)) return false;
+    uiValue = static_cast<uint32_t>((static_cast<uint64_t>(1) << uiLeadingZeros) - 1 + uiSuffix);
+    return true;
+  }
+
+private:
+  Buffer m_buffer;
+  uint32_t m_uiBitsRemaining;
+  uint32_t m_uiBitsInCurrentByte;
+  uint32_t m_uiCurrentBytePos;
+};
+
+} // benchmark
+} // rtp_plus_plus
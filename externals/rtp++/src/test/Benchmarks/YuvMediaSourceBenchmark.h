@@ -0,0 +1,66 @@
+/**********
+This file is part of rtp++ .
+
+rtp++ is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rtp++ is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with rtp++.  If not, see <http://www.gnu.org/licenses/>.
+
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <rtp++/media/YuvMediaSource.h>
+#include "Benchmark.h"
+
+namespace rtp_plus_plus {
+namespace benchmark {
+
+/**
+ * @brief benchmarks frame delivery of YuvMediaSource from an in-memory sequence of
+ * uiFrames 720p frames so that the numbers do not depend on the disk
+ */
+inline bool runYuvMediaSourceBenchmarks(uint32_t uiIterations, uint32_t uiFrames)
+{
+  const uint32_t uiWidth = 1280;
+  const uint32_t uiHeight = 720;
+  const size_t uiFrameSize = uiWidth * uiHeight * 3 / 2;
+  std::string sSequence(uiFrameSize * uiFrames, '\0');
+  srand(420);
+  for (char& c : sSequence) c = static_cast<char>(rand());
+  std::istringstream in(sSequence);
+
+  uint64_t uiChecksum = runBenchmark("YuvMediaSource::getNextAccessUnit", uiIterations, uiFrames, uiFrameSize * uiFrames, [&in, uiWidth, uiHeight]()
+  {
+    in.clear();
+    in.seekg(0, std::ios_base::beg);
+    media::YuvMediaSource source(in, uiWidth, uiHeight);
+    uint64_t uiFramesRead = 0;
+    while (source.isGood())
+    {
+      if (!source.getNextAccessUnit().empty()) ++uiFramesRead;
+    }
+    return uiFramesRead;
+  });
+  if (uiChecksum != static_cast<uint64_t>(uiFrames) * uiIterations)
+  {
+    std::cout << "YuvMediaSource delivered " << uiChecksum << " frames, expected " << static_cast<uint64_t>(uiFrames) * uiIterations << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // benchmark
+} // rtp_plus_plus
@@ -0,0 +1,70 @@
+#ifdef _WIN32
+#pragma warning(push)     // disable for this header only
+#pragma warning(disable:4251)
+// To get around compile error on windows: ERROR macro is defined
+#define GLOG_NO_ABBREVIATED_SEVERITIES
+#endif
+#include <glog/logging.h>
+#ifdef _WIN32
+#pragma warning(pop)     // restore original warning level
+#endif
+
+#include <boost/exception/all.hpp>
+#include <boost/program_options.hpp>
+#include "AnnexBBenchmark.h"
+#include "BitStreamBenchmark.h"
+#include "BufferBenchmark.h"
+#include "EmulationPreventionBenchmark.h"
+#include "YuvMediaSourceBenchmark.h"
+
+using namespace boost::program_options;
+using namespace rtp_plus_plus;
+
+int main(int argc, char** argv)
+{
+  google::InitGoogleLogging(argv[0]);
+
+  uint32_t uiIterations = 0;
+  uint32_t uiFields = 0;
+  uint32_t uiFrames = 0;
+  std::string sJsonFile;
+  std::string sLabel;
+  options_description desc("Allowed options");
+  desc.add_options()
+    ("help,?", "produce help message")
+    ("iterations,i", value<uint32_t>(&uiIterations)->default_value(200), "Number of iterations per benchmark")
+    ("fields,f", value<uint32_t>(&uiFields)->default_value(100000), "Number of fields in the generated bitstreams")
+    ("frames", value<uint32_t>(&uiFrames)->default_value(60), "Number of frames in the generated Annex B streams and YUV sequence")
+    ("json", value<std::string>(&sJsonFile), "Write the results to this JSON file")
+    ("label", value<std::string>(&sLabel), "Label stored with the JSON results e.g. the commit")
+    ;
+
+  try
+  {
+    variables_map vm;
+    store(parse_command_line(argc, argv, desc), vm);
+    notify(vm);
+
+    if (vm.count("help"))
+    {
+      std::cout << desc << std::endl;
+      return 1;
+    }
+  }
+  catch (boost::exception& e)
+  {
+    LOG(ERROR) << "Exception: " << boost::diagnostic_information(e);
+    return 1;
+  }
+
+  bool bSuccess = benchmark::runBitStreamBenchmarks(uiIterations, uiFields);
+  bSuccess = benchmark::runEmulationPreventionBenchmarks(uiIterations) && bSuccess;
+  bSuccess = benchmark::runAnnexBBenchmarks(uiIterations, uiFrames) && bSuccess;
+  bSuccess = benchmark::runBufferBenchmarks(uiIterations) && bSuccess;
+  bSuccess = benchmark::runYuvMediaSourceBenchmarks(uiIterations, uiFrames) && bSuccess;
+  if (!sJsonFile.empty())
+  {
+    bSuccess = benchmark::writeJson(sJsonFile, sLabel) && bSuccess;
+  }
+  return bSuccess ? 0 : 1;
+}
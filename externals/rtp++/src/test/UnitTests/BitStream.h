@@ -0,0 +1,275 @@
+#pragma once
+#include <cstdlib>
+#include <vector>
+#include <rtp++/media/EmulationPrevention.h>
+#include <rtp++/util/IBitStream.h>
+#include <rtp++/util/OBitStream.h>
+
+namespace rtp_plus_plus {
+namespace test {
+
+/**
+ * @brief writes ue(v) using the plain OBitStream write
+ */
+static void writeExpGolomb(OBitStream& out, uint32_t uiValue)
+{
+  uint64_t uiCodeNum = static_cast<uint64_t>(uiValue) + 1;
+  uint32_t uiBits = 0;
+  while ((uiCodeNum >> uiBits) > 1) ++uiBits;
+  // leading zeros
+  for (uint32_t i = 0; i < uiBits; ++i) out.write(0, 1);
+  out.write(1, 1);
+  if (uiBits > 0)
+    out.write(static_cast<uint32_t>(uiCodeNum & ((static_cast<uint64_t>(1) << uiBits) - 1)), uiBits);
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_IBitStreamRead)
+{
+  OBitStream out;
+  // fields of varying width spanning several cache refills
+  std::vector<std::pair<uint32_t, uint32_t> > vFields;
+  srand(1234);
+  for (size_t i = 0; i < 1000; ++i)
+  {
+    uint32_t uiBits = 1 + rand() % 32;
+    uint32_t uiValue = static_cast<uint32_t>(rand()) & (uiBits == 32 ? 0xFFFFFFFF : ((1u << uiBits) - 1));
+    vFields.push_back(std::make_pair(uiValue, uiBits));
+    out.write(uiValue, uiBits);
+  }
+
+  IBitStream in(out.data());
+  uint32_t uiTotalBits = in.getBitsRemaining();
+  uint32_t uiBitsRead = 0;
+  for (size_t i = 0; i < vFields.size(); ++i)
+  {
+    if (i % 3 == 0)
+    {
+      BOOST_CHECK_EQUAL(in.peekBits(vFields[i].second), vFields[i].first);
+    }
+    uint32_t uiValue = 0;
+    BOOST_CHECK(in.read(uiValue, vFields[i].second));
+    BOOST_CHECK_EQUAL(uiValue, vFields[i].first);
+    uiBitsRead += vFields[i].second;
+    BOOST_CHECK_EQUAL(in.getBitsRemaining(), uiTotalBits - uiBitsRead);
+  }
+  BOOST_CHECK(!in.hasError());
+
+  // overrun is reported via the return value and the sticky error flag
+  uint32_t uiRemaining = in.getBitsRemaining();
+  uint8_t uiByte = 0;
+  BOOST_CHECK(!in.read(uiByte, uiRemaining + 1));
+  in.readBits(uiRemaining);
+  BOOST_CHECK(!in.hasError());
+  BOOST_CHECK_EQUAL(in.readBits(1), 0);
+  BOOST_CHECK(in.hasError());
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_IBitStreamSkip)
+{
+  uint8_t data[] = { 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0, 0x11, 0x22, 0x33 };
+  uint8_t* pData = new uint8_t[sizeof(data)];
+  memcpy(pData, data, sizeof(data));
+  Buffer buffer(pData, sizeof(data));
+
+  IBitStream in(buffer);
+  BOOST_CHECK(in.skipBytes(1));
+  BOOST_CHECK_EQUAL(in.peekAtCurrentByte(), 0x34);
+  BOOST_CHECK(in.skipBits(4));
+  BOOST_CHECK(!in.skipBytes(1));
+  uint32_t uiValue = 0;
+  BOOST_CHECK(in.read(uiValue, 8));
+  BOOST_CHECK_EQUAL(uiValue, 0x45);
+  // skip past the cached bits
+  BOOST_CHECK(in.skipBits(44));
+  BOOST_CHECK(in.isByteAligned());
+  BOOST_CHECK_EQUAL(in.peekAtCurrentByte(), 0x11);
+  uint8_t dest[2];
+  uint8_t* pDest = dest;
+  BOOST_CHECK(in.readBytes(pDest, 2));
+  BOOST_CHECK_EQUAL(dest[0], 0x11);
+  BOOST_CHECK_EQUAL(dest[1], 0x22);
+  uint64_t uiLast = 0;
+  BOOST_CHECK(!in.read(uiLast, 9));
+  BOOST_CHECK(in.read(uiLast, 8));
+  BOOST_CHECK_EQUAL(uiLast, 0x33);
+  BOOST_CHECK_EQUAL(in.getBitsRemaining(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_IBitStreamExpGolomb)
+{
+  std::vector<uint32_t> vValues;
+  for (uint32_t i = 0; i < 300; ++i) vValues.push_back(i);
+  vValues.push_back(65535);
+  vValues.push_back(0x7FFFFFFF);
+  vValues.push_back(0xFFFFFFFE);
+
+  OBitStream out;
+  for (size_t i = 0; i < vValues.size(); ++i)
+  {
+    writeExpGolomb(out, vValues[i]);
+    // interleave fixed length fields
+    out.write(1, 1);
+  }
+  // place the largest code at the very end of the stream
+  writeExpGolomb(out, 0xFFFFFFFE);
+
+  IBitStream in(out.data());
+  for (size_t i = 0; i < vValues.size(); ++i)
+  {
+    BOOST_CHECK_EQUAL(in.readUE(), vValues[i]);
+    BOOST_CHECK(in.readFlag());
+  }
+  BOOST_CHECK_EQUAL(in.readUE(), 0xFFFFFFFE);
+  BOOST_CHECK(!in.hasError());
+
+  // se(v): 0, 1, -1, 2, -2, ...
+  OBitStream seOut;
+  for (uint32_t i = 0; i < 9; ++i) writeExpGolomb(seOut, i);
+  IBitStream seIn(seOut.data());
+  int32_t expected[] = { 0, 1, -1, 2, -2, 3, -3, 4, -4 };
+  for (uint32_t i = 0; i < 9; ++i)
+  {
+    BOOST_CHECK_EQUAL(seIn.readSE(), expected[i]);
+  }
+  BOOST_CHECK(!seIn.hasError());
+  // a run of zeros without terminating one is invalid
+  uint8_t zeros[] = { 0x00, 0x00, 0x00, 0x00, 0x00 };
+  uint8_t* pZeros = new uint8_t[sizeof(zeros)];
+  memcpy(pZeros, zeros, sizeof(zeros));
+  Buffer zeroBuffer(pZeros, sizeof(zeros));
+  IBitStream zeroIn(zeroBuffer);
+  zeroIn.readUE();
+  BOOST_CHECK(zeroIn.hasError());
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_OBitStreamWrite)
+{
+  // small initial buffer to force reallocation
+  OBitStream out(4);
+  OBitStream reference(4);
+  srand(4321);
+  std::vector<int32_t> vSigned;
+  for (size_t i = 0; i < 500; ++i)
+  {
+    uint32_t uiBits = 1 + rand() % 32;
+    uint32_t uiValue = static_cast<uint32_t>(rand());
+    out.write(uiValue, uiBits);
+    uint32_t uiUE = (i % 50 == 0) ? 0xFFFFFFFE - static_cast<uint32_t>(i) : static_cast<uint32_t>(rand() % 1000);
+    out.writeUE(uiUE);
+    int32_t iSE = (rand() % 2000) - 1000;
+    vSigned.push_back(iSE);
+    out.writeSE(iSE);
+    out.writeFlag((i & 1) != 0);
+
+    reference.write(uiValue, uiBits);
+    writeExpGolomb(reference, uiUE);
+    writeExpGolomb(reference, iSE > 0 ? 2 * iSE - 1 : -2 * iSE);
+    reference.write(i & 1, 1);
+  }
+  out.writeSE(-2147483647 - 1);
+  out.writeUE(0xFFFFFFFF);
+  out.writeRbspTrailingBits();
+  BOOST_CHECK(out.isByteAligned());
+  const uint8_t payload[] = { 0xDE, 0xAD, 0xBE, 0xEF };
+  const uint8_t* pPayload = payload;
+  BOOST_CHECK(out.writeBytes(pPayload, sizeof(payload)));
+
+  Buffer written = out.data();
+  BOOST_CHECK_EQUAL(written.getSize(), out.bytesUsed());
+  Buffer expected = reference.data();
+  BOOST_CHECK(written.getSize() > expected.getSize());
+  BOOST_CHECK(memcmp(written.data(), expected.data(), expected.getSize() - 1) == 0);
+
+  IBitStream in(written);
+  IBitStream refIn(expected);
+  for (size_t i = 0; i < vSigned.size(); ++i)
+  {
+    uint32_t uiBits = 1 + (i % 32);
+    uint32_t uiValue = 0;
+    uint32_t uiRef = 0;
+    BOOST_CHECK(refIn.read(uiRef, uiBits));
+    BOOST_CHECK(in.read(uiValue, uiBits));
+    BOOST_CHECK_EQUAL(uiValue, uiRef);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_OBitStreamExpGolombRoundTrip)
+{
+  OBitStream out;
+  for (uint32_t i = 0; i < 1000; ++i)
+  {
+    out.writeUE(i * 7919);
+    out.writeSE(static_cast<int32_t>(i) - 500);
+  }
+  out.writeUE(0xFFFFFFFE);
+  out.writeRbspTrailingBits();
+  IBitStream in(out.data());
+  for (uint32_t i = 0; i < 1000; ++i)
+  {
+    BOOST_CHECK_EQUAL(in.readUE(), i * 7919);
+    BOOST_CHECK_EQUAL(in.readSE(), static_cast<int32_t>(i) - 500);
+  }
+  BOOST_CHECK_EQUAL(in.readUE(), 0xFFFFFFFE);
+  BOOST_CHECK(in.readFlag());
+  BOOST_CHECK(!in.hasError());
+}
+
+/**
+ * @brief byte-wise reference implementation of emulation prevention
+ */
+static std::vector<uint8_t> insertEmulationPreventionReference(const std::vector<uint8_t>& vRbsp)
+{
+  std::vector<uint8_t> vEbsp;
+  uint32_t uiZeros = 0;
+  for (uint8_t uiByte : vRbsp)
+  {
+    if (uiZeros == 2 && uiByte <= 3)
+    {
+      vEbsp.push_back(3);
+      uiZeros = 0;
+    }
+    vEbsp.push_back(uiByte);
+    uiZeros = (uiByte == 0) ? uiZeros + 1 : 0;
+  }
+  if (uiZeros == 2) vEbsp.push_back(3);
+  return vEbsp;
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_EmulationPrevention)
+{
+  const uint8_t rbsp[] = { 0x00, 0x00, 0x01, 0x65, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x03, 0x00, 0x00 };
+  const uint8_t ebsp[] = { 0x00, 0x00, 0x03, 0x01, 0x65, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x04, 0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x03 };
+  std::vector<uint8_t> vOut(media::getMaxEbspSize(sizeof(rbsp)));
+  size_t uiSize = media::insertEmulationPrevention(rbsp, sizeof(rbsp), &vOut[0]);
+  BOOST_CHECK_EQUAL(uiSize, sizeof(ebsp));
+  BOOST_CHECK(memcmp(&vOut[0], ebsp, sizeof(ebsp)) == 0);
+  uiSize = media::removeEmulationPrevention(&vOut[0], uiSize, &vOut[0]);
+  BOOST_CHECK_EQUAL(uiSize, sizeof(rbsp));
+  BOOST_CHECK(memcmp(&vOut[0], rbsp, sizeof(rbsp)) == 0);
+
+  // random data with runs of zeros at every alignment relative to the SIMD blocks
+  srand(99);
+  for (size_t uiLength = 1; uiLength < 300; uiLength += 7)
+  {
+    std::vector<uint8_t> vRbsp(uiLength);
+    for (size_t i = 0; i < uiLength; ++i)
+    {
+      int iRand = rand() % 10;
+      vRbsp[i] = (iRand < 4) ? 0 : (iRand < 6 ? static_cast<uint8_t>(rand() % 4) : static_cast<uint8_t>(rand()));
+    }
+    std::vector<uint8_t> vExpected = insertEmulationPreventionReference(vRbsp);
+    std::vector<uint8_t> vEbsp(media::getMaxEbspSize(uiLength));
+    size_t uiEbspSize = media::insertEmulationPrevention(&vRbsp[0], uiLength, &vEbsp[0]);
+    BOOST_REQUIRE_EQUAL(uiEbspSize, vExpected.size());
+    BOOST_CHECK(memcmp(&vEbsp[0], &vExpected[0], uiEbspSize) == 0);
+
+    Buffer ebspBuffer(new uint8_t[uiEbspSize], uiEbspSize);
+    memcpy(const_cast<uint8_t*>(ebspBuffer.data()), &vEbsp[0], uiEbspSize);
+    Buffer rbspBuffer = media::removeEmulationPrevention(ebspBuffer);
+    BOOST_REQUIRE_EQUAL(rbspBuffer.getSize(), uiLength);
+    BOOST_CHECK(memcmp(rbspBuffer.data(), &vRbsp[0], uiLength) == 0);
+  }
+}
+
+} // test
+} // rtp_plus_plus
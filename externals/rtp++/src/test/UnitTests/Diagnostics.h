@@ -0,0 +1,262 @@
+#pragma once
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include <rtp++/util/Diagnostics.h>
+#include <rtp++/util/LockFreeRing.h>
+#include <rtp++/util/MemoryUsage.h>
+#include <rtp++/util/PerfCounters.h>
+#include <rtp++/util/Trace.h>
+
+namespace rtp_plus_plus {
+namespace test {
+
+BOOST_AUTO_TEST_CASE(tc_test_LockFreeRing)
+{
+  LockFreeRing<uint32_t> ring(8);
+  uint32_t uiValue = 0;
+  BOOST_CHECK(!ring.tryPop(uiValue));
+  for (uint32_t i = 0; i < 8; ++i)
+    BOOST_CHECK(ring.tryPush(i));
+  BOOST_CHECK(!ring.tryPush(8));
+  BOOST_CHECK(ring.tryPop(uiValue) && uiValue == 0);
+  BOOST_CHECK(ring.tryPush(8));
+  for (uint32_t i = 1; i <= 8; ++i)
+    BOOST_CHECK(ring.tryPop(uiValue) && uiValue == i);
+  BOOST_CHECK(!ring.tryPop(uiValue));
+
+  // several producers: every value must arrive exactly once and in order per producer
+  const uint32_t uiProducers = 4;
+  const uint32_t uiPerProducer = 100000;
+  LockFreeRing<uint32_t> shared(64);
+  boost::thread_group producers;
+  for (uint32_t p = 0; p < uiProducers; ++p)
+  {
+    producers.create_thread([&shared, p, uiPerProducer]()
+    {
+      for (uint32_t i = 0; i < uiPerProducer; ++i)
+      {
+        while (!shared.tryPush((p << 24) | i))
+          boost::this_thread::yield();
+      }
+    });
+  }
+  std::vector<uint32_t> vNext(uiProducers, 0);
+  uint32_t uiReceived = 0;
+  bool bInOrder = true;
+  while (uiReceived < uiProducers * uiPerProducer)
+  {
+    if (!shared.tryPop(uiValue)) continue;
+    uint32_t p = uiValue >> 24;
+    bInOrder &= (p < uiProducers) && ((uiValue & 0xFFFFFF) == vNext[p]);
+    if (p < uiProducers) ++vNext[p];
+    ++uiReceived;
+  }
+  producers.join_all();
+  BOOST_CHECK(bInOrder);
+  BOOST_CHECK(!shared.tryPop(uiValue));
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_DiagnosticsFormat)
+{
+  {
+    DIAG_EVENT(event, "Frame {} Time: {} ({*} ) Time to encode: {}ms");
+    event << 3 << 0.12 << 10u << 20u << (int64_t)-5;
+    // the record is only formatted by the drain thread: format a copy here
+  }
+  diagnostics::Record record;
+  record.File = __FILE__;
+  record.Line = __LINE__;
+  record.Format = "Frame {} Time: {} ({*} ) Time to encode: {}ms";
+  record.Count = 5;
+  record.Next = 0;
+  record.Types[0] = diagnostics::Record::VT_UINT; record.Values[0].UInt = 3;
+  record.Types[1] = diagnostics::Record::VT_DOUBLE; record.Values[1].Double = 0.12;
+  record.Types[2] = diagnostics::Record::VT_UINT; record.Values[2].UInt = 10;
+  record.Types[3] = diagnostics::Record::VT_UINT; record.Values[3].UInt = 20;
+  record.Types[4] = diagnostics::Record::VT_INT; record.Values[4].Int = -5;
+  BOOST_CHECK_EQUAL(diagnostics::format(record), "Frame 3 Time: 0.12 ( 10 20 ) Time to encode: -5ms");
+
+  // empty list and missing values
+  record.Count = 2;
+  BOOST_CHECK_EQUAL(diagnostics::format(record), "Frame 3 Time: 0.12 ( ) Time to encode: ?ms");
+  record.Format = "no placeholders";
+  BOOST_CHECK_EQUAL(diagnostics::format(record), "no placeholders");
+  record.Format = "{*}";
+  record.Count = 3;
+  BOOST_CHECK_EQUAL(diagnostics::format(record), " 3 0.12 10");
+
+  // lists longer than a record continue in chained records without losing values
+  {
+    DIAG_EVENT(event, "Frame {} ({*} ) Time to encode: {}ms");
+    event << 7u;
+    for (uint32_t i = 0; i < 70; ++i) event << 1000u + i;
+    event << 12u;
+    const diagnostics::Record& first = event.getRecord();
+    BOOST_CHECK_EQUAL(first.Count, static_cast<uint32_t>(diagnostics::Record::MAX_VALUES));
+    BOOST_REQUIRE(first.Next && first.Next->Next);
+    BOOST_CHECK(!first.Next->Next->Next);
+    BOOST_CHECK_EQUAL(first.Next->Next->Count, 72 - 2 * diagnostics::Record::MAX_VALUES);
+    std::ostringstream expected;
+    expected << "Frame 7 (";
+    for (uint32_t i = 0; i < 70; ++i) expected << " " << 1000 + i;
+    expected << " ) Time to encode: 12ms";
+    BOOST_CHECK_EQUAL(diagnostics::format(first), expected.str());
+  }
+
+  // events are drained without loss even when producers outrun the drain thread
+  boost::thread_group producers;
+  for (uint32_t p = 0; p < 4; ++p)
+  {
+    producers.create_thread([p]()
+    {
+      for (uint32_t i = 0; i < 3000; ++i)
+      {
+        DIAG_EVENT(event, "Producer {} event {}");
+        event << p << i;
+      }
+    });
+  }
+  producers.join_all();
+  diagnostics::flush();
+  BOOST_CHECK(true);
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_Trace)
+{
+  trace::Tracer& tracer = trace::Tracer::get();
+  {
+    // scopes are not recorded while tracing is off
+    TRACE_SCOPE("off");
+  }
+  tracer.start();
+  trace::setThreadName("main");
+  {
+    TRACE_SCOPE("outer");
+    TRACE_SCOPE("inner");
+  }
+  boost::thread_group workers;
+  for (uint32_t t = 0; t < 3; ++t)
+  {
+    workers.create_thread([]()
+    {
+      for (uint32_t i = 0; i < 100; ++i)
+      {
+        TRACE_SCOPE("work");
+      }
+    });
+  }
+  workers.join_all();
+  tracer.stop();
+
+  const std::string sFilename("test_trace.json");
+  BOOST_REQUIRE(tracer.write(sFilename));
+  std::ifstream in(sFilename.c_str());
+  std::stringstream json;
+  json << in.rdbuf();
+  const std::string sJson = json.str();
+  auto count = [&sJson](const std::string& sPattern)
+  {
+    size_t uiCount = 0;
+    for (size_t pos = sJson.find(sPattern); pos != std::string::npos; pos = sJson.find(sPattern, pos + 1)) ++uiCount;
+    return uiCount;
+  };
+  BOOST_CHECK_EQUAL(count("\"name\":\"off\""), 0);
+  BOOST_CHECK_EQUAL(count("\"name\":\"outer\""), 1);
+  BOOST_CHECK_EQUAL(count("\"name\":\"inner\""), 1);
+  BOOST_CHECK_EQUAL(count("\"name\":\"work\""), 300);
+  BOOST_CHECK_EQUAL(count("\"ph\":\"M\""), 1);
+  BOOST_CHECK_EQUAL(sJson.substr(sJson.size() - 4), "\n]}\n");
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_PerfCounters)
+{
+  // counters may be unavailable e.g. in a VM: these must read as -1
+  perf::PerfCounters counters;
+  perf::CounterValues start = counters.read();
+  volatile uint64_t uiSum = 0;
+  for (uint32_t i = 0; i < 10000000; ++i) uiSum += i;
+  perf::CounterValues end = counters.read();
+  perf::CounterValues delta = end - start;
+  perf::CounterTotals totals;
+  totals.add(delta);
+  totals.add(delta);
+  BOOST_CHECK_EQUAL(totals.getSamples(), 2);
+  for (int i = 0; i < perf::PC_COUNT; ++i)
+  {
+    perf::Counter eCounter = static_cast<perf::Counter>(i);
+    if (counters.isAvailable(eCounter))
+    {
+      BOOST_CHECK_GE(start[i], 0);
+      BOOST_CHECK_GE(delta[i], 0);
+      BOOST_CHECK_EQUAL(totals.getTotal(eCounter), 2 * delta[i]);
+    }
+    else
+    {
+      BOOST_CHECK_EQUAL(start[i], -1);
+      BOOST_CHECK_EQUAL(delta[i], -1);
+      BOOST_CHECK_EQUAL(totals.getTotal(eCounter), -1);
+    }
+  }
+  if (counters.isAvailable(perf::PC_TASK_CLOCK))
+  {
+    BOOST_CHECK_GT(delta[perf::PC_TASK_CLOCK], 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_MemoryUsage)
+{
+#ifdef __linux__
+  memory::MemorySnapshot before = memory::getMemorySnapshot();
+  BOOST_CHECK_GT(before.RssKb, 0);
+  BOOST_CHECK_GE(before.PeakRssKb, before.RssKb);
+  // 32 MB of touched pages must show up in the RSS
+  std::vector<uint8_t> vBlock(32 * 1024 * 1024, 1);
+  memory::MemorySnapshot after = memory::getMemorySnapshot();
+  BOOST_CHECK_GE(after.RssKb - before.RssKb, 16 * 1024);
+  if (before.AnonymousKb != -1)
+  {
+    BOOST_CHECK_GE(after.AnonymousKb - before.AnonymousKb, 16 * 1024);
+  }
+  vBlock = std::vector<uint8_t>();
+  if (memory::resetPeakRss())
+  {
+    BOOST_CHECK_LT(memory::getMemorySnapshot().PeakRssKb, after.PeakRssKb);
+  }
+#endif
+  // the unit tests do not interpose the allocator: report as the hook would. Counting is off by default.
+  BOOST_CHECK(!memory::isAllocationCountingEnabled());
+  memory::AllocationCounts start = memory::getAllocationCounts();
+  memory::onAllocate(100);
+  BOOST_CHECK_EQUAL((memory::getAllocationCounts() - start).Allocations, 0);
+  memory::setAllocationCounting(true);
+  memory::onAllocate(100);
+  memory::onAllocate(28);
+  memory::onFree(100);
+  BOOST_CHECK(memory::isAllocationHookInstalled());
+  memory::AllocationCounts delta = memory::getAllocationCounts() - start;
+  BOOST_CHECK_EQUAL(delta.Allocations, 2);
+  BOOST_CHECK_EQUAL(delta.AllocatedBytes, 128);
+  BOOST_CHECK_EQUAL(delta.Frees, 1);
+  BOOST_CHECK_EQUAL(delta.FreedBytes, 100);
+
+  // the counts of each thread are kept after it exits and summed on report
+  start = memory::getAllocationCounts();
+  boost::thread_group threads;
+  for (uint32_t t = 0; t < 4; ++t)
+  {
+    threads.create_thread([]()
+    {
+      for (uint32_t i = 0; i < 1000; ++i) memory::onAllocate(8);
+    });
+  }
+  threads.join_all();
+  delta = memory::getAllocationCounts() - start;
+  BOOST_CHECK_EQUAL(delta.Allocations, 4000);
+  BOOST_CHECK_EQUAL(delta.AllocatedBytes, 32000);
+  memory::setAllocationCounting(false);
+}
+
+} // test
+} // rtp_plus_plus
@@ -1,5 +1,16 @@
 #pragma once
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <rtp++/media/AsyncVideoEncoder.h>
+#include <rtp++/media/EmulationPrevention.h>
+#include <rtp++/media/MediaSink.h>
 #include <rtp++/media/NalUnitMediaSource.h>
+#include <rtp++/media/TemporalLayerPruner.h>
+#include <rtp++/media/VideoCodecPlugin.h>
+#include <rtp++/media/h264/H264AnnexBStreamWriter.h>
+#include <rtp++/media/h264/H264SliceHeaderParser.h>
+#include <rtp++/media/h265/H265SliceHeaderParser.h>
+#include <rtp++/util/OBitStream.h>
 #include <rtp++/media/YuvMediaSource.h>
 
 namespace rtp_plus_plus {
@@ -47,5 +58,836 @@ BOOST_AUTO_TEST_CASE(tc_test_NalUnitMediaSource)
   BOOST_CHECK_EQUAL(iCount, 300);
 }
 
+/**
+ * @brief writeTestH264Stream writes an Annex B stream with optional AUDs, parameter sets and
+ * AUs of varying size some of which span the read chunks of the parser
+ * @return the NAL unit payload sizes (without start code) per AU
+ */
+static std::vector<std::vector<uint32_t> > writeTestH264Stream(const std::string& sFilename, uint32_t uiAuCount, bool bAud = true)
+{
+  std::vector<std::vector<uint32_t> > vAuSizes;
+  std::ofstream out(sFilename.c_str(), std::ofstream::binary);
+  const char startcode[4] = { 0, 0, 0, 1 };
+  for (uint32_t i = 0; i < uiAuCount; ++i)
+  {
+    std::vector<uint32_t> vSizes;
+    if (bAud)
+    {
+      const char aud[2] = { 0x09, (char)0xF0 };
+      out.write(startcode, 4);
+      out.write(aud, 2);
+      vSizes.push_back(2);
+    }
+    if (i == 0)
+    {
+      const char sps[5] = { 0x67, 0x42, (char)0xC0, 0x1E, (char)0x88 };
+      const char pps[4] = { 0x68, (char)0xCE, 0x3C, (char)0x80 };
+      out.write(startcode, 4);
+      out.write(sps, 5);
+      vSizes.push_back(5);
+      out.write(startcode, 4);
+      out.write(pps, 4);
+      vSizes.push_back(4);
+    }
+    // slice with 3 byte start code
+    std::string sSlice(1000 + (i * 7919) % 60000, (char)0xAA);
+    sSlice[0] = (i == 0) ? 0x65 : 0x41;
+    out.write(startcode + 1, 3);
+    out.write(sSlice.c_str(), sSlice.length());
+    vSizes.push_back(sSlice.length());
+    vAuSizes.push_back(vSizes);
+  }
+  return vAuSizes;
+}
+
+static std::vector<std::vector<uint32_t> > readAuSizes(media::NalUnitMediaSource& naluMediaSource)
+{
+  std::vector<std::vector<uint32_t> > vAuSizes;
+  while (naluMediaSource.isGood())
+  {
+    std::vector<media::MediaSample> au = naluMediaSource.getNextAccessUnit();
+    if (au.empty()) continue;
+    std::vector<uint32_t> vSizes;
+    for (const media::MediaSample& mediaSample : au)
+      vSizes.push_back(mediaSample.getPayloadSize());
+    vAuSizes.push_back(vSizes);
+  }
+  return vAuSizes;
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_NalUnitMediaSourceIndexFile)
+{
+  const std::string sFilename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.264")).string();
+  const std::string sIndexFilename = media::NalUnitMediaSource::getIndexFilename(sFilename);
+  std::vector<std::vector<uint32_t> > vExpected = writeTestH264Stream(sFilename, 60);
+
+  {
+    // full scan
+    media::NalUnitMediaSource naluMediaSource(sFilename, rfc6184::H264, false, 0);
+    BOOST_CHECK(readAuSizes(naluMediaSource) == vExpected);
+    BOOST_CHECK(!boost::filesystem::exists(sIndexFilename));
+  }
+  {
+    // full scan and index file written
+    media::NalUnitMediaSource naluMediaSource(sFilename, rfc6184::H264, false, 0, 20000, true);
+    BOOST_CHECK(boost::filesystem::exists(sIndexFilename));
+    BOOST_CHECK(readAuSizes(naluMediaSource) == vExpected);
+  }
+  {
+    // loaded from index file
+    media::NalUnitMediaSource naluMediaSource(sFilename, rfc6184::H264, false, 0, 20000, true);
+    BOOST_CHECK(readAuSizes(naluMediaSource) == vExpected);
+  }
+  {
+    // index file for another media type must not be used
+    media::NalUnitMediaSource naluMediaSource(sFilename, rfchevc::H265, false, 0, 20000, true);
+    BOOST_CHECK(readAuSizes(naluMediaSource) != vExpected);
+  }
+  boost::filesystem::remove(sIndexFilename);
+  {
+    // lazy indexing with looping
+    media::NalUnitMediaSource naluMediaSource(sFilename, rfc6184::H264, true, 1, 20000, false, true);
+    std::vector<std::vector<uint32_t> > vLooped = vExpected;
+    vLooped.insert(vLooped.end(), vExpected.begin(), vExpected.end());
+    BOOST_CHECK(readAuSizes(naluMediaSource) == vLooped);
+  }
+  boost::filesystem::remove(sFilename);
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_NalUnitMediaSourceWithoutAud)
+{
+  const std::string sFilename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.264")).string();
+  std::vector<std::vector<uint32_t> > vExpected = writeTestH264Stream(sFilename, 30, false);
+  media::NalUnitMediaSource naluMediaSource(sFilename, rfc6184::H264, false, 0);
+  BOOST_CHECK(readAuSizes(naluMediaSource) == vExpected);
+  boost::filesystem::remove(sFilename);
+}
+
+static media::MediaSample createMediaSample(const std::string& sData, const boost::posix_time::ptime& tPresentation)
+{
+  uint8_t* pData = new uint8_t[sData.length()];
+  memcpy(pData, sData.c_str(), sData.length());
+  media::MediaSample mediaSample;
+  mediaSample.setData(pData, sData.length());
+  mediaSample.setPresentationTime(tPresentation);
+  return mediaSample;
+}
+
+static std::string readFile(const std::string& sFilename)
+{
+  std::ifstream in(sFilename.c_str(), std::ifstream::binary);
+  return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_MediaSink)
+{
+  const std::string sFilename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.bin")).string();
+  const boost::posix_time::ptime tNow = boost::posix_time::microsec_clock::universal_time();
+  std::string sExpected;
+  {
+    // small buffers so that samples span several buffers
+    media::MediaSink sink(sFilename, 64, 2);
+    for (uint32_t i = 0; i < 50; ++i)
+    {
+      std::string sData(1 + (i * 37) % 200, (char)i);
+      sink.write(createMediaSample(sData, tNow));
+      sExpected += sData;
+    }
+    sink.flush();
+    BOOST_CHECK_EQUAL(sink.getBytesWritten(), sExpected.length());
+    BOOST_CHECK_EQUAL(sink.getFlushCount(), (sExpected.length() + 63) / 64);
+    BOOST_CHECK(readFile(sFilename) == sExpected);
+
+    std::vector<media::MediaSample> au;
+    au.push_back(createMediaSample("abc", tNow));
+    au.push_back(createMediaSample("defg", tNow));
+    sink.writeAu(au);
+    sExpected += "abcdefg";
+  }
+  BOOST_CHECK(readFile(sFilename) == sExpected);
+  boost::filesystem::remove(sFilename);
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_H264AnnexBStreamWriterParallel)
+{
+  // writers used from several threads must not share start code state
+  const uint32_t uiWriters = 4;
+  const uint32_t uiAuCount = 40;
+  std::vector<std::string> vFilenames;
+  for (uint32_t i = 0; i < uiWriters; ++i)
+  {
+    vFilenames.push_back((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.264")).string());
+  }
+
+  std::vector<std::vector<uint32_t> > vExpected;
+  for (uint32_t i = 0; i < uiAuCount; ++i)
+  {
+    std::vector<uint32_t> vSizes;
+    // inserted AUD
+    vSizes.push_back(2);
+    vSizes.push_back(500 + (i * 7919) % 5000);
+    vSizes.push_back(300);
+    vExpected.push_back(vSizes);
+  }
+
+  boost::thread_group writers;
+  for (uint32_t i = 0; i < uiWriters; ++i)
+  {
+    writers.create_thread([&vFilenames, &vExpected, i]()
+    {
+      media::h264::H264AnnexBStreamWriter writer(vFilenames[i], false, true, 4096, 2);
+      boost::posix_time::ptime tPresentation = boost::posix_time::microsec_clock::universal_time();
+      for (size_t j = 0; j < vExpected.size(); ++j)
+      {
+        tPresentation += boost::posix_time::milliseconds(40);
+        std::string sFirst(vExpected[j][1], (char)0xAA);
+        sFirst[0] = (j == 0) ? 0x65 : 0x41;
+        std::string sSecond(vExpected[j][2], (char)0xBB);
+        sSecond[0] = (j == 0) ? 0x65 : 0x41;
+        std::vector<media::MediaSample> au;
+        au.push_back(createMediaSample(sFirst, tPresentation));
+        au.push_back(createMediaSample(sSecond, tPresentation));
+        writer.writeAu(au);
+      }
+    });
+  }
+  writers.join_all();
+
+  const std::string sFirstFile = readFile(vFilenames[0]);
+  for (const std::string& sFilename : vFilenames)
+  {
+    BOOST_CHECK(readFile(sFilename) == sFirstFile);
+    media::NalUnitMediaSource naluMediaSource(sFilename, rfc6184::H264, false, 0);
+    BOOST_CHECK(readAuSizes(naluMediaSource) == vExpected);
+    boost::filesystem::remove(sFilename);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_TemporalLayerPruner)
+{
+  // dyadic 3 layer structure: temporal ids 0 2 1 2 with 400, 100, 200 and 100 bytes
+  const uint8_t uiTemporalIds[] = { 0, 2, 1, 2 };
+  const uint32_t uiSizes[] = { 400, 100, 200, 100 };
+  auto makeFrame = [&uiTemporalIds, &uiSizes](uint32_t uiFrame)
+  {
+    media::MediaSample nalu;
+    nalu.setData(new uint8_t[uiSizes[uiFrame % 4]], uiSizes[uiFrame % 4]);
+    nalu.setTemporalId(uiTemporalIds[uiFrame % 4]);
+    return std::vector<media::MediaSample>(1, nalu);
+  };
+  media::TemporalLayerPruner pruner(3);
+  for (uint32_t i = 0; i < 4; ++i) pruner.addFrame(makeFrame(i), 4.0);
+  BOOST_CHECK_CLOSE(pruner.getLayerKbps(0, 4.0), 3.2, 1e-6);
+  BOOST_CHECK_CLOSE(pruner.getLayerKbps(1, 4.0), 4.8, 1e-6);
+  BOOST_CHECK_CLOSE(pruner.getLayerKbps(2, 4.0), 6.4, 1e-6);
+  BOOST_CHECK_EQUAL(pruner.setTargetBitrate(5.0, 4.0), 1);
+
+  // frames in the dropped layer are pruned to nothing and counted as dropped frames
+  std::vector<uint32_t> vSizes;
+  uint32_t uiEmptyFrames = 0;
+  for (uint32_t i = 0; i < 4; ++i)
+  {
+    std::vector<media::MediaSample> accessUnit = makeFrame(i);
+    vSizes.push_back(pruner.prune(accessUnit));
+    if (accessUnit.empty()) ++uiEmptyFrames;
+  }
+  BOOST_CHECK(vSizes == std::vector<uint32_t>({ 400, 0, 200, 0 }));
+  BOOST_CHECK_EQUAL(uiEmptyFrames, 2);
+  BOOST_CHECK_EQUAL(pruner.getDroppedFrames(), 2);
+  BOOST_CHECK_EQUAL(pruner.getDroppedNalUnits(), 2);
+  BOOST_CHECK_EQUAL(pruner.getDroppedBytes(), 200);
+  // a frame skipped by the encoder is not a dropped frame
+  std::vector<media::MediaSample> skipped;
+  BOOST_CHECK_EQUAL(pruner.prune(skipped), 0);
+  BOOST_CHECK_EQUAL(pruner.getDroppedFrames(), 2);
+  // the base layer is always kept
+  BOOST_CHECK_EQUAL(pruner.setTargetBitrate(0.0, 4.0), 0);
+}
+
+/**
+ * @brief toNalUnit returns the NAL unit header followed by the EBSP of the RBSP
+ */
+static std::vector<uint8_t> toNalUnit(const std::vector<uint8_t>& vHeader, OBitStream& rbsp)
+{
+  // slice data containing a start code emulation
+  rbsp.write(0, 16);
+  rbsp.write(1, 8);
+  rbsp.writeRbspTrailingBits();
+  Buffer data = rbsp.data();
+  std::vector<uint8_t> vNalUnit(vHeader);
+  vNalUnit.resize(vHeader.size() + media::getMaxEbspSize(data.getSize()));
+  size_t uiSize = media::insertEmulationPrevention(data.data(), data.getSize(), &vNalUnit[vHeader.size()]);
+  vNalUnit.resize(vHeader.size() + uiSize);
+  return vNalUnit;
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_H264SliceHeaderParser)
+{
+  media::h264::H264SliceHeaderParser parser;
+  media::SliceHeaderInfo info;
+
+  // baseline SPS: log2_max_frame_num = 4, pic_order_cnt_type 0, log2_max_pic_order_cnt_lsb = 4
+  OBitStream sps;
+  sps.write(66, 8);
+  sps.write(0, 8);
+  sps.write(30, 8);
+  sps.writeUE(0);
+  sps.writeUE(0);
+  sps.writeUE(0);
+  sps.writeUE(0);
+  sps.writeUE(1);
+  sps.writeFlag(false);
+  sps.writeUE(21);
+  sps.writeUE(17);
+  sps.writeFlag(true);
+  sps.writeFlag(true);
+  sps.writeFlag(false);
+  sps.writeFlag(false);
+  std::vector<uint8_t> vSps = toNalUnit(std::vector<uint8_t>(1, 0x67), sps);
+  BOOST_CHECK(!parser.parseNalUnit(&vSps[0], vSps.size(), info));
+
+  // PPS: pic_init_qp = 22
+  OBitStream pps;
+  pps.writeUE(0);
+  pps.writeUE(0);
+  pps.writeFlag(false);
+  pps.writeFlag(false);
+  pps.writeUE(0);
+  pps.writeUE(0);
+  pps.writeUE(0);
+  pps.writeFlag(false);
+  pps.write(0, 2);
+  pps.writeSE(-4);
+  pps.writeSE(0);
+  pps.writeSE(0);
+  pps.writeFlag(true);
+  pps.writeFlag(false);
+  pps.writeFlag(false);
+  std::vector<uint8_t> vPps = toNalUnit(std::vector<uint8_t>(1, 0x68), pps);
+  BOOST_CHECK(!parser.parseNalUnit(&vPps[0], vPps.size(), info));
+
+  for (uint32_t i = 0; i < 40; ++i)
+  {
+    bool bIdr = (i == 0);
+    // every third picture is a non-reference picture
+    bool bReference = (i % 3 != 2);
+    for (uint32_t uiFirstMb = 0; uiFirstMb < 200; uiFirstMb += 100)
+    {
+      OBitStream slice;
+      slice.writeUE(uiFirstMb);
+      slice.writeUE(bIdr ? 7 : 5);
+      slice.writeUE(0);
+      slice.write(i % 16, 4);
+      if (bIdr) slice.writeUE(0);
+      slice.write((2 * i) % 16, 4);
+      if (!bIdr)
+      {
+        // num_ref_idx_active_override_flag, ref_pic_list_modification_flag_l0
+        slice.writeFlag(false);
+        slice.writeFlag(false);
+      }
+      if (bReference)
+      {
+        slice.writeFlag(false);
+        if (bIdr) slice.writeFlag(false);
+      }
+      slice.writeSE(static_cast<int32_t>(i % 5) - 2);
+      std::vector<uint8_t> vHeader(1, static_cast<uint8_t>((bReference ? 0x60 : 0x00) | (bIdr ? 5 : 1)));
+      std::vector<uint8_t> vSlice = toNalUnit(vHeader, slice);
+      BOOST_REQUIRE(parser.parseNalUnit(&vSlice[0], vSlice.size(), info));
+      BOOST_CHECK_EQUAL(info.Type, bIdr ? media::ST_I : media::ST_P);
+      BOOST_CHECK_EQUAL(info.Idr, bIdr);
+      BOOST_CHECK_EQUAL(info.Reference, bReference);
+      BOOST_CHECK_EQUAL(info.FirstSliceInPicture, uiFirstMb == 0);
+      BOOST_CHECK_EQUAL(info.FrameNum, i % 16);
+      BOOST_CHECK_EQUAL(info.PicOrderCnt, static_cast<int32_t>(2 * i));
+      BOOST_CHECK_EQUAL(info.SliceQpDelta, static_cast<int32_t>(i % 5) - 2);
+      BOOST_CHECK_EQUAL(info.SliceQp, 22 + static_cast<int32_t>(i % 5) - 2);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_H264SliceHeaderParserAccessUnit)
+{
+  // baseline SPS and PPS (pic_init_qp = 26) followed by two IDR slices with slice_qp_delta -2 and 3
+  OBitStream sps;
+  sps.write(66, 8);
+  sps.write(0, 8);
+  sps.write(30, 8);
+  sps.writeUE(0);
+  sps.writeUE(0);
+  sps.writeUE(0);
+  sps.writeUE(0);
+  sps.writeUE(1);
+  sps.writeFlag(false);
+  sps.writeUE(21);
+  sps.writeUE(17);
+  sps.writeFlag(true);
+  sps.writeFlag(true);
+  sps.writeFlag(false);
+  sps.writeFlag(false);
+  OBitStream pps;
+  pps.writeUE(0);
+  pps.writeUE(0);
+  pps.writeFlag(false);
+  pps.writeFlag(false);
+  pps.writeUE(0);
+  pps.writeUE(0);
+  pps.writeUE(0);
+  pps.writeFlag(false);
+  pps.write(0, 2);
+  pps.writeSE(0);
+  pps.writeSE(0);
+  pps.writeSE(0);
+  pps.writeFlag(true);
+  pps.writeFlag(false);
+  pps.writeFlag(false);
+  std::vector<std::vector<uint8_t> > vNalUnits;
+  vNalUnits.push_back(toNalUnit(std::vector<uint8_t>(1, 0x67), sps));
+  vNalUnits.push_back(toNalUnit(std::vector<uint8_t>(1, 0x68), pps));
+  const int32_t qpDelta[] = { -2, 3 };
+  for (uint32_t i = 0; i < 2; ++i)
+  {
+    OBitStream slice;
+    slice.writeUE(i * 100);
+    slice.writeUE(7);
+    slice.writeUE(0);
+    slice.write(0, 4);
+    slice.writeUE(0);
+    slice.write(0, 4);
+    slice.writeFlag(false);
+    slice.writeFlag(false);
+    slice.writeSE(qpDelta[i]);
+    vNalUnits.push_back(toNalUnit(std::vector<uint8_t>(1, 0x65), slice));
+  }
+
+  // the parameter sets have four byte start codes, the first slice a three byte one and the second none
+  std::vector<media::MediaSample> accessUnit;
+  const uint32_t uiStartCodeLength[] = { 4, 4, 3, 0 };
+  for (size_t i = 0; i < vNalUnits.size(); ++i)
+  {
+    std::vector<uint8_t> vData(uiStartCodeLength[i], 0);
+    if (uiStartCodeLength[i] > 0) vData.back() = 1;
+    vData.insert(vData.end(), vNalUnits[i].begin(), vNalUnits[i].end());
+    uint8_t* pData = new uint8_t[vData.size()];
+    memcpy(pData, &vData[0], vData.size());
+    media::MediaSample mediaSample;
+    mediaSample.setData(pData, static_cast<uint32_t>(vData.size()));
+    accessUnit.push_back(mediaSample);
+  }
+
+  media::h264::H264SliceHeaderParser parser;
+  media::SliceHeaderInfo info;
+  double dAverageQp = 0.0;
+  BOOST_CHECK_EQUAL(parser.parseAccessUnit(accessUnit, info, dAverageQp), 2);
+  BOOST_CHECK_EQUAL(info.Type, media::ST_I);
+  BOOST_CHECK(info.Idr);
+  BOOST_CHECK_EQUAL(info.SliceQp, 24);
+  BOOST_CHECK_CLOSE(dAverageQp, 26.5, 0.001);
+
+  // only the NAL units from uiFirst on belong to the access unit
+  BOOST_CHECK_EQUAL(parser.parseAccessUnit(accessUnit, info, dAverageQp, 3), 1);
+  BOOST_CHECK_EQUAL(info.SliceQp, 29);
+  BOOST_CHECK_CLOSE(dAverageQp, 29.0, 0.001);
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_H265SliceHeaderParser)
+{
+  media::h265::H265SliceHeaderParser parser;
+  media::SliceHeaderInfo info;
+
+  // SPS: 352x288, 64x64 CTBs, log2_max_pic_order_cnt_lsb = 4, one short term RPS
+  OBitStream sps;
+  sps.write(0, 4);
+  sps.write(0, 3);
+  sps.writeFlag(true);
+  // profile_tier_level
+  sps.write(1, 8);
+  sps.write(0x60000000, 32);
+  sps.write(0, 16);
+  sps.write(0, 32);
+  sps.write(93, 8);
+  sps.writeUE(0);
+  sps.writeUE(1);
+  sps.writeUE(352);
+  sps.writeUE(288);
+  sps.writeFlag(false);
+  sps.writeUE(0);
+  sps.writeUE(0);
+  sps.writeUE(0);
+  sps.writeFlag(true);
+  sps.writeUE(1);
+  sps.writeUE(0);
+  sps.writeUE(0);
+  sps.writeUE(0);
+  sps.writeUE(3);
+  sps.writeUE(0);
+  sps.writeUE(3);
+  sps.writeUE(1);
+  sps.writeUE(1);
+  // scaling_list_enabled_flag, amp_enabled_flag, sample_adaptive_offset_enabled_flag, pcm_enabled_flag
+  sps.writeFlag(false);
+  sps.writeFlag(true);
+  sps.writeFlag(true);
+  sps.writeFlag(false);
+  sps.writeUE(1);
+  sps.writeUE(1);
+  sps.writeUE(0);
+  sps.writeUE(0);
+  sps.writeFlag(true);
+  sps.writeFlag(false);
+  sps.writeFlag(true);
+  sps.writeFlag(true);
+  sps.writeFlag(false);
+  sps.writeFlag(false);
+  std::vector<uint8_t> vSpsHeader = { 0x42, 0x01 };
+  std::vector<uint8_t> vSps = toNalUnit(vSpsHeader, sps);
+  BOOST_CHECK(!parser.parseNalUnit(&vSps[0], vSps.size(), info));
+
+  // PPS: init_qp = 30, dependent slice segments and cabac_init_present_flag enabled
+  OBitStream pps;
+  pps.writeUE(0);
+  pps.writeUE(0);
+  pps.writeFlag(true);
+  pps.writeFlag(false);
+  pps.write(0, 3);
+  pps.writeFlag(false);
+  pps.writeFlag(true);
+  pps.writeUE(0);
+  pps.writeUE(0);
+  pps.writeSE(4);
+  pps.write(0, 3);
+  pps.writeSE(0);
+  pps.writeSE(0);
+  pps.write(0, 6);
+  pps.writeFlag(true);
+  pps.write(0, 3);
+  pps.writeUE(0);
+  pps.write(0, 2);
+  std::vector<uint8_t> vPpsHeader = { 0x44, 0x01 };
+  std::vector<uint8_t> vPps = toNalUnit(vPpsHeader, pps);
+  BOOST_CHECK(!parser.parseNalUnit(&vPps[0], vPps.size(), info));
+
+  for (uint32_t i = 0; i < 40; ++i)
+  {
+    bool bIdr = (i == 0);
+    // independent slice segment, dependent slice segment, second independent slice segment
+    for (uint32_t uiSegment = 0; uiSegment < 3; ++uiSegment)
+    {
+      OBitStream slice;
+      slice.writeFlag(uiSegment == 0);
+      if (bIdr) slice.writeFlag(false);
+      slice.writeUE(0);
+      if (uiSegment > 0)
+      {
+        slice.writeFlag(uiSegment == 1);
+        // 30 CTBs
+        slice.write(uiSegment * 10, 5);
+      }
+      int32_t iQpDelta = static_cast<int32_t>(i % 7) - 3 + static_cast<int32_t>(uiSegment);
+      if (uiSegment != 1)
+      {
+        slice.writeUE(bIdr ? 2 : 1);
+        if (!bIdr)
+        {
+          slice.write(i % 16, 4);
+          // short_term_ref_pic_set_sps_flag, slice_temporal_mvp_enabled_flag
+          slice.writeFlag(true);
+          slice.writeFlag(true);
+        }
+        slice.writeFlag(true);
+        slice.writeFlag(true);
+        if (!bIdr)
+        {
+          // num_ref_idx_active_override_flag, cabac_init_flag, five_minus_max_num_merge_cand
+          slice.writeFlag(false);
+          slice.writeFlag(false);
+          slice.writeUE(0);
+        }
+        slice.writeSE(iQpDelta);
+      }
+      std::vector<uint8_t> vHeader = { static_cast<uint8_t>((bIdr ? 19 : 1) << 1), 0x01 };
+      std::vector<uint8_t> vSlice = toNalUnit(vHeader, slice);
+      BOOST_REQUIRE(parser.parseNalUnit(&vSlice[0], vSlice.size(), info));
+      BOOST_CHECK_EQUAL(info.Type, bIdr ? media::ST_I : media::ST_P);
+      BOOST_CHECK_EQUAL(info.Idr, bIdr);
+      BOOST_CHECK(info.Reference);
+      BOOST_CHECK_EQUAL(info.FirstSliceInPicture, uiSegment == 0);
+      BOOST_CHECK_EQUAL(info.PicOrderCnt, static_cast<int32_t>(i));
+      // dependent slice segments inherit the values of the preceding independent slice segment
+      int32_t iExpectedQpDelta = (uiSegment == 1) ? iQpDelta - 1 : iQpDelta;
+      BOOST_CHECK_EQUAL(info.SliceQpDelta, iExpectedQpDelta);
+      BOOST_CHECK_EQUAL(info.SliceQp, 30 + iExpectedQpDelta);
+    }
+  }
+}
+
+/**
+ * @brief A codec without delay that outputs each frame as is, reports the bitrate it was
+ * encoded at as QP, refuses bitrates above 2000 kbps and fails on empty frames
+ */
+class PassThroughCodec : public media::IVideoCodecTransform
+{
+public:
+  PassThroughCodec() : m_iInput(0), m_uiBitrate(500) {}
+  virtual boost::system::error_code setInputType(const media::MediaTypeDescriptor&) { return boost::system::error_code(); }
+  virtual boost::system::error_code configure(const std::string&, const std::string&) { return boost::system::error_code(); }
+  virtual boost::system::error_code initialise() { return boost::system::error_code(); }
+  virtual boost::system::error_code getOutputType(media::MediaTypeDescriptor&) { return boost::system::error_code(); }
+  virtual boost::system::error_code transform(const std::vector<media::MediaSample>& in, std::vector<media::MediaSample>& out, uint32_t& uiSize)
+  {
+    if (in.empty() || in[0].getPayloadSize() == 0)
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    out.push_back(in[0]);
+    uiSize = static_cast<uint32_t>(in[0].getPayloadSize());
+    m_stats = media::FrameStats();
+    m_stats.Encoded = true;
+    m_stats.InputFrame = m_iInput++;
+    m_stats.Qp = m_uiBitrate;
+    return boost::system::error_code();
+  }
+  virtual media::FrameStats getFrameStats() const { return m_stats; }
+  virtual boost::system::error_code setBitrate(uint32_t uiTargetBitrateKbps)
+  {
+    if (uiTargetBitrateKbps > 2000)
+      return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+    m_uiBitrate = uiTargetBitrateKbps;
+    return boost::system::error_code();
+  }
+  virtual boost::system::error_code startIntraRefresh() { return boost::system::error_code(); }
+  virtual boost::system::error_code generateIdr() { return boost::system::error_code(); }
+  virtual boost::system::error_code updateReferencePicture(uint32_t) { return boost::system::error_code(); }
+  virtual boost::system::error_code setMaxFrameSize(uint32_t) { return boost::system::error_code(); }
+  virtual boost::system::error_code setFramerate(double) { return boost::system::error_code(); }
+
+private:
+  int32_t m_iInput;
+  uint32_t m_uiBitrate;
+  media::FrameStats m_stats;
+};
+
+BOOST_AUTO_TEST_CASE(tc_test_TransformBatch)
+{
+  PassThroughCodec codec;
+  std::vector<media::BatchFrame> vBatch;
+  for (uint32_t i = 0; i < 6; ++i)
+  {
+    media::MediaSample frame;
+    frame.setData(new uint8_t[i + 1], i + 1);
+    vBatch.push_back(media::BatchFrame(frame));
+  }
+  // switches inside the batch apply from the frame that carries them: the refused one is reported
+  vBatch[2].TargetBitrateKbps = 1000;
+  vBatch[4].TargetBitrateKbps = 3000;
+
+  std::vector<media::EncodedFrame> vOut;
+  BOOST_CHECK(!codec.transformBatch(vBatch, vOut));
+  BOOST_REQUIRE_EQUAL(vOut.size(), vBatch.size());
+  const double dBitrate[] = { 500, 500, 1000, 1000, 1000, 1000 };
+  for (size_t i = 0; i < vOut.size(); ++i)
+  {
+    BOOST_REQUIRE_EQUAL(vOut[i].Samples.size(), 1);
+    BOOST_CHECK_EQUAL(vOut[i].Size, i + 1);
+    BOOST_CHECK_EQUAL(vOut[i].Stats.InputFrame, static_cast<int32_t>(i));
+    BOOST_CHECK_EQUAL(vOut[i].Stats.Qp, dBitrate[i]);
+    BOOST_CHECK_EQUAL(static_cast<bool>(vOut[i].BitrateResult), i == 4);
+  }
+
+  // on error the frames encoded before the failing one are kept after the earlier output
+  vBatch[3].Frame = media::MediaSample();
+  BOOST_CHECK(codec.transformBatch(vBatch, vOut));
+  BOOST_REQUIRE_EQUAL(vOut.size(), 9);
+  for (size_t i = 6; i < vOut.size(); ++i)
+  {
+    BOOST_CHECK_EQUAL(vOut[i].Size, i - 5);
+    BOOST_CHECK_EQUAL(vOut[i].Stats.InputFrame, static_cast<int32_t>(i));
+  }
+}
+
+/**
+ * @brief A codec with two frames of delay that outputs the frames of each group of three in
+ * the order 0 2 1 like an encoder with B-frames and drops every tenth frame
+ */
+class DelayedCodec : public media::IVideoCodecTransform
+{
+public:
+  DelayedCodec() : m_iInput(0), m_uiBitrate(0) {}
+  virtual boost::system::error_code setInputType(const media::MediaTypeDescriptor&) { return boost::system::error_code(); }
+  virtual boost::system::error_code configure(const std::string&, const std::string&) { return boost::system::error_code(); }
+  virtual boost::system::error_code initialise() { return boost::system::error_code(); }
+  virtual boost::system::error_code getOutputType(media::MediaTypeDescriptor&) { return boost::system::error_code(); }
+  virtual boost::system::error_code transform(const std::vector<media::MediaSample>& in, std::vector<media::MediaSample>& out, uint32_t& uiSize)
+  {
+    const int32_t iInput = m_iInput++;
+    if (iInput % 10 != 9) m_qDelayed.push_back(std::make_pair(iInput, in[0]));
+    uiSize = 0;
+    m_stats = media::FrameStats();
+    if (m_qDelayed.size() > 2) output(out, uiSize);
+    return boost::system::error_code();
+  }
+  virtual media::FrameStats getFrameStats() const { return m_stats; }
+  virtual boost::system::error_code flush(std::vector<media::EncodedFrame>& out)
+  {
+    while (!m_qDelayed.empty())
+    {
+      media::EncodedFrame encodedFrame;
+      output(encodedFrame.Samples, encodedFrame.Size);
+      encodedFrame.Stats = m_stats;
+      out.push_back(encodedFrame);
+    }
+    return boost::system::error_code();
+  }
+  virtual boost::system::error_code setBitrate(uint32_t uiTargetBitrateKbps) { m_uiBitrate = uiTargetBitrateKbps; return boost::system::error_code(); }
+  virtual boost::system::error_code startIntraRefresh() { return boost::system::error_code(); }
+  virtual boost::system::error_code generateIdr() { return boost::system::error_code(); }
+  virtual boost::system::error_code updateReferencePicture(uint32_t) { return boost::system::error_code(); }
+  virtual boost::system::error_code setMaxFrameSize(uint32_t) { return boost::system::error_code(); }
+  virtual boost::system::error_code setFramerate(double) { return boost::system::error_code(); }
+  uint32_t getBitrate() const { return m_uiBitrate; }
+
+private:
+  void output(std::vector<media::MediaSample>& out, uint32_t& uiSize)
+  {
+    // swap the second and third frame of each group of three
+    size_t uiIndex = (m_qDelayed.size() > 1 && m_qDelayed[0].first % 3 == 1 && m_qDelayed[1].first == m_qDelayed[0].first + 1) ? 1 : 0;
+    out.push_back(m_qDelayed[uiIndex].second);
+    uiSize = static_cast<uint32_t>(m_qDelayed[uiIndex].second.getPayloadSize());
+    m_stats.Encoded = true;
+    m_stats.InputFrame = m_qDelayed[uiIndex].first;
+    m_qDelayed.erase(m_qDelayed.begin() + uiIndex);
+  }
+
+  int32_t m_iInput;
+  uint32_t m_uiBitrate;
+  std::deque<std::pair<int32_t, media::MediaSample> > m_qDelayed;
+  media::FrameStats m_stats;
+};
+
+BOOST_AUTO_TEST_CASE(tc_test_TransformBatchWithDelay)
+{
+  // group i is the result of encoding frame i: the output belongs to Stats.InputFrame
+  DelayedCodec codec;
+  const uint32_t uiFrames = 12;
+  std::vector<media::BatchFrame> vBatch;
+  for (uint32_t i = 0; i < uiFrames; ++i)
+  {
+    // the size of each frame identifies its input frame
+    media::MediaSample frame;
+    frame.setData(new uint8_t[i + 1], i + 1);
+    vBatch.push_back(media::BatchFrame(frame));
+  }
+  std::vector<media::EncodedFrame> vOut;
+  BOOST_CHECK(!codec.transformBatch(vBatch, vOut));
+  BOOST_REQUIRE_EQUAL(vOut.size(), uiFrames);
+  BOOST_CHECK(codec.flush(vOut) == boost::system::error_code());
+
+  // output order: 0 2 1 3 5 4 6 8 7 11 10 with frame 9 dropped, the last two from the flush
+  const int32_t iInputFrames[] = { -1, -1, 0, 2, 1, 3, 5, 4, 6, -1, 8, 7, 11, 10 };
+  BOOST_REQUIRE_EQUAL(vOut.size(), sizeof(iInputFrames) / sizeof(iInputFrames[0]));
+  std::vector<bool> vCompleted(uiFrames, false);
+  for (size_t i = 0; i < vOut.size(); ++i)
+  {
+    const media::EncodedFrame& encodedFrame = vOut[i];
+    BOOST_CHECK_EQUAL(encodedFrame.Stats.InputFrame, iInputFrames[i]);
+    if (encodedFrame.Stats.InputFrame < 0)
+    {
+      // an empty group is no output, not an access unit
+      BOOST_CHECK(encodedFrame.Samples.empty());
+      BOOST_CHECK_EQUAL(encodedFrame.Size, 0);
+      continue;
+    }
+    const uint32_t uiFrame = static_cast<uint32_t>(encodedFrame.Stats.InputFrame);
+    BOOST_REQUIRE_LT(uiFrame, uiFrames);
+    BOOST_CHECK(!vCompleted[uiFrame]);
+    vCompleted[uiFrame] = true;
+    BOOST_REQUIRE_EQUAL(encodedFrame.Samples.size(), 1);
+    BOOST_CHECK_EQUAL(encodedFrame.Size, uiFrame + 1);
+    BOOST_CHECK_EQUAL(encodedFrame.Samples[0].getPayloadSize(), uiFrame + 1);
+  }
+  for (uint32_t i = 0; i < uiFrames; ++i)
+    BOOST_CHECK_EQUAL(vCompleted[i], i != 9);
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_AsyncVideoEncoder)
+{
+  DelayedCodec codec;
+  const uint32_t uiFrames = 25;
+  std::vector<uint32_t> vTags;
+  std::vector<uint32_t> vSizes;
+  uint32_t uiMaxDelay = 0;
+  {
+    media::AsyncVideoEncoder encoder(codec, [&](const boost::system::error_code& ec, const media::CompletedFrame& completedFrame)
+    {
+      BOOST_CHECK(!ec);
+      vTags.push_back(completedFrame.Tag);
+      vSizes.push_back(completedFrame.Frame.Size);
+      uiMaxDelay = std::max(uiMaxDelay, completedFrame.DelayFrames);
+    }, 4);
+    for (uint32_t i = 0; i < uiFrames; ++i)
+    {
+      // the size of each frame identifies its tag
+      media::MediaSample frame;
+      frame.setData(new uint8_t[i + 1], i + 1);
+      BOOST_CHECK(!encoder.submit(media::BatchFrame(frame, i == 5 ? 500 : 0), 100 + i));
+    }
+    BOOST_CHECK(!encoder.drain());
+    BOOST_CHECK_EQUAL(encoder.getFramesInFlight(), 0);
+    BOOST_CHECK(encoder.submit(media::BatchFrame(), 0));
+  }
+  BOOST_CHECK_EQUAL(codec.getBitrate(), 500);
+  // every frame completes exactly once with its own output or none if dropped
+  BOOST_REQUIRE_EQUAL(vTags.size(), uiFrames);
+  std::vector<bool> vCompleted(uiFrames, false);
+  for (size_t i = 0; i < vTags.size(); ++i)
+  {
+    const uint32_t uiFrame = vTags[i] - 100;
+    BOOST_REQUIRE_LT(uiFrame, uiFrames);
+    BOOST_CHECK(!vCompleted[uiFrame]);
+    vCompleted[uiFrame] = true;
+    BOOST_CHECK_EQUAL(vSizes[i], uiFrame % 10 == 9 ? 0 : uiFrame + 1);
+  }
+  // output order: 0 2 1 3 5 4 ...
+  BOOST_CHECK_EQUAL(vTags[1], 102);
+  BOOST_CHECK_EQUAL(vTags[2], 101);
+  BOOST_CHECK_GE(uiMaxDelay, 2);
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_VideoCodecPlugins)
+{
+  for (int i = 0; i < cpu::ISA_COUNT; ++i)
+  {
+    cpu::IsaLevel eIsa = cpu::ISA_COUNT;
+    BOOST_CHECK(cpu::parseIsaLevel(cpu::getName(static_cast<cpu::IsaLevel>(i)), eIsa));
+    BOOST_CHECK_EQUAL(eIsa, i);
+  }
+  cpu::IsaLevel eIsa = cpu::ISA_BASELINE;
+  BOOST_CHECK(!cpu::parseIsaLevel("sse9", eIsa));
+  BOOST_CHECK_LT(cpu::getIsaLevel(), cpu::ISA_COUNT);
+
+  // plugins are listed by file name without loading them
+  const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  BOOST_REQUIRE(boost::filesystem::create_directories(dir));
+  const char* const files[] = { "codec_x264_avx2", "codec_x264", "codec_abc_sse9", "libX264Codec", "codec_x265_avx512" };
+  const std::string sExtension = boost::filesystem::path(media::getVideoCodecPluginFilename("x264", cpu::ISA_BASELINE)).extension().string();
+  for (const char* szFile : files)
+  {
+    std::ofstream out((dir / (szFile + sExtension)).string().c_str());
+  }
+  std::vector<media::VideoCodecPluginFile> plugins = media::findVideoCodecPlugins(dir.string());
+  BOOST_REQUIRE_EQUAL(plugins.size(), 3);
+  BOOST_CHECK(plugins[0].Codec == "x264" && plugins[0].Isa == cpu::ISA_BASELINE);
+  BOOST_CHECK(plugins[1].Codec == "x264" && plugins[1].Isa == cpu::ISA_AVX2);
+  BOOST_CHECK(plugins[2].Codec == "x265" && plugins[2].Isa == cpu::ISA_AVX512);
+  BOOST_CHECK_EQUAL(boost::filesystem::path(plugins[1].Path).filename().string(), media::getVideoCodecPluginFilename("X264", cpu::ISA_AVX2));
+
+  // files that are not loadable fall back to lower builds and fail without a plugin
+  boost::system::error_code ec;
+  BOOST_CHECK(!media::loadVideoCodecPlugin(dir.string(), "x264", "H264", cpu::ISA_AVX512, ec));
+  BOOST_CHECK_EQUAL(ec, boost::system::errc::no_such_file_or_directory);
+  BOOST_CHECK(!media::loadVideoCodecPlugin(dir.string(), "openh264", "H264", cpu::ISA_AVX512, ec));
+  BOOST_CHECK_EQUAL(ec, boost::system::errc::no_such_file_or_directory);
+  boost::filesystem::remove_all(dir);
+}
+
 } // test
 } // rtp_plus_plus
@@ -0,0 +1,310 @@
+#pragma once
+#include <vector>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <rtp++/network/LossModel.h>
+#include <rtp++/network/RtpPacketSink.h>
+#include <rtp++/rfc6184/Rfc6184Packetiser.h>
+#include <rtp++/rfchevc/RfchevcPacketiser.h>
+
+namespace rtp_plus_plus {
+namespace test {
+
+static media::MediaSample createNalUnitSample(const std::vector<uint8_t>& vNalUnit, uint32_t uiRtpTime, bool bStartCode)
+{
+  uint32_t uiOffset = bStartCode ? 4 : 0;
+  uint8_t* pData = new uint8_t[vNalUnit.size() + uiOffset];
+  if (bStartCode)
+  {
+    const uint8_t startcode[4] = { 0, 0, 0, 1 };
+    memcpy(pData, startcode, 4);
+  }
+  memcpy(pData + uiOffset, &vNalUnit[0], vNalUnit.size());
+  media::MediaSample mediaSample;
+  mediaSample.setData(pData, vNalUnit.size() + uiOffset);
+  mediaSample.setRtpTime(uiRtpTime);
+  mediaSample.setNaluContainsStartCode(bStartCode);
+  return mediaSample;
+}
+
+static std::vector<uint8_t> createNalUnit(uint32_t uiSize, uint8_t uiHeader0, uint8_t uiHeader1, bool bTwoByteHeader)
+{
+  std::vector<uint8_t> vNalUnit(uiSize);
+  for (uint32_t i = 0; i < uiSize; ++i)
+    vNalUnit[i] = (uint8_t)(i * 7 + uiSize);
+  vNalUnit[0] = uiHeader0;
+  if (bTwoByteHeader) vNalUnit[1] = uiHeader1;
+  return vNalUnit;
+}
+
+/**
+ * @brief depacketises single NAL unit, aggregation and fragmentation unit packets
+ * of both payload formats
+ */
+static std::vector<std::vector<uint8_t> > depacketise(const std::vector<RtpPacket>& packets, bool bH265)
+{
+  const uint32_t uiHeaderSize = bH265 ? 2 : 1;
+  std::vector<std::vector<uint8_t> > vNalUnits;
+  std::vector<uint8_t> vPacket;
+  for (const RtpPacket& packet : packets)
+  {
+    packet.serialise(vPacket);
+    const uint8_t* pPayload = &vPacket[RtpPacket::RTP_HEADER_SIZE];
+    const size_t uiSize = vPacket.size() - RtpPacket::RTP_HEADER_SIZE;
+    uint8_t uiType = bH265 ? (pPayload[0] >> 1) & 0x3F : pPayload[0] & 0x1F;
+    if (uiType == (bH265 ? rfchevc::AP : rfc6184::STAP_A))
+    {
+      size_t uiPos = uiHeaderSize;
+      while (uiPos + 2 <= uiSize)
+      {
+        size_t uiLength = (pPayload[uiPos] << 8) | pPayload[uiPos + 1];
+        vNalUnits.push_back(std::vector<uint8_t>(pPayload + uiPos + 2, pPayload + uiPos + 2 + uiLength));
+        uiPos += 2 + uiLength;
+      }
+    }
+    else if (uiType == (bH265 ? rfchevc::FU : rfc6184::FU_A))
+    {
+      const uint8_t uiFuHeader = pPayload[uiHeaderSize];
+      if (uiFuHeader & 0x80)
+      {
+        std::vector<uint8_t> vNalUnit;
+        if (bH265)
+        {
+          vNalUnit.push_back((pPayload[0] & 0x81) | ((uiFuHeader & 0x3F) << 1));
+          vNalUnit.push_back(pPayload[1]);
+        }
+        else
+        {
+          vNalUnit.push_back((pPayload[0] & 0xE0) | (uiFuHeader & 0x1F));
+        }
+        vNalUnits.push_back(vNalUnit);
+      }
+      vNalUnits.back().insert(vNalUnits.back().end(), pPayload + uiHeaderSize + 1, pPayload + uiSize);
+    }
+    else
+    {
+      vNalUnits.push_back(std::vector<uint8_t>(pPayload, pPayload + uiSize));
+    }
+  }
+  return vNalUnits;
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_Rfc6184Packetiser)
+{
+  const uint32_t uiMaxPacketSize = 200;
+  rfc6184::Rfc6184Packetiser packetiser(uiMaxPacketSize, 96, 0x12345678, 0xFFFE);
+
+  // SPS, PPS and SEI are aggregated, a large IDR slice is fragmented and a small slice fits a single NAL unit packet
+  std::vector<std::vector<uint8_t> > vNalUnits;
+  vNalUnits.push_back(createNalUnit(10, 0x67, 0, false));
+  vNalUnits.push_back(createNalUnit(4, 0x68, 0, false));
+  vNalUnits.push_back(createNalUnit(20, 0x06, 0, false));
+  vNalUnits.push_back(createNalUnit(1000, 0x65, 0, false));
+  vNalUnits.push_back(createNalUnit(150, 0x65, 0, false));
+  std::vector<media::MediaSample> accessUnit;
+  for (size_t i = 0; i < vNalUnits.size(); ++i)
+    accessUnit.push_back(createNalUnitSample(vNalUnits[i], 3000, i % 2 == 0));
+
+  std::vector<RtpPacket> packets;
+  packetiser.packetise(accessUnit, packets);
+  // STAP-A + 6 FU-A (998 bytes in fragments of 186) + single NAL unit packet
+  BOOST_REQUIRE_EQUAL(packets.size(), 8);
+  BOOST_CHECK_EQUAL(packets[0].getSize(), 12 + 1 + 3 * 2 + 10 + 4 + 20);
+  uint32_t uiHeaderBytes = 0;
+  for (size_t i = 0; i < packets.size(); ++i)
+  {
+    BOOST_CHECK(packets[i].getSize() <= uiMaxPacketSize);
+    BOOST_CHECK_EQUAL(packets[i].getSequenceNumber(), (uint16_t)(0xFFFE + i));
+    BOOST_CHECK_EQUAL(packets[i].getRtpTime(), 3000);
+    BOOST_CHECK_EQUAL(packets[i].getSsrc(), 0x12345678);
+    BOOST_CHECK_EQUAL(packets[i].getPayloadType(), 96);
+    BOOST_CHECK_EQUAL(packets[i].isMarkerSet(), i == packets.size() - 1);
+    uiHeaderBytes += packets[i].getHeaderSize();
+  }
+  BOOST_CHECK_EQUAL(uiHeaderBytes, 8 * 12 + (1 + 3 * 2) + 6 * 2);
+  // STAP-A NRI is the maximum of the aggregated NAL units
+  std::vector<uint8_t> vPacket;
+  packets[0].serialise(vPacket);
+  BOOST_CHECK_EQUAL(vPacket[12], 0x60 | rfc6184::STAP_A);
+  // payloads are referenced and not copied: the start code is skipped
+  BOOST_CHECK(packets[7].getSegmentData(1) == accessUnit[4].getDataBuffer().data() + 4);
+  BOOST_CHECK(depacketise(packets, false) == vNalUnits);
+
+  // sequence numbers continue with the next access unit
+  std::vector<RtpPacket> next;
+  packetiser.packetise(std::vector<media::MediaSample>(1, accessUnit[4]), next);
+  BOOST_REQUIRE_EQUAL(next.size(), 1);
+  BOOST_CHECK_EQUAL(next[0].getSequenceNumber(), 6);
+  BOOST_CHECK(next[0].isMarkerSet());
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_RfchevcPacketiser)
+{
+  const uint32_t uiMaxPacketSize = 300;
+  rfchevc::RfchevcPacketiser packetiser(uiMaxPacketSize, 97, 1, 0);
+
+  // VPS, SPS, PPS are aggregated, the IDR slice with TID 0 is fragmented
+  std::vector<std::vector<uint8_t> > vNalUnits;
+  vNalUnits.push_back(createNalUnit(24, 32 << 1, 0x01, true));
+  vNalUnits.push_back(createNalUnit(40, 33 << 1, 0x01, true));
+  vNalUnits.push_back(createNalUnit(8, 34 << 1, 0x01, true));
+  vNalUnits.push_back(createNalUnit(2000, 19 << 1, 0x01, true));
+  std::vector<media::MediaSample> accessUnit;
+  for (size_t i = 0; i < vNalUnits.size(); ++i)
+    accessUnit.push_back(createNalUnitSample(vNalUnits[i], 0, false));
+
+  std::vector<RtpPacket> packets;
+  packetiser.packetise(accessUnit, packets);
+  // AP + 8 FUs (1998 bytes in fragments of 285)
+  BOOST_REQUIRE_EQUAL(packets.size(), 9);
+  std::vector<uint8_t> vPacket;
+  packets[0].serialise(vPacket);
+  BOOST_CHECK_EQUAL(vPacket[12], rfchevc::AP << 1);
+  BOOST_CHECK_EQUAL(vPacket[13], 0x01);
+  packets[1].serialise(vPacket);
+  BOOST_CHECK_EQUAL(vPacket[12], rfchevc::FU << 1);
+  BOOST_CHECK_EQUAL(vPacket[14], 0x80 | 19);
+  for (const RtpPacket& packet : packets)
+    BOOST_CHECK(packet.getSize() <= uiMaxPacketSize);
+  BOOST_CHECK(packets.back().isMarkerSet());
+  BOOST_CHECK(depacketise(packets, true) == vNalUnits);
+}
+
+static std::vector<std::vector<uint8_t> > getPayloads(const std::vector<media::MediaSample>& nalUnits)
+{
+  std::vector<std::vector<uint8_t> > vNalUnits;
+  for (const media::MediaSample& mediaSample : nalUnits)
+  {
+    const uint8_t* pData = mediaSample.getDataBuffer().data();
+    vNalUnits.push_back(std::vector<uint8_t>(pData, pData + mediaSample.getPayloadSize()));
+  }
+  return vNalUnits;
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_NalUnitPacketiserDepacketise)
+{
+  std::vector<std::vector<uint8_t> > vNalUnits;
+  vNalUnits.push_back(createNalUnit(10, 0x67, 0, false));
+  vNalUnits.push_back(createNalUnit(4, 0x68, 0, false));
+  vNalUnits.push_back(createNalUnit(1000, 0x65, 0, false));
+  vNalUnits.push_back(createNalUnit(150, 0x41, 0, false));
+  std::vector<media::MediaSample> accessUnit;
+  for (size_t i = 0; i < vNalUnits.size(); ++i)
+    accessUnit.push_back(createNalUnitSample(vNalUnits[i], 3000, i % 2 == 0));
+
+  rfc6184::Rfc6184Packetiser packetiser(200, 96, 1, 0xFFFF);
+  std::vector<RtpPacket> packets;
+  packetiser.packetise(accessUnit, packets);
+  BOOST_REQUIRE_EQUAL(packets.size(), 8);
+  std::vector<media::MediaSample> nalUnits;
+  packetiser.depacketise(packets, nalUnits);
+  BOOST_CHECK(getPayloads(nalUnits) == vNalUnits);
+  BOOST_CHECK_EQUAL(nalUnits[0].getRtpTime(), 3000);
+
+  // a missing fragment discards the fragmented NAL unit only
+  std::vector<RtpPacket> received(packets);
+  received.erase(received.begin() + 3);
+  nalUnits.clear();
+  packetiser.depacketise(received, nalUnits);
+  std::vector<std::vector<uint8_t> > vExpected(vNalUnits);
+  vExpected.erase(vExpected.begin() + 2);
+  BOOST_CHECK(getPayloads(nalUnits) == vExpected);
+
+  // losing the aggregation packet loses all aggregated NAL units
+  received.assign(packets.begin() + 1, packets.end());
+  nalUnits.clear();
+  packetiser.depacketise(received, nalUnits);
+  BOOST_CHECK(getPayloads(nalUnits) == std::vector<std::vector<uint8_t> >(vNalUnits.begin() + 2, vNalUnits.end()));
+
+  std::vector<std::vector<uint8_t> > vHevcNalUnits;
+  vHevcNalUnits.push_back(createNalUnit(24, 32 << 1, 0x01, true));
+  vHevcNalUnits.push_back(createNalUnit(2000, 19 << 1, 0x01, true));
+  std::vector<media::MediaSample> hevcAccessUnit;
+  for (size_t i = 0; i < vHevcNalUnits.size(); ++i)
+    hevcAccessUnit.push_back(createNalUnitSample(vHevcNalUnits[i], 0, false));
+  rfchevc::RfchevcPacketiser hevcPacketiser(300, 97, 1, 0);
+  packets.clear();
+  hevcPacketiser.packetise(hevcAccessUnit, packets);
+  nalUnits.clear();
+  hevcPacketiser.depacketise(packets, nalUnits);
+  BOOST_CHECK(getPayloads(nalUnits) == vHevcNalUnits);
+  packets.pop_back();
+  nalUnits.clear();
+  hevcPacketiser.depacketise(packets, nalUnits);
+  BOOST_CHECK(getPayloads(nalUnits) == std::vector<std::vector<uint8_t> >(1, vHevcNalUnits[0]));
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_LossModel)
+{
+  BOOST_CHECK(!network::LossModel::create("bernoulli", 1));
+  BOOST_CHECK(!network::LossModel::create("bernoulli:1.5", 1));
+  BOOST_CHECK(!network::LossModel::create("ge:0.1", 1));
+  BOOST_CHECK(!network::LossModel::create("uniform:0.1", 1));
+  // bursts this short can not reach the loss rate: p(good to bad) would be above 1
+  BOOST_CHECK(!network::LossModel::create("ge:0.9:1", 1));
+  BOOST_CHECK(!network::LossModel::create("ge:0.75:1:0.0:0.8", 1));
+  std::unique_ptr<network::LossModel> pLimit = network::LossModel::create("ge:0.5:1", 1);
+  BOOST_REQUIRE(pLimit);
+  BOOST_CHECK_CLOSE(static_cast<network::GilbertElliottLossModel*>(pLimit.get())->getGoodToBadProbability(), 1.0, 0.001);
+
+  // the same seed reproduces the same loss pattern
+  std::unique_ptr<network::LossModel> pFirst = network::LossModel::create("ge:0.05:4", 42);
+  std::unique_ptr<network::LossModel> pSecond = network::LossModel::create("ge:0.05:4", 42);
+  BOOST_REQUIRE(pFirst && pSecond);
+  bool bSame = true;
+  for (int i = 0; i < 10000; ++i)
+    bSame &= pFirst->isLost() == pSecond->isLost();
+  BOOST_CHECK(bSame);
+
+  const uint32_t uiPackets = 200000;
+  std::unique_ptr<network::LossModel> pBernoulli = network::LossModel::create("bernoulli:0.1", 7);
+  for (uint32_t i = 0; i < uiPackets; ++i)
+    pBernoulli->isLost();
+  BOOST_CHECK_EQUAL(pBernoulli->getPacketCount(), uiPackets);
+  BOOST_CHECK_CLOSE(pBernoulli->getLossCount() / (double)uiPackets, 0.1, 5.0);
+
+  // loss rate and mean burst length match the parameters
+  std::unique_ptr<network::LossModel> pGilbert = network::LossModel::create("ge:0.05:4", 7);
+  uint32_t uiBursts = 0;
+  bool bPreviousLost = false;
+  for (uint32_t i = 0; i < uiPackets; ++i)
+  {
+    bool bLost = pGilbert->isLost();
+    if (bLost && !bPreviousLost) ++uiBursts;
+    bPreviousLost = bLost;
+  }
+  BOOST_CHECK_CLOSE(pGilbert->getLossCount() / (double)uiPackets, 0.05, 10.0);
+  BOOST_CHECK_CLOSE(pGilbert->getLossCount() / (double)uiBursts, 4.0, 10.0);
+}
+
+BOOST_AUTO_TEST_CASE(tc_test_UdpRtpPacketSink)
+{
+  boost::asio::io_service ioService;
+  boost::asio::ip::udp::socket receiver(ioService, boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+  std::ostringstream descriptor;
+  descriptor << "udp:127.0.0.1:" << receiver.local_endpoint().port();
+  std::unique_ptr<network::RtpPacketSink> pSink = network::RtpPacketSink::create(descriptor.str());
+  BOOST_REQUIRE(pSink);
+  BOOST_CHECK(!network::RtpPacketSink::create("udp:127.0.0.1"));
+  BOOST_CHECK(network::RtpPacketSink::create("null"));
+
+  rfc6184::Rfc6184Packetiser packetiser(1400, 96, 7, 0);
+  std::vector<media::MediaSample> accessUnit;
+  accessUnit.push_back(createNalUnitSample(createNalUnit(3000, 0x65, 0, false), 0, false));
+  std::vector<RtpPacket> packets;
+  packetiser.packetise(accessUnit, packets);
+  pSink->send(packets);
+  BOOST_CHECK_EQUAL(pSink->getPacketCount(), packets.size());
+
+  std::vector<uint8_t> vExpected;
+  std::vector<uint8_t> vReceived(2048);
+  for (const RtpPacket& packet : packets)
+  {
+    packet.serialise(vExpected);
+    size_t uiReceived = receiver.receive(boost::asio::buffer(vReceived));
+    BOOST_CHECK(std::vector<uint8_t>(vReceived.begin(), vReceived.begin() + uiReceived) == vExpected);
+  }
+}
+
+} // test
+} // rtp_plus_plus
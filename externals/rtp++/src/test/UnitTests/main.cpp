@@ -25,7 +25,10 @@
 #pragma warning(pop)     // restore original warning level
 #endif
 
+#include "BitStream.h"
+#include "Diagnostics.h"
 #include "Media.h"
+#include "Rtp.h"
 
 using namespace std;
 using namespace rtp_plus_plus::test;
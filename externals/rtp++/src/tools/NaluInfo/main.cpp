@@ -16,10 +16,14 @@
 #pragma warning(pop)     // restore original warning level
 #endif
 
+#include <fstream>
+#include <numeric>
 #include <boost/exception/all.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 #include <rtp++/media/NalUnitMediaSource.h>
+#include <rtp++/media/h264/H264SliceHeaderParser.h>
+#include <rtp++/media/h265/H265SliceHeaderParser.h>
 
 using namespace boost::program_options;
 using namespace rtp_plus_plus;
@@ -53,6 +57,53 @@ void validateFps(const double dFps)
   }
 }
 
+/**
+ * @brief Per AU summary of the slice headers
+ */
+struct AccessUnitSliceInfo
+{
+  AccessUnitSliceInfo()
+    :Slices(0),
+    MinQp(0),
+    MaxQp(0)
+  {
+  }
+  // header of the first slice in the AU
+  media::SliceHeaderInfo First;
+  uint32_t Slices;
+  int32_t MinQp;
+  int32_t MaxQp;
+};
+
+/**
+ * @brief parseSliceHeaders parses the slice headers of all NAL units in the AU
+ */
+template <typename T>
+AccessUnitSliceInfo parseSliceHeaders(T& parser, const std::vector<media::MediaSample>& nalus)
+{
+  AccessUnitSliceInfo auInfo;
+  for (auto& mediaSample : nalus)
+  {
+    media::SliceHeaderInfo info;
+    if (parser.parseNalUnit(mediaSample.getDataBuffer().data(), mediaSample.getPayloadSize(), info))
+    {
+      if (auInfo.Slices == 0)
+      {
+        auInfo.First = info;
+        auInfo.MinQp = info.SliceQp;
+        auInfo.MaxQp = info.SliceQp;
+      }
+      else
+      {
+        auInfo.MinQp = std::min(auInfo.MinQp, info.SliceQp);
+        auInfo.MaxQp = std::max(auInfo.MaxQp, info.SliceQp);
+      }
+      ++auInfo.Slices;
+    }
+  }
+  return auInfo;
+}
+
 /**
  * @brief main
  * @param argc
@@ -71,6 +122,9 @@ int main(int argc, char** argv)
     std::string sOutput;
     bool bExtractBaseLayer;
     bool bOutputVideoMetaData;
+    bool bUseIndexFile;
+    bool bLazyIndexing;
+    std::string sSliceInfo;
 
     options_description desc("Allowed options");
     desc.add_options()
@@ -83,6 +137,9 @@ int main(int argc, char** argv)
         ("output,o", value<std::string>(&sOutput)->default_value(""), "Outfile")
         ("extractBl,x", bool_switch(&bExtractBaseLayer)->default_value(false), "Extract base layer only (for SVC streams) to output file")
         ("output-meta-data,m", bool_switch(&bOutputVideoMetaData)->default_value(false), "Output video meta data to files (file source only)")
+        ("index", bool_switch(&bUseIndexFile)->default_value(false), "Use/create AU index file (<<input>>.auidx)")
+        ("lazy-index", bool_switch(&bLazyIndexing)->default_value(false), "Index stream in background while reading")
+        ("slice-info,s", value<std::string>(&sSliceInfo)->default_value(""), "Parse slice headers and write per AU info to file [- for stdout]")
         ;
 
     positional_options_description p;
@@ -115,11 +172,36 @@ int main(int argc, char** argv)
         return -1;
       }
     }
-    media::NalUnitMediaSource naluMediaSource(sInput, sMediaType, false, 0);
+    media::NalUnitMediaSource naluMediaSource(sInput, sMediaType, false, 0, 20000, bUseIndexFile, bLazyIndexing);
     int iCount = 0;
     int iNalCount = 0;
     double dAuDuration = 1.0/dFps;
 
+    // the columns start with Frame and Time so that the file can be joined with the ECSR #1 frame records
+    std::ofstream sliceInfoFile;
+    std::ostream* pSliceInfo = nullptr;
+    if (!sSliceInfo.empty())
+    {
+      if (sSliceInfo == "-")
+      {
+        pSliceInfo = &std::cout;
+      }
+      else
+      {
+        sliceInfoFile.open(sSliceInfo.c_str(), std::ios_base::out | std::ios_base::trunc);
+        if (!sliceInfoFile.is_open())
+        {
+          LOG(ERROR) << "Failed to open " << sSliceInfo;
+          return -1;
+        }
+        pSliceInfo = &sliceInfoFile;
+      }
+      *pSliceInfo << "Frame Time Size NALUs Slices Type IDR Ref FrameNum POC TId QPDelta QP MinQP MaxQP\n";
+    }
+    media::h264::H264SliceHeaderParser h264Parser;
+    media::h265::H265SliceHeaderParser h265Parser;
+    bool bH265 = (sMediaType == rfchevc::H265);
+
     while (naluMediaSource.isGood())
     {
       std::vector<media::MediaSample> nalus = naluMediaSource.getNextAccessUnit();
@@ -140,6 +222,23 @@ int main(int argc, char** argv)
           }
           LOG(INFO) << "AU " << iCount << " Start: " << dAuDuration * iCount << " Size: " << uiTotalAuSize << " (" << sizes.str() << ") ";
         }
+        if (pSliceInfo)
+        {
+          AccessUnitSliceInfo auInfo = bH265 ? parseSliceHeaders(h265Parser, nalus) : parseSliceHeaders(h264Parser, nalus);
+          std::ostream& out = *pSliceInfo;
+          out << iCount << " " << dAuDuration * iCount << " " << uiTotalAuSize << " " << nalus.size() << " " << auInfo.Slices << " ";
+          if (auInfo.Slices > 0)
+          {
+            const media::SliceHeaderInfo& info = auInfo.First;
+            out << media::toString(info.Type) << " " << info.Idr << " " << info.Reference << " "
+                << info.FrameNum << " " << info.PicOrderCnt << " " << info.TemporalId << " "
+                << info.SliceQpDelta << " " << info.SliceQp << " " << auInfo.MinQp << " " << auInfo.MaxQp << "\n";
+          }
+          else
+          {
+            out << "- - - - - - - - - -\n";
+          }
+        }
         ++iCount;
       }
     }
@@ -0,0 +1,65 @@
+#!/bin/bash
+# Encodes each sequence in sequences.cfg at a bitrate ladder with x265, once with full analysis and
+# once reusing the analysis of a reference encode, and reports the time saved and the rate and
+# quality deviation of every rung.
+# usage: analysis_ladder.sh <reference kbps> <kbps> [<kbps> ...]
+
+sequences=sequences.cfg
+# x265 exchanges the analysis through a file: keep it on tmpfs
+analysis_dir=/dev/shm
+
+if [ $# -lt 2 ]; then
+  echo "usage: $0 <reference kbps> <kbps> [<kbps> ...]"
+  exit -1
+fi
+reference_rate=$1
+shift
+ladder=("$@")
+
+# summary <log>: prints the encoding time, bitrate and Y-PSNR of the x265 summary line
+summary() {
+  grep "X265 summary" $1 | tail -n1 | sed -e 's/.*encoding time: \([^ ]*\) ms.*bitrate: \([^ ]*\) kbps Y-PSNR: \([^ ]*\) dB.*/\1 \2 \3/'
+}
+
+# encode <sequence> <width> <height> <fps> <kbps> <out> <analysis mode> <analysis file>
+encode() {
+  GLOG_v=0 GLOG_logtostderr=0 ../EvalCodecStepResponse -i $1 -f $4 -w $2 -h $3 --video-codec h265 --vc-impl x265 -o $6 -L logs -l EvalCodecStepResponse_$6 --rate-descriptor "$5:-1" \
+    --vc-param "analysis-mode=$7" --vc-param "analysis-file=$8" --vc-param "psnr=1" > /dev/null 2>&1
+  res=$?
+  if [ $res -ne 0 ]; then
+    echo "Error encoding $6" >&2
+    return 1
+  fi
+  summary logs/EvalCodecStepResponse.INFO
+}
+
+mkdir -p logs
+
+while read sequence width height fps total_frames
+do
+  if [[ $sequence = \#* ]]; then
+    continue
+  fi
+
+  fn=$(basename $sequence)
+  base_fn=${fn%.*}
+  id=$base_fn"_"$width"_"$height"_"$fps"_x265"
+  analysis_file=$analysis_dir/"$id"_$reference_rate.analysis
+
+  echo "Sequence: $sequence $width"x"$height@$fps reference: $reference_rate kbps"
+  ref=($(encode $sequence $width $height $fps $reference_rate "enc_$id"_"$reference_rate"_save save $analysis_file)) || exit -1
+  echo "Reference: ${ref[1]} kbps Y-PSNR: ${ref[2]} dB encoding time: ${ref[0]} ms"
+
+  csv_file="ladder_$id".csv
+  echo "Rate FullTimeMs LoadTimeMs TimeSavedMs FullKbps LoadKbps RateDeviation FullPsnr LoadPsnr PsnrDeviation" > $csv_file
+  for rate in "${ladder[@]}"
+  do
+    full=($(encode $sequence $width $height $fps $rate "enc_$id"_"$rate"_full off $analysis_file)) || exit -1
+    load=($(encode $sequence $width $height $fps $rate "enc_$id"_"$rate"_load load $analysis_file)) || exit -1
+    echo "$rate ${full[0]} ${load[0]} ${full[1]} ${load[1]} ${full[2]} ${load[2]}" | \
+      awk '{ printf "%s %s %s %.1f %s %s %.4f %s %s %.3f\n", $1, $2, $3, $2 - $3, $4, $5, ($5 - $4) / $4, $6, $7, $7 - $6 }' >> $csv_file
+  done
+  column -t $csv_file
+  rm -f $analysis_file
+
+done < $sequences
@@ -0,0 +1,122 @@
+#!/bin/bash
+# Encodes a synthetic sequence with every available codec wrapper over a grid of presets,
+# resolutions and thread counts at constant quality and collects the steady-state fps, the CPU
+# seconds per frame, the p99 encode latency, the resulting bitrate, the resident memory of the
+# initialised codec, the peak RSS while encoding and the allocation rate in one CSV file.
+# Wrappers that are not compiled in are skipped. Allocation counting slows down every allocation:
+# the allocation rate is only collected with COUNT_ALLOCATIONS=1.
+# usage: [COUNT_ALLOCATIONS=1] encoder_matrix.sh [frames] [threads ...]
+
+frames=${1:-300}
+shift
+threads=("$@")
+if [ ${#threads[@]} -eq 0 ]; then
+  threads=(1 2 4 8)
+fi
+fps=30
+warmup=30
+resolutions=("352x288" "1280x720" "1920x1080" "3840x2160")
+# the synthetic sequences are generated once and looped: replace them with YUV 4:2:0 sequences
+# of the same name to benchmark on natural content
+cache_dir=${YUV_CACHE_DIR:-yuv_cache}
+cache_frames=60
+csv_file=encoder_matrix_$(hostname).csv
+count_allocations=""
+if [ "$COUNT_ALLOCATIONS" = "1" ]; then
+  count_allocations="--count-allocations"
+fi
+cpu=$(grep -m1 "model name" /proc/cpuinfo | sed -e 's/.*: //' -e 's/,/ /g')
+
+# presets <impl>: prints the presets or complexity levels of the wrapper
+presets() {
+  case $1 in
+    x264|x265) echo "ultrafast veryfast medium slow" ;;
+    openh264) echo "0 1 2" ;;
+    *) echo "default" ;;
+  esac
+}
+
+# quality <impl>: prints the constant quality parameter of the wrapper
+quality() {
+  case $1 in
+    x264) echo "crf=23" ;;
+    x265) echo "crf=28" ;;
+    openh264) echo "qp=26" ;;
+    *) echo "" ;;
+  esac
+}
+
+# params <impl> <preset> <threads>: prints the --vc-param arguments
+params() {
+  case $1 in
+    x264|x265) echo "--vc-param preset=$2 --vc-param threads=$3 --vc-param $(quality $1)" ;;
+    openh264) echo "--vc-param complexity=$2 --vc-param threads=$3 --vc-param $(quality $1)" ;;
+    *) echo "" ;;
+  esac
+}
+
+# sequence <width> <height>: prints the cached sequence, generating it if required
+sequence() {
+  yuv=$cache_dir/synthetic_$1x$2.yuv
+  if [ ! -f $yuv ]; then
+    if ! command -v ffmpeg > /dev/null; then
+      echo "ffmpeg is required to generate $yuv" >&2
+      return 1
+    fi
+    ffmpeg -loglevel error -f lavfi -i testsrc2=size=$1x$2:rate=$fps -frames:v $cache_frames -pix_fmt yuv420p -f rawvideo $yuv || return 1
+  fi
+  echo $yuv
+}
+
+mkdir -p logs $cache_dir
+# the source repeats without its first frame
+repeat_count=$(( (frames - cache_frames + cache_frames - 2) / (cache_frames - 1) ))
+# a repeat count of 0 loops forever
+repeat=""
+if [ $repeat_count -gt 0 ]; then
+  repeat="-r -c $repeat_count"
+fi
+
+echo "host,cpu,impl,preset,width,height,threads,quality,frames,fps,cpu_s_per_frame,p50_ms,p99_ms,kbps,codec_kb,peak_rss_kb,allocs_per_s,alloc_mb_per_s" > $csv_file
+for codec in "x264 h264" "x265 h265" "openh264 h264"
+do
+  pair=($codec)
+  impl=${pair[0]}
+  video_codec=${pair[1]}
+  for resolution in "${resolutions[@]}"
+  do
+    width=${resolution%x*}
+    height=${resolution#*x}
+    yuv=$(sequence $width $height) || exit -1
+    for preset in $(presets $impl)
+    do
+      for t in "${threads[@]}"
+      do
+        id="$impl"_"$preset"_"$width"x"$height"_t$t
+        echo "Encoding $id"
+        # the rate is only used by wrappers without a constant quality mode
+        GLOG_v=0 GLOG_logtostderr=0 ../EvalCodecStepResponse -i $yuv -f $fps -w $width -h $height $repeat \
+          --video-codec $video_codec --vc-impl $impl -o enc_$id -L logs -l EvalCodecStepResponse_$id \
+          --rate-mode 1 --rate-descriptor "0.1:-1" --warmup-frames $warmup $count_allocations $(params $impl $preset $t) > /dev/null 2>&1
+        res=$?
+        rm -f enc_$id.*
+        if [ $res -ne 0 ]; then
+          echo "Skipping $impl: encoding failed" >&2
+          continue 3
+        fi
+        throughput=($(grep "Throughput:" logs/EvalCodecStepResponse.INFO | tail -n1 | \
+          sed -e 's/.*frames: \([^ ]*\) warmup: [^ ]* fps: \([^ ]*\) CPU s\/frame: \([^ ]*\) p50 latency: \([^ ]*\) ms p99 latency: \([^ ]*\) ms kbps: \([^ ]*\).*/\1 \2 \3 \4 \5 \6/'))
+        # the last codec delta: anonymous memory, or the RSS on kernels without smaps_rollup
+        codec_kb=$(grep "after initialise RSS:" logs/EvalCodecStepResponse.INFO | tail -n1 | sed -e 's/.*(codec: \([^ ]*\) kB).*/\1/')
+        memory_line=$(grep "Memory: RSS:" logs/EvalCodecStepResponse.INFO | tail -n1)
+        memory=($(echo "$memory_line" | sed -e 's/.*peak RSS[^:]*: \([^ ]*\) kB.*/\1/'))
+        if [ -n "$count_allocations" ]; then
+          memory+=($(echo "$memory_line" | sed -e 's/.*allocations\/s: \([^ ]*\) allocated MB\/s: \([^ ]*\).*/\1 \2/'))
+        fi
+        q=$(quality $impl)
+        echo "$(hostname),$cpu,$impl,$preset,$width,$height,$t,${q:-rate},${throughput[0]},${throughput[1]},${throughput[2]},${throughput[3]},${throughput[4]},${throughput[5]},$codec_kb,${memory[0]},${memory[1]},${memory[2]}" >> $csv_file
+      done
+    done
+  done
+done
+column -s, -t $csv_file
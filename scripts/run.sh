@@ -5,6 +5,23 @@ rates=rates.cfg
 sequences=sequences.cfg
 cmd_template=EvalCodecStepResponse.template
 
+# the tools are run from the parent directory like the decoders: NaluInfo is built into the
+# rtp++ bin directory unless it has been copied there. NALU_INFO overrides the location.
+nalu_info=$NALU_INFO
+if [ -z "$nalu_info" ]; then
+  for candidate in ../NaluInfo ../../externals/rtp++/bin/NaluInfo
+  do
+    if [ -x $candidate ]; then
+      nalu_info=$candidate
+      break
+    fi
+  done
+fi
+if [ -z "$nalu_info" ] || [ ! -x "$nalu_info" ]; then
+  echo "NaluInfo not found: build it or set NALU_INFO"
+  exit -1
+fi
+
 # iterate over all codecs, rates, and sequences
 
 while read name codec codec_mt file_ext decoder dec_if codec_parameters
@@ -114,6 +131,15 @@ do
 	csv_file="$out".csv
         echo "Frame Time NALUs Bpp TargetBpp Size" > $csv_file
         grep "ECSR #1" logs/EvalCodecStepResponse.INFO | awk '{print $8" "$10" "$12" "$14" "$17" "$21" "}' >> "$csv_file"
+
+# per frame slice type, QP and POC: the Frame column joins with $csv_file
+        echo "Parsing slice headers"
+        "$nalu_info" -i "$out"."$file_ext" -f $fps -s "$out".slices.csv
+        res=$?
+        if [ $res -ne 0 ]; then
+          echo "Error parsing slice headers: $out.$file_ext"
+          exit -1
+        fi
         yuv_file="$out".yuv
 
 ## decode encoded file for PSNR
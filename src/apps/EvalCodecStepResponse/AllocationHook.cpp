@@ -0,0 +1,85 @@
+#include "stdafx.h"
+#include <cstdlib>
+#include <rtp++/util/MemoryUsage.h>
+
+// Interposes the glibc allocator so that the allocation rate of the encoders, which allocate
+// with malloc and posix_memalign rather than operator new, can be reported. Definitions in the
+// executable take precedence over libc for all shared libraries. operator new is covered since
+// libstdc++ allocates with malloc. Blocks are counted by usable size on allocation and on free.
+// Counting is off unless turned on with --count-allocations: the hook then only checks the switch.
+#if defined(__GLIBC__)
+#include <cerrno>
+#include <malloc.h>
+
+using rtp_plus_plus::memory::isAllocationCountingEnabled;
+using rtp_plus_plus::memory::onAllocate;
+using rtp_plus_plus::memory::onFree;
+
+extern "C" {
+
+void* __libc_malloc(size_t uiSize);
+void* __libc_calloc(size_t uiCount, size_t uiSize);
+void* __libc_realloc(void* p, size_t uiSize);
+void* __libc_memalign(size_t uiAlignment, size_t uiSize);
+void __libc_free(void* p);
+
+static inline void* countAllocation(void* p)
+{
+  if (p && isAllocationCountingEnabled()) onAllocate(malloc_usable_size(p));
+  return p;
+}
+
+void* malloc(size_t uiSize)
+{
+  return countAllocation(__libc_malloc(uiSize));
+}
+
+void* calloc(size_t uiCount, size_t uiSize)
+{
+  return countAllocation(__libc_calloc(uiCount, uiSize));
+}
+
+void* realloc(void* p, size_t uiSize)
+{
+  // a resize is counted as a free and an allocation
+  const bool bCount = isAllocationCountingEnabled();
+  if (p && bCount) onFree(malloc_usable_size(p));
+  void* pNew = __libc_realloc(p, uiSize);
+  if (!pNew && p && uiSize > 0)
+  {
+    // the original block is still allocated
+    if (bCount) onAllocate(malloc_usable_size(p));
+    return pNew;
+  }
+  return countAllocation(pNew);
+}
+
+void* memalign(size_t uiAlignment, size_t uiSize)
+{
+  return countAllocation(__libc_memalign(uiAlignment, uiSize));
+}
+
+void* aligned_alloc(size_t uiAlignment, size_t uiSize)
+{
+  return countAllocation(__libc_memalign(uiAlignment, uiSize));
+}
+
+int posix_memalign(void** pp, size_t uiAlignment, size_t uiSize)
+{
+  if (uiAlignment % sizeof(void*) != 0 || (uiAlignment & (uiAlignment - 1)) != 0)
+    return EINVAL;
+  void* p = countAllocation(__libc_memalign(uiAlignment, uiSize));
+  if (!p) return ENOMEM;
+  *pp = p;
+  return 0;
+}
+
+void free(void* p)
+{
+  if (!p) return;
+  if (isAllocationCountingEnabled()) onFree(malloc_usable_size(p));
+  __libc_free(p);
+}
+
+} // extern "C"
+#endif
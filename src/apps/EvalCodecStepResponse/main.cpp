@@ -1,23 +1,40 @@
 #include "stdafx.h"
 #include <chrono>
+#include <cmath>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <random>
 #include <sstream>
 #include <vector>
 #include <boost/exception/all.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/algorithm/string.hpp>
+#include <rtp++/RtpPacket.h>
+#include <rtp++/media/AsyncVideoEncoder.h>
 #include <rtp++/media/IVideoCodecTransform.h>
+#include <rtp++/media/NalUnitPacketiser.h>
+#include <rtp++/media/TemporalLayerPruner.h>
+#include <rtp++/media/VideoCodecPlugin.h>
 #include <rtp++/media/YuvMediaSource.h>
 #include <rtp++/media/h264/H264AnnexBStreamWriter.h>
 #include <rtp++/media/h265/H265AnnexBStreamWriter.h>
+#include <rtp++/network/LossModel.h>
+#include <rtp++/network/RtpPacketSink.h>
+#include <rtp++/rfc6184/Rfc6184Packetiser.h>
+#include <rtp++/rfchevc/RfchevcPacketiser.h>
 #include <rtp++/util/Conversion.h>
+#include <rtp++/util/CpuFeatures.h>
+#include <rtp++/util/Diagnostics.h>
+#include <rtp++/util/MemoryUsage.h>
+#include <rtp++/util/PerfCounters.h>
 #include <rtp++/util/StringTokenizer.h>
-#include <OpenH264Codec/OpenH264Codec.h>
-#include <X264Codec/X264Codec.h>
-#include <X265Codec/X265Codec.h>
-#ifdef ENABLE_VPP
-#include <VppH264Codec/VppH264Codec.h>
-#endif
+#include <rtp++/util/Trace.h>
+#include <OpenH264Codec/OpenH264Decoder.h>
 using namespace rtp_plus_plus;
 using namespace rtp_plus_plus::media;
 using namespace boost::program_options;
@@ -62,25 +79,59 @@ struct RateDescriptor
 {
   RateDescriptor()
     :Rate(0.0),
+      Fps(0.0),
       Duration(0.0)
   {
 
   }
-  RateDescriptor(double dRate, double dDuration)
+  RateDescriptor(double dRate, double dFps, double dDuration, const std::string& sRecovery = "")
     :Rate(dRate),
-      Duration(dDuration)
+      Fps(dFps),
+      Duration(dDuration),
+      Recovery(sRecovery)
   {
 
   }
   // rate in kbps OR bpp
   double Rate;
+  // frame rate of the segment: 0 = source frame rate
+  double Fps;
   // duration in seconds OR number of frames
   double Duration;
+  // optional recovery action at the start of the segment: idr, ref or refresh
+  std::string Recovery;
 };
 
+bool isValidRecovery(const std::string& sRecovery)
+{
+  return sRecovery == "idr" || sRecovery == "ref" || sRecovery == "refresh";
+}
+
+/**
+ * @brief parseRate parses the <<rate>>[@<<fps>>] field of a rate descriptor segment
+ */
+bool parseRate(const std::string& sRate, double& dRate, double& dFps)
+{
+  std::vector<std::string> vRateInfo = StringTokenizer::tokenize(sRate, "@", true, true);
+  if (vRateInfo.empty() || vRateInfo.size() > 2)
+    return false;
+  bool bSuccess = false;
+  dRate = convert<double>(vRateInfo[0], bSuccess);
+  if (!bSuccess)
+    return false;
+  dFps = 0.0;
+  if (vRateInfo.size() == 2)
+  {
+    dFps = convert<double>(vRateInfo[1], bSuccess);
+    if (!bSuccess || dFps <= 0.0)
+      return false;
+  }
+  return true;
+}
+
 /**
  * @brief parseRateDescriptor parses a rate descriptor string which has the form:
- * rate_descriptor = <<rate>>[:<<duration>>[|<<rate_descriptor>>]]
+ * rate_descriptor = <<rate>>[@<<fps>>][:<<duration>>[:<<recovery>>]][,<<rate_descriptor>>]
  * @param sRatesDescriptor The rate descriptor to be parsed
  * @return vector of rates
  */
@@ -93,19 +144,31 @@ std::vector<RateDescriptor> parseRateDescriptor(const std::string& sRatesDescrip
   {
     std::vector<std::string> vSegmentInfo = StringTokenizer::tokenize(sSegment, ":", true, true);
     bool bDummy;
-    if (vSegmentInfo.size() == 2)
+    double dRate = 0.0;
+    double dFps = 0.0;
+    if (vSegmentInfo.empty() || !parseRate(vSegmentInfo[0], dRate, dFps))
     {
-      double dRate = convert<double>(vSegmentInfo[0], bDummy);
+      return std::vector<RateDescriptor>();
+    }
+    if (vSegmentInfo.size() == 3)
+    {
+      double dDuration = convert<double>(vSegmentInfo[1], bDummy);
       assert(bDummy);
+      if (!isValidRecovery(vSegmentInfo[2]))
+      {
+        return std::vector<RateDescriptor>();
+      }
+      rates.push_back(RateDescriptor(dRate, dFps, dDuration, vSegmentInfo[2]));
+    }
+    else if (vSegmentInfo.size() == 2)
+    {
       double dDuration = convert<double>(vSegmentInfo[1], bDummy);
       assert(bDummy);
-      rates.push_back(RateDescriptor(dRate, dDuration));
+      rates.push_back(RateDescriptor(dRate, dFps, dDuration));
     }
     else if (vSegmentInfo.size() == 1)
     {
-      double dRate = convert<double>(vSegmentInfo[0], bDummy);
-      assert(bDummy);
-      rates.push_back(RateDescriptor(dRate, -1.0));
+      rates.push_back(RateDescriptor(dRate, dFps, -1.0));
     }
     else
     {
@@ -139,50 +202,113 @@ void validateVideoCodec(const std::string& sVideoCodec)
   }
 }
 
-void validateVideoCodecImpl(const std::string& sVideoCodecImpl)
+void validateVideoCodecImpl(const std::string& sVideoCodecImpl, const std::string& sPluginDir)
 {
-  // TODO: instead of using hard-coded string, load all DLLs in directory meeting requirements
-  std::vector<std::string> codecs = {"openh264", "x264", "x265", "vpp"};
-  auto it = std::find_if(codecs.begin(), codecs.end(), [sVideoCodecImpl](const std::string& sCodecImpl)
-  { return boost::to_upper_copy(sVideoCodecImpl) == boost::to_upper_copy(sCodecImpl);});
-  if (it == codecs.end())
+  // the codec implementations are the plugins in the plugin directory: these are only loaded once selected
+  std::vector<VideoCodecPluginFile> plugins = findVideoCodecPlugins(sPluginDir);
+  auto it = std::find_if(plugins.begin(), plugins.end(), [sVideoCodecImpl](const VideoCodecPluginFile& plugin)
+  { return boost::to_lower_copy(sVideoCodecImpl) == plugin.Codec;});
+  if (it == plugins.end())
   {
-    LOG(ERROR) << "Invalid video codec impl: " << sVideoCodecImpl;
+    std::ostringstream available;
+    for (const VideoCodecPluginFile& plugin : plugins)
+      available << " " << plugin.Codec << (plugin.Isa == cpu::ISA_BASELINE ? "" : std::string("(") + cpu::getName(plugin.Isa) + ")");
+    LOG(ERROR) << "Invalid video codec impl: " << sVideoCodecImpl << " Plugins in " << sPluginDir << ":" << available.str();
     throw validation_error(validation_error::invalid_option_value);
   }
 }
 
-std::unique_ptr<IVideoCodecTransform> createAndInitialiseCodec(const std::string& sVideoCodec, const std::string& sVideoCodecImpl, uint32_t uiWidth, uint32_t uiHeight, double dFps, const std::vector<std::string>& videoCodecParams, uint32_t uiInitialBitrateKbps)
+void validateCodecIsa(const std::string& sIsa)
 {
-  std::unique_ptr<IVideoCodecTransform> pCodec;
-  if (sVideoCodec == "H264")
+  cpu::IsaLevel eIsa;
+  if (!cpu::parseIsaLevel(sIsa, eIsa))
   {
-    if (sVideoCodecImpl == "OPENH264")
-    {
-      pCodec = std::unique_ptr<IVideoCodecTransform>(new OpenH264Codec());
-    }
-    else if (sVideoCodecImpl == "X264")
-    {
-      pCodec = std::unique_ptr<IVideoCodecTransform>(new X264Codec());
-    }
-#ifdef ENABLE_VPP
-    else if (sVideoCodecImpl == "VPP")
-    {
-      pCodec = std::unique_ptr<IVideoCodecTransform>(new VppH264Codec());
-    }
-#endif
+    LOG(ERROR) << "Invalid instruction set: " << sIsa;
+    throw validation_error(validation_error::invalid_option_value);
+  }
+}
+
+void validateRecovery(const std::string& sRecovery)
+{
+  if (!isValidRecovery(sRecovery))
+  {
+    LOG(ERROR) << "Invalid recovery: " << sRecovery;
+    throw validation_error(validation_error::invalid_option_value);
   }
-  else if (sVideoCodec == "H265")
+}
+
+void validateLossModel(const std::string& sLossModel)
+{
+  if (!network::LossModel::create(sLossModel, 0))
   {
-#ifdef ENABLE_X265
-    if (sVideoCodecImpl == "X265")
-    {
-      pCodec = std::unique_ptr<IVideoCodecTransform>(new X265Codec());
-    }
-#endif
+    LOG(ERROR) << "Invalid loss model: " << sLossModel;
+    throw validation_error(validation_error::invalid_option_value);
+  }
+}
+
+void validatePerfCounters(const std::string& sScope)
+{
+  if (sScope != "thread" && sScope != "process")
+  {
+    LOG(ERROR) << "Invalid performance counter scope: " << sScope;
+    throw validation_error(validation_error::invalid_option_value);
+  }
+}
+
+/**
+ * @brief logCodecFootprint logs the resident memory after the codec has been initialised and the
+ * growth attributed to the codec
+ */
+void logCodecFootprint(const std::string& sCodec, const memory::MemorySnapshot& before, const memory::MemorySnapshot& after)
+{
+  std::ostringstream footprint;
+  footprint << "Memory: " << sCodec << " after initialise RSS: " << after.RssKb << " kB (codec: " << after.RssKb - before.RssKb << " kB)";
+  if (after.AnonymousKb != -1)
+    footprint << " anonymous: " << after.AnonymousKb << " kB (codec: " << after.AnonymousKb - before.AnonymousKb << " kB)";
+  if (after.PssKb != -1)
+    footprint << " PSS: " << after.PssKb << " kB";
+  LOG(INFO) << footprint.str();
+}
+
+/**
+ * @brief computePsnr computes the PSNR of a plane of 8-bit samples, capped at 100 dB for identical planes
+ */
+double computePsnr(const uint8_t* pReference, const uint8_t* pTest, uint32_t uiSize)
+{
+  uint64_t uiSse = 0;
+  for (uint32_t i = 0; i < uiSize; ++i)
+  {
+    int iDiff = pReference[i] - pTest[i];
+    uiSse += iDiff * iDiff;
+  }
+  if (uiSse == 0) return 100.0;
+  return std::min(100.0, 10.0 * std::log10((255.0 * 255.0 * uiSize) / uiSse));
+}
+
+std::unique_ptr<OpenH264Decoder> createAndInitialiseDecoder(uint32_t uiWidth, uint32_t uiHeight, double dFps)
+{
+  std::unique_ptr<OpenH264Decoder> pDecoder(new OpenH264Decoder());
+  MediaTypeDescriptor mediaIn(MediaTypeDescriptor::MT_VIDEO, MediaTypeDescriptor::MST_H264, uiWidth, uiHeight, dFps);
+  if (pDecoder->setInputType(mediaIn) || pDecoder->initialise())
+  {
+    return std::unique_ptr<OpenH264Decoder>();
   }
+  return pDecoder;
+}
 
+/**
+ * @brief createAndInitialiseCodec loads the codec plugin of sVideoCodecImpl built for the highest instruction
+ * set up to eMaxIsa that the CPU supports
+ */
+std::unique_ptr<IVideoCodecTransform> createAndInitialiseCodec(const std::string& sVideoCodec, const std::string& sVideoCodecImpl, const std::string& sPluginDir, cpu::IsaLevel eMaxIsa, uint32_t uiWidth, uint32_t uiHeight, double dFps, const std::vector<std::string>& videoCodecParams, uint32_t uiInitialBitrateKbps, uint32_t uiMaxFrameSizeBytes)
+{
   boost::system::error_code ec;
+  std::unique_ptr<IVideoCodecTransform> pCodec = loadVideoCodecPlugin(sPluginDir, sVideoCodecImpl, sVideoCodec, eMaxIsa, ec);
+  if (ec)
+  {
+    LOG(ERROR) << "Failed to load " << sVideoCodecImpl << " " << sVideoCodec << " codec: " << ec.message();
+  }
+
   if (pCodec)
   {
     MediaTypeDescriptor mediaIn(MediaTypeDescriptor::MT_VIDEO, MediaTypeDescriptor::MST_YUV_420P, uiWidth, uiHeight, dFps);
@@ -226,6 +352,15 @@ std::unique_ptr<IVideoCodecTransform> createAndInitialiseCodec(const std::string
   {
     VLOG(2) << "Setting initial bitrate to " << uiInitialBitrateKbps << " kbps";
     pCodec->setBitrate(uiInitialBitrateKbps);
+    if (uiMaxFrameSizeBytes > 0)
+    {
+      VLOG(2) << "Setting max frame size to " << uiMaxFrameSizeBytes << " bytes";
+      ec = pCodec->setMaxFrameSize(uiMaxFrameSizeBytes);
+      if (ec)
+      {
+        LOG(WARNING) << "Failed to set max frame size: " << ec.message();
+      }
+    }
     ec = pCodec->initialise();
     if (ec)
     {
@@ -256,6 +391,217 @@ std::unique_ptr<MediaSink> createMediaSink(const std::string& sVideoCodec, const
   return pMediaSink;
 }
 
+std::unique_ptr<NalUnitPacketiser> createPacketiser(const std::string& sVideoCodec, uint32_t uiMaxPacketSize)
+{
+  const uint8_t uiPayloadType = 96;
+  std::random_device rd;
+  uint32_t uiSsrc = rd();
+  uint16_t uiSequenceNumber = rd() & 0xFFFF;
+  std::unique_ptr<NalUnitPacketiser> pPacketiser;
+  if ( sVideoCodec == "H264" )
+  {
+    pPacketiser = std::unique_ptr<NalUnitPacketiser>(new rfc6184::Rfc6184Packetiser(uiMaxPacketSize, uiPayloadType, uiSsrc, uiSequenceNumber));
+  }
+  else if ( sVideoCodec == "H265" )
+  {
+    pPacketiser = std::unique_ptr<NalUnitPacketiser>(new rfchevc::RfchevcPacketiser(uiMaxPacketSize, uiPayloadType, uiSsrc, uiSequenceNumber));
+  }
+  return pPacketiser;
+}
+
+/**
+ * @brief The NalSizeHistogram struct counts NAL units in power of two size classes: <= 256 bytes up to > 32768 bytes
+ */
+struct NalSizeHistogram
+{
+  static const uint32_t BINS = 9;
+  NalSizeHistogram()
+  {
+    reset();
+  }
+  void reset()
+  {
+    std::fill(Counts, Counts + BINS, 0);
+  }
+  void add(uint32_t uiSize)
+  {
+    uint32_t uiBin = 0;
+    while (uiBin < BINS - 1 && uiSize > (256u << uiBin)) ++uiBin;
+    ++Counts[uiBin];
+  }
+  uint32_t Counts[BINS];
+};
+
+/**
+ * @brief FrameStatsSummary averages the encoder reported frame stats: PSNR and SSIM
+ * are only averaged over the frames for which the encoder computed them
+ */
+struct FrameStatsSummary
+{
+  FrameStatsSummary()
+    :Frames(0), QpFrames(0), QpSum(0.0), PsnrFrames(0), PsnrYSum(0.0), SsimFrames(0), SsimSum(0.0)
+  {
+  }
+  void add(const FrameStats& stats)
+  {
+    ++Frames;
+    if (stats.Qp >= 0.0) { ++QpFrames; QpSum += stats.Qp; }
+    if (stats.PsnrY >= 0.0) { ++PsnrFrames; PsnrYSum += stats.PsnrY; }
+    if (stats.Ssim >= 0.0) { ++SsimFrames; SsimSum += stats.Ssim; }
+  }
+  uint32_t Frames;
+  uint32_t QpFrames;
+  double QpSum;
+  uint32_t PsnrFrames;
+  double PsnrYSum;
+  uint32_t SsimFrames;
+  double SsimSum;
+};
+
+/**
+ * @brief getStartCodeLength returns the length of the Annex B start code preceding the NAL unit or 0
+ */
+uint32_t getStartCodeLength(const MediaSample& mediaSample)
+{
+  const uint8_t* pData = mediaSample.getDataBuffer().data();
+  if (mediaSample.getPayloadSize() < 4 || pData[0] != 0 || pData[1] != 0) return 0;
+  if (pData[2] == 1) return 3;
+  return (pData[2] == 0 && pData[3] == 1) ? 4 : 0;
+}
+
+/**
+ * @brief isSlice returns if the NAL unit contains a coded slice
+ */
+bool isSlice(const MediaSample& mediaSample, uint32_t uiStartCodeLength, bool bH265)
+{
+  const uint8_t* pHeader = mediaSample.getDataBuffer().data() + uiStartCodeLength;
+  if (bH265)
+  {
+    // VCL NAL unit types
+    return ((pHeader[0] >> 1) & 0x3F) < 32;
+  }
+  uint8_t uiNut = pHeader[0] & 0x1F;
+  return uiNut >= 1 && uiNut <= 5;
+}
+
+/**
+ * @brief getCodecParameter looks up an unsigned codec parameter passed with --vc-param
+ */
+uint32_t getCodecParameter(const std::vector<std::string>& videoCodecParams, const std::string& sName, uint32_t uiDefault)
+{
+  uint32_t uiValue = uiDefault;
+  for (auto& item : videoCodecParams)
+  {
+    auto pair = StringTokenizer::tokenize(item, "=", true, true);
+    bool bSuccess = false;
+    if (pair.size() == 2 && pair[0] == sName)
+    {
+      uint32_t uiParsed = convert<uint32_t>(pair[1], bSuccess);
+      if (bSuccess) uiValue = uiParsed;
+    }
+  }
+  return uiValue;
+}
+
+/**
+ * @brief triggerRecovery applies a recovery action to the codec
+ * @param uiFirstLostFrame The frames from this frame on are treated as lost by reference invalidation
+ */
+boost::system::error_code triggerRecovery(IVideoCodecTransform& codec, const std::string& sRecovery, uint32_t uiFirstLostFrame)
+{
+  if (sRecovery == "idr")
+    return codec.generateIdr();
+  else if (sRecovery == "refresh")
+    return codec.startIntraRefresh();
+  return codec.updateReferencePicture(uiFirstLostFrame);
+}
+
+/**
+ * @brief The RecoveryMonitor class measures the cost of recovery actions: the bytes spent over the
+ * recovery window above the average size of the frames preceding the recovery, the peak frame size
+ * and the time to encode the first frame after the recovery was triggered
+ */
+class RecoveryMonitor
+{
+public:
+  static const uint32_t HISTORY = 10;
+
+  struct Cost
+  {
+    Cost()
+      :Count(0), Frames(0), Bytes(0), ExtraBytes(0.0), PeakFrameSize(0), EncodingTimeMs(0)
+    {
+
+    }
+    uint32_t Count;
+    uint32_t Frames;
+    uint64_t Bytes;
+    double ExtraBytes;
+    uint32_t PeakFrameSize;
+    uint64_t EncodingTimeMs;
+  };
+
+  RecoveryMonitor()
+    :m_uiFramesLeft(0), m_iStartFrame(0), m_dBaseline(0.0)
+  {
+
+  }
+  /**
+   * @brief start starts measuring a recovery spread over uiWindow frames
+   */
+  void start(const std::string& sRecovery, uint32_t uiWindow, int iFrame)
+  {
+    if (!m_sActive.empty()) finish();
+    m_sActive = sRecovery;
+    m_uiFramesLeft = std::max<uint32_t>(uiWindow, 1);
+    m_iStartFrame = iFrame;
+    m_dBaseline = m_recentSizes.empty() ? 0.0 : std::accumulate(m_recentSizes.begin(), m_recentSizes.end(), 0.0) / m_recentSizes.size();
+    m_current = Cost();
+    m_current.Count = 1;
+  }
+  void addFrame(uint32_t uiSize, uint32_t uiEncodingTimeMs)
+  {
+    if (m_sActive.empty())
+    {
+      m_recentSizes.push_back(uiSize);
+      if (m_recentSizes.size() > HISTORY) m_recentSizes.pop_front();
+      return;
+    }
+    if (m_current.Frames == 0) m_current.EncodingTimeMs = uiEncodingTimeMs;
+    ++m_current.Frames;
+    m_current.Bytes += uiSize;
+    m_current.PeakFrameSize = std::max(m_current.PeakFrameSize, uiSize);
+    if (--m_uiFramesLeft == 0) finish();
+  }
+  const std::map<std::string, Cost>& getCosts() const { return m_costs; }
+
+private:
+  void finish()
+  {
+    m_current.ExtraBytes = m_current.Bytes - m_current.Frames * m_dBaseline;
+    // rare event with a string value: logged directly rather than through the diagnostics records
+    VLOG(2) << "RECOVERY Frame " << m_iStartFrame << " type: " << m_sActive << " frames: " << m_current.Frames
+            << " bytes: " << m_current.Bytes << " extra bytes: " << m_current.ExtraBytes
+            << " peak frame: " << m_current.PeakFrameSize << " bytes time to encode: " << m_current.EncodingTimeMs << "ms";
+    Cost& total = m_costs[m_sActive];
+    total.Count += m_current.Count;
+    total.Frames += m_current.Frames;
+    total.Bytes += m_current.Bytes;
+    total.ExtraBytes += m_current.ExtraBytes;
+    total.PeakFrameSize = std::max(total.PeakFrameSize, m_current.PeakFrameSize);
+    total.EncodingTimeMs += m_current.EncodingTimeMs;
+    m_sActive.clear();
+  }
+
+  std::deque<uint32_t> m_recentSizes;
+  std::string m_sActive;
+  uint32_t m_uiFramesLeft;
+  int m_iStartFrame;
+  double m_dBaseline;
+  Cost m_current;
+  std::map<std::string, Cost> m_costs;
+};
+
 enum RateMode
 {
   RATE_MODE_KBPS = 0,
@@ -268,6 +614,505 @@ enum SwitchMode
   SWITCH_MODE_TIME = 1
 };
 
+/**
+ * @brief The RateSchedule struct holds the per segment targets of a rate descriptor in kbps
+ * and the frames at which the segments start
+ */
+struct RateSchedule
+{
+  std::vector<double> Kbps;
+  std::vector<double> Bpp;
+  std::vector<std::string> Recoveries;
+  std::vector<double> Fps;
+  // first switch to bitrate is at the beginning
+  std::vector<uint32_t> SwitchFrames = {0};
+};
+
+/**
+ * @brief createRateSchedule converts the rates to kbps and the switch points to frames
+ */
+bool createRateSchedule(const std::vector<RateDescriptor>& rates, uint32_t uiRateMode, uint32_t uiSwitchMode,
+                        uint32_t uiWidth, uint32_t uiHeight, double dFps, RateSchedule& schedule)
+{
+  uint32_t uiPreviousSwitchFrame = 0;
+  double dFrameDuration = 1.0/dFps;
+  for (RateDescriptor rate : rates)
+  {
+    schedule.Recoveries.push_back(rate.Recovery);
+    // frame rate steps only decimate the source
+    if (rate.Fps > dFps)
+    {
+      LOG(ERROR) << "Segment frame rate " << rate.Fps << " exceeds the source frame rate " << dFps;
+      return false;
+    }
+    const double dSegmentFps = rate.Fps > 0.0 ? rate.Fps : dFps;
+    schedule.Fps.push_back(dSegmentFps);
+    switch (uiRateMode)
+    {
+      case RATE_MODE_KBPS:
+      {
+        schedule.Kbps.push_back(rate.Rate);
+        schedule.Bpp.push_back(rate.Rate * 1000 /( uiWidth * uiHeight * dSegmentFps));
+        break;
+      }
+      case RATE_MODE_BPP:
+      {
+        schedule.Bpp.push_back(rate.Rate);
+        double dKbps = (rate.Rate * uiWidth * uiHeight * dSegmentFps)/1000.0;
+        schedule.Kbps.push_back(dKbps);
+        break;
+      }
+    }
+    switch (uiSwitchMode)
+    {
+      case SWITCH_MODE_FRAME:
+      {
+        uint32_t uiNextSwitch = uiPreviousSwitchFrame + rate.Duration;
+        schedule.SwitchFrames.push_back(uiNextSwitch);
+        uiPreviousSwitchFrame = uiNextSwitch;
+        break;
+      }
+      case SWITCH_MODE_TIME:
+      {
+        if (rate.Duration != -1.0)
+        {
+          uint32_t uiNextSwitch = uiPreviousSwitchFrame + (rate.Duration/dFrameDuration);
+          schedule.SwitchFrames.push_back(uiNextSwitch);
+          uiPreviousSwitchFrame = uiNextSwitch;
+        }
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief The Rendition class encodes one rate schedule of a simulcast on its own thread. The source
+ * frames are shared by all renditions: the codecs only read the frame buffers.
+ */
+class Rendition
+{
+public:
+  static const size_t MAX_QUEUED_FRAMES = 4;
+
+  Rendition(uint32_t uiIndex, std::unique_ptr<IVideoCodecTransform> pCodec, std::unique_ptr<MediaSink> pMediaSink,
+            const RateSchedule& schedule, double dFrameDuration, uint32_t uiBatchFrames)
+    :m_uiIndex(uiIndex),
+      m_pCodec(std::move(pCodec)),
+      m_pMediaSink(std::move(pMediaSink)),
+      m_schedule(schedule),
+      m_dFrameDuration(dFrameDuration),
+      m_uiBatchFrames(std::max(uiBatchFrames, 1u)),
+      m_uiMaxQueuedFrames(std::max(static_cast<size_t>(MAX_QUEUED_FRAMES), static_cast<size_t>(2 * m_uiBatchFrames))),
+      m_bShutdown(false),
+      m_bError(false),
+      m_iCodecFrames(0),
+      m_uiFrames(0),
+      m_uiBytes(0),
+      m_uiEncodingTimeUs(0),
+      m_uiMaxEncodingTimeUs(0)
+  {
+    m_thread = boost::thread(&Rendition::encodeInBackground, this);
+  }
+  ~Rendition()
+  {
+    stop();
+  }
+  /**
+   * @brief push queues a source frame for encoding and blocks while the queue is full
+   */
+  void push(int iFrame, const std::vector<MediaSample>& frame)
+  {
+    boost::mutex::scoped_lock l(m_lock);
+    while (m_qFrames.size() >= m_uiMaxQueuedFrames)
+    {
+      m_condFree.wait(l);
+    }
+    m_qFrames.push_back(std::make_pair(iFrame, frame));
+    m_condPending.notify_one();
+  }
+  /**
+   * @brief stop encodes the queued frames, flushes the codec and joins the encoding thread
+   */
+  void stop()
+  {
+    {
+      boost::mutex::scoped_lock l(m_lock);
+      m_bShutdown = true;
+    }
+    m_condPending.notify_one();
+    if (m_thread.joinable()) m_thread.join();
+  }
+  uint32_t getIndex() const { return m_uiIndex; }
+  bool hasError() const { return m_bError; }
+  uint32_t getFrames() const { return m_uiFrames; }
+  uint64_t getBytes() const { return m_uiBytes; }
+  uint64_t getEncodingTimeUs() const { return m_uiEncodingTimeUs; }
+  uint64_t getMaxEncodingTimeUs() const { return m_uiMaxEncodingTimeUs; }
+
+private:
+  /**
+   * @brief The source frame and target rate of a frame passed to the codec
+   */
+  struct PendingFrame
+  {
+    int Frame;
+    double RateKbps;
+  };
+
+  void encodeInBackground()
+  {
+    trace::setThreadName("rendition " + toString(m_uiIndex));
+    uint32_t uiSwitchIndex = 0;
+    double dCurrentRateKbps = 0.0;
+    std::vector<int> vFrameIndices;
+    std::vector<BatchFrame> batch;
+    std::vector<EncodedFrame> encodedFrames;
+    while (true)
+    {
+      // the queued frames up to the batch size are encoded in one call
+      vFrameIndices.clear();
+      batch.clear();
+      {
+        boost::mutex::scoped_lock l(m_lock);
+        while (m_qFrames.empty() && !m_bShutdown)
+        {
+          m_condPending.wait(l);
+        }
+        if (m_qFrames.empty()) break;
+        while (!m_qFrames.empty() && batch.size() < m_uiBatchFrames)
+        {
+          vFrameIndices.push_back(m_qFrames.front().first);
+          batch.push_back(BatchFrame(m_qFrames.front().second.at(0)));
+          m_qFrames.pop_front();
+        }
+      }
+      m_condFree.notify_one();
+      // keep draining the queue after an error so that the reader does not block
+      if (m_bError) continue;
+
+      // rate switches are applied by the codec before the frame that carries them
+      std::vector<double> vRatesKbps;
+      for (size_t i = 0; i < batch.size(); ++i)
+      {
+        const int iFrame = vFrameIndices[i];
+        if (uiSwitchIndex < m_schedule.SwitchFrames.size() && uiSwitchIndex < m_schedule.Kbps.size() &&
+            m_schedule.SwitchFrames[uiSwitchIndex] == static_cast<uint32_t>(iFrame))
+        {
+          dCurrentRateKbps = m_schedule.Kbps[uiSwitchIndex++];
+          VLOG(2) << "Rendition " << m_uiIndex << " setting next bitrate to " << dCurrentRateKbps << " kbps Current frame: " << iFrame;
+          batch[i].TargetBitrateKbps = static_cast<uint32_t>(dCurrentRateKbps);
+        }
+        vRatesKbps.push_back(dCurrentRateKbps);
+        PendingFrame pending = { iFrame, dCurrentRateKbps };
+        m_pending[m_iCodecFrames++] = pending;
+      }
+
+      boost::posix_time::ptime tStart = boost::posix_time::microsec_clock::universal_time();
+      encodedFrames.clear();
+      boost::system::error_code ec;
+      {
+        TRACE_SCOPE("encode");
+        ec = m_pCodec->transformBatch(batch, encodedFrames);
+      }
+      uint64_t uiEncodingTimeUs = (boost::posix_time::microsec_clock::universal_time() - tStart).total_microseconds();
+      if (ec)
+      {
+        LOG(WARNING) << "Rendition " << m_uiIndex << " error in media encode: " << ec.message();
+        m_bError = true;
+      }
+      // a batch is timed as a whole: frames are attributed the average
+      const uint64_t uiFrameTimeUs = uiEncodingTimeUs / batch.size();
+      m_uiFrames += batch.size();
+      m_uiEncodingTimeUs += uiEncodingTimeUs;
+      m_uiMaxEncodingTimeUs = std::max(m_uiMaxEncodingTimeUs, uiFrameTimeUs);
+      // group i is the result of encoding batch[i]: its output may belong to an earlier input frame
+      for (size_t i = 0; i < encodedFrames.size(); ++i)
+      {
+        const EncodedFrame& encodedFrame = encodedFrames[i];
+        if (encodedFrame.BitrateResult)
+        {
+          LOG(WARNING) << "Rendition " << m_uiIndex << " failed to update bitrate to " << vRatesKbps[i] << "kbps";
+        }
+        if (encodedFrame.Stats.InputFrame >= 0 || !encodedFrame.Samples.empty())
+          complete(encodedFrame.Stats.InputFrame, encodedFrame, uiFrameTimeUs);
+      }
+    }
+    if (m_bError) return;
+    // output the frames that the encoder still holds
+    TRACE_SCOPE("flush");
+    encodedFrames.clear();
+    boost::system::error_code ec = m_pCodec->flush(encodedFrames);
+    for (const EncodedFrame& encodedFrame : encodedFrames)
+      complete(encodedFrame.Stats.InputFrame, encodedFrame, 0);
+    if (ec)
+    {
+      LOG(WARNING) << "Rendition " << m_uiIndex << " error in media flush: " << ec.message();
+      m_bError = true;
+      return;
+    }
+    // frames the encoder dropped
+    EncodedFrame dropped;
+    while (!m_pending.empty())
+      complete(m_pending.begin()->first, dropped, 0);
+  }
+  /**
+   * @brief complete charges the output to the input frame it belongs to: output without an input frame
+   * belongs to the oldest pending frame. A frame that the encoder skipped has no access unit to write.
+   */
+  void complete(int32_t iInputFrame, const EncodedFrame& encodedFrame, uint64_t uiFrameTimeUs)
+  {
+    auto it = iInputFrame >= 0 ? m_pending.find(iInputFrame) : m_pending.begin();
+    if (it == m_pending.end())
+    {
+      LOG(WARNING) << "Rendition " << m_uiIndex << " output for unknown input frame " << iInputFrame;
+      return;
+    }
+    const PendingFrame pending = it->second;
+    m_pending.erase(it);
+    m_uiBytes += encodedFrame.Size;
+    DIAG(2, "SIMULCAST Rendition {} Frame {} Time: {} target kbps: {} Encoded sample size: {} Time to encode: {}us")
+        << m_uiIndex << pending.Frame << pending.Frame * m_dFrameDuration << pending.RateKbps << encodedFrame.Size << uiFrameTimeUs;
+    if (!encodedFrame.Samples.empty())
+    {
+      TRACE_SCOPE("sink writeAu");
+      m_pMediaSink->writeAu(encodedFrame.Samples);
+    }
+  }
+
+  uint32_t m_uiIndex;
+  std::unique_ptr<IVideoCodecTransform> m_pCodec;
+  std::unique_ptr<MediaSink> m_pMediaSink;
+  RateSchedule m_schedule;
+  double m_dFrameDuration;
+  uint32_t m_uiBatchFrames;
+  size_t m_uiMaxQueuedFrames;
+
+  boost::mutex m_lock;
+  boost::condition_variable m_condPending;
+  boost::condition_variable m_condFree;
+  std::deque<std::pair<int, std::vector<MediaSample> > > m_qFrames;
+  bool m_bShutdown;
+  boost::thread m_thread;
+
+  // only accessed by the encoding thread until it is joined
+  bool m_bError;
+  // frames passed to the codec by codec input index
+  std::map<int32_t, PendingFrame> m_pending;
+  int32_t m_iCodecFrames;
+  uint32_t m_uiFrames;
+  uint64_t m_uiBytes;
+  uint64_t m_uiEncodingTimeUs;
+  uint64_t m_uiMaxEncodingTimeUs;
+};
+
+/**
+ * @brief runSimulcast encodes the source once per rate schedule with a single reader: each rendition
+ * has its own codec, sink and encoding thread. Each encoding thread passes up to uiBatchFrames queued frames
+ * to the codec per call.
+ */
+int runSimulcast(const std::vector<RateSchedule>& schedules, const std::string& sYuvFile, uint32_t uiWidth, uint32_t uiHeight,
+                 double dFps, bool bRepeat, uint32_t uiLoopCount, const std::string& sVideoCodec, const std::string& sVideoCodecImpl,
+                 const std::string& sPluginDir, cpu::IsaLevel eMaxIsa,
+                 const std::vector<std::string>& videoCodecParams, uint32_t uiMaxFrameSize, const std::string& sOutput,
+                 uint32_t uiBatchFrames)
+{
+  const double dFrameDuration = 1.0/dFps;
+  std::vector<std::unique_ptr<Rendition> > renditions;
+  for (uint32_t i = 0; i < schedules.size(); ++i)
+  {
+    for (double dSegmentFps : schedules[i].Fps)
+    {
+      if (dSegmentFps != dFps)
+      {
+        LOG(ERROR) << "Frame rate steps are not supported in simulcast mode.";
+        return -1;
+      }
+    }
+    for (const std::string& sRecovery : schedules[i].Recoveries)
+    {
+      if (!sRecovery.empty())
+      {
+        LOG(ERROR) << "Recovery actions are not supported in simulcast mode.";
+        return -1;
+      }
+    }
+    const memory::MemorySnapshot memoryBeforeCodec = memory::getMemorySnapshot();
+    std::unique_ptr<IVideoCodecTransform> pCodec = createAndInitialiseCodec(sVideoCodec, sVideoCodecImpl, sPluginDir, eMaxIsa, uiWidth, uiHeight, dFps, videoCodecParams, schedules[i].Kbps.at(0), uiMaxFrameSize);
+    std::unique_ptr<MediaSink> pMediaSink = createMediaSink(sVideoCodec, sOutput + "_r" + toString(i));
+    if (!pCodec || !pMediaSink)
+    {
+      LOG(ERROR) << "Failed to create rendition " << i;
+      return -1;
+    }
+    logCodecFootprint("rendition " + toString(i), memoryBeforeCodec, memory::getMemorySnapshot());
+    renditions.push_back(std::unique_ptr<Rendition>(new Rendition(i, std::move(pCodec), std::move(pMediaSink), schedules[i], dFrameDuration, uiBatchFrames)));
+  }
+
+  media::YuvMediaSource yuvMediaSource(sYuvFile, uiWidth, uiHeight, bRepeat, uiLoopCount);
+  int iCurrentFrame = 0;
+  uint64_t uiInputBytes = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (yuvMediaSource.isGood())
+  {
+    std::vector<media::MediaSample> frame;
+    {
+      TRACE_SCOPE("read");
+      frame = yuvMediaSource.getNextAccessUnit();
+    }
+    if (!frame.empty())
+    {
+      TRACE_SCOPE("push");
+      // the frame buffers are reference counted: every rendition encodes from the same buffer
+      for (auto& pRendition : renditions)
+        pRendition->push(iCurrentFrame, frame);
+      uiInputBytes += frame[0].getPayloadSize();
+      ++iCurrentFrame;
+    }
+  }
+  for (auto& pRendition : renditions)
+    pRendition->stop();
+  auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+  diagnostics::flush();
+
+  const double dElapsedS = std::max<int64_t>(elapsed_ms.count(), 1) / 1000.0;
+  const double dDurationS = std::max(iCurrentFrame * dFrameDuration, dFrameDuration);
+  uint32_t uiEncodedFrames = 0;
+  bool bError = false;
+  for (auto& pRendition : renditions)
+  {
+    uiEncodedFrames += pRendition->getFrames();
+    bError = bError || pRendition->hasError();
+    LOG(INFO) << "Rendition " << pRendition->getIndex() << ": " << pRendition->getFrames() << " frames Avg rate: "
+              << pRendition->getBytes() * 8 / (1000.0 * dDurationS) << " kbps Avg encoding time: "
+              << (pRendition->getFrames() > 0 ? pRendition->getEncodingTimeUs() / (1000.0 * pRendition->getFrames()) : 0.0)
+              << " ms max: " << pRendition->getMaxEncodingTimeUs() / 1000.0 << " ms";
+  }
+  const double dInputMb = uiInputBytes / (1024.0 * 1024.0);
+  LOG(INFO) << "Simulcast: " << renditions.size() << " renditions of " << iCurrentFrame << " frames in " << elapsed_ms.count()
+            << " ms Aggregate throughput: " << uiEncodedFrames / dElapsedS << " frames/s (" << iCurrentFrame / dElapsedS << " source frames/s)";
+  LOG(INFO) << "Simulcast input: read " << dInputMb << " MB once (" << dInputMb / dElapsedS << " MB/s) saved "
+            << dInputMb * (renditions.size() - 1) << " MB of reads and copies compared with " << renditions.size() << " separate runs";
+  return bError ? -1 : 0;
+}
+
+/**
+ * @brief runAsync encodes the source through an AsyncVideoEncoder: frames are submitted without waiting
+ * for their output and complete in output order on the encoding thread. Reports the submit to output
+ * latency and the delay in frames that lookahead, frame threads and B-frames add.
+ */
+int runAsync(const RateSchedule& schedule, const std::string& sYuvFile, uint32_t uiWidth, uint32_t uiHeight,
+             double dFps, bool bRepeat, uint32_t uiLoopCount, const std::string& sVideoCodec, const std::string& sVideoCodecImpl,
+             const std::string& sPluginDir, cpu::IsaLevel eMaxIsa,
+             const std::vector<std::string>& videoCodecParams, uint32_t uiMaxFrameSize, const std::string& sOutput,
+             uint32_t uiQueuedFrames)
+{
+  const double dFrameDuration = 1.0/dFps;
+  for (double dSegmentFps : schedule.Fps)
+  {
+    if (dSegmentFps != dFps)
+    {
+      LOG(ERROR) << "Frame rate steps are not supported in async mode.";
+      return -1;
+    }
+  }
+  for (const std::string& sRecovery : schedule.Recoveries)
+  {
+    if (!sRecovery.empty())
+    {
+      LOG(ERROR) << "Recovery actions are not supported in async mode.";
+      return -1;
+    }
+  }
+  const memory::MemorySnapshot memoryBeforeCodec = memory::getMemorySnapshot();
+  std::unique_ptr<IVideoCodecTransform> pCodec = createAndInitialiseCodec(sVideoCodec, sVideoCodecImpl, sPluginDir, eMaxIsa, uiWidth, uiHeight, dFps, videoCodecParams, schedule.Kbps.at(0), uiMaxFrameSize);
+  std::unique_ptr<MediaSink> pMediaSink = createMediaSink(sVideoCodec, sOutput);
+  if (!pCodec || !pMediaSink)
+  {
+    LOG(ERROR) << "Failed to create codec and media sink.";
+    return -1;
+  }
+  logCodecFootprint(sVideoCodecImpl, memoryBeforeCodec, memory::getMemorySnapshot());
+
+  // only accessed by the encoding thread until the encoder is drained
+  std::vector<uint64_t> vLatenciesUs;
+  uint32_t uiMaxDelayFrames = 0;
+  uint32_t uiDroppedFrames = 0;
+  uint64_t uiBytes = 0;
+  bool bError = false;
+  AsyncVideoEncoder encoder(*pCodec, [&](const boost::system::error_code& ec, const CompletedFrame& completedFrame)
+  {
+    if (ec)
+    {
+      bError = true;
+      return;
+    }
+    const EncodedFrame& encodedFrame = completedFrame.Frame;
+    if (encodedFrame.BitrateResult)
+    {
+      LOG(WARNING) << "Failed to update bitrate at frame " << completedFrame.Tag;
+    }
+    if (encodedFrame.Samples.empty()) ++uiDroppedFrames;
+    vLatenciesUs.push_back(completedFrame.LatencyUs);
+    uiMaxDelayFrames = std::max(uiMaxDelayFrames, completedFrame.DelayFrames);
+    uiBytes += encodedFrame.Size;
+    DIAG(2, "ASYNC Frame {} Time: {} Encoded sample size: {} Latency: {}us Delay frames: {}")
+        << completedFrame.Tag << completedFrame.Tag * dFrameDuration << encodedFrame.Size << completedFrame.LatencyUs << completedFrame.DelayFrames;
+    TRACE_SCOPE("sink writeAu");
+    pMediaSink->writeAu(encodedFrame.Samples);
+  }, uiQueuedFrames);
+
+  media::YuvMediaSource yuvMediaSource(sYuvFile, uiWidth, uiHeight, bRepeat, uiLoopCount);
+  int iCurrentFrame = 0;
+  uint32_t uiSwitchIndex = 0;
+  boost::system::error_code ec;
+  auto start = std::chrono::steady_clock::now();
+  while (yuvMediaSource.isGood() && !ec)
+  {
+    std::vector<media::MediaSample> frame;
+    {
+      TRACE_SCOPE("read");
+      frame = yuvMediaSource.getNextAccessUnit();
+    }
+    if (frame.empty()) continue;
+    BatchFrame batchFrame(frame[0]);
+    if (uiSwitchIndex < schedule.SwitchFrames.size() && uiSwitchIndex < schedule.Kbps.size() &&
+        schedule.SwitchFrames[uiSwitchIndex] == static_cast<uint32_t>(iCurrentFrame))
+    {
+      batchFrame.TargetBitrateKbps = static_cast<uint32_t>(schedule.Kbps[uiSwitchIndex++]);
+      VLOG(2) << "Setting next bitrate to " << batchFrame.TargetBitrateKbps << " kbps Current frame: " << iCurrentFrame;
+    }
+    {
+      TRACE_SCOPE("submit");
+      ec = encoder.submit(batchFrame, iCurrentFrame);
+    }
+    ++iCurrentFrame;
+  }
+  if (!ec) ec = encoder.drain();
+  auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+  diagnostics::flush();
+  if (ec)
+  {
+    LOG(WARNING) << "Error in media encode: " << ec.message();
+    bError = true;
+  }
+
+  const double dElapsedS = std::max<int64_t>(elapsed_ms.count(), 1) / 1000.0;
+  const double dDurationS = std::max(iCurrentFrame * dFrameDuration, dFrameDuration);
+  std::sort(vLatenciesUs.begin(), vLatenciesUs.end());
+  auto percentileMs = [&vLatenciesUs](double dPercentile)
+  {
+    return vLatenciesUs.empty() ? 0.0 : vLatenciesUs[static_cast<size_t>(dPercentile * (vLatenciesUs.size() - 1))] / 1000.0;
+  };
+  LOG(INFO) << "Async: " << vLatenciesUs.size() << " of " << iCurrentFrame << " frames in " << elapsed_ms.count()
+            << " ms Throughput: " << vLatenciesUs.size() / dElapsedS << " frames/s Avg rate: " << uiBytes * 8 / (1000.0 * dDurationS)
+            << " kbps Dropped frames: " << uiDroppedFrames;
+  LOG(INFO) << "Async latency: p50: " << percentileMs(0.5) << " ms p99: " << percentileMs(0.99)
+            << " ms max: " << percentileMs(1.0) << " ms Max delay: " << uiMaxDelayFrames << " frames";
+  return bError ? -1 : 0;
+}
+
 int main(int argc, char** argv)
 {
   // call any code here that needs to be called on application startup
@@ -287,10 +1132,32 @@ int main(int argc, char** argv)
     uint32_t uiLoopCount = 1;
     std::string sLogfile, sLogDir;
     std::string sVideoCodec, sVideoCodecImpl;
+    // the plugins are built next to the executable
+    std::string sPluginDir;
+    std::string sDefaultPluginDir = boost::filesystem::path(argv[0]).parent_path().string();
+    if (sDefaultPluginDir.empty()) sDefaultPluginDir = ".";
+    std::string sCodecIsa;
     std::vector<std::string> videoCodecParams;
     uint32_t uiRateMode;
     uint32_t uiSwitchMode;
     std::string sRateDescriptor;
+    std::string sRtpSink;
+    uint32_t uiMaxPacketSize = 1400;
+    std::string sLossModel;
+    uint32_t uiLossSeed = 1;
+    std::string sRefreshFrames;
+    std::string sLossRecovery;
+    uint32_t uiFeedbackDelay = 1;
+    uint32_t uiMaxFrameSize = 0;
+    bool bPruneLayers = false;
+    std::vector<std::string> simulcastDescriptors;
+    std::string sTraceFile;
+    uint32_t uiWarmupFrames = 0;
+    std::string sPerfCounters;
+    uint32_t uiBatchFrames = 1;
+    bool bAsync = false;
+    bool bCountAllocations = false;
+    uint32_t uiAsyncQueue = AsyncVideoEncoder::DEFAULT_MAX_QUEUED_FRAMES;
     options_description cmdline_options;
     cmdline_options.add_options()
         ("help,?", "produce help message")
@@ -304,11 +1171,30 @@ int main(int argc, char** argv)
         ("repeat,r", bool_switch(&bRepeat)->default_value(false), "Repeat source on eof.")
         ("repeat-count,c", value<uint32_t>(&uiLoopCount)->default_value(1), "Number of repetitions. 0 = infinite.")
         ("video-codec", value<std::string>(&sVideoCodec)->required()->notifier(validateVideoCodec), "Codec: [h264,h265]")
-        ("vc-impl", value<std::string>(&sVideoCodecImpl)->required()->notifier(validateVideoCodecImpl), "Codec: [openh264,x264,x265,vpp]")
+        ("vc-impl", value<std::string>(&sVideoCodecImpl)->required(), "Codec plugin in --plugin-dir: [openh264,x264,x265]")
+        ("plugin-dir", value<std::string>(&sPluginDir)->default_value(sDefaultPluginDir), "Directory of the codec_<impl>[_<isa>] codec plugins.")
+        ("codec-isa", value<std::string>(&sCodecIsa)->notifier(validateCodecIsa), "Highest instruction set build of the codec plugin to load: [baseline,avx2,avx512]. Default: the best build that the CPU supports.")
         ("vc-param", value<std::vector<std::string>>(&videoCodecParams), "Video codec parameters.")
         ("rate-mode", value<uint32_t>(&uiRateMode)->default_value(0), "Rate mode. 0=kbps,1=bpp.")
         ("switch-mode", value<uint32_t>(&uiSwitchMode)->default_value(0), "Switch mode. 0=frame,1=time(s).")
-        ("rate-descriptor", value<std::string>(&sRateDescriptor)->required()->notifier(validateRateDescriptor), "Rate descriptor format: <rate>[:<duration>[_<rate_descriptor>]]")
+        ("rate-descriptor", value<std::string>(&sRateDescriptor)->required()->notifier(validateRateDescriptor), "Rate descriptor format: <rate>[@<fps>][:<duration>[:<recovery>]][,<rate_descriptor>] fps: decimates the source (default: source fps) recovery: [idr,ref,refresh] (ref treats the previous frame as lost)")
+        ("rtp", value<std::string>(&sRtpSink), "Packetise encoded AUs into RTP: [null,udp:<host>:<port>]")
+        ("mtu", value<uint32_t>(&uiMaxPacketSize)->default_value(1400), "Maximum RTP packet size.")
+        ("loss", value<std::string>(&sLossModel)->notifier(validateLossModel), "Decode through a lossy channel (H.264 only): [bernoulli:<p>,ge:<p>:<burst>[:<p good>:<p bad>]]. Applied per RTP packet with --rtp, otherwise per NAL unit.")
+        ("loss-seed", value<uint32_t>(&uiLossSeed)->default_value(1), "Seed of the loss model.")
+        ("loss-recovery", value<std::string>(&sLossRecovery)->notifier(validateRecovery), "Recovery action when --loss drops a packet: [idr,ref,refresh]")
+        ("feedback-delay", value<uint32_t>(&uiFeedbackDelay)->default_value(1), "Frames between a loss and the recovery action (>= 1).")
+        ("refresh-frames", value<std::string>(&sRefreshFrames), "Comma separated frames at which an intra refresh is started. Configure the refresh period with --vc-param intra-refresh=<frames>.")
+        ("max-frame-size", value<uint32_t>(&uiMaxFrameSize)->default_value(0), "Maximum encoded frame size in bytes. 0 = no cap.")
+        ("prune-layers", bool_switch(&bPruneLayers)->default_value(false), "Serve rate steps after the first by dropping temporal layers instead of re-targeting the encoder. Requires --vc-param temporal-layers=<n> with n > 1.")
+        ("simulcast", value<std::vector<std::string>>(&simulcastDescriptors)->notifier([](const std::vector<std::string>& descriptors){ for (const std::string& sDescriptor : descriptors) validateRateDescriptor(sDescriptor); }), "Rate descriptor of an additional rendition encoded in parallel from the same source frames. May be repeated.")
+        ("batch-frames", value<uint32_t>(&uiBatchFrames)->default_value(1), "Maximum number of queued frames passed to the codec per call in simulcast mode.")
+        ("async", bool_switch(&bAsync)->default_value(false), "Submit frames to the codec without waiting for their output and report the submit to output latency.")
+        ("async-queue", value<uint32_t>(&uiAsyncQueue)->default_value(AsyncVideoEncoder::DEFAULT_MAX_QUEUED_FRAMES), "Maximum number of frames queued for the codec in async mode.")
+        ("warmup-frames", value<uint32_t>(&uiWarmupFrames)->default_value(0), "Encoded frames excluded from the throughput summary while the encoder pipeline fills.")
+        ("trace", value<std::string>(&sTraceFile), "Write a timeline of the read, encode, rate control, sink and packetisation stages to this file (Chrome trace event JSON).")
+        ("count-allocations", bool_switch(&bCountAllocations)->default_value(false), "Count the allocations of the encoder and the driver for the allocation rate in the memory summary. Adds overhead to every allocation.")
+        ("perf-counters", value<std::string>(&sPerfCounters)->notifier(validatePerfCounters), "Count cycles, instructions, LLC and branch misses and the task clock per frame for the read, encode and sink stages: [thread,process]. process includes the encoder worker threads.")
         ;
 
     variables_map vm;
@@ -325,6 +1211,10 @@ int main(int argc, char** argv)
     }
 
     notify(vm);
+    memory::setAllocationCounting(bCountAllocations);
+    validateVideoCodecImpl(sVideoCodecImpl, sPluginDir);
+    cpu::IsaLevel eMaxIsa = static_cast<cpu::IsaLevel>(cpu::ISA_COUNT - 1);
+    if (!sCodecIsa.empty()) cpu::parseIsaLevel(sCodecIsa, eMaxIsa);
 
     std::ostringstream logPath; logPath << sLogDir << "/" << sLogfile;
     // update the log file: we want to be able to parse this file
@@ -337,63 +1227,109 @@ int main(int argc, char** argv)
       command << argv[i] << " ";
     LOG(INFO) << command.str();
 
+    if (!sTraceFile.empty())
+    {
+      trace::Tracer::get().start();
+      trace::setThreadName("main");
+    }
+
     // convert to kbps as this is understood by encoders
     // convert switch point to frame
     std::vector<RateDescriptor> rates = parseRateDescriptor(sRateDescriptor);
-    std::vector<double> vKbps;
-    std::vector<double> vBpp;
-    std::vector<uint32_t> vSwitchFrames = {0}; // first switch to bitrate is at the beginning
-    uint32_t uiPreviousSwitchFrame = 0;
+    RateSchedule schedule;
+    if (!createRateSchedule(rates, uiRateMode, uiSwitchMode, uiWidth, uiHeight, dFps, schedule))
+    {
+      return -1;
+    }
     double dFrameDuration = 1.0/dFps;
-    for (RateDescriptor rate : rates)
+
+    boost::to_upper(sVideoCodec);
+    boost::to_upper(sVideoCodecImpl);
+
+    if (bAsync)
     {
-      switch (uiRateMode)
+      if (!simulcastDescriptors.empty())
       {
-        case RATE_MODE_KBPS:
-        {
-          vKbps.push_back(rate.Rate);
-          vBpp.push_back(rate.Rate * 1000 /( uiWidth * uiHeight * dFps));
-          break;
-        }
-        case RATE_MODE_BPP:
-        {
-          vBpp.push_back(rate.Rate);
-          double dKbps = (rate.Rate * uiWidth * uiHeight * dFps)/1000.0;
-          vKbps.push_back(dKbps);
-          break;
-        }
+        LOG(ERROR) << "--async and --simulcast are mutually exclusive.";
+        return -1;
       }
-      switch (uiSwitchMode)
+      if (!sRtpSink.empty() || !sLossModel.empty() || !sRefreshFrames.empty() || bPruneLayers || uiBatchFrames > 1)
       {
-        case SWITCH_MODE_FRAME:
-        {
-          uint32_t uiNextSwitch = uiPreviousSwitchFrame + rate.Duration;
-          vSwitchFrames.push_back(uiNextSwitch);
-          uiPreviousSwitchFrame = uiNextSwitch;
-          break;
-        }
-        case SWITCH_MODE_TIME:
+        LOG(WARNING) << "--rtp, --loss, --refresh-frames, --prune-layers and --batch-frames are ignored in async mode.";
+      }
+      if (uiAsyncQueue == 0)
+      {
+        LOG(ERROR) << "--async-queue must be at least 1.";
+        return -1;
+      }
+      int iResult = runAsync(schedule, sYuvFile, uiWidth, uiHeight, dFps, bRepeat, uiLoopCount, sVideoCodec, sVideoCodecImpl, sPluginDir, eMaxIsa,
+                             videoCodecParams, uiMaxFrameSize, sOutput, uiAsyncQueue);
+      if (!sTraceFile.empty())
+      {
+        trace::Tracer::get().stop();
+        trace::Tracer::get().write(sTraceFile);
+      }
+      return iResult;
+    }
+
+    if (!simulcastDescriptors.empty())
+    {
+      std::vector<RateSchedule> schedules(1, schedule);
+      for (const std::string& sDescriptor : simulcastDescriptors)
+      {
+        RateSchedule simulcastSchedule;
+        if (!createRateSchedule(parseRateDescriptor(sDescriptor), uiRateMode, uiSwitchMode, uiWidth, uiHeight, dFps, simulcastSchedule))
         {
-          if (rate.Duration != -1.0)
-          {
-            uint32_t uiNextSwitch = uiPreviousSwitchFrame + (rate.Duration/dFrameDuration);
-            vSwitchFrames.push_back(uiNextSwitch);
-            uiPreviousSwitchFrame = uiNextSwitch;
-          }
-          break;
+          return -1;
         }
+        schedules.push_back(simulcastSchedule);
       }
+      if (!sRtpSink.empty() || !sLossModel.empty() || !sRefreshFrames.empty() || bPruneLayers)
+      {
+        LOG(WARNING) << "--rtp, --loss, --refresh-frames and --prune-layers are ignored in simulcast mode.";
+      }
+      if (uiBatchFrames == 0)
+      {
+        LOG(ERROR) << "--batch-frames must be at least 1.";
+        return -1;
+      }
+      int iResult = runSimulcast(schedules, sYuvFile, uiWidth, uiHeight, dFps, bRepeat, uiLoopCount, sVideoCodec, sVideoCodecImpl, sPluginDir, eMaxIsa,
+                                 videoCodecParams, uiMaxFrameSize, sOutput, uiBatchFrames);
+      if (!sTraceFile.empty())
+      {
+        trace::Tracer::get().stop();
+        trace::Tracer::get().write(sTraceFile);
+      }
+      return iResult;
     }
 
-    boost::to_upper(sVideoCodec);
-    boost::to_upper(sVideoCodecImpl);
+    // opened before the codec so that inherited counters see the encoder worker threads
+    std::unique_ptr<perf::PerfCounters> pPerfCounters;
+    if (!sPerfCounters.empty())
+    {
+      pPerfCounters.reset(new perf::PerfCounters(sPerfCounters == "process"));
+      if (!pPerfCounters->isAvailable())
+      {
+        LOG(WARNING) << "No performance counters available: disabling --perf-counters.";
+        pPerfCounters.reset();
+      }
+    }
+
+    if (uiBatchFrames > 1)
+    {
+      LOG(WARNING) << "--batch-frames is ignored without --simulcast: rate control and recovery react to every frame.";
+    }
 
-    std::unique_ptr<IVideoCodecTransform> pCodec = createAndInitialiseCodec(sVideoCodec, sVideoCodecImpl, uiWidth, uiHeight, dFps, videoCodecParams, vKbps.at(0));
+    const memory::MemorySnapshot memoryBeforeCodec = memory::getMemorySnapshot();
+    std::unique_ptr<IVideoCodecTransform> pCodec = createAndInitialiseCodec(sVideoCodec, sVideoCodecImpl, sPluginDir, eMaxIsa, uiWidth, uiHeight, dFps, videoCodecParams, schedule.Kbps.at(0), uiMaxFrameSize);
     if (!pCodec)
     {
       LOG(ERROR) << "Failed to create and initialise codec.";
       return -1;
     }
+    logCodecFootprint(sVideoCodecImpl, memoryBeforeCodec, memory::getMemorySnapshot());
+    // the peak is measured over the encoding loop
+    const bool bPeakRssReset = memory::resetPeakRss();
 
     std::unique_ptr<MediaSink> pMediaSink = createMediaSink(sVideoCodec, sOutput);
     if (!pMediaSink)
@@ -402,6 +1338,121 @@ int main(int argc, char** argv)
       return -1;
     }
 
+    std::unique_ptr<NalUnitPacketiser> pPacketiser;
+    std::unique_ptr<network::RtpPacketSink> pRtpSink;
+    if (!sRtpSink.empty())
+    {
+      pPacketiser = createPacketiser(sVideoCodec, uiMaxPacketSize);
+      pRtpSink = network::RtpPacketSink::create(sRtpSink);
+      if (!pPacketiser || !pRtpSink)
+      {
+        LOG(ERROR) << "Failed to create RTP packetiser.";
+        return -1;
+      }
+    }
+    std::vector<RtpPacket> rtpPackets;
+    uint64_t uiPacketisationTimeUs = 0;
+
+    // slice statistics: max-nal-bytes is only known to the codec so it is looked up in the codec parameters
+    const uint32_t uiMaxNalBytes = getCodecParameter(videoCodecParams, "max-nal-bytes", 0);
+    NalSizeHistogram frameNalSizes;
+    NalSizeHistogram totalNalSizes;
+    FrameStatsSummary frameStatsSummary;
+    // the encoder's own view of a frame: type is a SliceType (0=P 1=B 2=I), -1 = not reported.
+    // Encoders with delay output frames late: the stats are logged for the codec input frame.
+    auto addFrameStats = [&frameStatsSummary](const FrameStats& frameStats)
+    {
+      if (!frameStats.Encoded) return;
+      frameStatsSummary.add(frameStats);
+      DIAG(2, "FRAMESTATS Frame {} type: {} idr: {} qp: {} bits: {} Y-PSNR: {} U-PSNR: {} V-PSNR: {} SSIM: {}")
+          << frameStats.InputFrame << static_cast<int>(frameStats.Type) << frameStats.Idr << frameStats.Qp << frameStats.Bits
+          << frameStats.PsnrY << frameStats.PsnrU << frameStats.PsnrV << frameStats.Ssim;
+    };
+    uint64_t uiTotalSlices = 0;
+    uint64_t uiOversizedNalUnits = 0;
+    uint32_t uiPeakFrameSize = 0;
+    int iPeakFrame = 0;
+
+    // frames over the max frame size: codecs that enforce the cap by skipping produce empty frames
+    uint32_t uiCapViolations = 0;
+    uint32_t uiCapSkippedFrames = 0;
+    uint32_t uiMaxCapOvershoot = 0;
+    uint64_t uiCapViolationTimeUs = 0;
+
+    // temporal layer pruning: the encoder keeps the initial bitrate
+    std::unique_ptr<TemporalLayerPruner> pPruner;
+    if (bPruneLayers)
+    {
+      const uint32_t uiTemporalLayers = getCodecParameter(videoCodecParams, "temporal-layers", 1);
+      if (uiTemporalLayers < 2)
+      {
+        LOG(ERROR) << "Layer pruning requires --vc-param temporal-layers=<n> with n > 1.";
+        return -1;
+      }
+      pPruner = std::unique_ptr<TemporalLayerPruner>(new TemporalLayerPruner(uiTemporalLayers));
+    }
+
+    // intra refresh progress is derived from the refresh period and the last refresh start
+    const uint32_t uiIntraRefreshPeriod = getCodecParameter(videoCodecParams, "intra-refresh", 0);
+    std::vector<uint32_t> vRefreshFrames;
+    for (const std::string& sFrame : StringTokenizer::tokenize(sRefreshFrames, ",", true, true))
+    {
+      bool bSuccess = false;
+      uint32_t uiFrame = convert<uint32_t>(sFrame, bSuccess);
+      if (!bSuccess)
+      {
+        LOG(ERROR) << "Invalid refresh frame: " << sFrame;
+        return -1;
+      }
+      vRefreshFrames.push_back(uiFrame);
+    }
+    int iRefreshStartFrame = 0;
+
+    RecoveryMonitor recoveryMonitor;
+    // the first lost frame is a codec input frame, the recovery frame a source frame
+    int iFirstLostFrame = -1;
+    int iRecoveryFrame = -1;
+    if (uiFeedbackDelay == 0)
+    {
+      LOG(ERROR) << "Losses are detected after encoding: the feedback delay must be at least one frame.";
+      return -1;
+    }
+
+    // the lossy stream and the loss-free reference are decoded side by side
+    std::unique_ptr<network::LossModel> pLossModel;
+    std::unique_ptr<OpenH264Decoder> pDecoder;
+    std::unique_ptr<OpenH264Decoder> pReferenceDecoder;
+    if (!sLossModel.empty())
+    {
+      if (sVideoCodec != "H264")
+      {
+        LOG(ERROR) << "Loss simulation requires the H.264 decoder.";
+        return -1;
+      }
+      pLossModel = network::LossModel::create(sLossModel, uiLossSeed);
+      pDecoder = createAndInitialiseDecoder(uiWidth, uiHeight, dFps);
+      pReferenceDecoder = createAndInitialiseDecoder(uiWidth, uiHeight, dFps);
+      if (!pDecoder || !pReferenceDecoder)
+      {
+        LOG(ERROR) << "Failed to create and initialise decoder.";
+        return -1;
+      }
+    }
+    const uint32_t uiLumaSize = uiWidth * uiHeight;
+    std::deque<std::vector<uint8_t> > sourceFrames;
+    std::vector<uint8_t> vPreviousOutput;
+    std::vector<uint8_t> vPreviousReferenceOutput;
+    std::vector<RtpPacket> receivedPackets;
+    std::vector<MediaSample> receivedSamples;
+    std::vector<MediaSample> decodedSamples;
+    std::vector<MediaSample> referenceSamples;
+    int iImpairedSinceFrame = -1;
+    std::vector<uint32_t> vRecoveryFrames;
+    uint32_t uiDecodedFrames = 0;
+    uint32_t uiFrozenFrames = 0;
+    double dTotalPsnr = 0.0;
+    double dTotalReferencePsnr = 0.0;
+
     media::YuvMediaSource yuvMediaSource(sYuvFile, uiWidth, uiHeight, bRepeat, uiLoopCount);
 
     std::vector<uint32_t> vEncodingTimes;
@@ -412,35 +1463,158 @@ int main(int argc, char** argv)
 
     double dCurrentRateKbps = 0.0;
     double dCurrentRateBpp = 0.0;
+    // source frames are dropped once the credit falls below one frame
+    double dCurrentFps = dFps;
+    double dFrameCredit = 0.0;
+    uint32_t uiDecimatedFrames = 0;
+    // frames passed to the codec: reference invalidation counts codec input frames
+    uint32_t uiCodecFrames = 0;
+    // throughput after the warm-up frames
+    std::vector<uint64_t> vSteadyStateTimesUs;
+    uint64_t uiSteadyStateBytes = 0;
+    int iSteadyStateStartFrame = 0;
+    auto tSteadyStateStart = start;
+    std::clock_t cpuSteadyStateStart = std::clock();
+    memory::AllocationCounts allocationsSteadyStateStart = memory::getAllocationCounts();
+    // per stage counter totals: read, encode, sink
+    const char* perfStages[] = { "read", "encode", "sink" };
+    perf::CounterTotals perfTotals[3];
+    perf::CounterValues perfDeltas[3];
+    perf::CounterValues perfStart;
     while (yuvMediaSource.isGood())
     {
       std::vector<media::MediaSample> encodedSamples;
-      std::vector<media::MediaSample> frame = yuvMediaSource.getNextAccessUnit();
+      std::vector<media::MediaSample> frame;
+      {
+        TRACE_SCOPE("read");
+        if (pPerfCounters) perfStart = pPerfCounters->read();
+        frame = yuvMediaSource.getNextAccessUnit();
+        if (pPerfCounters)
+        {
+          perfDeltas[0] = pPerfCounters->read() - perfStart;
+          perfTotals[0].add(perfDeltas[0]);
+        }
+      }
       if (!frame.empty())
       {
-        if ((uiCurrentSwitchFrameIndex < vSwitchFrames.size()) &&
-            (vSwitchFrames[uiCurrentSwitchFrameIndex] == iCurrentFrame) &&
-            (uiCurrentRateKbpsIndex < vKbps.size())
+        TRACE_SCOPE("frame");
+        // the rate descriptor treats the previous frame as lost
+        std::string sRecovery;
+        uint32_t uiFirstLostFrame = uiCodecFrames > 0 ? uiCodecFrames - 1 : 0;
+        if ((uiCurrentSwitchFrameIndex < schedule.SwitchFrames.size()) &&
+            (schedule.SwitchFrames[uiCurrentSwitchFrameIndex] == iCurrentFrame) &&
+            (uiCurrentRateKbpsIndex < schedule.Kbps.size())
             )
         {
-          dCurrentRateKbps = vKbps[uiCurrentRateKbpsIndex];
-          dCurrentRateBpp = vBpp[uiCurrentRateKbpsIndex++];
-          VLOG(2) << "Setting next bitrate to " << dCurrentRateKbps << " kbps Current frame: " << iCurrentFrame;
-          boost::system::error_code ec = pCodec->setBitrate(dCurrentRateKbps);
-          if (ec)
+          dCurrentRateKbps = schedule.Kbps[uiCurrentRateKbpsIndex];
+          sRecovery = schedule.Recoveries[uiCurrentRateKbpsIndex];
+          const double dNextFps = schedule.Fps[uiCurrentRateKbpsIndex];
+          dCurrentRateBpp = schedule.Bpp[uiCurrentRateKbpsIndex++];
+          if (dNextFps != dCurrentFps)
+          {
+            VLOG(2) << "Setting next frame rate to " << dNextFps << " fps Current frame: " << iCurrentFrame;
+            TRACE_SCOPE("setFramerate");
+            boost::system::error_code ec = pCodec->setFramerate(dNextFps);
+            if (ec)
+            {
+              LOG(WARNING) << "Failed to update frame rate to " << dNextFps << "fps: " << ec.message();
+            }
+            // the first frame at the new rate is encoded
+            dCurrentFps = dNextFps;
+            dFrameCredit = 1.0 - dCurrentFps / dFps;
+            DIAG(2, "FRAMERATE Frame {} Time: {} fps: {} target kbps: {}") << iCurrentFrame << iCurrentFrame * dFrameDuration << dCurrentFps << dCurrentRateKbps;
+          }
+          if (pPruner && iCurrentFrame > 0)
+          {
+            uint32_t uiMaxTemporalId = pPruner->setTargetBitrate(dCurrentRateKbps, dCurrentFps);
+            VLOG(2) << "Pruning to temporal id " << uiMaxTemporalId << " for " << dCurrentRateKbps << " kbps Current frame: " << iCurrentFrame;
+            DIAG(2, "PRUNE Frame {} target kbps: {} max temporal id: {} layer kbps: {}")
+                << iCurrentFrame << dCurrentRateKbps << uiMaxTemporalId << pPruner->getLayerKbps(uiMaxTemporalId, dCurrentFps);
+          }
+          else
           {
-            LOG(WARNING) << "Failed to update bitrate to " << dCurrentRateKbps << "kbps";
+            VLOG(2) << "Setting next bitrate to " << dCurrentRateKbps << " kbps Current frame: " << iCurrentFrame;
+            TRACE_SCOPE("setBitrate");
+            boost::system::error_code ec = pCodec->setBitrate(dCurrentRateKbps);
+            if (ec)
+            {
+              LOG(WARNING) << "Failed to update bitrate to " << dCurrentRateKbps << "kbps";
+            }
           }
           ++uiCurrentSwitchFrameIndex;
         }
 
+        if (std::find(vRefreshFrames.begin(), vRefreshFrames.end(), iCurrentFrame) != vRefreshFrames.end())
+        {
+          VLOG(2) << "Starting intra refresh at frame " << iCurrentFrame;
+          TRACE_SCOPE("recovery");
+          boost::system::error_code ec = pCodec->startIntraRefresh();
+          if (ec)
+          {
+            LOG(WARNING) << "Failed to start intra refresh: " << ec.message();
+          }
+          else
+          {
+            iRefreshStartFrame = iCurrentFrame;
+          }
+        }
+
+        if (iCurrentFrame == iRecoveryFrame)
+        {
+          sRecovery = sLossRecovery;
+          uiFirstLostFrame = iFirstLostFrame;
+          iFirstLostFrame = iRecoveryFrame = -1;
+        }
+        if (!sRecovery.empty())
+        {
+          VLOG(2) << "Recovery " << sRecovery << " at frame " << iCurrentFrame << " first lost frame: " << uiFirstLostFrame;
+          TRACE_SCOPE("recovery");
+          boost::system::error_code ec = triggerRecovery(*pCodec, sRecovery, uiFirstLostFrame);
+          if (ec)
+          {
+            LOG(WARNING) << "Failed to trigger recovery " << sRecovery << ": " << ec.message();
+          }
+          else
+          {
+            if (sRecovery == "refresh") iRefreshStartFrame = iCurrentFrame;
+            recoveryMonitor.start(sRecovery, sRecovery == "refresh" ? uiIntraRefreshPeriod : 1, iCurrentFrame);
+          }
+        }
+
+        // decimate the source to the current frame rate: pending actions apply to the next encoded frame
+        dFrameCredit += dCurrentFps / dFps;
+        if (dFrameCredit < 1.0 - 1e-6)
+        {
+          ++uiDecimatedFrames;
+          ++iCurrentFrame;
+          continue;
+        }
+        dFrameCredit -= 1.0;
+
+        if (uiCodecFrames == uiWarmupFrames)
+        {
+          tSteadyStateStart = std::chrono::steady_clock::now();
+          cpuSteadyStateStart = std::clock();
+          allocationsSteadyStateStart = memory::getAllocationCounts();
+          iSteadyStateStartFrame = iCurrentFrame;
+        }
 #define MEASURE_ENCODING_TIME
 #ifdef MEASURE_ENCODING_TIME
         boost::posix_time::ptime tStart = boost::posix_time::microsec_clock::universal_time();
 #endif
         // encode
         uint32_t uiEncodedSize = 0;
-        boost::system::error_code ec = pCodec->transform(frame, encodedSamples, uiEncodedSize);
+        boost::system::error_code ec;
+        {
+          TRACE_SCOPE("encode");
+          if (pPerfCounters) perfStart = pPerfCounters->read();
+          ec = pCodec->transform(frame, encodedSamples, uiEncodedSize);
+          if (pPerfCounters)
+          {
+            perfDeltas[1] = pPerfCounters->read() - perfStart;
+            perfTotals[1].add(perfDeltas[1]);
+          }
+        }
 
 #ifdef MEASURE_ENCODING_TIME
         boost::posix_time::ptime tEnd = boost::posix_time::microsec_clock::universal_time();
@@ -450,33 +1624,262 @@ int main(int argc, char** argv)
         if (ec)
         {
           LOG(WARNING) << "Error in media encode: " << ec.message();
+          diagnostics::flush();
           return -1;
         }
         else
         {
-          std::ostringstream ostr;
-          ostr << "ECSR #1 Frame " << iCurrentFrame << " Time: " << iCurrentFrame * dFrameDuration
-               << " NALUs: " << encodedSamples.size()
-               << " bpp: " << (uiEncodedSize * 8.0)/(uiWidth * uiHeight)
-               << " target bpp: " << dCurrentRateBpp
-               << " Encoded sample size: " << uiEncodedSize << " (";
-          for (auto& nalu : encodedSamples)
-            ostr << " " << nalu.getPayloadSize();
-          ostr << " )";
 #ifdef MEASURE_ENCODING_TIME
-          ostr << " Time to encode: " << diff.total_milliseconds() << "ms";
           vEncodingTimes.push_back(diff.total_milliseconds());
 #endif
+          const bool bEncoderSkipped = encodedSamples.empty();
+          // everything downstream sees the pruned stream: a frame in the dropped layers is left empty
+          if (pPruner)
+          {
+            pPruner->addFrame(encodedSamples, dCurrentFps);
+            uiEncodedSize = pPruner->prune(encodedSamples);
+          }
+          if (uiCodecFrames >= uiWarmupFrames)
+          {
+#ifdef MEASURE_ENCODING_TIME
+            vSteadyStateTimesUs.push_back(diff.total_microseconds());
+#endif
+            uiSteadyStateBytes += uiEncodedSize;
+          }
+          // formatted by the diagnostics drain thread: scripts parse this line
+          if (DIAG_IS_ON(2))
+          {
+#ifdef MEASURE_ENCODING_TIME
+            DIAG_EVENT(event, "ECSR #1 Frame {} Time: {} NALUs: {} bpp: {} target bpp: {} Encoded sample size: {} ({*} ) Time to encode: {}ms");
+#else
+            DIAG_EVENT(event, "ECSR #1 Frame {} Time: {} NALUs: {} bpp: {} target bpp: {} Encoded sample size: {} ({*} )");
+#endif
+            event << iCurrentFrame << iCurrentFrame * dFrameDuration
+                  << encodedSamples.size()
+                  << (uiEncodedSize * 8.0)/(uiWidth * uiHeight)
+                  << dCurrentRateBpp
+                  << uiEncodedSize;
+            for (auto& nalu : encodedSamples)
+              event << nalu.getPayloadSize();
+#ifdef MEASURE_ENCODING_TIME
+            event << diff.total_milliseconds();
+#endif
+          }
+          addFrameStats(pCodec->getFrameStats());
 
-          VLOG(2) << ostr.str();
+          frameNalSizes.reset();
+          uint32_t uiSlices = 0;
+          uint32_t uiLargestNalUnit = 0;
+          uint32_t uiOversized = 0;
+          for (const MediaSample& nalu : encodedSamples)
+          {
+            uint32_t uiStartCodeLength = getStartCodeLength(nalu);
+            uint32_t uiNaluSize = nalu.getPayloadSize() - uiStartCodeLength;
+            frameNalSizes.add(uiNaluSize);
+            totalNalSizes.add(uiNaluSize);
+            uiLargestNalUnit = std::max(uiLargestNalUnit, uiNaluSize);
+            if (uiNaluSize > 0 && isSlice(nalu, uiStartCodeLength, sVideoCodec == "H265")) ++uiSlices;
+            if (uiMaxNalBytes > 0 && uiNaluSize > uiMaxNalBytes) ++uiOversized;
+          }
+          uiTotalSlices += uiSlices;
+          uiOversizedNalUnits += uiOversized;
+          recoveryMonitor.addFrame(uiEncodedSize, vEncodingTimes.empty() ? 0 : vEncodingTimes.back());
+          if (uiEncodedSize > uiPeakFrameSize)
+          {
+            uiPeakFrameSize = uiEncodedSize;
+            iPeakFrame = iCurrentFrame;
+          }
+          if (uiIntraRefreshPeriod > 0)
+          {
+            uint32_t uiProgress = ((iCurrentFrame - iRefreshStartFrame) % uiIntraRefreshPeriod + 1) * 100 / uiIntraRefreshPeriod;
+            DIAG(2, "REFRESH Frame {} size: {} largest NAL: {} bytes refresh progress: {}%") << iCurrentFrame << uiEncodedSize << uiLargestNalUnit << uiProgress;
+          }
+          if (uiMaxFrameSize > 0)
+          {
+            const uint32_t uiOvershoot = uiEncodedSize > uiMaxFrameSize ? uiEncodedSize - uiMaxFrameSize : 0;
+            if (uiOvershoot > 0)
+            {
+              ++uiCapViolations;
+              uiMaxCapOvershoot = std::max(uiMaxCapOvershoot, uiOvershoot);
+              uiCapViolationTimeUs += diff.total_microseconds();
+            }
+            if (bEncoderSkipped) ++uiCapSkippedFrames;
+            DIAG(2, "FRAMECAP Frame {} size: {} max: {} over: {} bytes skipped: {} Time to encode: {}us")
+                << iCurrentFrame << uiEncodedSize << uiMaxFrameSize << uiOvershoot << (bEncoderSkipped ? 1 : 0) << diff.total_microseconds();
+          }
+          if (DIAG_IS_ON(2))
+          {
+            DIAG_EVENT(event, "SLICES Frame {} slices: {} largest NAL: {} bytes over max: {} NAL sizes (<=256 ... >32768): {*}");
+            event << iCurrentFrame << uiSlices << uiLargestNalUnit << uiOversized;
+            for (uint32_t uiCount : frameNalSizes.Counts)
+              event << uiCount;
+          }
+
+          // a skipped or entirely pruned frame has no access unit to write, packetise or lose
+          const bool bHasOutput = !encodedSamples.empty();
           // write to sink
-          pMediaSink->writeAu(encodedSamples);
+          perfDeltas[2] = perf::CounterValues();
+          if (bHasOutput)
+          {
+            TRACE_SCOPE("sink writeAu");
+            if (pPerfCounters) perfStart = pPerfCounters->read();
+            pMediaSink->writeAu(encodedSamples);
+            if (pPerfCounters)
+            {
+              perfDeltas[2] = pPerfCounters->read() - perfStart;
+              perfTotals[2].add(perfDeltas[2]);
+            }
+          }
+          if (pPerfCounters && DIAG_IS_ON(2))
+          {
+            // unavailable counters are logged as -1
+            DIAG_EVENT(event, "PERF Frame {} read cycles: {} instructions: {} llc-misses: {} branch-misses: {} task-clock-us: {}"
+                              " encode cycles: {} instructions: {} llc-misses: {} branch-misses: {} task-clock-us: {}"
+                              " sink cycles: {} instructions: {} llc-misses: {} branch-misses: {} task-clock-us: {}");
+            event << iCurrentFrame;
+            for (const perf::CounterValues& delta : perfDeltas)
+            {
+              for (int i = 0; i < perf::PC_TASK_CLOCK; ++i)
+                event << delta[i];
+              event << (delta[perf::PC_TASK_CLOCK] == -1 ? -1 : delta[perf::PC_TASK_CLOCK] / 1000);
+            }
+          }
+
+          if (pPacketiser && bHasOutput)
+          {
+            TRACE_SCOPE("packetise");
+            boost::posix_time::ptime tPacketiseStart = boost::posix_time::microsec_clock::universal_time();
+            const uint32_t uiRtpTime = static_cast<uint32_t>(iCurrentFrame * dFrameDuration * 90000 + 0.5);
+            for (MediaSample& mediaSample : encodedSamples)
+              mediaSample.setRtpTime(uiRtpTime);
+            rtpPackets.clear();
+            pPacketiser->packetise(encodedSamples, rtpPackets);
+            pRtpSink->send(rtpPackets);
+            uiPacketisationTimeUs += (boost::posix_time::microsec_clock::universal_time() - tPacketiseStart).total_microseconds();
+            if (DIAG_IS_ON(2))
+            {
+              uint32_t uiHeaderBytes = 0;
+              for (const RtpPacket& packet : rtpPackets)
+                uiHeaderBytes += packet.getHeaderSize();
+              DIAG(2, "RTP Frame {} packets: {} header overhead: {} bytes") << iCurrentFrame << rtpPackets.size() << uiHeaderBytes;
+            }
+          }
+
+          if (pLossModel && bHasOutput)
+          {
+            TRACE_SCOPE("loss and decode");
+            const uint64_t uiLossesBefore = pLossModel->getLossCount();
+            receivedSamples.clear();
+            if (pPacketiser)
+            {
+              receivedPackets.clear();
+              for (const RtpPacket& packet : rtpPackets)
+              {
+                if (!pLossModel->isLost()) receivedPackets.push_back(packet);
+              }
+              pPacketiser->depacketise(receivedPackets, receivedSamples);
+            }
+            else
+            {
+              for (const MediaSample& mediaSample : encodedSamples)
+              {
+                if (!pLossModel->isLost()) receivedSamples.push_back(mediaSample);
+              }
+            }
+            const uint32_t uiLost = static_cast<uint32_t>(pLossModel->getLossCount() - uiLossesBefore);
+            if (uiLost > 0 && iImpairedSinceFrame == -1)
+              iImpairedSinceFrame = iCurrentFrame;
+            if (uiLost > 0 && !sLossRecovery.empty() && iFirstLostFrame == -1)
+            {
+              iFirstLostFrame = uiCodecFrames;
+              iRecoveryFrame = iCurrentFrame + uiFeedbackDelay;
+            }
+
+            const uint8_t* pSource = frame[0].getDataBuffer().data();
+            sourceFrames.push_back(std::vector<uint8_t>(pSource, pSource + uiLumaSize));
+
+            uint32_t uiDecodedSize = 0;
+            decodedSamples.clear();
+            referenceSamples.clear();
+            pDecoder->transform(receivedSamples, decodedSamples, uiDecodedSize);
+            pReferenceDecoder->transform(encodedSamples, referenceSamples, uiDecodedSize);
+            // the reference decoder paces the output: encoder delay is absorbed by the source queue
+            if (!referenceSamples.empty() && !sourceFrames.empty())
+            {
+              const std::vector<uint8_t>& source = sourceFrames.front();
+              const uint8_t* pReference = referenceSamples[0].getDataBuffer().data();
+              double dReferencePsnr = computePsnr(&source[0], pReference, uiLumaSize);
+              bool bReferenceChanged = vPreviousReferenceOutput.empty() || memcmp(&vPreviousReferenceOutput[0], pReference, uiLumaSize) != 0;
+              // no output counts as a frozen frame showing the previous picture
+              const uint8_t* pDecoded = decodedSamples.empty()
+                  ? (vPreviousOutput.empty() ? nullptr : &vPreviousOutput[0])
+                  : decodedSamples[0].getDataBuffer().data();
+              double dPsnr = pDecoded ? computePsnr(&source[0], pDecoded, uiLumaSize) : 0.0;
+              bool bFrozen = decodedSamples.empty() ||
+                  (bReferenceChanged && !vPreviousOutput.empty() && memcmp(&vPreviousOutput[0], pDecoded, uiLumaSize) == 0);
+              if (bFrozen) ++uiFrozenFrames;
+              if (iImpairedSinceFrame != -1 && !decodedSamples.empty() &&
+                  memcmp(pDecoded, pReference, uiLumaSize * 3 / 2) == 0)
+              {
+                vRecoveryFrames.push_back(iCurrentFrame - iImpairedSinceFrame);
+                iImpairedSinceFrame = -1;
+              }
+              ++uiDecodedFrames;
+              dTotalPsnr += dPsnr;
+              dTotalReferencePsnr += dReferencePsnr;
+              DIAG(2, "LOSS Frame {} lost: {} Y-PSNR: {} reference Y-PSNR: {} frozen: {} impaired: {}")
+                  << iCurrentFrame << uiLost << dPsnr << dReferencePsnr << bFrozen << (iImpairedSinceFrame != -1);
+
+              vPreviousReferenceOutput.assign(pReference, pReference + uiLumaSize);
+              if (pDecoded) vPreviousOutput.assign(pDecoded, pDecoded + uiLumaSize);
+              sourceFrames.pop_front();
+            }
+          }
         }
+        ++uiCodecFrames;
         ++iCurrentFrame;
       }
     }
+    // the frames that the encoder still holds at the end of the stream
+    {
+      TRACE_SCOPE("flush");
+      std::vector<EncodedFrame> flushed;
+      boost::system::error_code ec = pCodec->flush(flushed);
+      if (ec)
+      {
+        LOG(WARNING) << "Error in media flush: " << ec.message();
+      }
+      for (EncodedFrame& encodedFrame : flushed)
+      {
+        if (pPruner)
+        {
+          pPruner->addFrame(encodedFrame.Samples, dCurrentFps);
+          encodedFrame.Size = pPruner->prune(encodedFrame.Samples);
+        }
+        if (uiCodecFrames > uiWarmupFrames)
+          uiSteadyStateBytes += encodedFrame.Size;
+        addFrameStats(encodedFrame.Stats);
+        if (!encodedFrame.Samples.empty())
+        {
+          TRACE_SCOPE("sink writeAu");
+          pMediaSink->writeAu(encodedFrame.Samples);
+        }
+      }
+    }
     auto end = std::chrono::steady_clock::now();
+    // process CPU time: includes the encoder worker threads
+    std::clock_t cpuEnd = std::clock();
+    const memory::AllocationCounts allocations = memory::getAllocationCounts() - allocationsSteadyStateStart;
+    const memory::MemorySnapshot memoryEnd = memory::getMemorySnapshot();
     auto diff = end - start;
+    diagnostics::flush();
+    if (!sTraceFile.empty())
+    {
+      // the tail of the sink is written by the flush thread
+      pMediaSink->flush();
+      trace::Tracer::get().stop();
+      trace::Tracer::get().write(sTraceFile);
+    }
     auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(diff);
 
     double dAverageEncodingTime = std::accumulate(vEncodingTimes.begin(), vEncodingTimes.end(), 0) / static_cast<double>(vEncodingTimes.size());
@@ -484,6 +1887,118 @@ int main(int argc, char** argv)
     auto maxEncodingTimeMs = std::max_element(vEncodingTimes.begin(), vEncodingTimes.end());
 
     LOG(INFO) << "Read " << iCurrentFrame << " frames in " << sYuvFile << " (" << elapsed_ms.count() << " ms) Avg encoding time: " << dAverageEncodingTime << " ms min: " << *minEncodingTimeMs << " ms max: " << *maxEncodingTimeMs << "ms";
+    if (pPruner)
+    {
+      LOG(INFO) << "Layer pruning: dropped " << pPruner->getDroppedFrames() << " frames " << pPruner->getDroppedNalUnits() << " NAL units "
+                << pPruner->getDroppedBytes() << " bytes final max temporal id: " << pPruner->getMaxTemporalId();
+    }
+    if (!vSteadyStateTimesUs.empty())
+    {
+      // nearest rank percentiles of the time spent in transform
+      std::vector<uint64_t> vSorted(vSteadyStateTimesUs);
+      std::sort(vSorted.begin(), vSorted.end());
+      const size_t uiFrames = vSorted.size();
+      const uint64_t uiP50Us = vSorted[(uiFrames + 1) / 2 - 1];
+      const uint64_t uiP99Us = vSorted[static_cast<size_t>(std::ceil(uiFrames * 0.99)) - 1];
+      const double dWallS = std::max(std::chrono::duration<double>(end - tSteadyStateStart).count(), 1e-6);
+      const double dCpuS = static_cast<double>(cpuEnd - cpuSteadyStateStart) / CLOCKS_PER_SEC;
+      const double dDurationS = std::max(iCurrentFrame - iSteadyStateStartFrame, 1) / dFps;
+      // scripts/encoder_matrix.sh parses this line
+      LOG(INFO) << "Throughput: frames: " << uiFrames << " warmup: " << uiWarmupFrames << " fps: " << uiFrames / dWallS
+                << " CPU s/frame: " << dCpuS / uiFrames << " p50 latency: " << uiP50Us / 1000.0
+                << " ms p99 latency: " << uiP99Us / 1000.0 << " ms kbps: " << uiSteadyStateBytes * 8 / dDurationS / 1000.0;
+      std::ostringstream memoryUsage;
+      memoryUsage << "Memory: RSS: " << memoryEnd.RssKb << " kB peak RSS" << (bPeakRssReset ? " while encoding: " : ": ") << memoryEnd.PeakRssKb << " kB";
+      // process wide: includes the encoder worker threads and the sink
+      if (memory::isAllocationHookInstalled())
+      {
+        memoryUsage << " allocations/s: " << allocations.Allocations / dWallS << " allocated MB/s: " << allocations.AllocatedBytes / dWallS / 1e6
+                    << " allocations/frame: " << allocations.Allocations / static_cast<double>(uiFrames)
+                    << " allocated bytes/frame: " << allocations.AllocatedBytes / static_cast<double>(uiFrames);
+      }
+      LOG(INFO) << memoryUsage.str();
+    }
+    for (uint32_t uiStage = 0; pPerfCounters && uiStage < 3; ++uiStage)
+    {
+      const perf::CounterTotals& totals = perfTotals[uiStage];
+      if (totals.getSamples() == 0) continue;
+      std::ostringstream summary;
+      summary << "Perf counters " << perfStages[uiStage] << " (" << sPerfCounters << "): " << totals.getSamples() << " frames per frame:";
+      for (int i = 0; i < perf::PC_TASK_CLOCK; ++i)
+      {
+        const perf::Counter eCounter = static_cast<perf::Counter>(i);
+        if (totals.getTotal(eCounter) != -1)
+          summary << " " << perf::getName(eCounter) << ": " << totals.getTotal(eCounter) / totals.getSamples();
+      }
+      const int64_t iCycles = totals.getTotal(perf::PC_CYCLES);
+      const int64_t iInstructions = totals.getTotal(perf::PC_INSTRUCTIONS);
+      const int64_t iTaskClockNs = totals.getTotal(perf::PC_TASK_CLOCK);
+      if (iTaskClockNs != -1)
+        summary << " task-clock: " << iTaskClockNs / 1e6 / totals.getSamples() << " ms";
+      if (iCycles > 0 && iInstructions != -1)
+        summary << " IPC: " << iInstructions / static_cast<double>(iCycles);
+      // effective frequency: cycles per task clock second
+      if (iCycles != -1 && iTaskClockNs > 0)
+        summary << " GHz: " << iCycles / static_cast<double>(iTaskClockNs);
+      LOG(INFO) << summary.str();
+    }
+    if (uiDecimatedFrames > 0)
+    {
+      LOG(INFO) << "Frame rate: encoded " << uiCodecFrames << " of " << iCurrentFrame << " frames (" << uiDecimatedFrames << " dropped by decimation)";
+    }
+    if (iCurrentFrame > 0)
+    {
+      std::ostringstream histogram;
+      for (uint32_t i = 0; i < NalSizeHistogram::BINS; ++i)
+        histogram << " " << (i == NalSizeHistogram::BINS - 1 ? ">" : "<=") << (256u << std::min(i, NalSizeHistogram::BINS - 2)) << ":" << totalNalSizes.Counts[i];
+      if (uiMaxNalBytes > 0)
+        histogram << " over " << uiMaxNalBytes << ":" << uiOversizedNalUnits;
+      LOG(INFO) << "Slices: avg " << uiTotalSlices / static_cast<double>(iCurrentFrame) << " per frame NAL sizes:" << histogram.str();
+      for (auto& cost : recoveryMonitor.getCosts())
+      {
+        LOG(INFO) << "Recovery " << cost.first << ": " << cost.second.Count << " events Avg extra bytes: " << cost.second.ExtraBytes / cost.second.Count
+                  << " over " << cost.second.Frames / static_cast<double>(cost.second.Count) << " frames peak frame: " << cost.second.PeakFrameSize
+                  << " bytes Avg time to encode: " << cost.second.EncodingTimeMs / static_cast<double>(cost.second.Count) << "ms";
+      }
+      if (frameStatsSummary.Frames > 0)
+      {
+        std::ostringstream summary;
+        summary << "Frame stats: " << frameStatsSummary.Frames << " frames";
+        if (frameStatsSummary.QpFrames > 0)
+          summary << " Avg QP: " << frameStatsSummary.QpSum / frameStatsSummary.QpFrames;
+        if (frameStatsSummary.PsnrFrames > 0)
+          summary << " Avg Y-PSNR: " << frameStatsSummary.PsnrYSum / frameStatsSummary.PsnrFrames << " dB";
+        if (frameStatsSummary.SsimFrames > 0)
+          summary << " Avg SSIM: " << frameStatsSummary.SsimSum / frameStatsSummary.SsimFrames;
+        LOG(INFO) << summary.str();
+      }
+      LOG(INFO) << "Peak frame size: " << uiPeakFrameSize << " bytes (frame " << iPeakFrame << ") "
+                << (uiPeakFrameSize * 8.0) / (uiWidth * uiHeight) << " bpp";
+      if (uiMaxFrameSize > 0)
+      {
+        LOG(INFO) << "Max frame size " << uiMaxFrameSize << " bytes: " << uiCapViolations << " frames over ("
+                  << uiCapViolations * 100.0 / iCurrentFrame << "%) max overshoot: " << uiMaxCapOvershoot
+                  << " bytes skipped frames: " << uiCapSkippedFrames << " Avg time to encode frames over: "
+                  << (uiCapViolations > 0 ? uiCapViolationTimeUs / 1000.0 / uiCapViolations : 0.0) << "ms";
+      }
+    }
+    if (pRtpSink && iCurrentFrame > 0)
+    {
+      double dElapsedS = std::max<int64_t>(elapsed_ms.count(), 1) / 1000.0;
+      LOG(INFO) << "RTP: " << pRtpSink->getPacketCount() << " packets (" << pRtpSink->getPacketCount() / dElapsedS << " packets/s) "
+                << pRtpSink->getByteCount() << " bytes Avg header overhead: " << pRtpSink->getHeaderByteCount() / static_cast<double>(iCurrentFrame)
+                << " bytes/frame Time to packetise and send: " << uiPacketisationTimeUs / 1000.0 << " ms";
+    }
+    if (pLossModel && uiDecodedFrames > 0)
+    {
+      double dMeanRecovery = vRecoveryFrames.empty() ? 0.0 : std::accumulate(vRecoveryFrames.begin(), vRecoveryFrames.end(), 0) / static_cast<double>(vRecoveryFrames.size());
+      uint32_t uiMaxRecovery = vRecoveryFrames.empty() ? 0 : *std::max_element(vRecoveryFrames.begin(), vRecoveryFrames.end());
+      LOG(INFO) << "Loss: " << pLossModel->getLossCount() << "/" << pLossModel->getPacketCount() << (pPacketiser ? " packets" : " NAL units")
+                << " lost Avg Y-PSNR: " << dTotalPsnr / uiDecodedFrames << " dB reference: " << dTotalReferencePsnr / uiDecodedFrames
+                << " dB Frozen frames: " << uiFrozenFrames << " Recoveries: " << vRecoveryFrames.size()
+                << " Avg recovery time: " << dMeanRecovery << " frames max: " << uiMaxRecovery
+                << " frames Unrecovered: " << (iImpairedSinceFrame != -1 ? "yes" : "no");
+    }
   }
   catch (boost::exception& e)
   {
@@ -17,6 +17,7 @@
 // "CSIR"
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #include "stdafx.h"
+#include <algorithm>
 #include "OpenH264Codec.h"
 #include <codec_api.h>
 #include <rtp++/util/Conversion.h>
@@ -28,7 +29,19 @@ OpenH264Codec::OpenH264Codec()
   :m_pCodec(nullptr),
     m_uiTargetBitrate(0),
     m_bInitialised(false),
-    m_uiEncodingBufferSize(0)
+    m_uiEncodingBufferSize(0),
+    m_uiMaxNalBytes(0),
+    m_uiIntraRefreshPeriod(0),
+    m_uiTemporalLayers(1),
+    m_bLongTermReference(false),
+    m_uiFrameIndex(0),
+    m_uiLastIdrFrame(0),
+    m_uiIdrPicId(0),
+    m_uiMaxFrameSizeBytes(0),
+    m_dFramerate(0.0),
+    m_uiThreads(1),
+    m_uiComplexity(MEDIUM_COMPLEXITY),
+    m_uiQp(0)
 {
   int rv = WelsCreateSVCEncoder (&m_pCodec);
   assert (rv == 0);
@@ -53,6 +66,7 @@ boost::system::error_code OpenH264Codec::setInputType(const MediaTypeDescriptor&
   }
 
   m_in = in;
+  m_dFramerate = in.getFps();
 
   m_uiEncodingBufferSize = in.getWidth() * in.getHeight() * 1.5;
   VLOG(2) << "Encoding buffer size: " << m_uiEncodingBufferSize;
@@ -72,6 +86,90 @@ boost::system::error_code OpenH264Codec::configure(const std::string& sName, con
     assert(m_in.getFps() != 0.0);
     return boost::system::error_code();
   }
+  else if (sName == "max-nal-bytes")
+  {
+    bool bSuccess = false;
+    uint32_t uiMaxNalBytes = convert<uint32_t>(sValue, bSuccess);
+    if (!bSuccess)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_uiMaxNalBytes = uiMaxNalBytes;
+    VLOG(2) << "Max NAL bytes: " << m_uiMaxNalBytes;
+    return boost::system::error_code();
+  }
+  else if (sName == "intra-refresh")
+  {
+    bool bSuccess = false;
+    uint32_t uiPeriod = convert<uint32_t>(sValue, bSuccess);
+    if (!bSuccess)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_uiIntraRefreshPeriod = uiPeriod;
+    VLOG(2) << "Intra refresh period: " << m_uiIntraRefreshPeriod << " (IDR period)";
+    return boost::system::error_code();
+  }
+  else if (sName == "temporal-layers")
+  {
+    bool bSuccess = false;
+    uint32_t uiLayers = convert<uint32_t>(sValue, bSuccess);
+    if (!bSuccess || uiLayers < 1 || uiLayers > MAX_TEMPORAL_LAYER_NUM)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_uiTemporalLayers = uiLayers;
+    VLOG(2) << "Temporal layers: " << m_uiTemporalLayers;
+    return boost::system::error_code();
+  }
+  else if (sName == "ltr")
+  {
+    bool bSuccess = false;
+    uint32_t uiLtr = convert<uint32_t>(sValue, bSuccess);
+    if (!bSuccess)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_bLongTermReference = uiLtr != 0;
+    VLOG(2) << "Long term reference: " << m_bLongTermReference;
+    return boost::system::error_code();
+  }
+  else if (sName == "threads")
+  {
+    bool bSuccess = false;
+    uint32_t uiThreads = convert<uint32_t>(sValue, bSuccess);
+    if (!bSuccess)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_uiThreads = uiThreads;
+    VLOG(2) << "Threads: " << m_uiThreads;
+    return boost::system::error_code();
+  }
+  else if (sName == "complexity")
+  {
+    bool bSuccess = false;
+    uint32_t uiComplexity = convert<uint32_t>(sValue, bSuccess);
+    if (!bSuccess || uiComplexity > HIGH_COMPLEXITY)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_uiComplexity = uiComplexity;
+    VLOG(2) << "Complexity: " << m_uiComplexity;
+    return boost::system::error_code();
+  }
+  else if (sName == "qp")
+  {
+    bool bSuccess = false;
+    uint32_t uiQp = convert<uint32_t>(sValue, bSuccess);
+    if (!bSuccess || uiQp < 1 || uiQp > 51)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_uiQp = uiQp;
+    VLOG(2) << "QP: " << m_uiQp;
+    return boost::system::error_code();
+  }
   return boost::system::error_code(boost::system::errc::not_supported, boost::system::generic_category());
 }
 
@@ -92,40 +190,73 @@ boost::system::error_code OpenH264Codec::initialise()
   SEncParamExt param;
   m_pCodec->GetDefaultParams (&param);
   param.iUsageType = CAMERA_VIDEO_REAL_TIME;
-  param.fMaxFrameRate = (uint32_t)m_in.getFps();
+  param.fMaxFrameRate = static_cast<float>(m_dFramerate);
   param.iPicWidth = m_in.getWidth();
   param.iPicHeight = m_in.getHeight();
   param.iTargetBitrate = m_uiTargetBitrate * 1000;
   //param.bEnableDenoise = denoise;
   param.bEnableDenoise = false;
   param.iSpatialLayerNum = 1;
-  //SM_DYN_SLICE don't support multi-thread now
-#if 0
-  if (sliceMode != SM_SINGLE_SLICE && sliceMode != SM_DYN_SLICE)
-      param.iMultipleThreadIdc = 2;
-#endif
+  param.iMultipleThreadIdc = static_cast<unsigned short>(m_uiThreads);
+  param.iComplexityMode = static_cast<ECOMPLEXITY_MODE>(m_uiComplexity);
+  if (m_uiQp > 0)
+  {
+    // constant quality: the bitrate is the result. Adaptive quantisation would offset the QP of P frames
+    param.iRCMode = RC_OFF_MODE;
+    param.bEnableAdaptiveQuant = false;
+  }
+  // upper temporal layers are not referenced by lower ones and can be dropped
+  param.iTemporalLayerNum = m_uiTemporalLayers;
+  const SliceModeEnum sliceMode = m_uiMaxNalBytes > 0 ? SM_SIZELIMITED_SLICE : SM_SINGLE_SLICE;
+  if (sliceMode == SM_SIZELIMITED_SLICE)
+  {
+    // size limited slices are only deterministic when encoding on a single thread
+    param.iMultipleThreadIdc = 1;
+    param.uiMaxNalSize = m_uiMaxNalBytes;
+  }
   // RG: this prevents IDR generation on scene change
 #if 1
   param.bEnableSceneChangeDetect = false;
 #endif
   param.bEnableFrameSkip = false;
+  if (m_uiMaxFrameSizeBytes > 0)
+  {
+    // OpenH264 has no per-frame limit: frames are skipped while the max bitrate is exceeded
+    param.bEnableFrameSkip = true;
+    param.iMaxBitrate = getMaxBitrate();
+  }
+  param.uiIntraPeriod = m_uiIntraRefreshPeriod;
+  if (m_bLongTermReference)
+  {
+    param.bEnableLongTermReference = true;
+    param.iLTRRefNum = 1;
+  }
   for (int i = 0; i < param.iSpatialLayerNum; i++)
   {
     param.sSpatialLayers[i].iVideoWidth = m_in.getWidth() >> (param.iSpatialLayerNum - 1 - i);
     param.sSpatialLayers[i].iVideoHeight = m_in.getHeight() >> (param.iSpatialLayerNum - 1 - i);
-    param.sSpatialLayers[i].fFrameRate = (uint32_t)m_in.getFps();
+    param.sSpatialLayers[i].fFrameRate = static_cast<float>(m_dFramerate);
     param.sSpatialLayers[i].iSpatialBitrate = param.iTargetBitrate;
-    param.sSpatialLayers[i].sSliceArgument.uiSliceMode = SM_SINGLE_SLICE;
-#if 0
-    param.sSpatialLayers[i].sSliceCfg.uiSliceMode = sliceMode;
-    if (sliceMode == SM_DYN_SLICE) {
-        param.sSpatialLayers[i].sSliceCfg.sSliceArgument.uiSliceSizeConstraint = 600;
-        param.uiMaxNalSize = 1500;
+    if (m_uiQp > 0)
+    {
+      param.sSpatialLayers[i].iDLayerQp = m_uiQp;
+    }
+    if (m_uiMaxFrameSizeBytes > 0)
+    {
+      param.sSpatialLayers[i].iMaxSpatialBitrate = param.iMaxBitrate;
+    }
+    param.sSpatialLayers[i].sSliceArgument.uiSliceMode = sliceMode;
+    if (sliceMode == SM_SIZELIMITED_SLICE)
+    {
+      param.sSpatialLayers[i].sSliceArgument.uiSliceSizeConstraint = m_uiMaxNalBytes;
     }
-#endif
   }
   param.iTargetBitrate *= param.iSpatialLayerNum;
-  m_pCodec->InitializeExt (&param);
+  if (m_pCodec->InitializeExt (&param) != cmResultSuccess)
+  {
+    LOG(ERROR) << "Failed to initialise OpenH264 encoder";
+    return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+  }
   int videoFormat = videoFormatI420;
   m_pCodec->SetOption (ENCODER_OPTION_DATAFORMAT, &videoFormat);
 #endif
@@ -146,11 +277,28 @@ boost::system::error_code OpenH264Codec::getOutputType(MediaTypeDescriptor& out)
 
 boost::system::error_code OpenH264Codec::transform(const std::vector<MediaSample>& in, std::vector<MediaSample>& out, uint32_t& uiSize)
 {
-  VLOG(12) << "OpenH264Codec::transform";
+  if (in.empty())
+  {
+    return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+  }
+  // each sample is a frame: the NAL units of all frames are appended to out
+  uiSize = 0;
+  for (const MediaSample& mediaIn : in)
+  {
+    uint32_t uiFrameSize = 0;
+    boost::system::error_code ec = encodeFrame(mediaIn, out, uiFrameSize);
+    if (ec) return ec;
+    uiSize += uiFrameSize;
+  }
+  return boost::system::error_code();
+}
+
+boost::system::error_code OpenH264Codec::encodeFrame(const MediaSample& mediaIn, std::vector<MediaSample>& out, uint32_t& uiSize)
+{
+  VLOG(12) << "OpenH264Codec::encodeFrame";
   assert (m_pCodec);
-  // we only handle one sample at a time
-  assert(in.size() == 1);
-  const MediaSample& mediaIn = in[0];
+  // out may already hold the samples of earlier frames of a batch
+  const size_t uiFirstSample = out.size();
   // const uint8_t* pBufferIn = mediaIn.getDataBuffer().data();
   // const uint8_t* pBufferOut = m_encodingBuffer.data();
 
@@ -189,6 +337,25 @@ boost::system::error_code OpenH264Codec::transform(const std::vector<MediaSample
 #endif
   int rv = m_pCodec->EncodeFrame (&pic, &info);
   assert(rv == cmResultSuccess);
+  m_frameStats = FrameStats();
+  // OpenH264 outputs each frame before the next is passed in
+  m_frameStats.InputFrame = static_cast<int32_t>(m_uiFrameIndex);
+  if (info.eFrameType == videoFrameTypeIDR)
+  {
+    // the slice header idr_pic_id is incremented with every IDR
+    ++m_uiIdrPicId;
+    m_uiLastIdrFrame = m_uiFrameIndex;
+    if (m_bLongTermReference)
+    {
+      // there is no receiver feedback: assume that the IDR, which is marked as long term reference, arrived
+      SLTRMarkingFeedback feedback;
+      feedback.uiFeedbackType = LTR_MARKING_SUCCESS;
+      feedback.uiIDRPicId = m_uiIdrPicId;
+      feedback.iLTRFrameNum = 0;
+      m_pCodec->SetOption (ENCODER_LTR_MARKING_FEEDBACK, &feedback);
+    }
+  }
+  ++m_uiFrameIndex;
 
   if (info.eFrameType != videoFrameTypeSkip)
   {
@@ -220,17 +387,30 @@ boost::system::error_code OpenH264Codec::transform(const std::vector<MediaSample
         MediaSample mediaSample;
         mediaSample.setData(mediaData);
         mediaSample.setNaluContainsStartCode(true);
+        mediaSample.setTemporalId(layerInfo.uiTemporalId);
         out.push_back(mediaSample);
         pBuffer += uiNaluLength;
       }
     }
     VLOG(6) << "Total length: " << len;
     uiSize = len;
+
+    m_frameStats.Encoded = true;
+    m_frameStats.Bits = len * 8;
+    m_frameStats.Idr = (info.eFrameType == videoFrameTypeIDR);
+    m_frameStats.Type = (info.eFrameType == videoFrameTypeIDR || info.eFrameType == videoFrameTypeI) ? ST_I : ST_P;
+    SliceHeaderInfo sliceHeader;
+    double dAverageQp = 0.0;
+    if (m_sliceHeaderParser.parseAccessUnit(out, sliceHeader, dAverageQp, uiFirstSample) > 0)
+    {
+      m_frameStats.Qp = dAverageQp;
+    }
     return boost::system::error_code();
   }
   else
   {
     VLOG(2) << "Skip frame";
+    uiSize = 0;
     return boost::system::error_code();
   }
 }
@@ -244,6 +424,11 @@ boost::system::error_code OpenH264Codec::setBitrate(uint32_t uiTargetBitrate)
     {
       return boost::system::error_code();
     }
+    if (m_uiQp > 0)
+    {
+      LOG(WARNING) << "Bitrate changes are not supported at a fixed QP";
+      return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+    }
 
 #if 0
     return boost::system::error_code(boost::system::errc::argument_out_of_domain, boost::system::generic_category());
@@ -261,6 +446,11 @@ boost::system::error_code OpenH264Codec::setBitrate(uint32_t uiTargetBitrate)
     {
       LOG(WARNING) << "Failed to update bitrate";
     }
+    if (m_uiMaxFrameSizeBytes > 0)
+    {
+      // the max bitrate may not be lower than the target bitrate
+      return setMaxFrameSize(m_uiMaxFrameSizeBytes);
+    }
     return boost::system::error_code();
 #endif
     // return boost::system::error_code(boost::system::errc::argument_out_of_domain, boost::system::generic_category());
@@ -271,3 +461,123 @@ boost::system::error_code OpenH264Codec::setBitrate(uint32_t uiTargetBitrate)
     return boost::system::error_code();
   }
 }
+
+boost::system::error_code OpenH264Codec::startIntraRefresh()
+{
+  if (!m_bInitialised)
+  {
+    return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+  }
+  // there is no gradual refresh: the next frame is an IDR
+  return generateIdr();
+}
+
+boost::system::error_code OpenH264Codec::generateIdr()
+{
+  if (!m_bInitialised)
+  {
+    return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+  }
+  if (m_pCodec->ForceIntraFrame (true) != cmResultSuccess)
+  {
+    LOG(WARNING) << "Failed to force intra frame";
+    return boost::system::error_code(boost::system::errc::argument_out_of_domain, boost::system::generic_category());
+  }
+  return boost::system::error_code();
+}
+
+boost::system::error_code OpenH264Codec::updateReferencePicture(uint32_t uiFirstLostFrame)
+{
+  if (!m_bInitialised)
+  {
+    return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+  }
+  // frame_num is only known when every frame is a reference: upper temporal layers are not
+  // and skipped frames are not encoded
+  if (!m_bLongTermReference || uiFirstLostFrame <= m_uiLastIdrFrame ||
+      m_uiTemporalLayers > 1 || m_uiMaxFrameSizeBytes > 0)
+  {
+    return generateIdr();
+  }
+  // frame_num counts the frames since the last IDR.
+  // An unknown current frame_num makes the encoder predict the next frame from the confirmed LTR.
+  SLTRRecoverRequest request;
+  request.uiFeedbackType = LTR_RECOVERY_REQUEST;
+  request.uiIDRPicId = m_uiIdrPicId;
+  request.iLastCorrectFrameNum = uiFirstLostFrame - 1 - m_uiLastIdrFrame;
+  request.iCurrentFrameNum = -1;
+  VLOG(2) << "LTR recovery request: first lost frame: " << uiFirstLostFrame << " IDR pic id: " << m_uiIdrPicId;
+  if (m_pCodec->SetOption (ENCODER_LTR_RECOVERY_REQUEST, &request) != cmResultSuccess)
+  {
+    LOG(WARNING) << "Failed to request LTR recovery";
+    return boost::system::error_code(boost::system::errc::argument_out_of_domain, boost::system::generic_category());
+  }
+  return boost::system::error_code();
+}
+
+boost::system::error_code OpenH264Codec::setMaxFrameSize(uint32_t uiMaxFrameSizeBytes)
+{
+  const bool bFrameSkip = m_uiMaxFrameSizeBytes > 0;
+  m_uiMaxFrameSizeBytes = uiMaxFrameSizeBytes;
+  if (!m_bInitialised)
+  {
+    return boost::system::error_code();
+  }
+  // frame skipping can only be configured when initialising the encoder
+  if (bFrameSkip != (uiMaxFrameSizeBytes > 0))
+  {
+    return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+  }
+  if (uiMaxFrameSizeBytes == 0)
+  {
+    return boost::system::error_code();
+  }
+  SBitrateInfo maxBitrate;
+  maxBitrate.iLayer = SPATIAL_LAYER_ALL;
+  maxBitrate.iBitrate = getMaxBitrate();
+  VLOG(2) << "Max frame size: " << uiMaxFrameSizeBytes << " bytes max bitrate: " << maxBitrate.iBitrate << " bps";
+  if (m_pCodec->SetOption (ENCODER_OPTION_MAX_BITRATE, &maxBitrate) != cmResultSuccess)
+  {
+    LOG(WARNING) << "Failed to update max bitrate";
+    return boost::system::error_code(boost::system::errc::argument_out_of_domain, boost::system::generic_category());
+  }
+  return boost::system::error_code();
+}
+
+uint32_t OpenH264Codec::getMaxBitrate() const
+{
+  // a frame of the maximum size at every frame interval, but never below the target bitrate
+  uint32_t uiMaxBitrate = static_cast<uint32_t>(m_uiMaxFrameSizeBytes * 8 * m_dFramerate);
+  return std::max(uiMaxBitrate, m_uiTargetBitrate * 1000);
+}
+
+boost::system::error_code OpenH264Codec::setFramerate(double dFramerate)
+{
+  if (dFramerate <= 0.0)
+  {
+    return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+  }
+  m_dFramerate = dFramerate;
+  if (!m_bInitialised)
+  {
+    return boost::system::error_code();
+  }
+  float fFramerate = static_cast<float>(dFramerate);
+  VLOG(2) << "Frame rate: " << fFramerate;
+  if (m_pCodec->SetOption (ENCODER_OPTION_FRAME_RATE, &fFramerate) != cmResultSuccess)
+  {
+    LOG(WARNING) << "Failed to update frame rate";
+    return boost::system::error_code(boost::system::errc::argument_out_of_domain, boost::system::generic_category());
+  }
+  if (m_uiMaxFrameSizeBytes > 0)
+  {
+    // the max bitrate is derived from the frame rate
+    return setMaxFrameSize(m_uiMaxFrameSizeBytes);
+  }
+  return boost::system::error_code();
+}
+
+FrameStats OpenH264Codec::getFrameStats() const
+{
+  return m_frameStats;
+}
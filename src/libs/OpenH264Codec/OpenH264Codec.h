@@ -18,6 +18,7 @@
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #pragma once
 #include <rtp++/media/IVideoCodecTransform.h>
+#include <rtp++/media/h264/H264SliceHeaderParser.h>
 #include <rtp++/util/Buffer.h>
 
 #ifdef _WIN32
@@ -69,8 +70,34 @@ public:
    * @brief @INetworkCodecCooperation
    */
   virtual boost::system::error_code setBitrate(uint32_t uiTargetBitrate);
+  /**
+   * @brief @INetworkCodecCooperation
+   */
+  virtual boost::system::error_code startIntraRefresh();
+  /**
+   * @brief @INetworkCodecCooperation
+   */
+  virtual boost::system::error_code generateIdr();
+  /**
+   * @brief @INetworkCodecCooperation
+   */
+  virtual boost::system::error_code updateReferencePicture(uint32_t uiFirstLostFrame);
+  /**
+   * @brief @INetworkCodecCooperation
+   */
+  virtual boost::system::error_code setMaxFrameSize(uint32_t uiMaxFrameSizeBytes);
+  /**
+   * @brief @INetworkCodecCooperation
+   */
+  virtual boost::system::error_code setFramerate(double dFramerate);
+  /**
+   * @brief @IVideoCodecTransform
+   */
+  virtual rtp_plus_plus::media::FrameStats getFrameStats() const;
 
 private:
+  boost::system::error_code encodeFrame(const rtp_plus_plus::media::MediaSample& mediaIn, std::vector<rtp_plus_plus::media::MediaSample>& out, uint32_t& uiSize);
+  uint32_t getMaxBitrate() const;
 
   rtp_plus_plus::media::MediaTypeDescriptor m_in;
   rtp_plus_plus::media::MediaTypeDescriptor m_out;
@@ -80,4 +107,28 @@ private:
   bool m_bInitialised;
   uint32_t m_uiEncodingBufferSize;
   rtp_plus_plus::Buffer m_encodingBuffer;
+  // 0 = single slice per frame
+  uint32_t m_uiMaxNalBytes;
+  // OpenH264 has no intra refresh: the refresh period is an IDR period
+  uint32_t m_uiIntraRefreshPeriod;
+  // 1 = no temporal scalability: the GOP size is 2^(layers - 1) frames
+  uint32_t m_uiTemporalLayers;
+  // long term reference recovery
+  bool m_bLongTermReference;
+  uint32_t m_uiFrameIndex;
+  uint32_t m_uiLastIdrFrame;
+  uint16_t m_uiIdrPicId;
+  // 0 = no cap: the cap is enforced by skipping frames once the max bitrate is exceeded
+  uint32_t m_uiMaxFrameSizeBytes;
+  // the input frame rate until changed by setFramerate
+  double m_dFramerate;
+  // 0 = one thread per core
+  uint32_t m_uiThreads;
+  // LOW_COMPLEXITY, MEDIUM_COMPLEXITY or HIGH_COMPLEXITY
+  uint32_t m_uiComplexity;
+  // > 0: fixed QP with rate control off
+  uint32_t m_uiQp;
+  // OpenH264 does not report the QP: it is read from the slice headers of the output
+  rtp_plus_plus::media::h264::H264SliceHeaderParser m_sliceHeaderParser;
+  rtp_plus_plus::media::FrameStats m_frameStats;
 };
@@ -0,0 +1,173 @@
+/**********
+    This file is part of CodecStepResponse.
+
+    CodecStepResponse is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    CodecStepResponse is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CodecStepResponse.  If not, see <http://www.gnu.org/licenses/>.
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include "OpenH264Decoder.h"
+#include <codec_api.h>
+#include <rtp++/util/Conversion.h>
+
+using namespace rtp_plus_plus;
+using namespace rtp_plus_plus::media;
+
+OpenH264Decoder::OpenH264Decoder()
+  :m_pCodec(nullptr),
+    m_iErrorConcealment(ERROR_CON_SLICE_COPY_CROSS_IDR),
+    m_bInitialised(false),
+    m_bDecodingError(false)
+{
+  long rv = WelsCreateDecoder (&m_pCodec);
+  assert (rv == 0);
+  assert (m_pCodec != NULL);
+}
+
+OpenH264Decoder::~OpenH264Decoder()
+{
+  assert(m_pCodec);
+  if (m_pCodec) {
+    m_pCodec->Uninitialize();
+    WelsDestroyDecoder (m_pCodec);
+  }
+}
+
+boost::system::error_code OpenH264Decoder::setInputType(const MediaTypeDescriptor& in)
+{
+  VLOG(2) << "OpenH264Decoder::setInputType";
+  if (in.m_eSubtype != rtp_plus_plus::media::MediaTypeDescriptor::MST_H264)
+  {
+    return boost::system::error_code(boost::system::errc::not_supported, boost::system::generic_category());
+  }
+  m_in = in;
+  return boost::system::error_code();
+}
+
+boost::system::error_code OpenH264Decoder::configure(const std::string& sName, const std::string& sValue)
+{
+  if (sName == "error-concealment")
+  {
+    bool bSuccess = false;
+    int iErrorConcealment = convert<int>(sValue, bSuccess);
+    if (!bSuccess || iErrorConcealment < ERROR_CON_DISABLE || iErrorConcealment > ERROR_CON_SLICE_MV_COPY_CROSS_IDR_FREEZE_RES_CHANGE)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_iErrorConcealment = iErrorConcealment;
+    VLOG(2) << "Error concealment: " << m_iErrorConcealment;
+    return boost::system::error_code();
+  }
+  return boost::system::error_code(boost::system::errc::not_supported, boost::system::generic_category());
+}
+
+boost::system::error_code OpenH264Decoder::initialise()
+{
+  SDecodingParam param;
+  memset (&param, 0, sizeof (SDecodingParam));
+  param.eEcActiveIdc = (ERROR_CON_IDC)m_iErrorConcealment;
+  param.sVideoProperty.size = sizeof (param.sVideoProperty);
+  param.sVideoProperty.eVideoBsType = VIDEO_BITSTREAM_AVC;
+  if (m_pCodec->Initialize (&param) != cmResultSuccess)
+  {
+    LOG(WARNING) << "Failed to initialise OpenH264 decoder";
+    return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+  }
+  // the initialisation parameter is ignored by some versions
+  int iErrorConcealment = m_iErrorConcealment;
+  m_pCodec->SetOption (DECODER_OPTION_ERROR_CON_IDC, &iErrorConcealment);
+  m_bInitialised = true;
+  return boost::system::error_code();
+}
+
+boost::system::error_code OpenH264Decoder::getOutputType(MediaTypeDescriptor& out)
+{
+  VLOG(2) << "OpenH264Decoder::getOutputType";
+  out.m_eType = rtp_plus_plus::media::MediaTypeDescriptor::MT_VIDEO;
+  out.m_eSubtype = rtp_plus_plus::media::MediaTypeDescriptor::MST_YUV_420P;
+  out.m_uiWidth = m_in.getWidth();
+  out.m_uiHeight = m_in.getHeight();
+  m_out = out;
+  return boost::system::error_code();
+}
+
+boost::system::error_code OpenH264Decoder::transform(const std::vector<MediaSample>& in, std::vector<MediaSample>& out, uint32_t& uiSize)
+{
+  VLOG(12) << "OpenH264Decoder::transform";
+  assert (m_pCodec && m_bInitialised);
+  uiSize = 0;
+  m_bDecodingError = false;
+
+  const uint8_t startcode[4] = { 0, 0, 0, 1 };
+  m_vBitstream.clear();
+  for (const MediaSample& mediaSample : in)
+  {
+    if (!mediaSample.doesNaluContainsStartCode())
+    {
+      m_vBitstream.insert(m_vBitstream.end(), startcode, startcode + 4);
+    }
+    const uint8_t* pData = mediaSample.getDataBuffer().data();
+    m_vBitstream.insert(m_vBitstream.end(), pData, pData + mediaSample.getPayloadSize());
+  }
+  if (m_vBitstream.empty())
+  {
+    return boost::system::error_code();
+  }
+
+  uint8_t* pPlanes[3] = { nullptr, nullptr, nullptr };
+  SBufferInfo info;
+  memset (&info, 0, sizeof (SBufferInfo));
+  DECODING_STATE eState = m_pCodec->DecodeFrameNoDelay (&m_vBitstream[0], (int)m_vBitstream.size(), pPlanes, &info);
+  if (eState != dsErrorFree)
+  {
+    VLOG(5) << "Decoding state: " << eState;
+    m_bDecodingError = true;
+  }
+  if (info.iBufferStatus != 1)
+  {
+    return boost::system::error_code();
+  }
+
+  const uint32_t uiWidth = info.UsrData.sSystemBuffer.iWidth;
+  const uint32_t uiHeight = info.UsrData.sSystemBuffer.iHeight;
+  if (uiWidth != m_in.getWidth() || uiHeight != m_in.getHeight())
+  {
+    LOG(WARNING) << "Decoded picture size " << uiWidth << "x" << uiHeight << " does not match " << m_in.getWidth() << "x" << m_in.getHeight();
+  }
+  // copy the planes without stride padding
+  const uint32_t uiFrameSize = uiWidth * uiHeight * 3 / 2;
+  uint8_t* pFrame = new uint8_t[uiFrameSize];
+  uint8_t* pDest = pFrame;
+  for (int iPlane = 0; iPlane < 3; ++iPlane)
+  {
+    const uint32_t uiPlaneWidth = iPlane == 0 ? uiWidth : uiWidth >> 1;
+    const uint32_t uiPlaneHeight = iPlane == 0 ? uiHeight : uiHeight >> 1;
+    const int iStride = info.UsrData.sSystemBuffer.iStride[iPlane == 0 ? 0 : 1];
+    for (uint32_t uiRow = 0; uiRow < uiPlaneHeight; ++uiRow)
+    {
+      memcpy(pDest, pPlanes[iPlane] + uiRow * iStride, uiPlaneWidth);
+      pDest += uiPlaneWidth;
+    }
+  }
+  MediaSample mediaSample;
+  mediaSample.setData(pFrame, uiFrameSize);
+  if (!in.empty())
+  {
+    mediaSample.setPresentationTime(in[0].getPresentationTime());
+    mediaSample.setRtpTime(in[0].getRtpTime());
+  }
+  out.push_back(mediaSample);
+  uiSize = uiFrameSize;
+  return boost::system::error_code();
+}
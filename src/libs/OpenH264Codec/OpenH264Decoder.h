@@ -0,0 +1,89 @@
+/**********
+    This file is part of CodecStepResponse.
+
+    CodecStepResponse is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    CodecStepResponse is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CodecStepResponse.  If not, see <http://www.gnu.org/licenses/>.
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#pragma once
+#include <rtp++/media/IMediaTransform.h>
+#include <rtp++/util/Buffer.h>
+
+#ifdef _WIN32
+#ifdef OpenH264Codec_EXPORTS
+#define Open_H264_API __declspec(dllexport)
+#else
+#define Open_H264_API __declspec(dllimport)
+#endif
+#else
+#define Open_H264_API 
+#endif
+
+class ISVCDecoder;
+
+/**
+ * @brief The OpenH264Decoder class decodes the NAL units of one access unit per call to transform
+ * into a YUV 420P frame. Error concealment is enabled by default so that damaged access units
+ * still produce a picture: configure "error-concealment" with an ERROR_CON_IDC value to change it.
+ */
+class Open_H264_API OpenH264Decoder : public rtp_plus_plus::media::IMediaTransform
+{
+public:
+  /**
+   * @brief OpenH264Decoder
+   */
+  OpenH264Decoder();
+  /**
+   * @brief OpenH264Decoder
+   */
+  ~OpenH264Decoder();
+  /**
+   * @brief @IMediaTransform
+   */
+  virtual boost::system::error_code setInputType(const rtp_plus_plus::media::MediaTypeDescriptor& in);
+  /**
+   * @brief @IMediaTransform
+   */
+  virtual boost::system::error_code configure(const std::string& sName, const std::string& sValue);
+  /**
+   * @brief @IMediaTransform
+   */
+  virtual boost::system::error_code initialise();
+  /**
+   * @brief @IMediaTransform
+   */
+  virtual boost::system::error_code getOutputType(rtp_plus_plus::media::MediaTypeDescriptor& out);
+  /**
+   * @brief @IMediaTransform: out is empty if the decoder did not output a picture
+   */
+  virtual boost::system::error_code transform(const std::vector<rtp_plus_plus::media::MediaSample>& in,
+                                              std::vector<rtp_plus_plus::media::MediaSample>& out,
+                                              uint32_t& uiSize);
+  /**
+   * @brief returns whether the decoder reported an error for the last access unit
+   */
+  bool hasDecodingError() const { return m_bDecodingError; }
+
+private:
+
+  rtp_plus_plus::media::MediaTypeDescriptor m_in;
+  rtp_plus_plus::media::MediaTypeDescriptor m_out;
+
+  ISVCDecoder* m_pCodec;
+  int m_iErrorConcealment;
+  bool m_bInitialised;
+  bool m_bDecodingError;
+  // Annex B input of the current access unit
+  std::vector<uint8_t> m_vBitstream;
+};
@@ -17,10 +17,13 @@
 // "CSIR"
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #include "stdafx.h"
+#include <algorithm>
 #include "VppH264Codec.h"
 #include <ICodecv2.h>
 #include <H264v2.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <rtp++/util/Conversion.h>
+#include <rtp++/util/Diagnostics.h>
 
 using namespace rtp_plus_plus;
 using namespace rtp_plus_plus::media;
@@ -125,9 +128,17 @@ VppH264Codec::VppH264Codec()
     m_uiIFramePeriod(0),
     m_uiCurrentFrame(0),
     m_uiFrameBitLimit(0),
+    m_uiTargetBitrate(0),
+    m_dFramerate(0.0),
     m_uiMode(2),
     m_uiRateControlModelType(RCMT_POW),
     m_bNotifyOnIFrame(false),
+    m_bRestart(false),
+    m_uiMaxFrameSizeBytes(0),
+    m_uiReencodedFrames(0),
+    m_uiReencodeAttempts(0),
+    m_uiReencodeTimeUs(0),
+    m_uiInputFrames(0),
     m_uiEncodingBufferSize(0)
 {
   H264v2Factory factory;
@@ -137,6 +148,11 @@ VppH264Codec::VppH264Codec()
 VppH264Codec::~VppH264Codec()
 {
   assert(m_pCodec);
+  if (m_uiReencodedFrames > 0)
+  {
+    LOG(INFO) << "Re-encoded frames: " << m_uiReencodedFrames << " attempts: " << m_uiReencodeAttempts
+              << " time to re-encode: " << m_uiReencodeTimeUs / 1000.0 << "ms";
+  }
   m_pCodec->Close();
   H264v2Factory factory;
   factory.ReleaseCodecInstance(m_pCodec);
@@ -156,6 +172,7 @@ boost::system::error_code VppH264Codec::setInputType(const MediaTypeDescriptor&
   }
 
   m_in = in;
+  m_dFramerate = in.getFps();
 
   m_uiEncodingBufferSize = in.getWidth() * in.getHeight() * 1.5;
   VLOG(2) << "Encoding buffer size: " << m_uiEncodingBufferSize;
@@ -171,8 +188,9 @@ boost::system::error_code VppH264Codec::configure(const std::string& sName, cons
     bool bDummy;
     uint32_t uiKbps = convert<uint32_t>(sValue, bDummy);
     assert(bDummy);
-    assert(m_in.getFps() != 0.0);
-    m_uiFrameBitLimit = static_cast<uint32_t>((uiKbps * 1000) / m_in.getFps());
+    assert(m_dFramerate != 0.0);
+    m_uiTargetBitrate = uiKbps;
+    m_uiFrameBitLimit = static_cast<uint32_t>((uiKbps * 1000) / m_dFramerate);
     VLOG(2) << "Target bitrate: " << uiKbps  << "kbps - setting frame bit limit to " << m_uiFrameBitLimit;
     return boost::system::error_code();
   }
@@ -193,6 +211,19 @@ boost::system::error_code VppH264Codec::configure(const std::string& sName, cons
       return boost::system::error_code(boost::system::errc::not_supported, boost::system::generic_category());
     }
   }
+  else if (sName == "intra-refresh")
+  {
+    // the VPP codec has no intra refresh: the refresh period is an I-frame period
+    bool bSuccess = false;
+    uint32_t uiPeriod = convert<uint32_t>(sValue, bSuccess);
+    if (!bSuccess)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_uiIFramePeriod = uiPeriod;
+    VLOG(2) << "I-frame period: " << m_uiIFramePeriod;
+    return boost::system::error_code();
+  }
   else if (sName == "rcmt")
   {
     bool bDummy;
@@ -324,13 +355,33 @@ boost::system::error_code VppH264Codec::getOutputType(MediaTypeDescriptor& out)
 
 boost::system::error_code VppH264Codec::transform(const std::vector<MediaSample>& in, std::vector<MediaSample>& out, uint32_t& uiSize)
 {
-  VLOG(12) << "VppH264Codec::transform";
+  if (in.empty())
+  {
+    return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+  }
+  // each sample is a frame: the NAL units of all frames are appended to out
+  uiSize = 0;
+  for (const MediaSample& mediaIn : in)
+  {
+    uint32_t uiFrameSize = 0;
+    boost::system::error_code ec = encodeFrame(mediaIn, out, uiFrameSize);
+    if (ec) return ec;
+    uiSize += uiFrameSize;
+  }
+  return boost::system::error_code();
+}
+
+boost::system::error_code VppH264Codec::encodeFrame(const MediaSample& mediaIn, std::vector<MediaSample>& out, uint32_t& uiSize)
+{
+  VLOG(12) << "VppH264Codec::encodeFrame";
   assert(m_pCodec);
-  // we only handle one sample at a time
-  assert(in.size() == 1);
-  const MediaSample& mediaIn = in[0];
+  // out may already hold the samples of earlier frames of a batch
+  const size_t uiFirstSample = out.size();
   const uint8_t* pBufferIn = mediaIn.getDataBuffer().data();
   const uint8_t* pBufferOut = m_encodingBuffer.data();
+  m_frameStats = FrameStats();
+  // the VPP codec outputs each frame before the next is passed in
+  m_frameStats.InputFrame = static_cast<int32_t>(m_uiInputFrames++);
 
   if (m_pCodec->Ready())
   {
@@ -340,8 +391,14 @@ boost::system::error_code VppH264Codec::transform(const std::vector<MediaSample>
       if (m_uiCurrentFrame%m_uiIFramePeriod == 0)
       {
         m_pCodec->Restart();
+        m_bRestart = false;
       }
     }
+    if (m_bRestart)
+    {
+      m_pCodec->Restart();
+      m_bRestart = false;
+    }
 
     int nFrameBitLimit = 0;
     if (m_uiFrameBitLimit == 0)
@@ -349,9 +406,12 @@ boost::system::error_code VppH264Codec::transform(const std::vector<MediaSample>
       nFrameBitLimit = m_uiEncodingBufferSize * 8 /*8 bits*/;
     else
       nFrameBitLimit = m_uiFrameBitLimit;
+    if (m_uiMaxFrameSizeBytes > 0)
+      nFrameBitLimit = std::min<int>(nFrameBitLimit, m_uiMaxFrameSizeBytes * 8);
 
     int MAX_ATTEMPTS = 5;
     int iAttempts = 0;
+    boost::posix_time::ptime tFailed;
     do
     {
     VLOG(12) << "Coding with frame bit limit to " << nFrameBitLimit;
@@ -365,8 +425,19 @@ boost::system::error_code VppH264Codec::transform(const std::vector<MediaSample>
     boost::posix_time::time_duration diff = tEnd - tStart;
     VLOG(2) << "Time to encode: " << diff.total_milliseconds() << "ms";
 #endif
+    if (iAttempts > 0)
+    {
+      // every attempt after the first one is a re-encode of the same frame
+      boost::posix_time::ptime tNow = boost::posix_time::microsec_clock::universal_time();
+      uint64_t uiTimeUs = (tNow - tFailed).total_microseconds();
+      m_uiReencodeTimeUs += uiTimeUs;
+      ++m_uiReencodeAttempts;
+      DIAG(2, "VPP re-encode attempt {} frame bit limit: {} success: {} time to encode: {}us") << iAttempts << nFrameBitLimit << (nResult ? 1 : 0) << uiTimeUs;
+    }
     if (nResult)
     {
+      if (iAttempts > 0)
+        ++m_uiReencodedFrames;
       //Encoding was successful
       int iEncodedLength = m_pCodec->GetCompressedByteLength();
       VLOG(6) << "Transform complete: in size: " << mediaIn.getPayloadSize() << " out size: " << iEncodedLength;
@@ -445,6 +516,21 @@ boost::system::error_code VppH264Codec::transform(const std::vector<MediaSample>
         out.push_back(mediaSample);
         mediaSample.setStartCodeLengthHint(iLength);
       }
+
+      m_frameStats.Encoded = true;
+      m_frameStats.Bits = iEncodedLength * 8;
+      SliceHeaderInfo sliceHeader;
+      double dAverageQp = 0.0;
+      if (m_sliceHeaderParser.parseAccessUnit(out, sliceHeader, dAverageQp, uiFirstSample) > 0)
+      {
+        m_frameStats.Type = sliceHeader.Type;
+        m_frameStats.Idr = sliceHeader.Idr;
+        m_frameStats.Qp = dAverageQp;
+      }
+      else
+      {
+        m_frameStats.Type = (strcmp(szBuffer, "0") == 0) ? ST_I : ST_P;
+      }
       return boost::system::error_code();
     }
     else
@@ -456,6 +542,7 @@ boost::system::error_code VppH264Codec::transform(const std::vector<MediaSample>
       LOG(ERROR) << sError;
       nFrameBitLimit = nFrameBitLimit * 1.5; // increase frame bit limit
       ++iAttempts;
+      tFailed = boost::posix_time::microsec_clock::universal_time();
     }
     } while (iAttempts < MAX_ATTEMPTS);
 
@@ -470,9 +557,60 @@ boost::system::error_code VppH264Codec::transform(const std::vector<MediaSample>
 
 boost::system::error_code VppH264Codec::setBitrate(uint32_t uiTargetBitrate)
 {
-  assert(m_in.getFps() != 0.0);
-  m_uiFrameBitLimit = static_cast<uint32_t>((uiTargetBitrate * 1000) / m_in.getFps());
+  assert(m_dFramerate != 0.0);
+  m_uiTargetBitrate = uiTargetBitrate;
+  m_uiFrameBitLimit = static_cast<uint32_t>((uiTargetBitrate * 1000) / m_dFramerate);
   VLOG(2) << "Target bitrate: " << uiTargetBitrate  << "kbps - setting frame bit limit to " << m_uiFrameBitLimit;
   return boost::system::error_code();
   // return boost::system::error_code(boost::system::errc::argument_out_of_domain, boost::system::generic_category());
 }
+
+boost::system::error_code VppH264Codec::startIntraRefresh()
+{
+  VLOG(2) << "VppH264Codec::startIntraRefresh";
+  m_bRestart = true;
+  return boost::system::error_code();
+}
+
+boost::system::error_code VppH264Codec::generateIdr()
+{
+  VLOG(2) << "VppH264Codec::generateIdr";
+  m_bRestart = true;
+  return boost::system::error_code();
+}
+
+boost::system::error_code VppH264Codec::updateReferencePicture(uint32_t uiFirstLostFrame)
+{
+  // the codec only references the previous frame: restart with an I-frame
+  VLOG(2) << "VppH264Codec::updateReferencePicture first lost frame: " << uiFirstLostFrame;
+  m_bRestart = true;
+  return boost::system::error_code();
+}
+
+boost::system::error_code VppH264Codec::setMaxFrameSize(uint32_t uiMaxFrameSizeBytes)
+{
+  // re-encoding with an increased frame bit limit may exceed the cap
+  m_uiMaxFrameSizeBytes = uiMaxFrameSizeBytes;
+  VLOG(2) << "Max frame size: " << m_uiMaxFrameSizeBytes << " bytes";
+  return boost::system::error_code();
+}
+
+boost::system::error_code VppH264Codec::setFramerate(double dFramerate)
+{
+  if (dFramerate <= 0.0)
+  {
+    return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+  }
+  m_dFramerate = dFramerate;
+  if (m_uiTargetBitrate > 0)
+  {
+    m_uiFrameBitLimit = static_cast<uint32_t>((m_uiTargetBitrate * 1000) / m_dFramerate);
+  }
+  VLOG(2) << "Frame rate: " << m_dFramerate << " - setting frame bit limit to " << m_uiFrameBitLimit;
+  return boost::system::error_code();
+}
+
+FrameStats VppH264Codec::getFrameStats() const
+{
+  return m_frameStats;
+}
@@ -18,6 +18,7 @@
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #pragma once
 #include <rtp++/media/IVideoCodecTransform.h>
+#include <rtp++/media/h264/H264SliceHeaderParser.h>
 
 #ifdef _WIN32
 #ifdef VppH264Codec_EXPORTS
@@ -62,7 +63,32 @@ public:
    * @brief @ICooperativeCodec
    */
   virtual boost::system::error_code setBitrate(uint32_t uiTargetBitrate);
+  /**
+   * @brief @ICooperativeCodec
+   */
+  virtual boost::system::error_code startIntraRefresh();
+  /**
+   * @brief @ICooperativeCodec
+   */
+  virtual boost::system::error_code generateIdr();
+  /**
+   * @brief @ICooperativeCodec
+   */
+  virtual boost::system::error_code updateReferencePicture(uint32_t uiFirstLostFrame);
+  /**
+   * @brief @ICooperativeCodec
+   */
+  virtual boost::system::error_code setMaxFrameSize(uint32_t uiMaxFrameSizeBytes);
+  /**
+   * @brief @ICooperativeCodec
+   */
+  virtual boost::system::error_code setFramerate(double dFramerate);
+  /**
+   * @brief @IVideoCodecTransform
+   */
+  virtual rtp_plus_plus::media::FrameStats getFrameStats() const;
 private:
+  boost::system::error_code encodeFrame(const rtp_plus_plus::media::MediaSample& mediaIn, std::vector<rtp_plus_plus::media::MediaSample>& out, uint32_t& uiSize);
 
   rtp_plus_plus::media::MediaTypeDescriptor m_in;
   rtp_plus_plus::media::MediaTypeDescriptor m_out;
@@ -72,9 +98,24 @@ private:
   uint32_t m_uiIFramePeriod;
   uint32_t m_uiCurrentFrame;
   uint32_t m_uiFrameBitLimit;
+  // the frame bit limit is the target bitrate spread over the frame rate
+  uint32_t m_uiTargetBitrate;
+  double m_dFramerate;
   uint32_t m_uiMode;
   uint32_t m_uiRateControlModelType;
   bool m_bNotifyOnIFrame;
+  // the next frame is an I-frame
+  bool m_bRestart;
+  // 0 = no cap: the cap limits the frame bit limit of the first attempt
+  uint32_t m_uiMaxFrameSizeBytes;
+  // frames that were re-encoded with a higher frame bit limit
+  uint32_t m_uiReencodedFrames;
+  uint32_t m_uiReencodeAttempts;
+  uint64_t m_uiReencodeTimeUs;
+  uint32_t m_uiInputFrames;
+  // the QP is read from the slice headers of the output
+  rtp_plus_plus::media::h264::H264SliceHeaderParser m_sliceHeaderParser;
+  rtp_plus_plus::media::FrameStats m_frameStats;
 
   uint32_t m_uiEncodingBufferSize;
   rtp_plus_plus::Buffer m_encodingBuffer;
@@ -17,8 +17,11 @@
 // "CSIR"
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #include "stdafx.h"
+#include <algorithm>
 #include "X264Codec.h"
 #include <rtp++/util/Conversion.h>
+#include <rtp++/util/Diagnostics.h>
+#include <rtp++/util/Trace.h>
 
 using namespace rtp_plus_plus;
 using namespace rtp_plus_plus::media;
@@ -31,7 +34,18 @@ X264Codec::X264Codec()
     m_uiMode(0),
     m_dCbrFactor(0.8),
     m_sPreset("ultrafast"),
-    m_sTune("zerolatency")
+    m_sTune("zerolatency"),
+    m_uiMaxNalBytes(0),
+    m_uiIntraRefreshPeriod(0),
+    m_uiReferenceFrames(0),
+    m_iFrameIndex(0),
+    m_dFramerate(0.0),
+    m_bGenerateIdr(false),
+    m_uiMaxFrameSizeBytes(0),
+    m_bEnablePsnr(false),
+    m_bEnableSsim(false),
+    m_uiThreads(1),
+    m_dCrf(0.0)
 {
 
 }
@@ -57,6 +71,7 @@ boost::system::error_code X264Codec::setInputType(const MediaTypeDescriptor& in)
   }
 
   m_in = in;
+  m_dFramerate = in.getFps();
 
   m_uiEncodingBufferSize = in.getWidth() * in.getHeight() * 1.5;
   VLOG(2) << "Encoding buffer size: " << m_uiEncodingBufferSize;
@@ -122,6 +137,74 @@ boost::system::error_code X264Codec::configure(const std::string& sName, const s
     assert(bDummy);
     return boost::system::error_code();
   }
+  else if (sName == "max-nal-bytes")
+  {
+    uint32_t uiMaxNalBytes = convert<uint32_t>(sValue, bDummy);
+    if (!bDummy)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_uiMaxNalBytes = uiMaxNalBytes;
+    VLOG(2) << "Max NAL bytes set to: " << m_uiMaxNalBytes;
+    return boost::system::error_code();
+  }
+  else if (sName == "intra-refresh")
+  {
+    uint32_t uiPeriod = convert<uint32_t>(sValue, bDummy);
+    if (!bDummy)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_uiIntraRefreshPeriod = uiPeriod;
+    VLOG(2) << "Intra refresh period set to: " << m_uiIntraRefreshPeriod;
+    return boost::system::error_code();
+  }
+  else if (sName == "ref")
+  {
+    // reference invalidation requires more than one reference frame
+    uint32_t uiReferenceFrames = convert<uint32_t>(sValue, bDummy);
+    if (!bDummy || uiReferenceFrames > 16)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_uiReferenceFrames = uiReferenceFrames;
+    VLOG(2) << "Reference frames set to: " << m_uiReferenceFrames;
+    return boost::system::error_code();
+  }
+  else if (sName == "psnr")
+  {
+    m_bEnablePsnr = sValue.empty() || sValue == "1";
+    return boost::system::error_code();
+  }
+  else if (sName == "ssim")
+  {
+    m_bEnableSsim = sValue.empty() || sValue == "1";
+    return boost::system::error_code();
+  }
+  else if (sName == "threads")
+  {
+    bool bSuccess = false;
+    uint32_t uiThreads = convert<uint32_t>(sValue, bSuccess);
+    if (!bSuccess)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_uiThreads = uiThreads;
+    VLOG(2) << "Threads set to: " << m_uiThreads;
+    return boost::system::error_code();
+  }
+  else if (sName == "crf")
+  {
+    bool bSuccess = false;
+    double dCrf = convert<double>(sValue, bSuccess);
+    if (!bSuccess || dCrf <= 0.0 || dCrf > 51.0)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_dCrf = dCrf;
+    VLOG(2) << "CRF set to: " << m_dCrf;
+    return boost::system::error_code();
+  }
   return boost::system::error_code(boost::system::errc::not_supported, boost::system::generic_category());
 }
 
@@ -130,12 +213,13 @@ void X264Codec::configureParams()
   x264_param_default_preset(&params, m_sPreset.c_str(), m_sTune.c_str());
 
   VLOG(2) << "Default level: " << params.i_level_idc;
-  params.i_threads = 1;
+  params.i_threads = m_uiThreads > 0 ? static_cast<int>(m_uiThreads) : X264_THREADS_AUTO;
   params.i_width = m_in.getWidth();
   params.i_height = m_in.getHeight();
-  // HACK for now: we use doubles (won't work for 12.5)
-  params.i_fps_num = (int)m_in.getFps();
-  params.i_fps_den = 1;
+  params.i_fps_num = static_cast<int>(m_dFramerate * 1000 + 0.5);
+  params.i_fps_den = 1000;
+  // with variable frame rate input x264 holds back every picture by one frame in ABR mode
+  params.b_vfr_input = 0;
 
   // for debugging
 #if 0
@@ -143,6 +227,20 @@ void X264Codec::configureParams()
 #endif
   // disables periodic IDR frames
   params.i_keyint_max = X264_KEYINT_MAX_INFINITE;
+  // 0 = no limit: x264 includes the estimated NAL overhead in the slice size
+  params.i_slice_max_size = m_uiMaxNalBytes;
+  if (m_uiReferenceFrames > 0)
+    params.i_frame_reference = m_uiReferenceFrames;
+  if (m_uiIntraRefreshPeriod > 0)
+  {
+    // replaces periodic IDR frames with a column of intra macroblocks moving across the picture
+    // within each keyint period
+    params.b_intra_refresh = 1;
+    params.i_keyint_max = m_uiIntraRefreshPeriod;
+  }
+  // reported per frame in the frame stats
+  params.analyse.b_psnr = m_bEnablePsnr;
+  params.analyse.b_ssim = m_bEnableSsim;
 #if 1
   params.rc.i_rc_method = X264_RC_ABR ;
   params.rc.i_bitrate = m_uiTargetBitrate;
@@ -169,6 +267,13 @@ void X264Codec::configureParams()
       break;
     }
   }
+  if (m_dCrf > 0.0)
+  {
+    // constant quality: the bitrate is the result
+    params.rc.i_rc_method = X264_RC_CRF;
+    params.rc.f_rf_constant = static_cast<float>(m_dCrf);
+  }
+  applyMaxFrameSize(params);
   // TODO: look at other params for real-time
 #if 0
   i_nal_hrd // #define X264_NAL_HRD_CBR             2
@@ -227,10 +332,26 @@ boost::system::error_code X264Codec::getOutputType(MediaTypeDescriptor& out)
 
 boost::system::error_code X264Codec::transform(const std::vector<MediaSample>& in, std::vector<MediaSample>& out, uint32_t& uiSize)
 {
-  VLOG(12) << "X264Codec::transform";
+  if (in.empty())
+  {
+    return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+  }
+  // each sample is a frame: the NAL units of all frames are appended to out
+  uiSize = 0;
+  for (const MediaSample& mediaIn : in)
+  {
+    uint32_t uiFrameSize = 0;
+    boost::system::error_code ec = encodeFrame(mediaIn, out, uiFrameSize);
+    if (ec) return ec;
+    uiSize += uiFrameSize;
+  }
+  return boost::system::error_code();
+}
+
+boost::system::error_code X264Codec::encodeFrame(const MediaSample& mediaIn, std::vector<MediaSample>& out, uint32_t& uiSize)
+{
+  VLOG(12) << "X264Codec::encodeFrame";
   assert (encoder);
-  // we only handle one sample at a time
-  assert(in.size() == 1);
 
   // set bitrate: --bitrate 3000 --vbv-maxrate 3000 --vbv-bufsize 125
 #if 0
@@ -242,7 +363,6 @@ boost::system::error_code X264Codec::transform(const std::vector<MediaSample>& i
   Params.rc.f_rate_tolerance = 1.0 ;
 #endif
 
-  const MediaSample& mediaIn = in[0];
   const uint8_t* pBufferIn = mediaIn.getDataBuffer().data();
 #if 1
   memcpy(pic_in.img.plane[0], (uint8_t*)pBufferIn, m_uiEncodingBufferSize);
@@ -251,13 +371,46 @@ boost::system::error_code X264Codec::transform(const std::vector<MediaSample>& i
 #endif
   pic_in.img.i_stride[0]   = m_in.getWidth();
   pic_in.img.i_stride[1]   = pic_in.img.i_stride[2] = m_in.getWidth() >> 1;  // const uint8_t* pBufferOut = m_encodingBuffer.data();
+  // the input frame index is the pts for reference invalidation
+  pic_in.i_pts = m_iFrameIndex;
+  // returned with the output picture: frame threads and B-frames delay and reorder the output
+  pic_in.opaque = reinterpret_cast<void*>(static_cast<intptr_t>(m_iFrameIndex));
+  ++m_iFrameIndex;
+  pic_in.i_type = m_bGenerateIdr ? X264_TYPE_IDR : X264_TYPE_AUTO;
+  m_bGenerateIdr = false;
 
   int frame_size = x264_encoder_encode(encoder, &nals, &num_nals, &pic_in, &pic_out);
+  return collectOutput(frame_size, mediaIn.getPayloadSize(), out, uiSize);
+}
+
+boost::system::error_code X264Codec::collectOutput(int frame_size, uint32_t uiInSize, std::vector<MediaSample>& out, uint32_t& uiSize)
+{
+  m_frameStats = FrameStats();
+  if (frame_size < 0)
+  {
+    LOG(WARNING) << "x264_encoder_encode failed: " << frame_size;
+    return boost::system::error_code(boost::system::errc::io_error, boost::system::generic_category());
+  }
   if(frame_size)
   {
-    std::ostringstream ostr;
-    ostr << "Transform complete: in size: " << mediaIn.getPayloadSize() << " frame size: " << frame_size;
     uiSize = frame_size;
+    m_frameStats.Encoded = true;
+    m_frameStats.InputFrame = static_cast<int32_t>(reinterpret_cast<intptr_t>(pic_out.opaque));
+    m_frameStats.Bits = frame_size * 8;
+    m_frameStats.Idr = (pic_out.i_type == X264_TYPE_IDR);
+    m_frameStats.Type = IS_X264_TYPE_I(pic_out.i_type) ? ST_I : IS_X264_TYPE_B(pic_out.i_type) ? ST_B : ST_P;
+    // the frame QP before adaptive quantisation
+    m_frameStats.Qp = pic_out.i_qpplus1 - 1;
+    if (m_bEnablePsnr)
+    {
+      m_frameStats.PsnrY = pic_out.prop.f_psnr[0];
+      m_frameStats.PsnrU = pic_out.prop.f_psnr[1];
+      m_frameStats.PsnrV = pic_out.prop.f_psnr[2];
+    }
+    if (m_bEnableSsim)
+    {
+      m_frameStats.Ssim = pic_out.prop.f_ssim;
+    }
 #if 0
     Buffer mediaData(new uint8_t[frame_size], frame_size);
     memcpy((char*)mediaData.data(), nals[0].p_payload, frame_size);
@@ -266,12 +419,10 @@ boost::system::error_code X264Codec::transform(const std::vector<MediaSample>& i
     mediaSample.setNaluContainsStartCode(true);
     out.push_back(mediaSample);
 #else
-    ostr << " (";
     for (int i = 0; i < num_nals; ++i)
     {
       x264_nal_t * pNal = nals + i;
       int nalu_size = pNal->i_payload;
-      ostr << " " << nalu_size;
       Buffer mediaData(new uint8_t[nalu_size], nalu_size);
       memcpy((char*)mediaData.data(), nals[i].p_payload, nalu_size);
       MediaSample mediaSample;
@@ -279,53 +430,34 @@ boost::system::error_code X264Codec::transform(const std::vector<MediaSample>& i
       mediaSample.setNaluContainsStartCode(true);
       out.push_back(mediaSample);
     }
-    ostr << ")";
 #endif
-    VLOG(6) << ostr.str();
-  }
-
-  //  if (info.eFrameType != videoFrameTypeSkip)
-  //  {
-  //    VLOG(2) << "Transform complete: in size: " << mediaIn.getPayloadSize() << " frame size: " << info.iFrameSizeInBytes
-  //            << " Temporal Id: " << info.iTemporalId
-  //            << " Sub seq id: " << info.iSubSeqId
-  //            << " Layer num: " << info.iLayerNum
-  //            << " Frame type: " << (int)info.eFrameType
-  //            << " TS: " << info.uiTimeStamp;
-
-  //    int len = 0;
-  //    for (int i = 0; i < info.iLayerNum; ++i)
-  //    {
-  //      const SLayerBSInfo& layerInfo = info.sLayerInfo[i];
-  //      VLOG(2) << "Layer type: " << (int)layerInfo.uiLayerType
-  //              << " temp id: " << (int)layerInfo.uiTemporalId
-  //              << " spatial id: " << (int)layerInfo.uiSpatialId
-  //              << " quality id: " << (int)layerInfo.uiQualityId
-  //              << " nal count: " << layerInfo.iNalCount;
-
-  //      uint8_t* pBuffer = layerInfo.pBsBuf;
-  //      for (int j = 0; j < layerInfo.iNalCount; ++j)
-  //      {
-  //        uint32_t uiNaluLength = layerInfo.pNalLengthInByte[j];
-  //        VLOG(2) << "Adding NALU of length " << uiNaluLength;
-  //        len += uiNaluLength;
-  //        Buffer mediaData(new uint8_t[uiNaluLength], uiNaluLength);
-  //        memcpy((char*)mediaData.data(), pBuffer, uiNaluLength);
-  //        MediaSample mediaSample;
-  //        mediaSample.setData(mediaData);
-  //        out.push_back(mediaSample);
-  //        pBuffer += uiNaluLength;
-  //      }
-  //    }
-  //    VLOG(2) << "Total length: " << len;
+    if (DIAG_IS_ON(6))
+    {
+      DIAG_EVENT(event, "Transform complete: in size: {} frame size: {} ({*})");
+      event << uiInSize << frame_size;
+      for (int i = 0; i < num_nals; ++i)
+        event << nals[i].i_payload;
+    }
+  }
+
+  return boost::system::error_code();
+}
 
+boost::system::error_code X264Codec::flush(std::vector<EncodedFrame>& out)
+{
+  VLOG(2) << "X264Codec::flush: " << x264_encoder_delayed_frames(encoder) << " delayed frames";
+  assert (encoder);
+  while (x264_encoder_delayed_frames(encoder) > 0)
+  {
+    EncodedFrame encodedFrame;
+    int frame_size = x264_encoder_encode(encoder, &nals, &num_nals, NULL, &pic_out);
+    boost::system::error_code ec = collectOutput(frame_size, 0, encodedFrame.Samples, encodedFrame.Size);
+    if (ec) return ec;
+    if (frame_size == 0) break;
+    encodedFrame.Stats = m_frameStats;
+    out.push_back(std::move(encodedFrame));
+  }
   return boost::system::error_code();
-  //  }
-  //  else
-  //  {
-  //    VLOG(2) << "Skip frame";
-  //    return boost::system::error_code();
-  //  }
 }
 
 boost::system::error_code X264Codec::setBitrate(uint32_t uiTargetBitrate)
@@ -339,6 +471,11 @@ boost::system::error_code X264Codec::setBitrate(uint32_t uiTargetBitrate)
       // initialise has not been called yet
       return boost::system::error_code();
     }
+    if (m_dCrf > 0.0)
+    {
+      LOG(WARNING) << "Bitrate changes are not supported at constant quality";
+      return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+    }
   #if 0
     configureParams();
     // close and re-open encoder
@@ -362,7 +499,9 @@ boost::system::error_code X264Codec::setBitrate(uint32_t uiTargetBitrate)
     param.rc.i_bitrate = m_uiTargetBitrate;
     param.rc.i_vbv_buffer_size = m_uiTargetBitrate;
     param.rc.i_vbv_max_bitrate = m_uiTargetBitrate*m_dCbrFactor;
+    applyMaxFrameSize(param);
 #endif
+    TRACE_SCOPE("x264 reconfig");
     int res = x264_encoder_reconfig(encoder, &param);
     if (res < 0)
     {
@@ -380,3 +519,140 @@ boost::system::error_code X264Codec::setBitrate(uint32_t uiTargetBitrate)
     return boost::system::error_code();
   }
 }
+
+boost::system::error_code X264Codec::startIntraRefresh()
+{
+  if (!encoder)
+  {
+    return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+  }
+  if (m_uiIntraRefreshPeriod == 0)
+  {
+    // x264_encoder_intra_refresh requires b_intra_refresh
+    return boost::system::error_code(boost::system::errc::not_supported, boost::system::generic_category());
+  }
+  VLOG(2) << "X264Codec::startIntraRefresh";
+  x264_encoder_intra_refresh(encoder);
+  return boost::system::error_code();
+}
+
+boost::system::error_code X264Codec::generateIdr()
+{
+  VLOG(2) << "X264Codec::generateIdr";
+  m_bGenerateIdr = true;
+  return boost::system::error_code();
+}
+
+boost::system::error_code X264Codec::updateReferencePicture(uint32_t uiFirstLostFrame)
+{
+  if (!encoder)
+  {
+    return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+  }
+  // x264 does not support invalidating references with intra refresh or B-frames
+  if (m_uiIntraRefreshPeriod > 0)
+  {
+    VLOG(2) << "X264Codec::updateReferencePicture intra refresh from " << uiFirstLostFrame;
+    return startIntraRefresh();
+  }
+  x264_param_t param;
+  x264_encoder_parameters( encoder, &param );
+  if (param.i_bframe > 0)
+  {
+    VLOG(2) << "X264Codec::updateReferencePicture IDR from " << uiFirstLostFrame;
+    return generateIdr();
+  }
+  if (x264_encoder_invalidate_reference(encoder, uiFirstLostFrame) == 0)
+  {
+    VLOG(2) << "X264Codec::updateReferencePicture invalidated frames from " << uiFirstLostFrame;
+    return boost::system::error_code();
+  }
+  // there is no valid reference left
+  VLOG(2) << "X264Codec::updateReferencePicture failed to invalidate frames from " << uiFirstLostFrame;
+  return generateIdr();
+}
+
+boost::system::error_code X264Codec::setMaxFrameSize(uint32_t uiMaxFrameSizeBytes)
+{
+  m_uiMaxFrameSizeBytes = uiMaxFrameSizeBytes;
+  if (!encoder)
+  {
+    // initialise has not been called yet
+    return boost::system::error_code();
+  }
+  x264_param_t param;
+  x264_encoder_parameters( encoder, &param );
+  // VBV can not be switched on or off once the encoder is open
+  if (param.rc.i_vbv_buffer_size == 0 || param.rc.i_vbv_max_bitrate == 0)
+  {
+    return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+  }
+  if (uiMaxFrameSizeBytes == 0)
+  {
+    param.rc.i_vbv_buffer_size = m_uiTargetBitrate;
+  }
+  applyMaxFrameSize(param);
+  TRACE_SCOPE("x264 reconfig");
+  int res = x264_encoder_reconfig(encoder, &param);
+  if (res < 0)
+  {
+    return boost::system::error_code(boost::system::errc::argument_out_of_domain, boost::system::generic_category());
+  }
+  return boost::system::error_code();
+}
+
+void X264Codec::applyMaxFrameSize(x264_param_t& param)
+{
+  if (m_uiMaxFrameSizeBytes == 0)
+  {
+    return;
+  }
+  // x264 has no per-frame size limit: a frame can not be larger than the VBV buffer.
+  // x264 raises buffers smaller than one frame at the max bitrate.
+  param.rc.i_vbv_buffer_size = std::max<int>(1, m_uiMaxFrameSizeBytes * 8 / 1000);
+  if (param.rc.i_vbv_max_bitrate == 0)
+  {
+    param.rc.i_vbv_max_bitrate = m_uiTargetBitrate;
+  }
+  VLOG(2) << "Max frame size: " << m_uiMaxFrameSizeBytes << " bytes vbv_buffer_size: " << param.rc.i_vbv_buffer_size
+          << " kbit vbv_max_bitrate: " << param.rc.i_vbv_max_bitrate << " kbps";
+}
+
+boost::system::error_code X264Codec::setFramerate(double dFramerate)
+{
+  if (dFramerate <= 0.0)
+  {
+    return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+  }
+  VLOG(2) << "X264Codec::setFramerate " << dFramerate;
+  m_dFramerate = dFramerate;
+  if (!encoder)
+  {
+    // initialise has not been called yet
+    return boost::system::error_code();
+  }
+  // x264_encoder_reconfig can not change the frame rate: close and re-open the encoder
+  // with the current parameters so that bitrate and max frame size changes are kept
+  x264_param_t param;
+  x264_encoder_parameters( encoder, &param );
+  param.i_fps_num = static_cast<int>(m_dFramerate * 1000 + 0.5);
+  param.i_fps_den = 1000;
+  if (x264_encoder_delayed_frames(encoder) > 0)
+  {
+    LOG(WARNING) << "Re-opening the encoder drops " << x264_encoder_delayed_frames(encoder) << " delayed frames";
+  }
+  TRACE_SCOPE("x264 reopen");
+  x264_encoder_close(encoder);
+
+  encoder = x264_encoder_open(&param);
+  if(!encoder) {
+    LOG(ERROR) << "Failed to re-open the encoder";
+    return boost::system::error_code(boost::system::errc::not_supported, boost::system::generic_category());
+  }
+  return boost::system::error_code();
+}
+
+FrameStats X264Codec::getFrameStats() const
+{
+  return m_frameStats;
+}
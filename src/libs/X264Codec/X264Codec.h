@@ -58,9 +58,40 @@ public:
    * @brief @ICooperativeCodec
    */
   virtual boost::system::error_code setBitrate(uint32_t uiTargetBitrate);
+  /**
+   * @brief @INetworkCodecCooperation
+   */
+  virtual boost::system::error_code startIntraRefresh();
+  /**
+   * @brief @INetworkCodecCooperation
+   */
+  virtual boost::system::error_code generateIdr();
+  /**
+   * @brief @INetworkCodecCooperation
+   */
+  virtual boost::system::error_code updateReferencePicture(uint32_t uiFirstLostFrame);
+  /**
+   * @brief @INetworkCodecCooperation
+   */
+  virtual boost::system::error_code setMaxFrameSize(uint32_t uiMaxFrameSizeBytes);
+  /**
+   * @brief @INetworkCodecCooperation
+   */
+  virtual boost::system::error_code setFramerate(double dFramerate);
+  /**
+   * @brief @IVideoCodecTransform
+   */
+  virtual rtp_plus_plus::media::FrameStats getFrameStats() const;
+  /**
+   * @brief @IVideoCodecTransform
+   */
+  virtual boost::system::error_code flush(std::vector<rtp_plus_plus::media::EncodedFrame>& out);
 
 private:
+  boost::system::error_code encodeFrame(const rtp_plus_plus::media::MediaSample& mediaIn, std::vector<rtp_plus_plus::media::MediaSample>& out, uint32_t& uiSize);
+  boost::system::error_code collectOutput(int frame_size, uint32_t uiInSize, std::vector<rtp_plus_plus::media::MediaSample>& out, uint32_t& uiSize);
   void configureParams();
+  void applyMaxFrameSize(x264_param_t& param);
 
   rtp_plus_plus::media::MediaTypeDescriptor m_in;
   rtp_plus_plus::media::MediaTypeDescriptor m_out;
@@ -81,4 +112,21 @@ private:
   double m_dCbrFactor;
   std::string m_sPreset;
   std::string m_sTune;
+  uint32_t m_uiMaxNalBytes;
+  uint32_t m_uiIntraRefreshPeriod;
+  // 0 = preset default
+  uint32_t m_uiReferenceFrames;
+  // input frame index
+  int64_t m_iFrameIndex;
+  double m_dFramerate;
+  bool m_bGenerateIdr;
+  // 0 = no cap: the cap is the VBV buffer size
+  uint32_t m_uiMaxFrameSizeBytes;
+  bool m_bEnablePsnr;
+  bool m_bEnableSsim;
+  // 0 = X264_THREADS_AUTO
+  uint32_t m_uiThreads;
+  // > 0: constant quality instead of the target bitrate
+  double m_dCrf;
+  rtp_plus_plus::media::FrameStats m_frameStats;
 };
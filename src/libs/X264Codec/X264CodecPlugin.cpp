@@ -0,0 +1,23 @@
+/**********
+    This file is part of CodecStepResponse.
+
+    CodecStepResponse is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    CodecStepResponse is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CodecStepResponse.  If not, see <http://www.gnu.org/licenses/>.
+**********/
+// "CSIR"
+// Copyright (c) 2016 CSIR.  All rights reserved.
+#include "stdafx.h"
+#include <rtp++/media/VideoCodecPlugin.h>
+#include "X264Codec.h"
+
+DEFINE_VIDEO_CODEC_PLUGIN(X264Codec, "H264")
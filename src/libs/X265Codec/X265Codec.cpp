@@ -17,8 +17,12 @@
 // "CSIR"
 // Copyright (c) 2016 CSIR.  All rights reserved.
 #include "stdafx.h"
+#include <chrono>
+#include <cmath>
 #include "X265Codec.h"
 #include <rtp++/util/Conversion.h>
+#include <rtp++/util/Diagnostics.h>
+#include <rtp++/util/Trace.h>
 #include <x265.h>
 
 using namespace rtp_plus_plus;
@@ -39,7 +43,22 @@ X265Codec::X265Codec()
     m_uiEncodingBufferSize(0),
     m_uiTargetBitrate(500),
     m_sTune(TuneOptions.at(4)),
-    m_sPreset(PresetOptions.at(0))
+    m_sPreset(PresetOptions.at(0)),
+    m_uiMaxNalBytes(0),
+    m_uiIntraRefreshPeriod(0),
+    m_bGenerateIdr(false),
+    m_uiMaxFrameSizeBytes(0),
+    m_dFramerate(0.0),
+    m_iAnalysisMode(X265_ANALYSIS_OFF),
+    m_bEnablePsnr(false),
+    m_bEnableSsim(false),
+    m_uiEncodedFrames(0),
+    m_uiEncodingTimeUs(0),
+    m_uiTotalBits(0),
+    m_dTotalVideoTime(0.0),
+    m_dTotalPsnrY(0.0),
+    m_uiTotalPictures(0),
+    m_dCrf(0.0)
 {
 
 }
@@ -58,6 +77,16 @@ X265Codec::~X265Codec()
 
   if(encoder)
   {
+    accumulateStats();
+    // the summary of each rendition of a bitrate ladder: compare the encoding time, rate and quality
+    // of the analysis consumers against encodes with full analysis. The totals cover every encoder
+    // instance since initialise: rate and frame rate changes re-open the encoder.
+    LOG(INFO) << "X265 summary: analysis: " << x265_analysis_names[m_iAnalysisMode]
+              << " frames: " << m_uiEncodedFrames
+              << " encoding time: " << m_uiEncodingTimeUs / 1000.0 << " ms"
+              << " avg: " << (m_uiEncodedFrames > 0 ? m_uiEncodingTimeUs / (1000.0 * m_uiEncodedFrames) : 0.0) << " ms"
+              << " bitrate: " << (m_dTotalVideoTime > 0.0 ? m_uiTotalBits / (1000.0 * m_dTotalVideoTime) : 0.0) << " kbps"
+              << " Y-PSNR: " << (m_bEnablePsnr ? m_dTotalPsnrY / std::max<uint64_t>(m_uiTotalPictures, 1) : 0.0) << " dB";
     x265_encoder_close(encoder);
     encoder = NULL;
   }
@@ -89,6 +118,7 @@ boost::system::error_code X265Codec::setInputType(const MediaTypeDescriptor& in)
   }
 
   m_in = in;
+  m_dFramerate = in.getFps();
 
   m_uiEncodingBufferSize = m_in.getWidth() * m_in.getHeight() * 1.5;
   // buffer for incoming YUV
@@ -120,8 +150,8 @@ boost::system::error_code X265Codec::configure(const std::string& sName, const s
     }
     else
     {
+      m_sTune = *it;
       VLOG(2) << "Tune: " << m_sTune;
-      m_sTune == *it;
       return boost::system::error_code();
     }
   }
@@ -134,11 +164,96 @@ boost::system::error_code X265Codec::configure(const std::string& sName, const s
     }
     else
     {
-      m_sPreset == *it;
+      m_sPreset = *it;
       VLOG(2) << "Preset: " << m_sPreset;
       return boost::system::error_code();
     }
   }
+#if X265_BUILD >= 87
+  // multiple slices per picture were introduced in x265 2.0
+  else if (sName == "max-nal-bytes")
+  {
+    bool bSuccess = false;
+    uint32_t uiMaxNalBytes = convert<uint32_t>(sValue, bSuccess);
+    if (!bSuccess)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_uiMaxNalBytes = uiMaxNalBytes;
+    VLOG(2) << "Max NAL bytes: " << m_uiMaxNalBytes;
+    return boost::system::error_code();
+  }
+#endif
+  else if (sName == "analysis-mode")
+  {
+    // save on the reference encode of a ladder, load on the other rates
+    int iMode = 0;
+    while (x265_analysis_names[iMode] && sValue != x265_analysis_names[iMode]) ++iMode;
+    if (!x265_analysis_names[iMode])
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_iAnalysisMode = iMode;
+    VLOG(2) << "Analysis mode: " << sValue;
+    return boost::system::error_code();
+  }
+  else if (sName == "analysis-file")
+  {
+    if (sValue.empty())
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_sAnalysisFile = sValue;
+    VLOG(2) << "Analysis file: " << m_sAnalysisFile;
+    return boost::system::error_code();
+  }
+  else if (sName == "psnr")
+  {
+    m_bEnablePsnr = sValue.empty() || sValue == "1";
+    return boost::system::error_code();
+  }
+  else if (sName == "ssim")
+  {
+    m_bEnableSsim = sValue.empty() || sValue == "1";
+    return boost::system::error_code();
+  }
+  else if (sName == "intra-refresh")
+  {
+    bool bSuccess = false;
+    uint32_t uiPeriod = convert<uint32_t>(sValue, bSuccess);
+    if (!bSuccess)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_uiIntraRefreshPeriod = uiPeriod;
+    VLOG(2) << "Intra refresh period: " << m_uiIntraRefreshPeriod;
+    return boost::system::error_code();
+  }
+  else if (sName == "threads")
+  {
+    bool bSuccess = false;
+    uint32_t uiThreads = convert<uint32_t>(sValue, bSuccess);
+    if (!bSuccess)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    // 0 = one pool thread per core
+    m_sPools = uiThreads > 0 ? sValue : "";
+    VLOG(2) << "Pool threads: " << (m_sPools.empty() ? "auto" : m_sPools);
+    return boost::system::error_code();
+  }
+  else if (sName == "crf")
+  {
+    bool bSuccess = false;
+    double dCrf = convert<double>(sValue, bSuccess);
+    if (!bSuccess || dCrf <= 0.0 || dCrf > 51.0)
+    {
+      return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+    }
+    m_dCrf = dCrf;
+    VLOG(2) << "CRF: " << m_dCrf;
+    return boost::system::error_code();
+  }
   return boost::system::error_code(boost::system::errc::not_supported, boost::system::generic_category());
 }
 
@@ -170,11 +285,15 @@ boost::system::error_code X265Codec::initialise()
   }
 
   // params->ti_threads = 1;
+  if (!m_sPools.empty())
+  {
+    // the string is owned by this object and outlives the params
+    params->numaPools = m_sPools.c_str();
+  }
   params->sourceWidth = m_in.getWidth();
   params->sourceHeight = m_in.getHeight();
-  // HACK for now: we use doubles (won't work for 12.5)
-  params->fpsNum = (int)m_in.getFps();
-  params->fpsDenom = 1;
+  params->fpsNum = static_cast<uint32_t>(m_dFramerate * 1000 + 0.5);
+  params->fpsDenom = 1000;
   params->internalCsp = X265_CSP_I420;
   params->bRepeatHeaders = true;
   params->bEnableAccessUnitDelimiters = false;
@@ -185,12 +304,50 @@ boost::system::error_code X265Codec::initialise()
   //params->rc.rateControlMode = X265_RC_CQP;
   params->rc.vbvBufferSize = m_uiTargetBitrate;
   params->rc.vbvMaxBitrate = m_uiTargetBitrate;
+  if (m_dCrf > 0.0)
+  {
+    // constant quality: the bitrate is the result
+    params->rc.rateControlMode = X265_RC_CRF;
+    params->rc.rfConstant = m_dCrf;
+    params->rc.vbvBufferSize = 0;
+    params->rc.vbvMaxBitrate = 0;
+  }
+  applyMaxFrameSize();
 
   // dbg
   params->logLevel = X265_LOG_FULL;
 #endif
+  if (m_uiIntraRefreshPeriod > 0)
+  {
+    // a column of intra CTUs moves across the picture within each keyframe period
+    params->bIntraRefresh = 1;
+    params->keyframeMax = m_uiIntraRefreshPeriod;
+  }
+#if X265_BUILD >= 87
+  if (m_uiMaxNalBytes > 0)
+  {
+    // x265 has no size limited slices: the slice count is derived from the expected size of an
+    // I-frame (assumed to be 4 times the average frame size) and is limited to one slice per CTU row
+    const uint32_t uiCtuRows = (m_in.getHeight() + params->maxCUSize - 1) / params->maxCUSize;
+    const double dIFrameBytes = 4 * (m_uiTargetBitrate * 1000.0) / (8 * m_dFramerate);
+    uint32_t uiSlices = static_cast<uint32_t>(std::ceil(dIFrameBytes / m_uiMaxNalBytes));
+    params->maxSlices = std::max<uint32_t>(1, std::min(uiSlices, uiCtuRows));
+    VLOG(2) << "Max NAL bytes: " << m_uiMaxNalBytes << " slices: " << params->maxSlices;
+  }
+#endif
+  params->bEnablePsnr = m_bEnablePsnr;
+  params->bEnableSsim = m_bEnableSsim;
+  if (m_iAnalysisMode != X265_ANALYSIS_OFF)
+  {
+    // x265 disables cu-tree and pmode/pme in analysis mode
+    params->analysisMode = m_iAnalysisMode;
+    // the encoder releases the file name on close
+    params->analysisFileName = m_sAnalysisFile.empty() ? nullptr : strdup(m_sAnalysisFile.c_str());
+    VLOG(2) << "Analysis mode: " << x265_analysis_names[m_iAnalysisMode] << " file: " << m_sAnalysisFile;
+  }
 
   encoder = x265_encoder_open(params);
+  params->analysisFileName = nullptr;
   if (!encoder)
   {
     LOG(ERROR) << "Failed to x265_encoder_open";
@@ -212,7 +369,7 @@ boost::system::error_code X265Codec::initialise()
   pic_in->planes[1] = (uint8_t*)pic_in->planes[0] + pic_in->stride[0] * m_in.getHeight();
   pic_in->planes[2] = (uint8_t*)pic_in->planes[1] + ((m_in.getWidth() * m_in.getHeight()) >> 2);
 
-  // not currently using out pic
+  // carries the frame stats and, in analysis save mode, the analysis of the output frame
   pic_out = x265_picture_alloc();
   x265_picture_init(params, pic_out);
   return boost::system::error_code();
@@ -231,13 +388,28 @@ boost::system::error_code X265Codec::getOutputType(MediaTypeDescriptor& out)
 }
 
 boost::system::error_code X265Codec::transform(const std::vector<MediaSample>& in, std::vector<MediaSample>& out, uint32_t& uiSize)
+{
+  if (in.empty())
+  {
+    return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+  }
+  // each sample is a frame: the NAL units of all frames are appended to out
+  uiSize = 0;
+  for (const MediaSample& mediaIn : in)
+  {
+    uint32_t uiFrameSize = 0;
+    boost::system::error_code ec = encodeFrame(mediaIn, out, uiFrameSize);
+    if (ec) return ec;
+    uiSize += uiFrameSize;
+  }
+  return boost::system::error_code();
+}
+
+boost::system::error_code X265Codec::encodeFrame(const MediaSample& mediaIn, std::vector<MediaSample>& out, uint32_t& uiSize)
 {
   // boost::mutex::scoped_lock l(m_lock);
-  VLOG(COMPONENT_LOG_LEVEL) << "X265Codec::transform";
+  VLOG(COMPONENT_LOG_LEVEL) << "X265Codec::encodeFrame";
   assert (encoder);
-  // we only handle one sample at a time
-  assert(in.size() == 1);
-  const MediaSample& mediaIn = in[0];
   // const uint8_t* pBufferIn = mediaIn.getDataBuffer().data();
   memcpy(pBufferIn, mediaIn.getDataBuffer().data(), m_uiEncodingBufferSize);
 
@@ -245,17 +417,52 @@ boost::system::error_code X265Codec::transform(const std::vector<MediaSample>& i
   VLOG(COMPONENT_LOG_LEVEL) << "X265Codec::transform calling memcpy";
   memcpy(pic_in->planes[0], (uint8_t*)pBufferIn, m_uiEncodingBufferSize);
 #endif
+  pic_in->sliceType = m_bGenerateIdr ? X265_TYPE_IDR : X265_TYPE_AUTO;
+  m_bGenerateIdr = false;
+  // returned with the output picture: frame threads and B-frames delay and reorder the output
+  pic_in->userData = reinterpret_cast<void*>(static_cast<intptr_t>(m_uiEncodedFrames));
   uint32_t uiNalCount = 0;
+  boost::system::error_code ec;
   //int frame_size = x265_encoder_encode(encoder, &nals, &uiNalCount, pic_in, pic_out);
 #if 1
-  int frame_size = x265_encoder_encode(encoder, &nals, &uiNalCount, pic_in, NULL);
+  auto tStart = std::chrono::steady_clock::now();
+  int frame_size = x265_encoder_encode(encoder, &nals, &uiNalCount, pic_in, pic_out);
+  m_uiEncodingTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tStart).count();
+  ++m_uiEncodedFrames;
+  ec = collectOutput(frame_size, uiNalCount, mediaIn.getPayloadSize(), out, uiSize);
+#endif
+  return ec;
+}
+
+boost::system::error_code X265Codec::collectOutput(int frame_size, uint32_t uiNalCount, uint32_t uiInSize, std::vector<MediaSample>& out, uint32_t& uiSize)
+{
+  m_frameStats = FrameStats();
+  if (frame_size > 0)
+  {
+    const x265_frame_stats& frameData = pic_out->frameData;
+    m_frameStats.Encoded = true;
+    m_frameStats.InputFrame = static_cast<int32_t>(reinterpret_cast<intptr_t>(pic_out->userData));
+    m_frameStats.Bits = static_cast<uint32_t>(frameData.bits);
+    m_frameStats.Idr = (pic_out->sliceType == X265_TYPE_IDR);
+    // upper case for reference pictures, lower case otherwise
+    const char cSliceType = static_cast<char>(toupper(frameData.sliceType));
+    m_frameStats.Type = (cSliceType == 'I') ? ST_I : (cSliceType == 'B') ? ST_B : ST_P;
+    m_frameStats.Qp = frameData.qp;
+    if (m_bEnablePsnr)
+    {
+      m_frameStats.PsnrY = frameData.psnrY;
+      m_frameStats.PsnrU = frameData.psnrU;
+      m_frameStats.PsnrV = frameData.psnrV;
+    }
+    if (m_bEnableSsim)
+    {
+      m_frameStats.Ssim = frameData.ssim;
+    }
+  }
   // int frame_size = x264_encoder_encode(encoder, &nals, &num_nals, &pic_in, &pic_out);
   if(frame_size > 0)
   {
-    uiSize = frame_size;
     uint32_t uiLen = 0;
-    std::ostringstream ostr;
-    ostr << "Transform complete: in size: " << mediaIn.getPayloadSize() << " frame size: " << frame_size << " (";
     for (size_t i = 0; i < uiNalCount; ++i)
     {
       uiLen += nals[i].sizeBytes;
@@ -264,27 +471,48 @@ boost::system::error_code X265Codec::transform(const std::vector<MediaSample>& i
       MediaSample mediaSample;
       mediaSample.setData(mediaData);
       out.push_back(mediaSample);
-      ostr << "[" << " i: " << i
-           << " NALU type: " << nals[i].type
-           << " frame size: " << nals[i].sizeBytes
-           << "] ";
     }
-    ostr << ")";
-    VLOG(6) << ostr.str();
-    uiSize = frame_size;
+    if (DIAG_IS_ON(6))
+    {
+      // NALU type and size pairs
+      DIAG_EVENT(event, "Transform complete: in size: {} frame size: {} NALUs: {} (type size:{*})");
+      event << uiInSize << uiLen << uiNalCount;
+      for (size_t i = 0; i < uiNalCount; ++i)
+        event << nals[i].type << nals[i].sizeBytes;
+    }
+    // x265_encoder_encode returns the number of pictures output, not the payload size
+    uiSize = uiLen;
   }
   else
   {
     if (frame_size == 0)
     {
-      VLOG(2) << "NULL NAL Units" << mediaIn.getPayloadSize();
+      VLOG(2) << "NULL NAL Units" << uiInSize;
     }
     else
     {
-      VLOG(2) << "Transform failed: in size: " << mediaIn.getPayloadSize() << " frame size: " << frame_size;
+      VLOG(2) << "Transform failed: in size: " << uiInSize << " frame size: " << frame_size;
+      return boost::system::error_code(boost::system::errc::io_error, boost::system::generic_category());
     }
   }
-#endif
+  return boost::system::error_code();
+}
+
+boost::system::error_code X265Codec::flush(std::vector<EncodedFrame>& out)
+{
+  VLOG(2) << "X265Codec::flush";
+  assert (encoder);
+  while (true)
+  {
+    EncodedFrame encodedFrame;
+    uint32_t uiNalCount = 0;
+    int frame_size = x265_encoder_encode(encoder, &nals, &uiNalCount, NULL, pic_out);
+    boost::system::error_code ec = collectOutput(frame_size, uiNalCount, 0, encodedFrame.Samples, encodedFrame.Size);
+    if (ec) return ec;
+    if (frame_size == 0) break;
+    encodedFrame.Stats = m_frameStats;
+    out.push_back(std::move(encodedFrame));
+  }
   return boost::system::error_code();
 }
 
@@ -293,23 +521,36 @@ boost::system::error_code X265Codec::setBitrate(uint32_t uiTargetBitrate)
   VLOG(2) << "X265Codec::setBitrate: " << uiTargetBitrate;
   // return boost::system::error_code();
   // boost::mutex::scoped_lock l(m_lock);
+  if (encoder && uiTargetBitrate == m_uiTargetBitrate)
+  {
+    return boost::system::error_code();
+  }
   m_uiTargetBitrate = uiTargetBitrate;
+  if (!encoder)
+  {
+    // initialise has not been called yet
+    return boost::system::error_code();
+  }
+  if (m_iAnalysisMode != X265_ANALYSIS_OFF)
+  {
+    // re-opening restarts the POCs that the analysis file is indexed by
+    LOG(WARNING) << "Bitrate changes are not supported in analysis mode";
+    return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+  }
+  if (m_dCrf > 0.0)
+  {
+    LOG(WARNING) << "Bitrate changes are not supported at constant quality";
+    return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+  }
 
   params->rc.bitrate = m_uiTargetBitrate;
   params->rc.vbvBufferSize = m_uiTargetBitrate;
   params->rc.vbvMaxBitrate = m_uiTargetBitrate;
+  applyMaxFrameSize();
 
 #if 1
   // close and re-open encoder
-  x265_encoder_close(encoder);
-
-  LOG(WARNING) << "Re-opening codec!";
-  encoder = x265_encoder_open(params);
-  if(!encoder) {
-    LOG(ERROR) << "Failed to re-open the encoder";
-    return boost::system::error_code(boost::system::errc::not_supported, boost::system::generic_category());
-  }
-  return boost::system::error_code();
+  return reopenEncoder();
 #else
   VLOG(2) << "x265_encoder_reconfig!";
   params->rc.bitrate = uiTargetBitrate;
@@ -326,3 +567,131 @@ boost::system::error_code X265Codec::setBitrate(uint32_t uiTargetBitrate)
   return boost::system::error_code(boost::system::errc::argument_out_of_domain, boost::system::generic_category());
 #endif
 }
+
+boost::system::error_code X265Codec::startIntraRefresh()
+{
+  if (!encoder)
+  {
+    return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+  }
+  if (m_uiIntraRefreshPeriod == 0)
+  {
+    return boost::system::error_code(boost::system::errc::not_supported, boost::system::generic_category());
+  }
+  VLOG(2) << "X265Codec::startIntraRefresh";
+  if (x265_encoder_intra_refresh(encoder) < 0)
+  {
+    return boost::system::error_code(boost::system::errc::argument_out_of_domain, boost::system::generic_category());
+  }
+  return boost::system::error_code();
+}
+
+boost::system::error_code X265Codec::generateIdr()
+{
+  VLOG(2) << "X265Codec::generateIdr";
+  m_bGenerateIdr = true;
+  return boost::system::error_code();
+}
+
+boost::system::error_code X265Codec::updateReferencePicture(uint32_t uiFirstLostFrame)
+{
+  // x265 can not invalidate references: an intra refresh is the cheaper recovery
+  VLOG(2) << "X265Codec::updateReferencePicture first lost frame: " << uiFirstLostFrame;
+  if (m_uiIntraRefreshPeriod > 0)
+  {
+    return startIntraRefresh();
+  }
+  return generateIdr();
+}
+
+boost::system::error_code X265Codec::setMaxFrameSize(uint32_t uiMaxFrameSizeBytes)
+{
+  m_uiMaxFrameSizeBytes = uiMaxFrameSizeBytes;
+  if (!encoder)
+  {
+    // initialise has not been called yet
+    return boost::system::error_code();
+  }
+  if (m_iAnalysisMode != X265_ANALYSIS_OFF)
+  {
+    LOG(WARNING) << "Max frame size changes are not supported in analysis mode";
+    return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+  }
+  // constant quality runs without VBV unless the frame size is capped
+  params->rc.vbvBufferSize = m_dCrf > 0.0 ? 0 : m_uiTargetBitrate;
+  params->rc.vbvMaxBitrate = m_dCrf > 0.0 ? 0 : m_uiTargetBitrate;
+  applyMaxFrameSize();
+  // x265_encoder_reconfig ignores the rate control parameters: close and re-open encoder
+  return reopenEncoder();
+}
+
+void X265Codec::applyMaxFrameSize()
+{
+  if (m_uiMaxFrameSizeBytes == 0)
+  {
+    return;
+  }
+  // x265 has no per-frame size limit: a frame can not be larger than the VBV buffer
+  params->rc.vbvBufferSize = std::max<int>(1, m_uiMaxFrameSizeBytes * 8 / 1000);
+  // VBV is off without a max bitrate e.g. at constant quality
+  if (params->rc.vbvMaxBitrate == 0)
+  {
+    params->rc.vbvMaxBitrate = m_uiTargetBitrate;
+  }
+  VLOG(2) << "Max frame size: " << m_uiMaxFrameSizeBytes << " bytes vbvBufferSize: " << params->rc.vbvBufferSize
+          << " kbit vbvMaxBitrate: " << params->rc.vbvMaxBitrate << " kbps";
+}
+
+void X265Codec::accumulateStats()
+{
+  x265_stats stats;
+  x265_encoder_get_stats(encoder, &stats, sizeof(stats));
+  m_uiTotalBits += stats.accBits;
+  m_dTotalVideoTime += stats.elapsedVideoTime;
+  m_dTotalPsnrY += stats.globalPsnrY;
+  m_uiTotalPictures += stats.encodedPictureCount;
+}
+
+boost::system::error_code X265Codec::reopenEncoder()
+{
+  TRACE_SCOPE("x265 reopen");
+  accumulateStats();
+  x265_encoder_close(encoder);
+
+  LOG(WARNING) << "Re-opening codec!";
+  encoder = x265_encoder_open(params);
+  if(!encoder) {
+    LOG(ERROR) << "Failed to re-open the encoder";
+    return boost::system::error_code(boost::system::errc::not_supported, boost::system::generic_category());
+  }
+  return boost::system::error_code();
+}
+
+boost::system::error_code X265Codec::setFramerate(double dFramerate)
+{
+  if (dFramerate <= 0.0)
+  {
+    return boost::system::error_code(boost::system::errc::invalid_argument, boost::system::generic_category());
+  }
+  VLOG(2) << "X265Codec::setFramerate: " << dFramerate;
+  m_dFramerate = dFramerate;
+  if (!encoder)
+  {
+    // initialise has not been called yet
+    return boost::system::error_code();
+  }
+  if (m_iAnalysisMode != X265_ANALYSIS_OFF)
+  {
+    LOG(WARNING) << "Frame rate changes are not supported in analysis mode";
+    return boost::system::error_code(boost::system::errc::operation_not_permitted, boost::system::generic_category());
+  }
+  params->fpsNum = static_cast<uint32_t>(m_dFramerate * 1000 + 0.5);
+  params->fpsDenom = 1000;
+  // x265_encoder_reconfig can not change the frame rate: close and re-open encoder
+  return reopenEncoder();
+}
+
+FrameStats X265Codec::getFrameStats() const
+{
+  return m_frameStats;
+}
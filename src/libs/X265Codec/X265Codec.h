@@ -65,8 +65,48 @@ public:
    * @brief @ICooperativeCodec
    */
   virtual boost::system::error_code setBitrate(uint32_t uiTargetBitrate);
+  /**
+   * @brief @ICooperativeCodec
+   */
+  virtual boost::system::error_code startIntraRefresh();
+  /**
+   * @brief @ICooperativeCodec
+   */
+  virtual boost::system::error_code generateIdr();
+  /**
+   * @brief @ICooperativeCodec
+   */
+  virtual boost::system::error_code updateReferencePicture(uint32_t uiFirstLostFrame);
+  /**
+   * @brief @ICooperativeCodec
+   */
+  virtual boost::system::error_code setMaxFrameSize(uint32_t uiMaxFrameSizeBytes);
+  /**
+   * @brief @ICooperativeCodec
+   */
+  virtual boost::system::error_code setFramerate(double dFramerate);
+  /**
+   * @brief @IVideoCodecTransform
+   */
+  virtual rtp_plus_plus::media::FrameStats getFrameStats() const;
+  /**
+   * @brief @IVideoCodecTransform
+   */
+  virtual boost::system::error_code flush(std::vector<rtp_plus_plus::media::EncodedFrame>& out);
 
 private:
+  boost::system::error_code encodeFrame(const rtp_plus_plus::media::MediaSample& mediaIn, std::vector<rtp_plus_plus::media::MediaSample>& out, uint32_t& uiSize);
+  boost::system::error_code collectOutput(int frame_size, uint32_t uiNalCount, uint32_t uiInSize, std::vector<rtp_plus_plus::media::MediaSample>& out, uint32_t& uiSize);
+  void applyMaxFrameSize();
+  /**
+   * @brief accumulateStats adds the stats of the current encoder instance to the totals of the summary
+   */
+  void accumulateStats();
+  /**
+   * @brief reopenEncoder closes and re-opens the encoder with the current params: x265_encoder_reconfig
+   * can not change the rate control parameters or the frame rate
+   */
+  boost::system::error_code reopenEncoder();
 
   rtp_plus_plus::media::MediaTypeDescriptor m_in;
   rtp_plus_plus::media::MediaTypeDescriptor m_out;
@@ -89,6 +129,32 @@ private:
   uint32_t m_uiTargetBitrate;
   std::string m_sTune;
   std::string m_sPreset;
+  // approximated with a fixed slice count
+  uint32_t m_uiMaxNalBytes;
+  uint32_t m_uiIntraRefreshPeriod;
+  bool m_bGenerateIdr;
+  // 0 = no cap: the cap is the VBV buffer size
+  uint32_t m_uiMaxFrameSizeBytes;
+  // the input frame rate until changed by setFramerate
+  double m_dFramerate;
+  // analysis reuse across a bitrate ladder: X265_ANALYSIS_OFF, _SAVE or _LOAD
+  int m_iAnalysisMode;
+  // x265 exchanges the analysis through a file: use a tmpfs path to keep it in memory
+  std::string m_sAnalysisFile;
+  bool m_bEnablePsnr;
+  bool m_bEnableSsim;
+  rtp_plus_plus::media::FrameStats m_frameStats;
+  uint32_t m_uiEncodedFrames;
+  uint64_t m_uiEncodingTimeUs;
+  // x265_stats of the closed encoder instances
+  uint64_t m_uiTotalBits;
+  double m_dTotalVideoTime;
+  double m_dTotalPsnrY;
+  uint64_t m_uiTotalPictures;
+  // size of the worker pool: empty = one thread per core. Frame threads are derived from the pool size
+  std::string m_sPools;
+  // > 0: constant quality instead of the target bitrate
+  double m_dCrf;
 
   boost::mutex m_lock;
 };